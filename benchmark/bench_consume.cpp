@@ -0,0 +1,135 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "benchmark_util.h"
+
+using namespace AmqpClient;
+
+namespace {
+
+// Queues are filled before timing starts, so every benchmark here runs a
+// fixed number of iterations
+const std::int64_t MESSAGES = 20000;
+
+void Fill(Channel &channel, const std::vector<std::string> &queues,
+          std::size_t payload_size) {
+  BasicMessage::ptr_t message =
+      BasicMessage::Create(std::string(payload_size, 'x'));
+  std::vector<std::pair<std::string, BasicMessage::ptr_t> > batch;
+  for (std::int64_t i = 0; i < MESSAGES; ++i) {
+    batch.push_back(std::make_pair(queues[i % queues.size()], message));
+    if (batch.size() == 1000) {
+      channel.BasicPublishBatch("", batch);
+      batch.clear();
+    }
+  }
+  if (!batch.empty()) {
+    channel.BasicPublishBatch("", batch);
+  }
+}
+
+// Arguments are the prefetch count and the payload size. The prefetch count
+// only applies to a consumer that acks, so every message is acked.
+void BM_Consume(benchmark::State &state) {
+  Channel::OpenOpts opts;
+  if (!bench::GetBrokerOpts(state, opts)) {
+    return;
+  }
+  Channel::ptr_t channel = Channel::Open(opts);
+  std::vector<std::string> queues(1, channel->DeclareQueue(""));
+  Fill(*channel, queues, static_cast<std::size_t>(state.range(1)));
+  std::string tag =
+      channel->BasicConsume(queues[0], "", true, false, true,
+                            static_cast<std::uint16_t>(state.range(0)));
+
+  bench::LatencyRecorder latencies(MESSAGES);
+  Envelope::ptr_t envelope;
+  std::uint64_t messages = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    if (!channel->BasicConsumeMessage(tag, envelope, 5000)) {
+      state.SkipWithError("timed out waiting for a message");
+      break;
+    }
+    channel->BasicAck(envelope);
+    latencies.Add(std::chrono::steady_clock::now() - start);
+    ++messages;
+  }
+  bench::ReportMessages(state, messages, allocations);
+  latencies.Report(state);
+  state.SetBytesProcessed(state.range(1) * static_cast<std::int64_t>(messages));
+}
+BENCHMARK(BM_Consume)
+    ->ArgsProduct({{1, 100, 1000}, {16, 1024, 64 * 1024}})
+    ->Iterations(MESSAGES);
+
+// Messages spread over several consumers, taken with a single
+// BasicConsumeMessage over all of their tags
+void BM_ConsumeFanIn(benchmark::State &state) {
+  Channel::OpenOpts opts;
+  if (!bench::GetBrokerOpts(state, opts)) {
+    return;
+  }
+  Channel::ptr_t channel = Channel::Open(opts);
+  std::vector<std::string> queues;
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    queues.push_back(channel->DeclareQueue(""));
+  }
+  Fill(*channel, queues, 1024);
+  std::vector<std::string> tags;
+  for (std::size_t i = 0; i < queues.size(); ++i) {
+    tags.push_back(channel->BasicConsume(queues[i], "", true, true, true, 100));
+  }
+
+  bench::LatencyRecorder latencies(MESSAGES);
+  Envelope::ptr_t envelope;
+  std::uint64_t messages = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    if (!channel->BasicConsumeMessage(tags, envelope, 5000)) {
+      state.SkipWithError("timed out waiting for a message");
+      break;
+    }
+    latencies.Add(std::chrono::steady_clock::now() - start);
+    ++messages;
+  }
+  bench::ReportMessages(state, messages, allocations);
+  latencies.Report(state);
+}
+BENCHMARK(BM_ConsumeFanIn)->Arg(2)->Arg(8)->Arg(32)->Iterations(MESSAGES);
+
+}  // namespace
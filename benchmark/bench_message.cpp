@@ -0,0 +1,128 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SimpleAmqpClient/PublishTemplateImpl.h"
+#include "benchmark_util.h"
+
+using namespace AmqpClient;
+
+namespace {
+
+BasicMessage::ptr_t MakeMessage() {
+  BasicMessage::ptr_t message = BasicMessage::Create("body");
+  message->ContentType("application/json");
+  message->ContentEncoding("identity");
+  message->DeliveryMode(BasicMessage::dm_persistent);
+  message->Priority(4);
+  message->CorrelationId("correlation-id-0123456789");
+  message->ReplyTo("reply-queue");
+  message->Expiration("60000");
+  message->MessageId("message-id-0123456789");
+  message->Timestamp(1234567890);
+  message->Type("event");
+  message->AppId("benchmark");
+  Table headers;
+  headers.insert(TableEntry("trace-id", "abc123"));
+  headers.insert(TableEntry("hops", 3));
+  message->HeaderTable(headers);
+  return message;
+}
+
+// Sets every property, then reads each of them back
+void BM_MessageProperties(benchmark::State &state) {
+  std::uint64_t messages = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    BasicMessage::ptr_t message = MakeMessage();
+    benchmark::DoNotOptimize(message->ContentType());
+    benchmark::DoNotOptimize(message->ContentEncoding());
+    benchmark::DoNotOptimize(message->DeliveryMode());
+    benchmark::DoNotOptimize(message->Priority());
+    benchmark::DoNotOptimize(message->CorrelationId());
+    benchmark::DoNotOptimize(message->ReplyTo());
+    benchmark::DoNotOptimize(message->Expiration());
+    benchmark::DoNotOptimize(message->MessageId());
+    benchmark::DoNotOptimize(message->Timestamp());
+    benchmark::DoNotOptimize(message->Type());
+    benchmark::DoNotOptimize(message->AppId());
+    benchmark::DoNotOptimize(message->HeaderTable().size());
+    ++messages;
+  }
+  bench::ReportMessages(state, messages, allocations);
+}
+BENCHMARK(BM_MessageProperties);
+
+// The properties as they go out on BasicPublish and come back on receipt:
+// converted, encoded by rabbitmq-c, and decoded again
+void BM_MessagePropertiesWire(benchmark::State &state) {
+  const BasicMessage::ptr_t message = MakeMessage();
+  std::vector<char> buffer(64 * 1024);
+  amqp_bytes_t encoded;
+  encoded.bytes = buffer.data();
+
+  amqp_pool_t pool;
+  init_amqp_pool(&pool, 4096);
+  std::uint64_t messages = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    Detail::amqp_pool_ptr_t headers_pool;
+    amqp_basic_properties_t properties =
+        Detail::CreateAmqpProperties(*message, headers_pool);
+    encoded.len = buffer.size();
+    int size =
+        amqp_encode_properties(AMQP_BASIC_CLASS, &properties, encoded);
+    if (size < 0) {
+      state.SkipWithError("amqp_encode_properties failed");
+      break;
+    }
+    amqp_bytes_t wire;
+    wire.bytes = buffer.data();
+    wire.len = static_cast<std::size_t>(size);
+    void *decoded = NULL;
+    if (AMQP_STATUS_OK !=
+        amqp_decode_properties(AMQP_BASIC_CLASS, &pool, wire, &decoded)) {
+      state.SkipWithError("amqp_decode_properties failed");
+      break;
+    }
+    benchmark::DoNotOptimize(decoded);
+    recycle_amqp_pool(&pool);
+    ++messages;
+  }
+  bench::ReportMessages(state, messages, allocations);
+  empty_amqp_pool(&pool);
+}
+BENCHMARK(BM_MessagePropertiesWire);
+
+}  // namespace
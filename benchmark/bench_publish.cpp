@@ -0,0 +1,139 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "benchmark_util.h"
+
+using namespace AmqpClient;
+
+namespace {
+
+const std::int64_t PAYLOAD_SIZES[] = {16, 1024, 64 * 1024};
+
+void PayloadSizes(benchmark::internal::Benchmark *b) {
+  for (std::int64_t size : PAYLOAD_SIZES) {
+    b->Arg(size);
+  }
+}
+
+// BasicPublish waits for each confirm, so this is one round trip per message
+void BM_PublishConfirmed(benchmark::State &state) {
+  Channel::OpenOpts opts;
+  if (!bench::GetBrokerOpts(state, opts)) {
+    return;
+  }
+  Channel::ptr_t channel = Channel::Open(opts);
+  std::string queue = channel->DeclareQueue("");
+  BasicMessage::ptr_t message = BasicMessage::Create(
+      std::string(static_cast<std::size_t>(state.range(0)), 'x'));
+
+  bench::LatencyRecorder latencies;
+  std::uint64_t messages = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    channel->BasicPublish("", queue, message);
+    latencies.Add(std::chrono::steady_clock::now() - start);
+    ++messages;
+  }
+  bench::ReportMessages(state, messages, allocations);
+  latencies.Report(state);
+  state.SetBytesProcessed(state.range(0) * state.iterations());
+  channel->PurgeQueue(queue);
+}
+BENCHMARK(BM_PublishConfirmed)->Apply(PayloadSizes);
+
+// Latency is measured from BasicPublishAsync until the confirm is read
+void BM_PublishAsync(benchmark::State &state) {
+  Channel::OpenOpts opts;
+  if (!bench::GetBrokerOpts(state, opts)) {
+    return;
+  }
+  Channel::ptr_t channel = Channel::Open(opts);
+  std::string queue = channel->DeclareQueue("");
+  BasicMessage::ptr_t message = BasicMessage::Create(
+      std::string(static_cast<std::size_t>(state.range(0)), 'x'));
+
+  // Sequence numbers start at 1 and have no gaps
+  std::vector<std::chrono::steady_clock::time_point> sent(1);
+  bench::LatencyRecorder latencies;
+  channel->SetPublishConfirmCallback(
+      [&sent, &latencies](const Channel::PublishConfirm &confirm) {
+        latencies.Add(std::chrono::steady_clock::now() -
+                      sent[confirm.sequence_number]);
+      });
+
+  std::uint64_t messages = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    sent.push_back(std::chrono::steady_clock::now());
+    channel->BasicPublishAsync("", queue, message);
+    ++messages;
+  }
+  channel->WaitForConfirms();
+  bench::ReportMessages(state, messages, allocations);
+  latencies.Report(state);
+  state.SetBytesProcessed(state.range(0) * state.iterations());
+  channel->PurgeQueue(queue);
+}
+BENCHMARK(BM_PublishAsync)->Apply(PayloadSizes);
+
+// One iteration publishes a whole batch, latency is per batch
+void BM_PublishBatch(benchmark::State &state) {
+  Channel::OpenOpts opts;
+  if (!bench::GetBrokerOpts(state, opts)) {
+    return;
+  }
+  Channel::ptr_t channel = Channel::Open(opts);
+  std::string queue = channel->DeclareQueue("");
+  std::vector<BasicMessage::ptr_t> batch(
+      static_cast<std::size_t>(state.range(0)),
+      BasicMessage::Create(std::string(1024, 'x')));
+
+  bench::LatencyRecorder latencies;
+  std::uint64_t messages = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    channel->BasicPublishBatch("", queue, batch);
+    latencies.Add(std::chrono::steady_clock::now() - start);
+    messages += batch.size();
+  }
+  bench::ReportMessages(state, messages, allocations);
+  latencies.Report(state);
+  channel->PurgeQueue(queue);
+}
+BENCHMARK(BM_PublishBatch)->Arg(10)->Arg(100)->Arg(1000);
+
+}  // namespace
@@ -0,0 +1,145 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SimpleAmqpClient/TableImpl.h"
+#include "benchmark_util.h"
+
+using namespace AmqpClient;
+
+// Tables are converted with the library's internal routines, as they are
+// when a message is published or received, then run through rabbitmq-c's
+// own wire encoder and decoder.
+
+namespace {
+
+Table MakeTable(std::int64_t entries) {
+  Table table;
+  for (std::int64_t i = 0; i < entries; ++i) {
+    const std::string key = "key-" + std::to_string(i);
+    switch (i % 4) {
+      case 0:
+        table.insert(TableEntry(key, static_cast<std::int32_t>(i)));
+        break;
+      case 1:
+        table.insert(TableEntry(key, "a string value"));
+        break;
+      case 2:
+        table.insert(TableEntry(key, true));
+        break;
+      default:
+        table.insert(TableEntry(key, 1.5 * i));
+        break;
+    }
+  }
+  return table;
+}
+
+const std::size_t BUFFER_SIZE = 1024 * 1024;
+
+template <class TableType>
+void BM_Encode(benchmark::State &state) {
+  const TableType table(MakeTable(state.range(0)));
+  std::vector<char> buffer(BUFFER_SIZE);
+  amqp_bytes_t encoded;
+  encoded.bytes = buffer.data();
+  encoded.len = buffer.size();
+
+  std::uint64_t tables = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    Detail::amqp_pool_ptr_t pool;
+    amqp_table_t amqp_table =
+        Detail::TableValueImpl::CreateAmqpTable(table, pool);
+    size_t offset = 0;
+    if (AMQP_STATUS_OK != amqp_encode_table(encoded, &amqp_table, &offset)) {
+      state.SkipWithError("amqp_encode_table failed");
+      break;
+    }
+    benchmark::DoNotOptimize(offset);
+    ++tables;
+  }
+  bench::ReportMessages(state, tables, allocations);
+}
+BENCHMARK_TEMPLATE(BM_Encode, Table)->Arg(4)->Arg(32)->Arg(256);
+BENCHMARK_TEMPLATE(BM_Encode, FlatTable)->Arg(4)->Arg(32)->Arg(256);
+
+Table ToTableType(const amqp_table_t &table, const Table *) {
+  return Detail::TableValueImpl::CreateTable(table);
+}
+
+FlatTable ToTableType(const amqp_table_t &table, const FlatTable *) {
+  return Detail::TableValueImpl::CreateFlatTable(table);
+}
+
+template <class TableType>
+void BM_Decode(benchmark::State &state) {
+  const Table table = MakeTable(state.range(0));
+  std::vector<char> buffer(BUFFER_SIZE);
+  amqp_bytes_t encoded;
+  encoded.bytes = buffer.data();
+  encoded.len = buffer.size();
+  size_t encoded_size = 0;
+  {
+    Detail::amqp_pool_ptr_t pool;
+    amqp_table_t amqp_table =
+        Detail::TableValueImpl::CreateAmqpTable(table, pool);
+    amqp_encode_table(encoded, &amqp_table, &encoded_size);
+  }
+  encoded.len = encoded_size;
+
+  amqp_pool_t pool;
+  init_amqp_pool(&pool, 4096);
+  std::uint64_t tables = 0;
+  const std::uint64_t allocations = bench::AllocationCount();
+  for (auto _ : state) {
+    amqp_table_t amqp_table;
+    size_t offset = 0;
+    if (AMQP_STATUS_OK !=
+        amqp_decode_table(encoded, &pool, &amqp_table, &offset)) {
+      state.SkipWithError("amqp_decode_table failed");
+      break;
+    }
+    TableType decoded =
+        ToTableType(amqp_table, static_cast<const TableType *>(NULL));
+    benchmark::DoNotOptimize(decoded);
+    recycle_amqp_pool(&pool);
+    ++tables;
+  }
+  bench::ReportMessages(state, tables, allocations);
+  empty_amqp_pool(&pool);
+}
+BENCHMARK_TEMPLATE(BM_Decode, Table)->Arg(4)->Arg(32)->Arg(256);
+BENCHMARK_TEMPLATE(BM_Decode, FlatTable)->Arg(4)->Arg(32)->Arg(256);
+
+}  // namespace
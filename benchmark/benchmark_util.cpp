@@ -0,0 +1,105 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "benchmark_util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<std::uint64_t> allocations(0);
+}  // namespace
+
+// Counting every allocation is what makes allocs/msg possible; the cost is
+// one relaxed increment each
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = std::malloc(0 == size ? 1 : size);
+  if (NULL == p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+namespace bench {
+
+bool GetBrokerOpts(benchmark::State &state,
+                   AmqpClient::Channel::OpenOpts &opts) {
+  const char *host = std::getenv("AMQP_BROKER");
+  if (NULL == host) {
+    state.SkipWithError("AMQP_BROKER is not set");
+    return false;
+  }
+  opts.host = host;
+  opts.auth = AmqpClient::Channel::OpenOpts::BasicAuth("guest", "guest");
+  return true;
+}
+
+std::uint64_t AllocationCount() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+void LatencyRecorder::Report(benchmark::State &state) {
+  if (m_samples.empty()) {
+    return;
+  }
+  std::sort(m_samples.begin(), m_samples.end());
+  const double last = static_cast<double>(m_samples.size() - 1);
+  const double percentiles[] = {0.5, 0.99, 0.999};
+  const char *names[] = {"p50_us", "p99_us", "p999_us"};
+  for (int i = 0; i < 3; ++i) {
+    std::size_t index = static_cast<std::size_t>(percentiles[i] * last);
+    state.counters[names[i]] = m_samples[index] / 1000.0;
+  }
+}
+
+void ReportMessages(benchmark::State &state, std::uint64_t messages,
+                    std::uint64_t allocations_before) {
+  state.SetItemsProcessed(static_cast<std::int64_t>(messages));
+  state.counters["msg/s"] = benchmark::Counter(
+      static_cast<double>(messages), benchmark::Counter::kIsRate);
+  if (messages > 0) {
+    state.counters["allocs/msg"] =
+        static_cast<double>(AllocationCount() - allocations_before) /
+        static_cast<double>(messages);
+  }
+}
+
+}  // namespace bench
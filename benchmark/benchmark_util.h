@@ -0,0 +1,80 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef BENCHMARK_UTIL_H
+#define BENCHMARK_UTIL_H
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// Options for the broker named by the AMQP_BROKER environment variable, as
+// the smoke tests use. Returns false, having told state to skip, if it is
+// not set.
+bool GetBrokerOpts(benchmark::State &state,
+                   AmqpClient::Channel::OpenOpts &opts);
+
+// Heap allocations made by the process so far, counted by the replacement
+// operator new in benchmark_util.cpp
+std::uint64_t AllocationCount();
+
+// Per-operation latencies, reported as p50/p99/p999 counters in
+// microseconds
+class LatencyRecorder {
+ public:
+  explicit LatencyRecorder(std::size_t expected = 0) {
+    m_samples.reserve(expected);
+  }
+
+  void Add(std::chrono::steady_clock::duration latency) {
+    m_samples.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+  }
+
+  // Sorts the samples, so call once, after timing has stopped
+  void Report(benchmark::State &state);
+
+ private:
+  std::vector<std::int64_t> m_samples;
+};
+
+// Sets the msg/s and allocs/msg counters for messages handled while the
+// allocation count rose from allocations_before
+void ReportMessages(benchmark::State &state, std::uint64_t messages,
+                    std::uint64_t allocations_before);
+
+}  // namespace bench
+
+#endif  // BENCHMARK_UTIL_H
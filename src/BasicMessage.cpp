@@ -32,39 +32,280 @@
 #include <amqp.h>
 #include <amqp_framing.h>
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <mutex>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 #include "SimpleAmqpClient/TableImpl.h"
 
 namespace AmqpClient {
 
+namespace {
+// Looks key up in an encoded table without decoding the rest of it
+bool FindEntry(const amqp_table_t& table, const std::string& key,
+               TableValue& value) {
+  for (int i = 0; i < table.num_entries; ++i) {
+    const amqp_table_entry_t& entry = table.entries[i];
+    if (entry.key.len == key.size() &&
+        0 == std::memcmp(entry.key.bytes, key.data(), key.size())) {
+      value = Detail::TableValueImpl::CreateTableValue(entry.value);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Behaves like std::optional<std::string>, except that clearing the value
+// keeps the string's buffer so that a recycled message can be refilled
+// without allocating.
+class OptionalString {
+ public:
+  OptionalString() : m_is_set(false) {}
+
+  OptionalString& operator=(const std::string& value) {
+    m_value = value;
+    m_is_set = true;
+    return *this;
+  }
+  OptionalString& operator=(std::string&& value) {
+    m_value = std::move(value);
+    m_is_set = true;
+    return *this;
+  }
+  void assign(const amqp_bytes_t& value) {
+    m_value.assign(static_cast<const char*>(value.bytes), value.len);
+    m_is_set = true;
+  }
+  bool has_value() const { return m_is_set; }
+  const std::string& value() const { return m_value; }
+  void reset() {
+    m_value.clear();
+    m_is_set = false;
+  }
+
+ private:
+  std::string m_value;
+  bool m_is_set;
+};
+}  // namespace
+
 struct BasicMessage::Impl {
+  Impl()
+      : properties_pending(false),
+        pending_decoded(NULL),
+        headers_pending(false) {
+    init_amqp_pool(&decode_pool, 4096);
+  }
+  ~Impl() { empty_amqp_pool(&decode_pool); }
+
   std::string body;
-  std::optional<std::string> content_type;
-  std::optional<std::string> content_encoding;
+  OptionalString content_type;
+  OptionalString content_encoding;
   std::optional<delivery_mode_t> delivery_mode;
   std::optional<std::uint8_t> priority;
-  std::optional<std::string> correlation_id;
-  std::optional<std::string> reply_to;
-  std::optional<std::string> expiration;
-  std::optional<std::string> message_id;
+  OptionalString correlation_id;
+  OptionalString reply_to;
+  OptionalString expiration;
+  OptionalString message_id;
   std::optional<std::uint64_t> timestamp;
-  std::optional<std::string> type;
-  std::optional<std::string> user_id;
-  std::optional<std::string> app_id;
-  std::optional<std::string> cluster_id;
+  OptionalString type;
+  OptionalString user_id;
+  OptionalString app_id;
+  OptionalString cluster_id;
   std::optional<Table> header_table;
+  // Headers set as a FlatTable stay in that form until HeaderTable() asks
+  // for a Table, at most one of the two is set
+  std::optional<FlatTable> flat_headers;
+
+  // Properties of a received message are kept as they came off the wire and
+  // decoded the first time one of them is accessed. The headers table goes
+  // one step further: it is left in its amqp_table_t form (pointing into
+  // encoded_properties) until HeaderTable() asks for the full Table.
+  std::string encoded_properties;
+  std::atomic<bool> properties_pending;
+  amqp_pool_t decode_pool;
+  // encoded_properties parsed in place, their strings and tables point into
+  // it. Set by PendingProperties().
+  amqp_basic_properties_t* pending_decoded;
+  amqp_table_t encoded_headers;
+  std::atomic<bool> headers_pending;
+  // Serializes the lazy decoding done by const accessors, so that several
+  // threads may read the same received message. The pending flags are
+  // published after the fields they guard, a reader that sees them clear
+  // needs no lock.
+  mutable std::mutex decode_mutex;
+
+  // The property flags are the first two bytes of the encoded properties
+  std::uint16_t PendingFlags() const {
+    if (encoded_properties.size() < 2) {
+      return 0;
+    }
+    return static_cast<std::uint16_t>(
+        (static_cast<unsigned char>(encoded_properties[0]) << 8) |
+        static_cast<unsigned char>(encoded_properties[1]));
+  }
+
+  template <class T>
+  bool IsSet(const T& field, std::uint16_t flag) const {
+    if (properties_pending.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(decode_mutex);
+      if (properties_pending.load(std::memory_order_relaxed)) {
+        return 0 != (PendingFlags() & flag);
+      }
+    }
+    return field.has_value();
+  }
+
+  const amqp_basic_properties_t* PendingProperties();
+  void Decode();
+  void DecodeLocked();
+  void DecodeHeaders();
+  void FlatHeadersToTable();
+  void DropEncoded();
+  void ClearProperties();
 };
 
+const amqp_basic_properties_t* BasicMessage::Impl::PendingProperties() {
+  if (NULL != pending_decoded) {
+    return pending_decoded;
+  }
+  amqp_bytes_t encoded;
+  encoded.bytes = &encoded_properties[0];
+  encoded.len = encoded_properties.size();
+  if (AMQP_STATUS_OK !=
+      amqp_decode_properties(AMQP_BASIC_CLASS, &decode_pool, encoded,
+                             reinterpret_cast<void**>(&pending_decoded))) {
+    DropEncoded();
+    throw std::runtime_error("Failed to decode message properties");
+  }
+  return pending_decoded;
+}
+
+void BasicMessage::Impl::Decode() {
+  if (!properties_pending.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(decode_mutex);
+  DecodeLocked();
+}
+
+void BasicMessage::Impl::DecodeLocked() {
+  if (!properties_pending.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const amqp_basic_properties_t* props = PendingProperties();
+
+  if (0 != (props->_flags & AMQP_BASIC_CONTENT_TYPE_FLAG)) {
+    content_type.assign(props->content_type);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_CONTENT_ENCODING_FLAG)) {
+    content_encoding.assign(props->content_encoding);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_DELIVERY_MODE_FLAG)) {
+    delivery_mode = static_cast<delivery_mode_t>(props->delivery_mode);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_PRIORITY_FLAG)) {
+    priority = props->priority;
+  }
+  if (0 != (props->_flags & AMQP_BASIC_CORRELATION_ID_FLAG)) {
+    correlation_id.assign(props->correlation_id);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_REPLY_TO_FLAG)) {
+    reply_to.assign(props->reply_to);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_EXPIRATION_FLAG)) {
+    expiration.assign(props->expiration);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_MESSAGE_ID_FLAG)) {
+    message_id.assign(props->message_id);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_TIMESTAMP_FLAG)) {
+    timestamp = props->timestamp;
+  }
+  if (0 != (props->_flags & AMQP_BASIC_TYPE_FLAG)) {
+    type.assign(props->type);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_USER_ID_FLAG)) {
+    user_id.assign(props->user_id);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_APP_ID_FLAG)) {
+    app_id.assign(props->app_id);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_CLUSTER_ID_FLAG)) {
+    cluster_id.assign(props->cluster_id);
+  }
+  if (0 != (props->_flags & AMQP_BASIC_HEADERS_FLAG)) {
+    encoded_headers = props->headers;
+    headers_pending.store(true, std::memory_order_relaxed);
+    properties_pending.store(false, std::memory_order_release);
+  } else {
+    DropEncoded();
+  }
+}
+
+void BasicMessage::Impl::DecodeHeaders() {
+  Decode();
+  if (!headers_pending.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(decode_mutex);
+  if (!headers_pending.load(std::memory_order_relaxed)) {
+    return;
+  }
+  header_table = Detail::TableValueImpl::CreateTable(encoded_headers);
+  DropEncoded();
+}
+
+void BasicMessage::Impl::FlatHeadersToTable() {
+  std::lock_guard<std::mutex> lock(decode_mutex);
+  if (flat_headers.has_value()) {
+    header_table = flat_headers->ToTable();
+    flat_headers.reset();
+  }
+}
+
+void BasicMessage::Impl::DropEncoded() {
+  pending_decoded = NULL;
+  encoded_properties.clear();
+  recycle_amqp_pool(&decode_pool);
+  headers_pending.store(false, std::memory_order_release);
+  properties_pending.store(false, std::memory_order_release);
+}
+
+void BasicMessage::Impl::ClearProperties() {
+  DropEncoded();
+  content_type.reset();
+  content_encoding.reset();
+  delivery_mode.reset();
+  priority.reset();
+  correlation_id.reset();
+  reply_to.reset();
+  expiration.reset();
+  message_id.reset();
+  timestamp.reset();
+  type.reset();
+  user_id.reset();
+  app_id.reset();
+  cluster_id.reset();
+  header_table.reset();
+  flat_headers.reset();
+}
+
 BasicMessage::BasicMessage() : m_impl(new Impl) {}
 
 BasicMessage::BasicMessage(const std::string& body) : m_impl(new Impl) {
   Body(body);
 }
 
+BasicMessage::BasicMessage(std::string&& body) : m_impl(new Impl) {
+  Body(std::move(body));
+}
+
 BasicMessage::~BasicMessage() {}
 
 const std::string& BasicMessage::Body() const { return m_impl->body; }
@@ -73,8 +314,17 @@ std::string& BasicMessage::Body() { return m_impl->body; }
 
 void BasicMessage::Body(const std::string& body) { m_impl->body = body; }
 
+void BasicMessage::Body(std::string&& body) { m_impl->body = std::move(body); }
+
+std::string BasicMessage::ReleaseBody() {
+  std::string body;
+  body.swap(m_impl->body);
+  return body;
+}
+
 const std::string& BasicMessage::ContentType() const {
-  if (ContentTypeIsSet()) {
+  m_impl->Decode();
+  if (m_impl->content_type.has_value()) {
     return m_impl->content_type.value();
   }
   static const std::string empty;
@@ -82,17 +332,27 @@ const std::string& BasicMessage::ContentType() const {
 }
 
 void BasicMessage::ContentType(const std::string& content_type) {
+  m_impl->Decode();
   m_impl->content_type = content_type;
 }
 
+void BasicMessage::ContentType(std::string&& content_type) {
+  m_impl->Decode();
+  m_impl->content_type = std::move(content_type);
+}
+
 bool BasicMessage::ContentTypeIsSet() const {
-  return m_impl->content_type.has_value();
+  return m_impl->IsSet(m_impl->content_type, AMQP_BASIC_CONTENT_TYPE_FLAG);
 }
 
-void BasicMessage::ContentTypeClear() { m_impl->content_type.reset(); }
+void BasicMessage::ContentTypeClear() {
+  m_impl->Decode();
+  m_impl->content_type.reset();
+}
 
 const std::string& BasicMessage::ContentEncoding() const {
-  if (ContentEncodingIsSet()) {
+  m_impl->Decode();
+  if (m_impl->content_encoding.has_value()) {
     return m_impl->content_encoding.value();
   }
   static const std::string empty;
@@ -100,45 +360,66 @@ const std::string& BasicMessage::ContentEncoding() const {
 }
 
 void BasicMessage::ContentEncoding(const std::string& content_encoding) {
+  m_impl->Decode();
   m_impl->content_encoding = content_encoding;
 }
 
+void BasicMessage::ContentEncoding(std::string&& content_encoding) {
+  m_impl->Decode();
+  m_impl->content_encoding = std::move(content_encoding);
+}
+
 bool BasicMessage::ContentEncodingIsSet() const {
-  return m_impl->content_encoding.has_value();
+  return m_impl->IsSet(m_impl->content_encoding,
+                       AMQP_BASIC_CONTENT_ENCODING_FLAG);
 }
 
-void BasicMessage::ContentEncodingClear() { m_impl->content_encoding.reset(); }
+void BasicMessage::ContentEncodingClear() {
+  m_impl->Decode();
+  m_impl->content_encoding.reset();
+}
 
 BasicMessage::delivery_mode_t BasicMessage::DeliveryMode() const {
+  m_impl->Decode();
   return m_impl->delivery_mode.value_or(dm_notset);
 }
 
 void BasicMessage::DeliveryMode(delivery_mode_t delivery_mode) {
+  m_impl->Decode();
   m_impl->delivery_mode = delivery_mode;
 }
 
 bool BasicMessage::DeliveryModeIsSet() const {
-  return m_impl->delivery_mode.has_value();
+  return m_impl->IsSet(m_impl->delivery_mode, AMQP_BASIC_DELIVERY_MODE_FLAG);
 }
 
-void BasicMessage::DeliveryModeClear() { m_impl->delivery_mode.reset(); }
+void BasicMessage::DeliveryModeClear() {
+  m_impl->Decode();
+  m_impl->delivery_mode.reset();
+}
 
 std::uint8_t BasicMessage::Priority() const {
+  m_impl->Decode();
   return m_impl->priority.value_or(0);
 }
 
 void BasicMessage::Priority(std::uint8_t priority) {
+  m_impl->Decode();
   m_impl->priority = priority;
 }
 
 bool BasicMessage::PriorityIsSet() const {
-  return m_impl->priority.has_value();
+  return m_impl->IsSet(m_impl->priority, AMQP_BASIC_PRIORITY_FLAG);
 }
 
-void BasicMessage::PriorityClear() { m_impl->priority.reset(); }
+void BasicMessage::PriorityClear() {
+  m_impl->Decode();
+  m_impl->priority.reset();
+}
 
 const std::string& BasicMessage::CorrelationId() const {
-  if (CorrelationIdIsSet()) {
+  m_impl->Decode();
+  if (m_impl->correlation_id.has_value()) {
     return m_impl->correlation_id.value();
   }
   static const std::string empty;
@@ -146,17 +427,27 @@ const std::string& BasicMessage::CorrelationId() const {
 }
 
 void BasicMessage::CorrelationId(const std::string& correlation_id) {
+  m_impl->Decode();
   m_impl->correlation_id = correlation_id;
 }
 
+void BasicMessage::CorrelationId(std::string&& correlation_id) {
+  m_impl->Decode();
+  m_impl->correlation_id = std::move(correlation_id);
+}
+
 bool BasicMessage::CorrelationIdIsSet() const {
-  return m_impl->correlation_id.has_value();
+  return m_impl->IsSet(m_impl->correlation_id, AMQP_BASIC_CORRELATION_ID_FLAG);
 }
 
-void BasicMessage::CorrelationIdClear() { m_impl->correlation_id.reset(); }
+void BasicMessage::CorrelationIdClear() {
+  m_impl->Decode();
+  m_impl->correlation_id.reset();
+}
 
 const std::string& BasicMessage::ReplyTo() const {
-  if (ReplyToIsSet()) {
+  m_impl->Decode();
+  if (m_impl->reply_to.has_value()) {
     return m_impl->reply_to.value();
   }
   static const std::string empty;
@@ -164,17 +455,27 @@ const std::string& BasicMessage::ReplyTo() const {
 }
 
 void BasicMessage::ReplyTo(const std::string& reply_to) {
+  m_impl->Decode();
   m_impl->reply_to = reply_to;
 }
 
+void BasicMessage::ReplyTo(std::string&& reply_to) {
+  m_impl->Decode();
+  m_impl->reply_to = std::move(reply_to);
+}
+
 bool BasicMessage::ReplyToIsSet() const {
-  return m_impl->reply_to.has_value();
+  return m_impl->IsSet(m_impl->reply_to, AMQP_BASIC_REPLY_TO_FLAG);
 }
 
-void BasicMessage::ReplyToClear() { m_impl->reply_to.reset(); }
+void BasicMessage::ReplyToClear() {
+  m_impl->Decode();
+  m_impl->reply_to.reset();
+}
 
 const std::string& BasicMessage::Expiration() const {
-  if (ExpirationIsSet()) {
+  m_impl->Decode();
+  if (m_impl->expiration.has_value()) {
     return m_impl->expiration.value();
   }
   static const std::string empty;
@@ -182,17 +483,27 @@ const std::string& BasicMessage::Expiration() const {
 }
 
 void BasicMessage::Expiration(const std::string& expiration) {
+  m_impl->Decode();
   m_impl->expiration = expiration;
 }
 
+void BasicMessage::Expiration(std::string&& expiration) {
+  m_impl->Decode();
+  m_impl->expiration = std::move(expiration);
+}
+
 bool BasicMessage::ExpirationIsSet() const {
-  return m_impl->expiration.has_value();
+  return m_impl->IsSet(m_impl->expiration, AMQP_BASIC_EXPIRATION_FLAG);
 }
 
-void BasicMessage::ExpirationClear() { m_impl->expiration.reset(); }
+void BasicMessage::ExpirationClear() {
+  m_impl->Decode();
+  m_impl->expiration.reset();
+}
 
 const std::string& BasicMessage::MessageId() const {
-  if (MessageIdIsSet()) {
+  m_impl->Decode();
+  if (m_impl->message_id.has_value()) {
     return m_impl->message_id.value();
   }
   static const std::string empty;
@@ -200,45 +511,74 @@ const std::string& BasicMessage::MessageId() const {
 }
 
 void BasicMessage::MessageId(const std::string& message_id) {
+  m_impl->Decode();
   m_impl->message_id = message_id;
 }
 
+void BasicMessage::MessageId(std::string&& message_id) {
+  m_impl->Decode();
+  m_impl->message_id = std::move(message_id);
+}
+
 bool BasicMessage::MessageIdIsSet() const {
-  return m_impl->message_id.has_value();
+  return m_impl->IsSet(m_impl->message_id, AMQP_BASIC_MESSAGE_ID_FLAG);
 }
 
-void BasicMessage::MessageIdClear() { m_impl->message_id.reset(); }
+void BasicMessage::MessageIdClear() {
+  m_impl->Decode();
+  m_impl->message_id.reset();
+}
 
 std::uint64_t BasicMessage::Timestamp() const {
+  m_impl->Decode();
   return m_impl->timestamp.value_or(0);
 }
 
 void BasicMessage::Timestamp(std::uint64_t timestamp) {
+  m_impl->Decode();
   m_impl->timestamp = timestamp;
 }
 
 bool BasicMessage::TimestampIsSet() const {
-  return m_impl->timestamp.has_value();
+  return m_impl->IsSet(m_impl->timestamp, AMQP_BASIC_TIMESTAMP_FLAG);
 }
 
-void BasicMessage::TimestampClear() { m_impl->timestamp.reset(); }
+void BasicMessage::TimestampClear() {
+  m_impl->Decode();
+  m_impl->timestamp.reset();
+}
 
 const std::string& BasicMessage::Type() const {
-  if (TypeIsSet()) {
+  m_impl->Decode();
+  if (m_impl->type.has_value()) {
     return m_impl->type.value();
   }
   static const std::string empty;
   return empty;
 }
 
-void BasicMessage::Type(const std::string& type) { m_impl->type = type; }
+void BasicMessage::Type(const std::string& type) {
+  m_impl->Decode();
+  m_impl->type = type;
+}
+
+void BasicMessage::Type(std::string&& type) {
+  m_impl->Decode();
+  m_impl->type = std::move(type);
+}
 
-bool BasicMessage::TypeIsSet() const { return m_impl->type.has_value(); }
+bool BasicMessage::TypeIsSet() const {
+  return m_impl->IsSet(m_impl->type, AMQP_BASIC_TYPE_FLAG);
+}
 
-void BasicMessage::TypeClear() { m_impl->type.reset(); }
+void BasicMessage::TypeClear() {
+  m_impl->Decode();
+  m_impl->type.reset();
+}
 
 const std::string& BasicMessage::UserId() const {
-  if (UserIdIsSet()) {
+  m_impl->Decode();
+  if (m_impl->user_id.has_value()) {
     return m_impl->user_id.value();
   }
   static const std::string empty;
@@ -246,33 +586,55 @@ const std::string& BasicMessage::UserId() const {
 }
 
 void BasicMessage::UserId(const std::string& user_id) {
+  m_impl->Decode();
   m_impl->user_id = user_id;
 }
 
+void BasicMessage::UserId(std::string&& user_id) {
+  m_impl->Decode();
+  m_impl->user_id = std::move(user_id);
+}
+
 bool BasicMessage::UserIdIsSet() const {
-  return m_impl->user_id.has_value();
+  return m_impl->IsSet(m_impl->user_id, AMQP_BASIC_USER_ID_FLAG);
 }
 
-void BasicMessage::UserIdClear() { m_impl->user_id.reset(); }
+void BasicMessage::UserIdClear() {
+  m_impl->Decode();
+  m_impl->user_id.reset();
+}
 
 const std::string& BasicMessage::AppId() const {
-  if (AppIdIsSet()) {
+  m_impl->Decode();
+  if (m_impl->app_id.has_value()) {
     return m_impl->app_id.value();
   }
   static const std::string empty;
   return empty;
 }
 
-void BasicMessage::AppId(const std::string& app_id) { m_impl->app_id = app_id; }
+void BasicMessage::AppId(const std::string& app_id) {
+  m_impl->Decode();
+  m_impl->app_id = app_id;
+}
+
+void BasicMessage::AppId(std::string&& app_id) {
+  m_impl->Decode();
+  m_impl->app_id = std::move(app_id);
+}
 
 bool BasicMessage::AppIdIsSet() const {
-  return m_impl->app_id.has_value();
+  return m_impl->IsSet(m_impl->app_id, AMQP_BASIC_APP_ID_FLAG);
 }
 
-void BasicMessage::AppIdClear() { m_impl->app_id.reset(); }
+void BasicMessage::AppIdClear() {
+  m_impl->Decode();
+  m_impl->app_id.reset();
+}
 
 const std::string& BasicMessage::ClusterId() const {
-  if (ClusterIdIsSet()) {
+  m_impl->Decode();
+  if (m_impl->cluster_id.has_value()) {
     return m_impl->cluster_id.value();
   }
   static const std::string empty;
@@ -280,24 +642,37 @@ const std::string& BasicMessage::ClusterId() const {
 }
 
 void BasicMessage::ClusterId(const std::string& cluster_id) {
+  m_impl->Decode();
   m_impl->cluster_id = cluster_id;
 }
 
+void BasicMessage::ClusterId(std::string&& cluster_id) {
+  m_impl->Decode();
+  m_impl->cluster_id = std::move(cluster_id);
+}
+
 bool BasicMessage::ClusterIdIsSet() const {
-  return m_impl->cluster_id.has_value();
+  return m_impl->IsSet(m_impl->cluster_id, AMQP_BASIC_CLUSTER_ID_FLAG);
 }
 
-void BasicMessage::ClusterIdClear() { m_impl->cluster_id.reset(); }
+void BasicMessage::ClusterIdClear() {
+  m_impl->Decode();
+  m_impl->cluster_id.reset();
+}
 
 Table& BasicMessage::HeaderTable() {
-  if (!HeaderTableIsSet()) {
+  m_impl->DecodeHeaders();
+  m_impl->FlatHeadersToTable();
+  if (!m_impl->header_table.has_value()) {
     m_impl->header_table = Table();
   }
   return m_impl->header_table.value();
 }
 
 const Table& BasicMessage::HeaderTable() const {
-  if (HeaderTableIsSet()) {
+  m_impl->DecodeHeaders();
+  m_impl->FlatHeadersToTable();
+  if (m_impl->header_table.has_value()) {
     return m_impl->header_table.value();
   }
   static const Table empty;
@@ -305,13 +680,125 @@ const Table& BasicMessage::HeaderTable() const {
 }
 
 void BasicMessage::HeaderTable(const Table& header_table) {
+  m_impl->Decode();
+  m_impl->DropEncoded();
   m_impl->header_table = header_table;
+  m_impl->flat_headers.reset();
+}
+
+void BasicMessage::HeaderTable(const FlatTable& header_table) {
+  m_impl->Decode();
+  m_impl->DropEncoded();
+  m_impl->header_table.reset();
+  m_impl->flat_headers = header_table;
+}
+
+FlatTable BasicMessage::HeaderFlatTable() const {
+  m_impl->Decode();
+  std::lock_guard<std::mutex> lock(m_impl->decode_mutex);
+  if (m_impl->headers_pending) {
+    return Detail::TableValueImpl::CreateFlatTable(m_impl->encoded_headers);
+  }
+  if (m_impl->flat_headers.has_value()) {
+    return m_impl->flat_headers.value();
+  }
+  if (m_impl->header_table.has_value()) {
+    return FlatTable(m_impl->header_table.value());
+  }
+  return FlatTable();
 }
 
 bool BasicMessage::HeaderTableIsSet() const {
+  std::lock_guard<std::mutex> lock(m_impl->decode_mutex);
+  if (m_impl->headers_pending || m_impl->flat_headers.has_value()) {
+    return true;
+  }
+  if (m_impl->properties_pending) {
+    return 0 != (m_impl->PendingFlags() & AMQP_BASIC_HEADERS_FLAG);
+  }
   return m_impl->header_table.has_value();
 }
 
-void BasicMessage::HeaderTableClear() { m_impl->header_table.reset(); }
+void BasicMessage::HeaderTableClear() {
+  m_impl->Decode();
+  m_impl->DropEncoded();
+  m_impl->header_table.reset();
+  m_impl->flat_headers.reset();
+}
+
+bool BasicMessage::FindHeader(const std::string& key, TableValue& value) const {
+  std::lock_guard<std::mutex> lock(m_impl->decode_mutex);
+  if (m_impl->properties_pending) {
+    // Leaves the other properties encoded, so the message can still be
+    // relayed as it was received
+    const amqp_basic_properties_t* props = m_impl->PendingProperties();
+    return 0 != (props->_flags & AMQP_BASIC_HEADERS_FLAG) &&
+           FindEntry(props->headers, key, value);
+  }
+  if (m_impl->headers_pending) {
+    return FindEntry(m_impl->encoded_headers, key, value);
+  }
+
+  if (m_impl->flat_headers.has_value()) {
+    if (!m_impl->flat_headers->Contains(key)) {
+      return false;
+    }
+    value = m_impl->flat_headers->Get(key);
+    return true;
+  }
+
+  if (!m_impl->header_table.has_value()) {
+    return false;
+  }
+  Table::const_iterator it = m_impl->header_table->find(key);
+  if (m_impl->header_table->end() == it) {
+    return false;
+  }
+  value = it->second;
+  return true;
+}
+
+void BasicMessage::SetEncodedProperties(const void* data, std::size_t len) {
+  m_impl->ClearProperties();
+  m_impl->encoded_properties.assign(static_cast<const char*>(data), len);
+  m_impl->properties_pending.store(true, std::memory_order_release);
+}
+
+namespace Detail {
+
+amqp_table_t TableValueImpl::CreateAmqpHeaders(const BasicMessage& message,
+                                               amqp_pool_ptr_t& pool) {
+  BasicMessage::Impl& impl = *message.m_impl;
+  impl.Decode();
+  {
+    std::lock_guard<std::mutex> lock(impl.decode_mutex);
+    if (impl.headers_pending) {
+      // Relaying a received message, its headers need never be decoded
+      return CopyTable(impl.encoded_headers, pool);
+    }
+    if (impl.flat_headers.has_value()) {
+      return CreateAmqpTable(impl.flat_headers.value(), pool);
+    }
+  }
+  return CreateAmqpTable(message.HeaderTable(), pool);
+}
+
+bool TableValueImpl::GetReceivedProperties(
+    const BasicMessage& message, amqp_basic_properties_t& properties) {
+  BasicMessage::Impl& impl = *message.m_impl;
+  std::lock_guard<std::mutex> lock(impl.decode_mutex);
+  if (!impl.properties_pending) {
+    return false;
+  }
+  properties = *impl.PendingProperties();
+  return true;
+}
+
+}  // namespace Detail
+
+void BasicMessage::Reset() {
+  m_impl->body.clear();
+  m_impl->ClearProperties();
+}
 
 }  // namespace AmqpClient
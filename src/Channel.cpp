@@ -34,16 +34,40 @@
 #include <amqp_ssl_socket.h>
 #endif
 
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Winsock2.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 #include <string.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <exception>
+#include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <queue>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -54,19 +78,25 @@
 #include "SimpleAmqpClient/Bytes.h"
 #include "SimpleAmqpClient/Channel.h"
 #include "SimpleAmqpClient/ChannelImpl.h"
+#include "SimpleAmqpClient/ConnectionBlockedException.h"
+#include "SimpleAmqpClient/ConnectionClosedException.h"
+#include "SimpleAmqpClient/ConnectionRecovery.h"
 #include "SimpleAmqpClient/ConsumerCancelledException.h"
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
+#include "SimpleAmqpClient/EndpointSelector.h"
 #include "SimpleAmqpClient/MessageRejectedException.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
+#include "SimpleAmqpClient/PublishTemplateImpl.h"
 #include "SimpleAmqpClient/TableImpl.h"
+#include "SimpleAmqpClient/TlsContext.h"
 #include "SimpleAmqpClient/Util.h"
 
 namespace AmqpClient {
 
-namespace {
+namespace Detail {
 
 amqp_basic_properties_t CreateAmqpProperties(const BasicMessage &mes,
-                                             Detail::amqp_pool_ptr_t &pool) {
+                                             amqp_pool_ptr_t &pool) {
   amqp_basic_properties_t ret;
   ret._flags = 0;
 
@@ -124,13 +154,445 @@ amqp_basic_properties_t CreateAmqpProperties(const BasicMessage &mes,
     ret._flags |= AMQP_BASIC_CLUSTER_ID_FLAG;
   }
   if (mes.HeaderTableIsSet()) {
-    ret.headers =
-        Detail::TableValueImpl::CreateAmqpTable(mes.HeaderTable(), pool);
+    ret.headers = Detail::TableValueImpl::CreateAmqpHeaders(mes, pool);
     ret._flags |= AMQP_BASIC_HEADERS_FLAG;
   }
   return ret;
 }
 
+}  // namespace Detail
+
+namespace {
+
+// A received message that has not been modified is sent with its properties
+// as they arrived. header_edits, when given, replace or add headers, and
+// encoded, when given, is sent as the body along with its content-encoding.
+int SendBasicPublish(amqp_connection_state_t connection,
+                     amqp_channel_t channel, const std::string &exchange_name,
+                     const std::string &routing_key,
+                     const BasicMessage &message, bool mandatory,
+                     bool immediate, const FlatTable *header_edits = NULL,
+                     const Detail::encoded_body_t *encoded = NULL) {
+  Detail::amqp_pool_ptr_t pool;
+  amqp_basic_properties_t properties;
+  if (!Detail::TableValueImpl::GetReceivedProperties(message, properties)) {
+    properties = Detail::CreateAmqpProperties(message, pool);
+  }
+
+  Detail::amqp_pool_ptr_t edits_pool;
+  Detail::amqp_pool_ptr_t merged_pool;
+  if (NULL != header_edits && !header_edits->empty()) {
+    amqp_table_t edits =
+        Detail::TableValueImpl::CreateAmqpTable(*header_edits, edits_pool);
+    if (0 == (properties._flags & AMQP_BASIC_HEADERS_FLAG)) {
+      properties.headers = AMQP_EMPTY_TABLE;
+    }
+    properties.headers = Detail::TableValueImpl::MergeAmqpTable(
+        properties.headers, edits, merged_pool);
+    properties._flags |= AMQP_BASIC_HEADERS_FLAG;
+  }
+
+  amqp_bytes_t body = StringToBytes(message.Body());
+  if (NULL != encoded) {
+    properties.content_encoding = StringRefToBytes(encoded->content_encoding);
+    properties._flags |= AMQP_BASIC_CONTENT_ENCODING_FLAG;
+    body = StringRefToBytes(encoded->body);
+  }
+
+  return amqp_basic_publish(connection, channel, StringToBytes(exchange_name),
+                            StringToBytes(routing_key), mandatory, immediate,
+                            &properties, body);
+}
+
+// Publishes a request whose reply is to come back to reply_to
+int SendRpcRequest(amqp_connection_state_t connection, amqp_channel_t channel,
+                   const std::string &exchange_name,
+                   const std::string &routing_key, const BasicMessage &request,
+                   const char *reply_to, const std::string &correlation_id) {
+  Detail::amqp_pool_ptr_t pool;
+  amqp_basic_properties_t properties;
+  if (!Detail::TableValueImpl::GetReceivedProperties(request, properties)) {
+    properties = Detail::CreateAmqpProperties(request, pool);
+  }
+  properties.reply_to = amqp_cstring_bytes(reply_to);
+  properties.correlation_id = StringToBytes(correlation_id);
+  properties._flags |=
+      AMQP_BASIC_REPLY_TO_FLAG | AMQP_BASIC_CORRELATION_ID_FLAG;
+
+  return amqp_basic_publish(connection, channel, StringToBytes(exchange_name),
+                            StringToBytes(routing_key), false, false,
+                            &properties, StringToBytes(request.Body()));
+}
+
+// Sends the basic.publish method and content header of a message whose body
+// of body_size bytes the caller then sends with SendBodyFrame
+int SendBasicPublishHeader(amqp_connection_state_t connection,
+                           amqp_channel_t channel, amqp_bytes_t exchange,
+                           amqp_bytes_t routing_key, bool mandatory,
+                           bool immediate,
+                           const amqp_basic_properties_t &properties,
+                           std::uint64_t body_size) {
+  amqp_basic_publish_t publish = {};
+  publish.exchange = exchange;
+  publish.routing_key = routing_key;
+  publish.mandatory = mandatory;
+  publish.immediate = immediate;
+  int ret = amqp_send_method(connection, channel, AMQP_BASIC_PUBLISH_METHOD,
+                             &publish);
+  if (AMQP_STATUS_OK != ret) {
+    return ret;
+  }
+
+  amqp_frame_t frame;
+  frame.frame_type = AMQP_FRAME_HEADER;
+  frame.channel = channel;
+  frame.payload.properties.class_id = AMQP_BASIC_CLASS;
+  frame.payload.properties.body_size = body_size;
+  frame.payload.properties.decoded =
+      const_cast<amqp_basic_properties_t *>(&properties);
+  return amqp_send_frame(connection, &frame);
+}
+
+// The most body a single frame can carry, each frame has a 7 byte header and
+// a 1 byte end marker
+std::size_t MaxBodyFragment(amqp_connection_state_t connection) {
+  return static_cast<std::size_t>(amqp_get_frame_max(connection)) - 8;
+}
+
+int SendBodyFrame(amqp_connection_state_t connection, amqp_channel_t channel,
+                  const char *data, std::size_t len) {
+  amqp_frame_t frame;
+  frame.frame_type = AMQP_FRAME_BODY;
+  frame.channel = channel;
+  frame.payload.body_fragment.bytes = const_cast<char *>(data);
+  frame.payload.body_fragment.len = len;
+  return amqp_send_frame(connection, &frame);
+}
+
+// Like amqp_basic_publish, but the body is sent straight from each segment.
+// A body frame never spans two segments, so no segment is copied.
+int SendBasicPublishSegments(amqp_connection_state_t connection,
+                             amqp_channel_t channel, amqp_bytes_t exchange,
+                             amqp_bytes_t routing_key, bool mandatory,
+                             bool immediate,
+                             const amqp_basic_properties_t &properties,
+                             const std::vector<std::string_view> &body) {
+  std::uint64_t body_size = 0;
+  for (std::vector<std::string_view>::const_iterator it = body.begin();
+       it != body.end(); ++it) {
+    body_size += it->size();
+  }
+  int ret = SendBasicPublishHeader(connection, channel, exchange, routing_key,
+                                   mandatory, immediate, properties, body_size);
+  if (AMQP_STATUS_OK != ret) {
+    return ret;
+  }
+
+  const std::size_t max_fragment = MaxBodyFragment(connection);
+  for (std::vector<std::string_view>::const_iterator it = body.begin();
+       it != body.end(); ++it) {
+    for (std::size_t offset = 0; offset < it->size(); offset += max_fragment) {
+      ret = SendBodyFrame(connection, channel, it->data() + offset,
+                          std::min(it->size() - offset, max_fragment));
+      if (AMQP_STATUS_OK != ret) {
+        return ret;
+      }
+    }
+  }
+  return AMQP_STATUS_OK;
+}
+
+#if defined(_WIN32) || defined(SAC_SSL_SUPPORT_ENABLED)
+// connect_timeout is in milliseconds, 0 leaves it to the system
+int OpenSocket(amqp_socket_t *socket, const std::string &host, int port,
+               int connect_timeout) {
+  if (connect_timeout <= 0) {
+    return amqp_socket_open(socket, host.c_str(), port);
+  }
+  struct timeval timeout;
+  timeout.tv_sec = connect_timeout / 1000;
+  timeout.tv_usec = (connect_timeout % 1000) * 1000;
+  return amqp_socket_open_noblock(socket, host.c_str(), port, &timeout);
+}
+#endif
+
+void SetSocketOption(int sockfd, int level, int name, int value,
+                     const char *what) {
+  if (0 != setsockopt(sockfd, level, name,
+                      reinterpret_cast<const char *>(&value), sizeof(value))) {
+    throw AmqpLibraryException::CreateException(
+        AMQP_STATUS_SOCKET_ERROR, std::string("Error setting ") + what);
+  }
+}
+
+void SetSocketOptions(int sockfd,
+                      const Channel::OpenOpts::SocketOptions &options) {
+  SetSocketOption(sockfd, IPPROTO_TCP, TCP_NODELAY,
+                  options.tcp_nodelay ? 1 : 0, "TCP_NODELAY");
+  if (options.send_buffer_size > 0) {
+    SetSocketOption(sockfd, SOL_SOCKET, SO_SNDBUF, options.send_buffer_size,
+                    "SO_SNDBUF");
+  }
+  if (options.receive_buffer_size > 0) {
+    SetSocketOption(sockfd, SOL_SOCKET, SO_RCVBUF,
+                    options.receive_buffer_size, "SO_RCVBUF");
+  }
+#ifdef SO_BUSY_POLL
+  if (options.busy_poll > 0) {
+    SetSocketOption(sockfd, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll,
+                    "SO_BUSY_POLL");
+  }
+#endif
+}
+
+#ifndef _WIN32
+// Waits for the connection attempt on sockfd to finish, until deadline or
+// for as long as it takes if there is none. Returns an amqp_status_enum.
+int WaitForConnect(int sockfd,
+                   const std::chrono::steady_clock::time_point *deadline) {
+  int ready;
+  do {
+    fd_set write_fds;
+    FD_ZERO(&write_fds);
+    FD_SET(sockfd, &write_fds);
+    struct timeval timeout = {};
+    if (NULL != deadline) {
+      const std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now();
+      if (now < *deadline) {
+        const std::chrono::microseconds left =
+            std::chrono::duration_cast<std::chrono::microseconds>(*deadline -
+                                                                  now);
+        timeout.tv_sec = static_cast<time_t>(left.count() / 1000000);
+        timeout.tv_usec = static_cast<suseconds_t>(left.count() % 1000000);
+      }
+    }
+    ready = select(sockfd + 1, NULL, &write_fds, NULL,
+                   NULL != deadline ? &timeout : NULL);
+    // A signal only cuts the wait short, the attempt carries on
+  } while (-1 == ready && EINTR == errno);
+
+  if (0 == ready) {
+    return AMQP_STATUS_TIMEOUT;
+  }
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (ready > 0 &&
+      0 == getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len) &&
+      0 == error) {
+    return AMQP_STATUS_OK;
+  }
+  return AMQP_STATUS_SOCKET_ERROR;
+}
+
+// Connects sockfd to address, giving up at deadline, or leaving the timeout
+// to the system if there is none. Returns an amqp_status_enum.
+int ConnectAddress(int sockfd, const struct addrinfo &address,
+                   const std::chrono::steady_clock::time_point *deadline) {
+  int flags = 0;
+  if (NULL != deadline) {
+    flags = fcntl(sockfd, F_GETFL);
+    if (-1 == flags || -1 == fcntl(sockfd, F_SETFL, flags | O_NONBLOCK)) {
+      return AMQP_STATUS_SOCKET_ERROR;
+    }
+  }
+  int status = AMQP_STATUS_OK;
+  if (0 != connect(sockfd, address.ai_addr, address.ai_addrlen)) {
+    status = AMQP_STATUS_SOCKET_ERROR;
+    // A blocking connect() interrupted by a signal also carries on in the
+    // background
+    if (EINPROGRESS == errno || EINTR == errno) {
+      status = WaitForConnect(sockfd, deadline);
+    }
+  }
+  if (NULL != deadline && -1 == fcntl(sockfd, F_SETFL, flags)) {
+    status = AMQP_STATUS_SOCKET_ERROR;
+  }
+  return status;
+}
+
+// Opens a TCP connection to host with options set before the SYN is sent,
+// which SO_RCVBUF needs to size the window scale. Returns the socket, or a
+// negative amqp_status_enum.
+int ConnectTcpSocket(const std::string &host, int port, int connect_timeout,
+                     const Channel::OpenOpts::SocketOptions &options) {
+  struct addrinfo hint = {};
+  hint.ai_family = AF_UNSPEC;
+  hint.ai_socktype = SOCK_STREAM;
+  hint.ai_protocol = IPPROTO_TCP;
+  struct addrinfo *addresses = NULL;
+  if (0 != getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hint,
+                       &addresses)) {
+    return AMQP_STATUS_HOSTNAME_RESOLUTION_FAILED;
+  }
+
+  // connect_timeout covers the endpoint, however many addresses it has
+  const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(connect_timeout);
+  const std::chrono::steady_clock::time_point *connect_deadline =
+      connect_timeout > 0 ? &deadline : NULL;
+
+  int status = AMQP_STATUS_SOCKET_ERROR;
+  for (struct addrinfo *address = addresses; NULL != address;
+       address = address->ai_next) {
+    if (NULL != connect_deadline &&
+        std::chrono::steady_clock::now() >= deadline) {
+      status = AMQP_STATUS_TIMEOUT;
+      break;
+    }
+    const int sockfd = socket(address->ai_family, address->ai_socktype,
+                              address->ai_protocol);
+    if (-1 == sockfd) {
+      status = AMQP_STATUS_SOCKET_ERROR;
+      continue;
+    }
+    try {
+      fcntl(sockfd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+      SetSocketOption(sockfd, SOL_SOCKET, SO_NOSIGPIPE, 1, "SO_NOSIGPIPE");
+#endif
+      SetSocketOptions(sockfd, options);
+    } catch (...) {
+      close(sockfd);
+      freeaddrinfo(addresses);
+      throw;
+    }
+    status = ConnectAddress(sockfd, *address, connect_deadline);
+    if (AMQP_STATUS_OK == status) {
+      status = sockfd;
+      break;
+    }
+    close(sockfd);
+  }
+  freeaddrinfo(addresses);
+  return status;
+}
+#endif
+
+// Recorded topology keeps its arguments as FlatTables
+FlatTable ToFlatTable(const Table &table) { return FlatTable(table); }
+const FlatTable &ToFlatTable(const FlatTable &table) { return table; }
+
+// Sends the method for one declaration of a DeclareTopology() batch,
+// returns the rabbitmq-c status
+int SendTopologyOp(amqp_connection_state_t connection, amqp_channel_t channel,
+                   const Channel::TopologyOp &op, bool nowait) {
+  Detail::amqp_pool_ptr_t table_pool;
+  amqp_table_t arguments =
+      Detail::TableValueImpl::CreateAmqpTable(op.arguments, table_pool);
+
+  switch (op.kind) {
+    case Channel::TopologyOp::to_declare_exchange: {
+      amqp_exchange_declare_t declare = {};
+      declare.exchange = StringToBytes(op.name);
+      declare.type = StringToBytes(op.exchange_type);
+      declare.durable = op.durable;
+      declare.auto_delete = op.auto_delete;
+      declare.nowait = nowait;
+      declare.arguments = arguments;
+      return amqp_send_method(connection, channel,
+                              AMQP_EXCHANGE_DECLARE_METHOD, &declare);
+    }
+    case Channel::TopologyOp::to_declare_queue: {
+      amqp_queue_declare_t declare = {};
+      declare.queue = StringToBytes(op.name);
+      declare.durable = op.durable;
+      declare.exclusive = op.exclusive;
+      declare.auto_delete = op.auto_delete;
+      declare.nowait = nowait;
+      declare.arguments = arguments;
+      return amqp_send_method(connection, channel, AMQP_QUEUE_DECLARE_METHOD,
+                              &declare);
+    }
+    case Channel::TopologyOp::to_bind_queue: {
+      amqp_queue_bind_t bind = {};
+      bind.queue = StringToBytes(op.name);
+      bind.exchange = StringToBytes(op.source);
+      bind.routing_key = StringToBytes(op.routing_key);
+      bind.nowait = nowait;
+      bind.arguments = arguments;
+      return amqp_send_method(connection, channel, AMQP_QUEUE_BIND_METHOD,
+                              &bind);
+    }
+    case Channel::TopologyOp::to_bind_exchange: {
+      amqp_exchange_bind_t bind = {};
+      bind.destination = StringToBytes(op.name);
+      bind.source = StringToBytes(op.source);
+      bind.routing_key = StringToBytes(op.routing_key);
+      bind.nowait = nowait;
+      bind.arguments = arguments;
+      return amqp_send_method(connection, channel, AMQP_EXCHANGE_BIND_METHOD,
+                              &bind);
+    }
+  }
+  throw std::logic_error("Unhandled topology operation");
+}
+
+// The reply the broker sends to a declaration
+std::array<std::uint32_t, 1> TopologyReply(const Channel::TopologyOp &op) {
+  switch (op.kind) {
+    case Channel::TopologyOp::to_declare_exchange: {
+      std::array<std::uint32_t, 1> reply = {AMQP_EXCHANGE_DECLARE_OK_METHOD};
+      return reply;
+    }
+    case Channel::TopologyOp::to_declare_queue: {
+      std::array<std::uint32_t, 1> reply = {AMQP_QUEUE_DECLARE_OK_METHOD};
+      return reply;
+    }
+    case Channel::TopologyOp::to_bind_queue: {
+      std::array<std::uint32_t, 1> reply = {AMQP_QUEUE_BIND_OK_METHOD};
+      return reply;
+    }
+    case Channel::TopologyOp::to_bind_exchange: {
+      std::array<std::uint32_t, 1> reply = {AMQP_EXCHANGE_BIND_OK_METHOD};
+      return reply;
+    }
+  }
+  throw std::logic_error("Unhandled topology operation");
+}
+
+void RecordTopologyOp(Detail::ConnectionRecovery *recovery,
+                      const Channel::TopologyOp &op,
+                      const std::string &queue_name) {
+  if (NULL == recovery) {
+    return;
+  }
+  switch (op.kind) {
+    case Channel::TopologyOp::to_declare_exchange:
+      recovery->RecordExchange(op.name, op.exchange_type, op.durable,
+                               op.auto_delete, op.arguments);
+      break;
+    case Channel::TopologyOp::to_declare_queue:
+      recovery->RecordQueue(queue_name, op.name.empty(), op.durable,
+                            op.exclusive, op.auto_delete, op.arguments);
+      break;
+    case Channel::TopologyOp::to_bind_queue:
+      recovery->RecordBinding(false, op.name, op.source, op.routing_key,
+                              op.arguments);
+      break;
+    case Channel::TopologyOp::to_bind_exchange:
+      recovery->RecordBinding(true, op.name, op.source, op.routing_key,
+                              op.arguments);
+      break;
+  }
+}
+
+// Builds what TryBasicConsumeMessage() returns from what consuming reported
+Channel::ConsumeResult MakeConsumeResult(bool delivered,
+                                         Envelope::ptr_t &envelope,
+                                         std::string &cancelled_tag) {
+  Channel::ConsumeResult result;
+  if (delivered) {
+    result.status = Channel::ConsumeResult::cr_delivered;
+    result.envelope.swap(envelope);
+  } else if (!cancelled_tag.empty()) {
+    result.status = Channel::ConsumeResult::cr_cancelled;
+    result.consumer_tag.swap(cancelled_tag);
+  }
+  return result;
+}
+
 }  // namespace
 
 const std::string Channel::EXCHANGE_TYPE_DIRECT("direct");
@@ -159,6 +621,24 @@ Channel::OpenOpts Channel::OpenOpts::FromUri(const std::string &uri) {
   return opts;
 }
 
+Channel::OpenOpts Channel::OpenOpts::FromUris(
+    const std::vector<std::string> &uris) {
+  if (uris.empty()) {
+    throw BadUriException();
+  }
+  OpenOpts opts = FromUri(uris.front());
+  for (std::vector<std::string>::const_iterator it = uris.begin();
+       it != uris.end(); ++it) {
+    OpenOpts node = it == uris.begin() ? opts : FromUri(*it);
+    opts.endpoints.push_back(Endpoint(node.host, node.port));
+  }
+  return opts;
+}
+
+bool Channel::OpenOpts::Endpoint::operator==(const Endpoint &o) const {
+  return host == o.host && port == o.port && locality == o.locality;
+}
+
 bool Channel::OpenOpts::BasicAuth::operator==(const BasicAuth &o) const {
   return username == o.username && password == o.password;
 }
@@ -172,67 +652,298 @@ bool Channel::OpenOpts::TLSParams::operator==(const TLSParams &o) const {
   return client_key_path == o.client_key_path &&
          client_cert_path == o.client_cert_path &&
          ca_cert_path == o.ca_cert_path &&
-         verify_hostname == o.verify_hostname && verify_peer == o.verify_peer;
+         verify_hostname == o.verify_hostname &&
+         verify_peer == o.verify_peer && cipher_list == o.cipher_list &&
+         groups == o.groups && resume_sessions == o.resume_sessions;
+}
+
+bool Channel::OpenOpts::SocketOptions::operator==(
+    const SocketOptions &o) const {
+  return tcp_nodelay == o.tcp_nodelay &&
+         send_buffer_size == o.send_buffer_size &&
+         receive_buffer_size == o.receive_buffer_size &&
+         busy_poll == o.busy_poll;
 }
 
 bool Channel::OpenOpts::operator==(const OpenOpts &o) const {
   return host == o.host && vhost == o.vhost && port == o.port &&
-         frame_max == o.frame_max && auth == o.auth &&
-         tls_params == o.tls_params;
+         endpoints == o.endpoints && race_endpoints == o.race_endpoints &&
+         connect_timeout == o.connect_timeout && frame_max == o.frame_max &&
+         heartbeat == o.heartbeat && auth == o.auth &&
+         tls_params == o.tls_params && socket_options == o.socket_options &&
+         publisher_confirms == o.publisher_confirms &&
+         preopen_channels == o.preopen_channels &&
+         message_pool_size == o.message_pool_size &&
+         max_buffered_bytes == o.max_buffered_bytes &&
+         ack_batch_size == o.ack_batch_size &&
+         ack_batch_timeout == o.ack_batch_timeout &&
+         thread_safe == o.thread_safe &&
+         consumer_threads == o.consumer_threads &&
+         automatic_recovery == o.automatic_recovery &&
+         recovery_interval == o.recovery_interval &&
+         recovery_max_interval == o.recovery_max_interval &&
+         recovery_buffer_size == o.recovery_buffer_size &&
+         blocked_publish_buffer_size == o.blocked_publish_buffer_size &&
+         collect_stats == o.collect_stats;
 }
 
 Channel::ptr_t Channel::Open(const OpenOpts &opts) {
-  if (opts.host.empty()) {
-    throw std::runtime_error("opts.host is not specified, it is required");
+  if (opts.endpoints.empty()) {
+    if (opts.host.empty()) {
+      throw std::runtime_error("opts.host is not specified, it is required");
+    }
+    if (opts.port <= 0) {
+      throw std::runtime_error(
+          "opts.port is not valid, it must be a positive number");
+    }
+  }
+  for (std::vector<OpenOpts::Endpoint>::const_iterator it =
+           opts.endpoints.begin();
+       it != opts.endpoints.end(); ++it) {
+    if (it->host.empty() || it->port <= 0) {
+      throw std::runtime_error(
+          "opts.endpoints is not valid, each needs a host and a positive "
+          "port");
+    }
   }
   if (opts.vhost.empty()) {
     throw std::runtime_error("opts.vhost is not specified, it is required");
   }
-  if (opts.port <= 0) {
-    throw std::runtime_error(
-        "opts.port is not valid, it must be a positive number");
-  }
   if (opts.auth.index()==0) {
     throw std::runtime_error("opts.auth is not specified, it is required");
   }
+  if (opts.race_endpoints && opts.connect_timeout <= 0) {
+    // The losing connections finish on their own after Open() returns, this
+    // is what keeps them from lingering
+    throw std::runtime_error(
+        "opts.race_endpoints requires a positive opts.connect_timeout");
+  }
+  if (opts.consumer_threads > 0 && !opts.thread_safe) {
+    throw std::runtime_error(
+        "opts.consumer_threads requires opts.thread_safe to be set");
+  }
+  Detail::EndpointSelector endpoints(opts);
+  ChannelImpl *impl = Connect(opts, endpoints);
+  // Owned by the Channel first, so the connection is closed should any of
+  // what follows throw
+  ptr_t channel = std::make_shared<Channel>(impl);
+  impl->SetPublisherConfirms(opts.publisher_confirms);
+  impl->SetMessagePoolSize(opts.message_pool_size);
+  impl->SetMaxBufferedBytes(opts.max_buffered_bytes);
+  impl->SetBlockedPublishLimit(opts.blocked_publish_buffer_size);
+  if (opts.collect_stats) {
+    impl->EnableStats();
+  }
+  impl->SetAckBatching(opts.ack_batch_size,
+                       std::chrono::microseconds(opts.ack_batch_timeout));
+  impl->SetThreadSafe(opts.thread_safe);
+  impl->SetConsumerThreads(opts.consumer_threads);
+  if (opts.automatic_recovery) {
+    impl->EnableRecovery(opts, endpoints);
+  }
+  if (opts.preopen_channels > 0) {
+    ChannelImpl::ScopedLock lock(*impl);
+    impl->PreopenChannels(opts.preopen_channels);
+  }
+  return channel;
+}
+
+std::future<Channel::ptr_t> Channel::OpenAsync(const OpenOpts &opts) {
+  return std::async(std::launch::async, [opts]() { return Open(opts); });
+}
+
+std::vector<Channel::ptr_t> Channel::OpenMany(const OpenOpts &opts,
+                                              std::size_t count) {
+  std::vector<std::future<ptr_t> > pending;
+  pending.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    pending.push_back(OpenAsync(opts));
+  }
+  // Should get() throw, destroying the futures left waits for their opens to
+  // finish and the channels they made are closed along with them
+  std::vector<ptr_t> channels;
+  channels.reserve(count);
+  for (std::vector<std::future<ptr_t> >::iterator it = pending.begin();
+       it != pending.end(); ++it) {
+    channels.push_back(it->get());
+  }
+  return channels;
+}
+
+Channel::ChannelImpl *Channel::Connect(const OpenOpts &opts,
+                                       Detail::EndpointSelector &endpoints) {
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  const std::vector<std::size_t> candidates = endpoints.Candidates(now);
+  std::exception_ptr error;
+
+  std::size_t next = 0;
+  if (opts.race_endpoints) {
+    std::size_t tier = 1;
+    while (tier < candidates.size() &&
+           endpoints.SameTier(candidates[0], candidates[tier], now)) {
+      ++tier;
+    }
+    if (tier > 1) {
+      ChannelImpl *impl = RaceEndpoints(
+          opts, endpoints,
+          std::vector<std::size_t>(candidates.begin(),
+                                   candidates.begin() + tier),
+          error);
+      if (NULL != impl) {
+        return impl;
+      }
+      next = tier;
+    }
+  }
+
+  for (; next < candidates.size(); ++next) {
+    const std::size_t index = candidates[next];
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    try {
+      ChannelImpl *impl = ConnectToEndpoint(opts, endpoints.Endpoint(index));
+      endpoints.Succeeded(index,
+                          std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - start));
+      return impl;
+    } catch (...) {
+      endpoints.Failed(index, std::chrono::steady_clock::now());
+      error = std::current_exception();
+    }
+  }
+  // Whatever went wrong with the last endpoint tried
+  std::rethrow_exception(error);
+}
+
+Channel::ChannelImpl *Channel::RaceEndpoints(
+    const OpenOpts &opts, Detail::EndpointSelector &endpoints,
+    const std::vector<std::size_t> &candidates, std::exception_ptr &error) {
+  // Shared with the connecting threads, the losers finish after this returns
+  struct race_t {
+    race_t() : winner(NULL), finished(0), decided(false) {}
+    std::mutex mutex;
+    std::condition_variable done;
+    ChannelImpl *winner;
+    std::size_t winner_index;
+    std::chrono::microseconds handshake;
+    std::size_t finished;
+    bool decided;
+    std::vector<std::size_t> failed;
+    std::exception_ptr error;
+  };
+  std::shared_ptr<race_t> race = std::make_shared<race_t>();
+
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (std::vector<std::size_t>::const_iterator it = candidates.begin();
+       it != candidates.end(); ++it) {
+    const std::size_t index = *it;
+    const OpenOpts::Endpoint endpoint = endpoints.Endpoint(index);
+    std::thread([race, opts, endpoint, index, start]() {
+      ChannelImpl *impl = NULL;
+      std::exception_ptr failure;
+      try {
+        impl = ConnectToEndpoint(opts, endpoint);
+      } catch (...) {
+        failure = std::current_exception();
+      }
+
+      std::unique_lock<std::mutex> lock(race->mutex);
+      ++race->finished;
+      if (NULL == impl) {
+        race->failed.push_back(index);
+        race->error = failure;
+      } else if (NULL == race->winner && !race->decided) {
+        race->winner = impl;
+        race->winner_index = index;
+        race->handshake = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        impl = NULL;
+      }
+      race->done.notify_all();
+      lock.unlock();
+
+      if (NULL != impl) {
+        // Lost the race
+        amqp_connection_close(impl->m_connection, AMQP_REPLY_SUCCESS);
+        amqp_destroy_connection(impl->m_connection);
+        delete impl;
+      }
+    }).detach();
+  }
+
+  std::unique_lock<std::mutex> lock(race->mutex);
+  race->done.wait(lock, [&race, &candidates]() {
+    return NULL != race->winner || race->finished == candidates.size();
+  });
+  race->decided = true;
+
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  for (std::vector<std::size_t>::const_iterator it = race->failed.begin();
+       it != race->failed.end(); ++it) {
+    endpoints.Failed(*it, now);
+  }
+  if (NULL == race->winner) {
+    error = race->error;
+    return NULL;
+  }
+  endpoints.Succeeded(race->winner_index, race->handshake);
+  return race->winner;
+}
+
+Channel::ChannelImpl *Channel::ConnectToEndpoint(
+    const OpenOpts &opts, const OpenOpts::Endpoint &endpoint) {
+  ChannelImpl *impl = NULL;
   if (!opts.tls_params.has_value()) {
     switch (opts.auth.index()) {
       case 1: {
         const OpenOpts::BasicAuth &auth =
             std::get<OpenOpts::BasicAuth>(opts.auth);
-        return std::make_shared<Channel>(
-            OpenChannel(opts.host, opts.port, auth.username, auth.password,
-                        opts.vhost, opts.frame_max, false));
+        impl = OpenChannel(endpoint.host, endpoint.port, opts.connect_timeout,
+                           opts.socket_options, auth.username, auth.password,
+                           opts.vhost, opts.frame_max, opts.heartbeat, false);
+        break;
       }
       case 2: {
         const OpenOpts::ExternalSaslAuth &auth =
             std::get<OpenOpts::ExternalSaslAuth>(opts.auth);
-        return std::make_shared<Channel>(
-            OpenChannel(opts.host, opts.port, auth.identity, "", opts.vhost,
-                        opts.frame_max, true));
+        impl = OpenChannel(endpoint.host, endpoint.port, opts.connect_timeout,
+                           opts.socket_options, auth.identity, "", opts.vhost,
+                           opts.frame_max, opts.heartbeat, true);
+        break;
       }
       default:
         throw std::logic_error("Unhandled auth type");
     }
-  }
-  switch (opts.auth.index()) {
-    case 1: {
-      const OpenOpts::BasicAuth &auth =
-          std::get<OpenOpts::BasicAuth>(opts.auth);
-      return std::make_shared<Channel>(OpenSecureChannel(
-          opts.host, opts.port, auth.username, auth.password, opts.vhost,
-          opts.frame_max, opts.tls_params.value(), false));
-    }
-    case 2: {
-      const OpenOpts::ExternalSaslAuth &auth =
-          std::get<OpenOpts::ExternalSaslAuth>(opts.auth);
-      return std::make_shared<Channel>(
-          OpenSecureChannel(opts.host, opts.port, auth.identity, "", opts.vhost,
-                            opts.frame_max, opts.tls_params.value(), true));
+  } else {
+    switch (opts.auth.index()) {
+      case 1: {
+        const OpenOpts::BasicAuth &auth =
+            std::get<OpenOpts::BasicAuth>(opts.auth);
+        impl = OpenSecureChannel(endpoint.host, endpoint.port,
+                                 opts.connect_timeout, opts.socket_options,
+                                 auth.username, auth.password, opts.vhost,
+                                 opts.frame_max, opts.heartbeat,
+                                 opts.tls_params.value(), false);
+        break;
+      }
+      case 2: {
+        const OpenOpts::ExternalSaslAuth &auth =
+            std::get<OpenOpts::ExternalSaslAuth>(opts.auth);
+        impl = OpenSecureChannel(endpoint.host, endpoint.port,
+                                 opts.connect_timeout, opts.socket_options,
+                                 auth.identity, "", opts.vhost, opts.frame_max,
+                                 opts.heartbeat, opts.tls_params.value(),
+                                 true);
+        break;
+      }
+      default:
+        throw std::logic_error("Unhandled auth type");
     }
-    default:
-      throw std::logic_error("Unhandled auth type");
   }
+  return impl;
 }
 
 Channel::ptr_t Channel::Create(const std::string &host, int port,
@@ -369,11 +1080,11 @@ Channel::ptr_t Channel::CreateSecureFromUri(
   return Open(opts);
 }
 
-Channel::ChannelImpl *Channel::OpenChannel(const std::string &host, int port,
-                                           const std::string &username,
-                                           const std::string &password,
-                                           const std::string &vhost,
-                                           int frame_max, bool sasl_external) {
+Channel::ChannelImpl *Channel::OpenChannel(
+    const std::string &host, int port, int connect_timeout,
+    const OpenOpts::SocketOptions &socket_options, const std::string &username,
+    const std::string &password, const std::string &vhost, int frame_max,
+    int heartbeat, bool sasl_external) {
   ChannelImpl *impl = new ChannelImpl;
   impl->m_connection = amqp_new_connection();
 
@@ -383,10 +1094,20 @@ Channel::ChannelImpl *Channel::OpenChannel(const std::string &host, int port,
 
   try {
     amqp_socket_t *socket = amqp_tcp_socket_new(impl->m_connection);
-    int sock = amqp_socket_open(socket, host.c_str(), port);
+#ifndef _WIN32
+    int sock = ConnectTcpSocket(host, port, connect_timeout, socket_options);
+    impl->CheckForError(sock);
+    amqp_tcp_socket_set_sockfd(socket, sock);
+#else
+    // Winsock is set up by rabbitmq-c when it opens the socket, so the
+    // options can only be set once it is connected
+    int sock = OpenSocket(socket, host, port, connect_timeout);
     impl->CheckForError(sock);
+    SetSocketOptions(amqp_socket_get_sockfd(socket), socket_options);
+#endif
 
-    impl->DoLogin(username, password, vhost, frame_max, sasl_external);
+    impl->DoLogin(username, password, vhost, frame_max, heartbeat,
+                  sasl_external);
   } catch (...) {
     amqp_destroy_connection(impl->m_connection);
     delete impl;
@@ -399,9 +1120,11 @@ Channel::ChannelImpl *Channel::OpenChannel(const std::string &host, int port,
 
 #ifdef SAC_SSL_SUPPORT_ENABLED
 Channel::ChannelImpl *Channel::OpenSecureChannel(
-    const std::string &host, int port, const std::string &username,
-    const std::string &password, const std::string &vhost, int frame_max,
-    const OpenOpts::TLSParams &tls_params, bool sasl_external) {
+    const std::string &host, int port, int connect_timeout,
+    const OpenOpts::SocketOptions &socket_options,
+    const std::string &username, const std::string &password,
+    const std::string &vhost, int frame_max,
+    int heartbeat, const OpenOpts::TLSParams &tls_params, bool sasl_external) {
   Channel::ChannelImpl *impl = new ChannelImpl;
   impl->m_connection = amqp_new_connection();
   if (NULL == impl->m_connection) {
@@ -420,6 +1143,18 @@ Channel::ChannelImpl *Channel::OpenSecureChannel(
 #endif
 
   try {
+#if AMQP_VERSION >= 0x000A0000
+    Detail::TlsContext::Configure(amqp_ssl_socket_get_context(socket),
+                                  tls_params,
+                                  host + ":" + std::to_string(port));
+#else
+    if (!tls_params.cipher_list.empty() || !tls_params.groups.empty() ||
+        tls_params.resume_sessions) {
+      throw std::logic_error(
+          "TLS cipher, group and session options need rabbitmq-c v0.10.0 or "
+          "better");
+    }
+#endif
     int status;
     if (tls_params.ca_cert_path != "") {
       status =
@@ -440,13 +1175,17 @@ Channel::ChannelImpl *Channel::OpenSecureChannel(
       }
     }
 
-    status = amqp_socket_open(socket, host.c_str(), port);
+    status = OpenSocket(socket, host, port, connect_timeout);
     if (status) {
       throw AmqpLibraryException::CreateException(
           status, "Error setting client certificate for socket");
     }
+    // rabbitmq-c connects the socket and starts the TLS handshake in one go,
+    // so the options can only be set afterwards
+    SetSocketOptions(amqp_socket_get_sockfd(socket), socket_options);
 
-    impl->DoLogin(username, password, vhost, frame_max, sasl_external);
+    impl->DoLogin(username, password, vhost, frame_max, heartbeat,
+                  sasl_external);
   } catch (...) {
     amqp_destroy_connection(impl->m_connection);
     delete impl;
@@ -458,25 +1197,237 @@ Channel::ChannelImpl *Channel::OpenSecureChannel(
 }
 #else
 Channel::ChannelImpl *Channel::OpenSecureChannel(
-    const std::string &, int, const std::string &, const std::string &,
-    const std::string &, int, const OpenOpts::TLSParams &, bool) {
+    const std::string &, int, int, const OpenOpts::SocketOptions &,
+    const std::string &, const std::string &, const std::string &, int, int,
+    const OpenOpts::TLSParams &, bool) {
   throw std::logic_error(
       "SSL support has not been compiled into SimpleAmqpClient");
 }
 #endif
 
+void Channel::EnsureConnected() {
+  if (!m_impl->IsConnected()) {
+    Detail::ConnectionRecovery *recovery = m_impl->Recovery();
+    if (NULL != recovery && !recovery->Replaying()) {
+      Recover();
+    }
+  }
+  m_impl->CheckIsConnected();
+}
+
+void Channel::Recover() {
+  Detail::ConnectionRecovery &recovery = *m_impl->Recovery();
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  // A thread still waiting on the old socket will find out it has gone, the
+  // call after that recovers
+  if (!recovery.AttemptDue(now) || m_impl->ReaderActive()) {
+    return;
+  }
+
+  recovery.SetReplaying(true);
+  try {
+    std::unique_ptr<ChannelImpl> fresh(
+        Connect(recovery.Options(), recovery.Endpoints()));
+    m_impl->AdoptConnection(*fresh);
+    m_impl->PreopenChannels(recovery.Options().preopen_channels);
+    ReplayTopology();
+    PublishBuffered();
+    recovery.AttemptSucceeded();
+  } catch (const std::exception &) {
+    // Whatever went wrong, the connection is not usable. The next call made
+    // once the backoff has passed tries again from the start.
+    m_impl->SetIsConnected(false);
+    recovery.AttemptFailed(now);
+  }
+  recovery.SetReplaying(false);
+}
+
+void Channel::ReplayTopology() {
+  Detail::ConnectionRecovery &recovery = *m_impl->Recovery();
+  // Iterate over copies, declarations the broker now refuses are forgotten.
+  // Anything worse than a channel error ends the attempt.
+  const Detail::ConnectionRecovery::exchange_map_t exchanges =
+      recovery.Exchanges();
+  for (Detail::ConnectionRecovery::exchange_map_t::const_iterator it =
+           exchanges.begin();
+       it != exchanges.end(); ++it) {
+    try {
+      DoDeclareExchange(it->first, it->second.type, false, it->second.durable,
+                        it->second.auto_delete, it->second.arguments);
+    } catch (const ChannelException &) {
+      recovery.ForgetExchange(it->first);
+    }
+  }
+
+  const Detail::ConnectionRecovery::queue_map_t queues = recovery.Queues();
+  for (Detail::ConnectionRecovery::queue_map_t::const_iterator it =
+           queues.begin();
+       it != queues.end(); ++it) {
+    const Detail::ConnectionRecovery::queue_t &queue = it->second;
+    try {
+      std::uint32_t message_count;
+      std::uint32_t consumer_count;
+      std::string name = DoDeclareQueueWithCounts(
+          queue.server_named ? std::string() : it->first, message_count,
+          consumer_count, false, queue.durable, queue.exclusive,
+          queue.auto_delete, queue.arguments);
+      recovery.RenameQueue(it->first, name);
+    } catch (const ChannelException &) {
+      recovery.ForgetQueue(it->first);
+    }
+  }
+
+  const Detail::ConnectionRecovery::binding_list_t bindings =
+      recovery.Bindings();
+  for (Detail::ConnectionRecovery::binding_list_t::const_iterator it =
+           bindings.begin();
+       it != bindings.end(); ++it) {
+    try {
+      if (it->exchange_binding) {
+        DoBindExchange(it->destination, it->source, it->routing_key,
+                       it->arguments);
+      } else {
+        DoBindQueue(it->destination, it->source, it->routing_key,
+                    it->arguments);
+      }
+    } catch (const ChannelException &) {
+      recovery.ForgetBinding(it->exchange_binding, it->destination,
+                             it->source, it->routing_key, it->arguments);
+    }
+  }
+
+  const Detail::ConnectionRecovery::consumer_map_t consumers =
+      recovery.Consumers();
+  for (Detail::ConnectionRecovery::consumer_map_t::const_iterator it =
+           consumers.begin();
+       it != consumers.end(); ++it) {
+    const Detail::ConnectionRecovery::consumer_t &consumer = it->second;
+    try {
+      DoBasicConsume(consumer.queue, it->first, consumer.no_local,
+                     consumer.no_ack, consumer.exclusive,
+                     consumer.prefetch_count, consumer.arguments, false);
+      // basic.consume only carries the count
+      if (0 != consumer.prefetch_size) {
+        BasicQos(it->first, consumer.prefetch_count, consumer.prefetch_size);
+      }
+    } catch (const ChannelException &) {
+      recovery.ForgetConsumer(it->first);
+    }
+  }
+  m_impl->RemoveOrphanedHandlers();
+}
+
+void Channel::PublishBuffered() {
+  Detail::ConnectionRecovery &recovery = *m_impl->Recovery();
+  while (recovery.HasBufferedPublishes()) {
+    const Detail::ConnectionRecovery::publish_t &publish =
+        recovery.FrontPublish();
+    if (m_impl->PublisherConfirms()) {
+      // Nobody is waiting on these, confirms go to the confirm callback
+      BasicPublishAsync(publish.exchange, publish.routing_key, publish.message,
+                        publish.mandatory, publish.immediate);
+    } else {
+      BasicPublish(publish.exchange, publish.routing_key, publish.message,
+                   publish.mandatory, publish.immediate);
+    }
+    recovery.PopPublish();
+  }
+}
+
+void Channel::SendBlockedPublishes() {
+  while (m_impl->HasBlockedPublishes() && !m_impl->IsBlocked()) {
+    m_impl->WaitForPublishConfirms(m_impl->ConfirmWindow() - 1);
+    // Waiting may have read another connection.blocked, or seen the confirm
+    // channel close and the held publishes with it
+    if (m_impl->IsBlocked() || !m_impl->HasBlockedPublishes()) {
+      break;
+    }
+    const ChannelImpl::blocked_publish_t &publish =
+        m_impl->FrontBlockedPublish();
+    amqp_channel_t channel = m_impl->GetConfirmChannel();
+    m_impl->CheckForError(
+        SendBasicPublish(m_impl->m_connection, channel, publish.exchange,
+                         publish.routing_key, *publish.message,
+                         publish.mandatory, publish.immediate, NULL,
+                         m_impl->EncodeBody(*publish.message)));
+    m_impl->AddUnconfirmedPublish(publish.mandatory, publish.exchange,
+                                  publish.routing_key);
+    m_impl->PopBlockedPublish();
+  }
+}
+
 Channel::Channel(ChannelImpl *impl) : m_impl(impl) {}
 
 Channel::~Channel() {
+  // Handlers on the consumer threads may be waiting for the lock
+  m_impl->StopConsumerThreads();
+  ChannelImpl::ScopedLock lock(*m_impl);
+  if (m_impl->IsConnected() && m_impl->HasPendingAcks()) {
+    // Best effort, the connection is going away regardless
+    try {
+      m_impl->FlushAcks();
+    } catch (...) {
+    }
+  }
   amqp_connection_close(m_impl->m_connection, AMQP_REPLY_SUCCESS);
   amqp_destroy_connection(m_impl->m_connection);
 }
 
+int Channel::GetHeartbeat() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return amqp_get_heartbeat(m_impl->m_connection);
+}
+
+int Channel::GetFrameMax() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return amqp_get_frame_max(m_impl->m_connection);
+}
+
 int Channel::GetSocketFD() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
   return amqp_get_sockfd(m_impl->m_connection);
 }
 
+bool Channel::OnReadable() {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  // Over budget, the socket is left for TCP to push back on the broker.
+  // Heartbeats still go out.
+  const bool over_budget = m_impl->OverBufferBudget();
+  std::size_t read = over_budget ? 0 : m_impl->ReadAvailableFrames();
+  read += m_impl->ServiceHeartbeats(0 == read && !over_budget);
+  m_impl->RunConfirmCallbacks();
+  m_impl->RunPendingHandlers();
+  return read > 0;
+}
+
+bool Channel::WantsRead() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return !m_impl->OverBufferBudget();
+}
+
+std::size_t Channel::GetBufferedBytes() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return m_impl->BufferedBytes();
+}
+
+bool Channel::WantsWrite() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return m_impl->IsConnected() &&
+         (m_impl->HasPendingAcks() ||
+          (m_impl->HasBlockedPublishes() && !m_impl->IsBlocked()));
+}
+
+void Channel::OnWritable() {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  m_impl->FlushAcks();
+  SendBlockedPublishes();
+}
+
 bool Channel::CheckExchangeExists(std::string_view exchange_name) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> DECLARE_OK = {
       AMQP_EXCHANGE_DECLARE_OK_METHOD};
 
@@ -502,13 +1453,15 @@ void Channel::DeclareExchange(const std::string &exchange_name,
                   Table());
 }
 
-void Channel::DeclareExchange(const std::string &exchange_name,
-                              const std::string &exchange_type, bool passive,
-                              bool durable, bool auto_delete,
-                              const Table &arguments) {
+template <class ArgumentTable>
+void Channel::DoDeclareExchange(const std::string &exchange_name,
+                                const std::string &exchange_type, bool passive,
+                                bool durable, bool auto_delete,
+                                const ArgumentTable &arguments) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> DECLARE_OK = {
       AMQP_EXCHANGE_DECLARE_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_exchange_declare_t declare = {};
   declare.exchange = StringToBytes(exchange_name);
@@ -526,12 +1479,35 @@ void Channel::DeclareExchange(const std::string &exchange_name,
   amqp_frame_t frame =
       m_impl->DoRpc(AMQP_EXCHANGE_DECLARE_METHOD, &declare, DECLARE_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder();
+  if (NULL != recovery && !passive) {
+    recovery->RecordExchange(exchange_name, exchange_type, durable,
+                             auto_delete, ToFlatTable(arguments));
+  }
+}
+
+void Channel::DeclareExchange(const std::string &exchange_name,
+                              const std::string &exchange_type, bool passive,
+                              bool durable, bool auto_delete,
+                              const Table &arguments) {
+  DoDeclareExchange(exchange_name, exchange_type, passive, durable, auto_delete,
+                    arguments);
+}
+
+void Channel::DeclareExchange(const std::string &exchange_name,
+                              const std::string &exchange_type, bool passive,
+                              bool durable, bool auto_delete,
+                              const FlatTable &arguments) {
+  DoDeclareExchange(exchange_name, exchange_type, passive, durable, auto_delete,
+                    arguments);
 }
 
 void Channel::DeleteExchange(const std::string &exchange_name, bool if_unused) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> DELETE_OK = {
       AMQP_EXCHANGE_DELETE_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_exchange_delete_t del = {};
   del.exchange = StringToBytes(exchange_name);
@@ -541,6 +1517,10 @@ void Channel::DeleteExchange(const std::string &exchange_name, bool if_unused) {
   amqp_frame_t frame =
       m_impl->DoRpc(AMQP_EXCHANGE_DELETE_METHOD, &del, DELETE_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->ForgetExchange(exchange_name);
+  }
 }
 
 void Channel::BindExchange(const std::string &destination,
@@ -549,12 +1529,14 @@ void Channel::BindExchange(const std::string &destination,
   BindExchange(destination, source, routing_key, Table());
 }
 
-void Channel::BindExchange(const std::string &destination,
-                           const std::string &source,
-                           const std::string &routing_key,
-                           const Table &arguments) {
+template <class ArgumentTable>
+void Channel::DoBindExchange(const std::string &destination,
+                             const std::string &source,
+                             const std::string &routing_key,
+                             const ArgumentTable &arguments) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> BIND_OK = {AMQP_EXCHANGE_BIND_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_exchange_bind_t bind = {};
   bind.destination = StringToBytes(destination);
@@ -568,21 +1550,42 @@ void Channel::BindExchange(const std::string &destination,
 
   amqp_frame_t frame = m_impl->DoRpc(AMQP_EXCHANGE_BIND_METHOD, &bind, BIND_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
-}
 
-void Channel::UnbindExchange(const std::string &destination,
-                             const std::string &source,
-                             const std::string &routing_key) {
-  UnbindExchange(destination, source, routing_key, Table());
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->RecordBinding(true, destination, source, routing_key,
+                            ToFlatTable(arguments));
+  }
+}
+
+void Channel::BindExchange(const std::string &destination,
+                           const std::string &source,
+                           const std::string &routing_key,
+                           const Table &arguments) {
+  DoBindExchange(destination, source, routing_key, arguments);
+}
+
+void Channel::BindExchange(const std::string &destination,
+                           const std::string &source,
+                           const std::string &routing_key,
+                           const FlatTable &arguments) {
+  DoBindExchange(destination, source, routing_key, arguments);
 }
 
 void Channel::UnbindExchange(const std::string &destination,
                              const std::string &source,
-                             const std::string &routing_key,
-                             const Table &arguments) {
+                             const std::string &routing_key) {
+  UnbindExchange(destination, source, routing_key, Table());
+}
+
+template <class ArgumentTable>
+void Channel::DoUnbindExchange(const std::string &destination,
+                               const std::string &source,
+                               const std::string &routing_key,
+                               const ArgumentTable &arguments) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> UNBIND_OK = {
       AMQP_EXCHANGE_UNBIND_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_exchange_unbind_t unbind = {};
   unbind.destination = StringToBytes(destination);
@@ -597,9 +1600,29 @@ void Channel::UnbindExchange(const std::string &destination,
   amqp_frame_t frame =
       m_impl->DoRpc(AMQP_EXCHANGE_UNBIND_METHOD, &unbind, UNBIND_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->ForgetBinding(true, destination, source, routing_key,
+                            ToFlatTable(arguments));
+  }
+}
+
+void Channel::UnbindExchange(const std::string &destination,
+                             const std::string &source,
+                             const std::string &routing_key,
+                             const Table &arguments) {
+  DoUnbindExchange(destination, source, routing_key, arguments);
+}
+
+void Channel::UnbindExchange(const std::string &destination,
+                             const std::string &source,
+                             const std::string &routing_key,
+                             const FlatTable &arguments) {
+  DoUnbindExchange(destination, source, routing_key, arguments);
 }
 
 bool Channel::CheckQueueExists(std::string_view queue_name) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> DECLARE_OK = {
       AMQP_QUEUE_DECLARE_OK_METHOD};
 
@@ -635,6 +1658,17 @@ std::string Channel::DeclareQueue(const std::string &queue_name, bool passive,
                                 arguments);
 }
 
+std::string Channel::DeclareQueue(const std::string &queue_name, bool passive,
+                                  bool durable, bool exclusive,
+                                  bool auto_delete,
+                                  const FlatTable &arguments) {
+  std::uint32_t message_count;
+  std::uint32_t consumer_count;
+  return DeclareQueueWithCounts(queue_name, message_count, consumer_count,
+                                passive, durable, exclusive, auto_delete,
+                                arguments);
+}
+
 std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
                                             std::uint32_t &message_count,
                                             std::uint32_t &consumer_count,
@@ -645,15 +1679,17 @@ std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
                                 Table());
 }
 
-std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
-                                            std::uint32_t &message_count,
-                                            std::uint32_t &consumer_count,
-                                            bool passive, bool durable,
-                                            bool exclusive, bool auto_delete,
-                                            const Table &arguments) {
+template <class ArgumentTable>
+std::string Channel::DoDeclareQueueWithCounts(const std::string &queue_name,
+                                              std::uint32_t &message_count,
+                                              std::uint32_t &consumer_count,
+                                              bool passive, bool durable,
+                                              bool exclusive, bool auto_delete,
+                                              const ArgumentTable &arguments) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> DECLARE_OK = {
       AMQP_QUEUE_DECLARE_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_queue_declare_t declare = {};
   declare.queue = StringToBytes(queue_name);
@@ -679,13 +1715,42 @@ std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
   consumer_count = declare_ok->consumer_count;
 
   m_impl->MaybeReleaseBuffersOnChannel(response.channel);
+
+  Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder();
+  if (NULL != recovery && !passive) {
+    recovery->RecordQueue(ret, queue_name.empty(), durable, exclusive,
+                          auto_delete, ToFlatTable(arguments));
+  }
   return ret;
 }
 
+std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
+                                            std::uint32_t &message_count,
+                                            std::uint32_t &consumer_count,
+                                            bool passive, bool durable,
+                                            bool exclusive, bool auto_delete,
+                                            const Table &arguments) {
+  return DoDeclareQueueWithCounts(queue_name, message_count, consumer_count,
+                                  passive, durable, exclusive, auto_delete,
+                                  arguments);
+}
+
+std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
+                                            std::uint32_t &message_count,
+                                            std::uint32_t &consumer_count,
+                                            bool passive, bool durable,
+                                            bool exclusive, bool auto_delete,
+                                            const FlatTable &arguments) {
+  return DoDeclareQueueWithCounts(queue_name, message_count, consumer_count,
+                                  passive, durable, exclusive, auto_delete,
+                                  arguments);
+}
+
 void Channel::DeleteQueue(const std::string &queue_name, bool if_unused,
                           bool if_empty) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> DELETE_OK = {AMQP_QUEUE_DELETE_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_queue_delete_t del = {};
   del.queue = StringToBytes(queue_name);
@@ -695,6 +1760,10 @@ void Channel::DeleteQueue(const std::string &queue_name, bool if_unused,
 
   amqp_frame_t frame = m_impl->DoRpc(AMQP_QUEUE_DELETE_METHOD, &del, DELETE_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->ForgetQueue(queue_name);
+  }
 }
 
 void Channel::BindQueue(const std::string &queue_name,
@@ -703,12 +1772,14 @@ void Channel::BindQueue(const std::string &queue_name,
   BindQueue(queue_name, exchange_name, routing_key, Table());
 }
 
-void Channel::BindQueue(const std::string &queue_name,
-                        const std::string &exchange_name,
-                        const std::string &routing_key,
-                        const Table &arguments) {
+template <class ArgumentTable>
+void Channel::DoBindQueue(const std::string &queue_name,
+                          const std::string &exchange_name,
+                          const std::string &routing_key,
+                          const ArgumentTable &arguments) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> BIND_OK = {AMQP_QUEUE_BIND_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_queue_bind_t bind = {};
   bind.queue = StringToBytes(queue_name);
@@ -722,6 +1793,25 @@ void Channel::BindQueue(const std::string &queue_name,
 
   amqp_frame_t frame = m_impl->DoRpc(AMQP_QUEUE_BIND_METHOD, &bind, BIND_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->RecordBinding(false, queue_name, exchange_name, routing_key,
+                            ToFlatTable(arguments));
+  }
+}
+
+void Channel::BindQueue(const std::string &queue_name,
+                        const std::string &exchange_name,
+                        const std::string &routing_key,
+                        const Table &arguments) {
+  DoBindQueue(queue_name, exchange_name, routing_key, arguments);
+}
+
+void Channel::BindQueue(const std::string &queue_name,
+                        const std::string &exchange_name,
+                        const std::string &routing_key,
+                        const FlatTable &arguments) {
+  DoBindQueue(queue_name, exchange_name, routing_key, arguments);
 }
 
 void Channel::UnbindQueue(const std::string &queue_name,
@@ -730,12 +1820,14 @@ void Channel::UnbindQueue(const std::string &queue_name,
   UnbindQueue(queue_name, exchange_name, routing_key, Table());
 }
 
-void Channel::UnbindQueue(const std::string &queue_name,
-                          const std::string &exchange_name,
-                          const std::string &routing_key,
-                          const Table &arguments) {
+template <class ArgumentTable>
+void Channel::DoUnbindQueue(const std::string &queue_name,
+                            const std::string &exchange_name,
+                            const std::string &routing_key,
+                            const ArgumentTable &arguments) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> UNBIND_OK = {AMQP_QUEUE_UNBIND_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_queue_unbind_t unbind = {};
   unbind.queue = StringToBytes(queue_name);
@@ -749,11 +1841,31 @@ void Channel::UnbindQueue(const std::string &queue_name,
   amqp_frame_t frame =
       m_impl->DoRpc(AMQP_QUEUE_UNBIND_METHOD, &unbind, UNBIND_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->ForgetBinding(false, queue_name, exchange_name, routing_key,
+                            ToFlatTable(arguments));
+  }
+}
+
+void Channel::UnbindQueue(const std::string &queue_name,
+                          const std::string &exchange_name,
+                          const std::string &routing_key,
+                          const Table &arguments) {
+  DoUnbindQueue(queue_name, exchange_name, routing_key, arguments);
+}
+
+void Channel::UnbindQueue(const std::string &queue_name,
+                          const std::string &exchange_name,
+                          const std::string &routing_key,
+                          const FlatTable &arguments) {
+  DoUnbindQueue(queue_name, exchange_name, routing_key, arguments);
 }
 
 void Channel::PurgeQueue(const std::string &queue_name) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> PURGE_OK = {AMQP_QUEUE_PURGE_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_queue_purge_t purge = {};
   purge.queue = StringToBytes(queue_name);
@@ -763,6 +1875,145 @@ void Channel::PurgeQueue(const std::string &queue_name) {
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
 }
 
+Channel::TopologyOp Channel::TopologyOp::DeclareExchange(
+    const std::string &exchange_name, const std::string &exchange_type,
+    bool durable, bool auto_delete, const FlatTable &arguments) {
+  TopologyOp op;
+  op.kind = to_declare_exchange;
+  op.name = exchange_name;
+  op.exchange_type = exchange_type;
+  op.durable = durable;
+  op.auto_delete = auto_delete;
+  op.arguments = arguments;
+  return op;
+}
+
+Channel::TopologyOp Channel::TopologyOp::DeclareQueue(
+    const std::string &queue_name, bool durable, bool exclusive,
+    bool auto_delete, const FlatTable &arguments) {
+  TopologyOp op;
+  op.kind = to_declare_queue;
+  op.name = queue_name;
+  op.durable = durable;
+  op.exclusive = exclusive;
+  op.auto_delete = auto_delete;
+  op.arguments = arguments;
+  return op;
+}
+
+Channel::TopologyOp Channel::TopologyOp::BindQueue(
+    const std::string &queue_name, const std::string &exchange_name,
+    const std::string &routing_key, const FlatTable &arguments) {
+  TopologyOp op;
+  op.kind = to_bind_queue;
+  op.name = queue_name;
+  op.source = exchange_name;
+  op.routing_key = routing_key;
+  op.arguments = arguments;
+  return op;
+}
+
+Channel::TopologyOp Channel::TopologyOp::BindExchange(
+    const std::string &destination, const std::string &source,
+    const std::string &routing_key, const FlatTable &arguments) {
+  TopologyOp op;
+  op.kind = to_bind_exchange;
+  op.name = destination;
+  op.source = source;
+  op.routing_key = routing_key;
+  op.arguments = arguments;
+  return op;
+}
+
+std::vector<Channel::TopologyResult> Channel::DeclareTopology(
+    const std::vector<TopologyOp> &ops, bool nowait) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+
+  std::vector<TopologyResult> results(ops.size());
+  if (ops.empty()) {
+    return results;
+  }
+
+  if (nowait) {
+    for (std::vector<TopologyOp>::const_iterator it = ops.begin();
+         it != ops.end(); ++it) {
+      if (TopologyOp::to_declare_queue == it->kind && it->name.empty()) {
+        throw std::invalid_argument(
+            "a queue declared with nowait must have a name");
+      }
+    }
+
+    amqp_channel_t channel = m_impl->GetChannel();
+    amqp_frame_t frame;
+    try {
+      for (std::size_t i = 0; i < ops.size(); ++i) {
+        m_impl->CheckForError(SendTopologyOp(m_impl->m_connection, channel,
+                                             ops[i], i + 1 < ops.size()));
+      }
+      // A channel's methods are handled in order, and a refused one closes
+      // the channel, so a reply to the last means they all went through
+      std::array<amqp_channel_t, 1> channels = {channel};
+      m_impl->GetMethodOnChannel(channels, frame, TopologyReply(ops.back()));
+    } catch (const ChannelException &) {
+      // Declarations can be made again harmlessly, which is how the one that
+      // was refused is found
+      return DeclareTopology(ops, false);
+    }
+
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+      if (TopologyOp::to_declare_queue == ops[i].kind) {
+        results[i].queue_name = ops[i].name;
+      }
+      RecordTopologyOp(m_impl->TopologyRecorder(), ops[i], ops[i].name);
+    }
+    if (TopologyOp::to_declare_queue == ops.back().kind) {
+      amqp_queue_declare_ok_t *declare_ok =
+          (amqp_queue_declare_ok_t *)frame.payload.method.decoded;
+      results.back().message_count = declare_ok->message_count;
+      results.back().consumer_count = declare_ok->consumer_count;
+    }
+    m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+    m_impl->ReturnChannel(channel);
+    return results;
+  }
+
+  std::size_t next = 0;
+  while (next < ops.size()) {
+    amqp_channel_t channel = m_impl->GetChannel();
+    for (std::size_t i = next; i < ops.size(); ++i) {
+      m_impl->CheckForError(
+          SendTopologyOp(m_impl->m_connection, channel, ops[i], false));
+    }
+
+    // A refused declaration closes the channel, and the broker drops
+    // whatever was sent on it after, so the rest go again on a new one
+    try {
+      std::array<amqp_channel_t, 1> channels = {channel};
+      for (; next < ops.size(); ++next) {
+        amqp_frame_t frame;
+        m_impl->GetMethodOnChannel(channels, frame, TopologyReply(ops[next]));
+        TopologyResult &result = results[next];
+        if (TopologyOp::to_declare_queue == ops[next].kind) {
+          amqp_queue_declare_ok_t *declare_ok =
+              (amqp_queue_declare_ok_t *)frame.payload.method.decoded;
+          result.queue_name.assign((char *)declare_ok->queue.bytes,
+                                   declare_ok->queue.len);
+          result.message_count = declare_ok->message_count;
+          result.consumer_count = declare_ok->consumer_count;
+        }
+        m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+        RecordTopologyOp(m_impl->TopologyRecorder(), ops[next],
+                         result.queue_name);
+      }
+      m_impl->ReturnChannel(channel);
+    } catch (const ChannelException &) {
+      results[next++].error = std::current_exception();
+    }
+  }
+  return results;
+}
+
 void Channel::BasicAck(const Envelope::ptr_t &message) {
   BasicAck(message->GetDeliveryInfo());
 }
@@ -772,19 +2023,38 @@ void Channel::BasicAck(const Envelope::DeliveryInfo &info) {
 }
 
 void Channel::BasicAck(const Envelope::DeliveryInfo &info, bool multiple) {
-  m_impl->CheckIsConnected();
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
   // Delivery tag is local to the channel, so its important to use
   // that channel, sadly this can cause the channel to throw an exception
   // which will show up as an unrelated exception in a different method
   // that actually waits for a response from the broker
+  std::uint64_t delivery_tag;
+  if (!m_impl->BrokerDeliveryTag(info.delivery_tag, delivery_tag)) {
+    // Delivered before a recovery, the broker has requeued it already
+    return;
+  }
   amqp_channel_t channel = info.delivery_channel;
   if (!m_impl->IsChannelOpen(channel)) {
     throw std::runtime_error(
         "The channel that the message was delivered on has been closed");
   }
 
-  m_impl->CheckForError(amqp_basic_ack(m_impl->m_connection, channel,
-                                       info.delivery_tag, multiple));
+  if (!multiple && m_impl->AckBatchingEnabled()) {
+    m_impl->QueueAck(channel, delivery_tag);
+    return;
+  }
+
+  // Batched acks for lower tags have to reach the broker first
+  m_impl->FlushAcksOnChannel(channel);
+  m_impl->SendAck(channel, delivery_tag, multiple);
+  m_impl->SettleDeliveries(channel, delivery_tag, multiple);
+}
+
+void Channel::FlushAcks() {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  m_impl->FlushAcks();
 }
 
 void Channel::BasicReject(const Envelope::ptr_t &message, bool requeue,
@@ -794,89 +2064,432 @@ void Channel::BasicReject(const Envelope::ptr_t &message, bool requeue,
 
 void Channel::BasicReject(const Envelope::DeliveryInfo &info, bool requeue,
                           bool multiple) {
-  m_impl->CheckIsConnected();
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
   // Delivery tag is local to the channel, so its important to use
   // that channel, sadly this can cause the channel to throw an exception
   // which will show up as an unrelated exception in a different method
   // that actually waits for a response from the broker
+  std::uint64_t delivery_tag;
+  if (!m_impl->BrokerDeliveryTag(info.delivery_tag, delivery_tag)) {
+    return;
+  }
   amqp_channel_t channel = info.delivery_channel;
   if (!m_impl->IsChannelOpen(channel)) {
     throw std::runtime_error(
         "The channel that the message was delivered on has been closed");
   }
   amqp_basic_nack_t req;
-  req.delivery_tag = info.delivery_tag;
+  req.delivery_tag = delivery_tag;
   req.multiple = multiple;
   req.requeue = requeue;
 
+  // A multiple=true nack would otherwise cover messages already acked
+  m_impl->FlushAcksOnChannel(channel);
   m_impl->CheckForError(amqp_send_method(m_impl->m_connection, channel,
                                          AMQP_BASIC_NACK_METHOD, &req));
+  m_impl->SettleDeliveries(channel, delivery_tag, multiple);
 }
 
 void Channel::BasicPublish(const std::string &exchange_name,
                            const std::string &routing_key,
                            const BasicMessage::ptr_t message, bool mandatory,
                            bool immediate) {
-  m_impl->CheckIsConnected();
+  ChannelImpl::ThrowPublishFailure(
+      TryBasicPublish(exchange_name, routing_key, message, mandatory,
+                      immediate));
+}
+
+void Channel::BasicPublish(const PublishTemplate &publish,
+                           std::string_view body,
+                           const PublishTemplate::Overrides &overrides) {
+  ChannelImpl::ThrowPublishFailure(TryBasicPublish(publish, body, overrides));
+}
+
+Channel::PublishConfirm Channel::TryBasicPublish(
+    const std::string &exchange_name, const std::string &routing_key,
+    const BasicMessage::ptr_t message, bool mandatory, bool immediate) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  try {
+    EnsureConnected();
+  } catch (const ConnectionClosedException &) {
+    Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder();
+    if (NULL == recovery ||
+        !recovery->BufferPublish(exchange_name, routing_key, message,
+                                 mandatory, immediate)) {
+      throw;
+    }
+    PublishConfirm result;
+    result.status = PublishConfirm::pc_buffered;
+    return result;
+  }
   amqp_channel_t channel = m_impl->GetChannel();
 
-  Detail::amqp_pool_ptr_t pool;
-  amqp_basic_properties_t properties = CreateAmqpProperties(*message, pool);
+  m_impl->CheckForError(SendBasicPublish(
+      m_impl->m_connection, channel, exchange_name, routing_key, *message,
+      mandatory, immediate, NULL, m_impl->EncodeBody(*message)));
+
+  return m_impl->TryCompletePublish(channel);
+}
+
+Channel::PublishConfirm Channel::TryBasicPublish(
+    const PublishTemplate &publish, std::string_view body,
+    const PublishTemplate::Overrides &overrides) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetChannel();
 
+  const PublishTemplate::Impl &impl = *publish.m_impl;
+  amqp_basic_properties_t properties = impl.Properties(overrides);
   m_impl->CheckForError(amqp_basic_publish(
+      m_impl->m_connection, channel, StringToBytes(impl.exchange_name),
+      StringToBytes(impl.routing_key), impl.mandatory, impl.immediate,
+      &properties, StringRefToBytes(body)));
+
+  return m_impl->TryCompletePublish(channel);
+}
+
+void Channel::BasicPublish(const std::string &exchange_name,
+                           const std::string &routing_key,
+                           const BasicMessage::ptr_t message,
+                           const std::vector<std::string_view> &body,
+                           bool mandatory, bool immediate) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetChannel();
+
+  Detail::amqp_pool_ptr_t pool;
+  amqp_basic_properties_t properties =
+      Detail::CreateAmqpProperties(*message, pool);
+  m_impl->CheckForError(SendBasicPublishSegments(
       m_impl->m_connection, channel, StringToBytes(exchange_name),
-      StringToBytes(routing_key), mandatory, immediate, &properties,
-      StringToBytes(message->Body())));
-
-  // If we've done things correctly we can get one of 4 things back from the
-  // broker
-  // - basic.ack - our channel is in confirm mode, messsage was 'dealt with' by
-  // the broker
-  // - basic.nack - our channel is in confirm mode, queue has max-length set and
-  // is full, queue overflow stratege is reject-publish
-  // - basic.return then basic.ack - the message wasn't delievered, but was
-  // dealt with
-  // - channel.close - probably tried to publish to a non-existant exchange, in
-  // any case error!
-  // - connection.clsoe - something really bad happened
-  const std::array<std::uint32_t, 3> PUBLISH_ACK = {
-      AMQP_BASIC_ACK_METHOD, AMQP_BASIC_RETURN_METHOD, AMQP_BASIC_NACK_METHOD};
-  amqp_frame_t response;
-  std::array<amqp_channel_t, 1> channels = {channel};
-  m_impl->GetMethodOnChannel(channels, response, PUBLISH_ACK);
+      StringToBytes(routing_key), mandatory, immediate, properties, body));
 
-  if (AMQP_BASIC_NACK_METHOD == response.payload.method.id) {
-    amqp_basic_nack_t *return_method =
-        reinterpret_cast<amqp_basic_nack_t *>(response.payload.method.decoded);
-    MessageRejectedException message_rejected(return_method->delivery_tag);
-    m_impl->ReturnChannel(channel);
-    m_impl->MaybeReleaseBuffersOnChannel(channel);
-    throw message_rejected;
+  m_impl->CompletePublish(channel);
+}
+
+void Channel::BasicPublish(const std::string &exchange_name,
+                           const std::string &routing_key,
+                           const BasicMessage::ptr_t message,
+                           std::uint64_t body_size,
+                           const body_source_t &source, bool mandatory,
+                           bool immediate) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetChannel();
+
+  Detail::amqp_pool_ptr_t pool;
+  amqp_basic_properties_t properties =
+      Detail::CreateAmqpProperties(*message, pool);
+  m_impl->CheckForError(SendBasicPublishHeader(
+      m_impl->m_connection, channel, StringToBytes(exchange_name),
+      StringToBytes(routing_key), mandatory, immediate, properties, body_size));
+
+  // One frame's worth of body is staged at a time
+  const std::size_t max_fragment = MaxBodyFragment(m_impl->m_connection);
+  std::vector<char> buffer(static_cast<std::size_t>(
+      std::min<std::uint64_t>(body_size, max_fragment)));
+  std::uint64_t remaining = body_size;
+  while (remaining > 0) {
+    std::size_t wanted = static_cast<std::size_t>(
+        std::min<std::uint64_t>(remaining, buffer.size()));
+    std::size_t filled = 0;
+    while (filled < wanted) {
+      std::size_t read = source(buffer.data() + filled, wanted - filled);
+      if (0 == read || read > wanted - filled) {
+        // The header has promised body_size bytes, there is no way to take
+        // that back short of closing the connection
+        amqp_connection_close(m_impl->m_connection, AMQP_INTERNAL_ERROR);
+        m_impl->SetIsConnected(false);
+        throw std::runtime_error(
+            "Channel::BasicPublish: body source did not supply body_size "
+            "bytes");
+      }
+      filled += read;
+    }
+    m_impl->CheckForError(SendBodyFrame(m_impl->m_connection, channel,
+                                        buffer.data(), filled));
+    remaining -= filled;
   }
 
-  if (AMQP_BASIC_RETURN_METHOD == response.payload.method.id) {
-    MessageReturnedException message_returned =
-        m_impl->CreateMessageReturnedException(
-            *(reinterpret_cast<amqp_basic_return_t *>(
-                response.payload.method.decoded)),
-            channel);
+  m_impl->CompletePublish(channel);
+}
+
+void Channel::BasicPublish(const PublishTemplate &publish,
+                           const std::vector<std::string_view> &body,
+                           const PublishTemplate::Overrides &overrides) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetChannel();
 
-    const std::array<std::uint32_t, 1> BASIC_ACK = {AMQP_BASIC_ACK_METHOD};
-    m_impl->GetMethodOnChannel(channels, response, BASIC_ACK);
-    m_impl->ReturnChannel(channel);
-    m_impl->MaybeReleaseBuffersOnChannel(channel);
-    throw message_returned;
+  const PublishTemplate::Impl &impl = *publish.m_impl;
+  m_impl->CheckForError(SendBasicPublishSegments(
+      m_impl->m_connection, channel, StringToBytes(impl.exchange_name),
+      StringToBytes(impl.routing_key), impl.mandatory, impl.immediate,
+      impl.Properties(overrides), body));
+
+  m_impl->CompletePublish(channel);
+}
+
+std::uint64_t Channel::BasicPublishAsync(
+    const PublishTemplate &publish, const std::vector<std::string_view> &body,
+    const PublishTemplate::Overrides &overrides) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  SendBlockedPublishes();
+  if (m_impl->HoldingPublishes()) {
+    // The body belongs to the caller, there is nothing to hold on to
+    throw ConnectionBlockedException(m_impl->BlockedReason());
   }
+  m_impl->WaitForPublishConfirms(m_impl->ConfirmWindow() - 1);
+  amqp_channel_t channel = m_impl->GetConfirmChannel();
 
-  m_impl->ReturnChannel(channel);
-  m_impl->MaybeReleaseBuffersOnChannel(channel);
+  const PublishTemplate::Impl &impl = *publish.m_impl;
+  m_impl->CheckForError(SendBasicPublishSegments(
+      m_impl->m_connection, channel, StringToBytes(impl.exchange_name),
+      StringToBytes(impl.routing_key), impl.mandatory, impl.immediate,
+      impl.Properties(overrides), body));
+
+  return m_impl->AddUnconfirmedPublish(impl.mandatory, impl.exchange_name,
+                                       impl.routing_key);
+}
+
+std::uint64_t Channel::BasicPublishAsync(
+    const PublishTemplate &publish, std::string_view body,
+    const PublishTemplate::Overrides &overrides) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  SendBlockedPublishes();
+  if (m_impl->HoldingPublishes()) {
+    throw ConnectionBlockedException(m_impl->BlockedReason());
+  }
+  m_impl->WaitForPublishConfirms(m_impl->ConfirmWindow() - 1);
+  amqp_channel_t channel = m_impl->GetConfirmChannel();
+
+  const PublishTemplate::Impl &impl = *publish.m_impl;
+  amqp_basic_properties_t properties = impl.Properties(overrides);
+  m_impl->CheckForError(amqp_basic_publish(
+      m_impl->m_connection, channel, StringToBytes(impl.exchange_name),
+      StringToBytes(impl.routing_key), impl.mandatory, impl.immediate,
+      &properties, StringRefToBytes(body)));
+
+  return m_impl->AddUnconfirmedPublish(impl.mandatory, impl.exchange_name,
+                                       impl.routing_key);
+}
+
+std::uint64_t Channel::BasicPublishAsync(const std::string &exchange_name,
+                                         const std::string &routing_key,
+                                         const BasicMessage::ptr_t message,
+                                         bool mandatory, bool immediate) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  // Anything held back goes first, so that messages keep their order
+  SendBlockedPublishes();
+  if (m_impl->HoldingPublishes()) {
+    ChannelImpl::blocked_publish_t publish;
+    publish.exchange = exchange_name;
+    publish.routing_key = routing_key;
+    publish.message = message;
+    publish.mandatory = mandatory;
+    publish.immediate = immediate;
+    std::uint64_t sequence_number = m_impl->HoldBlockedPublish(publish);
+    if (0 == sequence_number) {
+      throw ConnectionBlockedException(m_impl->BlockedReason());
+    }
+    return sequence_number;
+  }
+  // Make room in the window before putting anything else on the wire
+  m_impl->WaitForPublishConfirms(m_impl->ConfirmWindow() - 1);
+  amqp_channel_t channel = m_impl->GetConfirmChannel();
+
+  m_impl->CheckForError(SendBasicPublish(
+      m_impl->m_connection, channel, exchange_name, routing_key, *message,
+      mandatory, immediate, NULL, m_impl->EncodeBody(*message)));
+
+  return m_impl->AddUnconfirmedPublish(mandatory, exchange_name, routing_key);
+}
+
+void Channel::BasicRelay(const std::string &exchange_name,
+                         const std::string &routing_key,
+                         const BasicMessage::ptr_t message,
+                         const FlatTable &header_edits, bool mandatory,
+                         bool immediate) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetChannel();
+
+  m_impl->CheckForError(SendBasicPublish(
+      m_impl->m_connection, channel, exchange_name, routing_key, *message,
+      mandatory, immediate, &header_edits, m_impl->EncodeBody(*message)));
+
+  m_impl->CompletePublish(channel);
+}
+
+std::uint64_t Channel::BasicRelayAsync(const std::string &exchange_name,
+                                       const std::string &routing_key,
+                                       const BasicMessage::ptr_t message,
+                                       const FlatTable &header_edits,
+                                       bool mandatory, bool immediate) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  SendBlockedPublishes();
+  if (m_impl->HoldingPublishes()) {
+    throw ConnectionBlockedException(m_impl->BlockedReason());
+  }
+  m_impl->WaitForPublishConfirms(m_impl->ConfirmWindow() - 1);
+  amqp_channel_t channel = m_impl->GetConfirmChannel();
+
+  m_impl->CheckForError(SendBasicPublish(
+      m_impl->m_connection, channel, exchange_name, routing_key, *message,
+      mandatory, immediate, &header_edits, m_impl->EncodeBody(*message)));
+
+  return m_impl->AddUnconfirmedPublish(mandatory, exchange_name, routing_key);
+}
+
+std::vector<Channel::PublishConfirm> Channel::BasicPublishBatch(
+    const std::string &exchange_name, const std::string &routing_key,
+    const std::vector<BasicMessage::ptr_t> &messages, bool mandatory) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  SendBlockedPublishes();
+  if (m_impl->HoldingPublishes()) {
+    throw ConnectionBlockedException(m_impl->BlockedReason());
+  }
+
+  return m_impl->PublishBatch(
+      messages.size(), [&](amqp_channel_t channel, std::size_t i) {
+        m_impl->CheckForError(SendBasicPublish(
+            m_impl->m_connection, channel, exchange_name, routing_key,
+            *messages[i], mandatory, false, NULL,
+            m_impl->EncodeBody(*messages[i])));
+        m_impl->AddUnconfirmedPublish(mandatory, exchange_name, routing_key);
+      });
+}
+
+std::vector<Channel::PublishConfirm> Channel::BasicPublishBatch(
+    const std::string &exchange_name,
+    const std::vector<std::pair<std::string, BasicMessage::ptr_t> > &messages,
+    bool mandatory) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  SendBlockedPublishes();
+  if (m_impl->HoldingPublishes()) {
+    throw ConnectionBlockedException(m_impl->BlockedReason());
+  }
+
+  return m_impl->PublishBatch(
+      messages.size(), [&](amqp_channel_t channel, std::size_t i) {
+        m_impl->CheckForError(SendBasicPublish(
+            m_impl->m_connection, channel, exchange_name, messages[i].first,
+            *messages[i].second, mandatory, false, NULL,
+            m_impl->EncodeBody(*messages[i].second)));
+        m_impl->AddUnconfirmedPublish(mandatory, exchange_name,
+                                      messages[i].first);
+      });
+}
+
+void Channel::SetPublishConfirmWindow(std::size_t max_unconfirmed) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  if (0 == max_unconfirmed) {
+    throw std::invalid_argument(
+        "max_unconfirmed is not valid, it must be at least 1");
+  }
+  m_impl->SetConfirmWindow(max_unconfirmed);
+}
+
+std::size_t Channel::GetPublishConfirmWindow() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return m_impl->ConfirmWindow();
+}
+
+void Channel::SetPublishConfirmCallback(const confirm_callback_t &callback) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  m_impl->SetConfirmCallback(callback);
+}
+
+bool Channel::WaitForConfirms(int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  const std::chrono::steady_clock::time_point end =
+      std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(std::max(timeout, 0));
+  for (;;) {
+    SendBlockedPublishes();
+    std::chrono::microseconds remaining = std::chrono::microseconds::max();
+    if (timeout >= 0) {
+      remaining = std::max(
+          std::chrono::microseconds::zero(),
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              end - std::chrono::steady_clock::now()));
+    }
+    if (!m_impl->WaitForPublishConfirms(0, remaining)) {
+      return false;
+    }
+    // Unblocked while waiting, the held back messages can go out now
+    if (!m_impl->HasBlockedPublishes() || m_impl->IsBlocked()) {
+      return !m_impl->HasBlockedPublishes();
+    }
+  }
+}
+
+std::size_t Channel::UnconfirmedPublishCount() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return m_impl->UnconfirmedPublishCount();
+}
+
+bool Channel::IsBlocked() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return m_impl->IsBlocked();
+}
+
+void Channel::SetConnectionBlockedCallback(
+    const connection_blocked_callback_t &callback) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  m_impl->SetBlockedCallback(callback);
+}
+
+Channel::Stats Channel::GetStats() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return m_impl->GetStats();
+}
+
+Channel::TlsHandshakeStats Channel::GetTlsHandshakeStats() {
+  return Detail::TlsContext::Stats();
+}
+
+const std::size_t Channel::LatencyHistogram::BUCKETS;
+
+std::uint64_t Channel::LatencyHistogram::Percentile(double fraction) const {
+  if (0 == count) {
+    return 0;
+  }
+  std::uint64_t wanted = static_cast<std::uint64_t>(std::ceil(
+      std::min(std::max(fraction, 0.0), 1.0) * static_cast<double>(count)));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < BUCKETS; ++i) {
+    seen += buckets[i];
+    if (seen >= wanted && seen > 0) {
+      return static_cast<std::uint64_t>(1) << i;
+    }
+  }
+  return static_cast<std::uint64_t>(1) << (BUCKETS - 1);
+}
+
+bool Channel::GetReturnedMessage(ReturnedMessage &returned, int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  std::chrono::microseconds real_timeout =
+      (timeout >= 0 ? std::chrono::milliseconds(timeout)
+                    : std::chrono::microseconds::max());
+  return m_impl->GetReturnedMessage(returned, real_timeout);
 }
 
 bool Channel::BasicGet(Envelope::ptr_t &envelope, const std::string &queue,
                        bool no_ack) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 2> GET_RESPONSES = {
       AMQP_BASIC_GET_OK_METHOD, AMQP_BASIC_GET_EMPTY_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_basic_get_t get = {};
   get.queue = StringToBytes(queue);
@@ -892,27 +2505,68 @@ bool Channel::BasicGet(Envelope::ptr_t &envelope, const std::string &queue,
     return false;
   }
 
-  amqp_basic_get_ok_t *get_ok =
-      (amqp_basic_get_ok_t *)response.payload.method.decoded;
-  std::uint64_t delivery_tag = get_ok->delivery_tag;
-  bool redelivered = (get_ok->redelivered == 0 ? false : true);
-  std::string exchange((char *)get_ok->exchange.bytes, get_ok->exchange.len);
-  std::string routing_key((char *)get_ok->routing_key.bytes,
-                          get_ok->routing_key.len);
-
-  BasicMessage::ptr_t message = m_impl->ReadContent(channel);
-  envelope = Envelope::Create(message, "", delivery_tag, exchange, redelivered,
-                              routing_key, channel);
+  envelope = m_impl->ReadGetOk(
+      *(amqp_basic_get_ok_t *)response.payload.method.decoded, channel,
+      no_ack);
 
   m_impl->ReturnChannel(channel);
   m_impl->MaybeReleaseBuffersOnChannel(channel);
   return true;
 }
 
+std::size_t Channel::BasicGetMany(const std::string &queue, std::size_t max,
+                                  std::vector<Envelope::ptr_t> &envelopes,
+                                  bool no_ack) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  const std::array<std::uint32_t, 2> GET_RESPONSES = {
+      AMQP_BASIC_GET_OK_METHOD, AMQP_BASIC_GET_EMPTY_METHOD};
+  // Gets sent at once to begin with, doubled each time they all come back
+  // with a message, so a short queue costs few get-empty replies
+  const std::size_t FIRST_WINDOW = 16;
+  EnsureConnected();
+
+  amqp_basic_get_t get = {};
+  get.queue = StringToBytes(queue);
+  get.no_ack = no_ack;
+
+  amqp_channel_t channel = m_impl->GetChannel();
+  std::array<amqp_channel_t, 1> channels = {channel};
+  std::size_t got = 0;
+  std::size_t window = FIRST_WINDOW;
+  bool empty = false;
+  while (!empty && got < max) {
+    const std::size_t sent = std::min(window, max - got);
+    for (std::size_t i = 0; i < sent; ++i) {
+      m_impl->CheckForError(amqp_send_method(
+          m_impl->m_connection, channel, AMQP_BASIC_GET_METHOD, &get));
+    }
+    // Replies come back in order. Each is read even after a get-empty, as a
+    // message published in the meantime can still follow it.
+    for (std::size_t i = 0; i < sent; ++i) {
+      amqp_frame_t response;
+      m_impl->GetMethodOnChannel(channels, response, GET_RESPONSES);
+      if (AMQP_BASIC_GET_EMPTY_METHOD == response.payload.method.id) {
+        empty = true;
+      } else {
+        envelopes.push_back(m_impl->ReadGetOk(
+            *(amqp_basic_get_ok_t *)response.payload.method.decoded,
+            channel, no_ack));
+        ++got;
+      }
+      m_impl->MaybeReleaseBuffersOnChannel(channel);
+    }
+    window *= 2;
+  }
+
+  m_impl->ReturnChannel(channel);
+  return got;
+}
+
 void Channel::BasicRecover(const std::string &consumer) {
+  ChannelImpl::ScopedLock lock(*m_impl);
   const std::array<std::uint32_t, 1> RECOVER_OK = {
       AMQP_BASIC_RECOVER_OK_METHOD};
-  m_impl->CheckIsConnected();
+  EnsureConnected();
 
   amqp_basic_recover_t recover = {};
   recover.requeue = true;
@@ -931,73 +2585,192 @@ std::string Channel::BasicConsume(const std::string &queue,
   return BasicConsume(queue, consumer_tag, no_local, no_ack, exclusive,
                       message_prefetch_count, Table());
 }
-std::string Channel::BasicConsume(const std::string &queue,
-                                  const std::string &consumer_tag,
-                                  bool no_local, bool no_ack, bool exclusive,
-                                  std::uint16_t message_prefetch_count,
-                                  const Table &arguments) {
-  m_impl->CheckIsConnected();
-  amqp_channel_t channel = m_impl->GetChannel();
-
-  // Set this before starting the consume as it may have been set by a previous
-  // consumer
-  const std::array<std::uint32_t, 1> QOS_OK = {AMQP_BASIC_QOS_OK_METHOD};
 
-  amqp_basic_qos_t qos = {};
-  qos.prefetch_size = 0;
-  qos.prefetch_count = message_prefetch_count;
-  qos.global = m_impl->BrokerHasNewQosBehavior();
+template <class ArgumentTable>
+std::string Channel::DoBasicConsume(const std::string &queue,
+                                    const std::string &consumer_tag,
+                                    bool no_local, bool no_ack, bool exclusive,
+                                    std::uint16_t message_prefetch_count,
+                                    const ArgumentTable &arguments,
+                                    bool nowait) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetChannel();
+  std::array<amqp_channel_t, 1> channels = {channel};
 
-  m_impl->DoRpcOnChannel(channel, AMQP_BASIC_QOS_METHOD, &qos, QOS_OK);
-  m_impl->MaybeReleaseBuffersOnChannel(channel);
+  // A previous consumer on the channel may have left a different prefetch.
+  // basic.qos and basic.consume are sent together and their replies read
+  // after, so setting it costs no extra round trip.
+  const bool set_qos = !m_impl->HasPrefetch(channel, message_prefetch_count);
+  if (set_qos) {
+    amqp_basic_qos_t qos = {};
+    qos.prefetch_size = 0;
+    qos.prefetch_count = message_prefetch_count;
+    qos.global = m_impl->BrokerHasNewQosBehavior();
+    m_impl->CheckForError(amqp_send_method(
+        m_impl->m_connection, channel, AMQP_BASIC_QOS_METHOD, &qos));
+  }
 
-  const std::array<std::uint32_t, 1> CONSUME_OK = {
-      AMQP_BASIC_CONSUME_OK_METHOD};
+  std::string tag = consumer_tag;
+  if (nowait && tag.empty()) {
+    tag = m_impl->NextConsumerTag();
+  }
 
   amqp_basic_consume_t consume = {};
   consume.queue = StringToBytes(queue);
-  consume.consumer_tag = StringToBytes(consumer_tag);
+  consume.consumer_tag = StringToBytes(tag);
   consume.no_local = no_local;
   consume.no_ack = no_ack;
   consume.exclusive = exclusive;
-  consume.nowait = false;
+  consume.nowait = nowait;
 
   Detail::amqp_pool_ptr_t table_pool;
   consume.arguments =
       Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
 
-  amqp_frame_t response = m_impl->DoRpcOnChannel(
-      channel, AMQP_BASIC_CONSUME_METHOD, &consume, CONSUME_OK);
+  m_impl->CheckForError(amqp_send_method(
+      m_impl->m_connection, channel, AMQP_BASIC_CONSUME_METHOD, &consume));
+
+  if (set_qos) {
+    const std::array<std::uint32_t, 1> QOS_OK = {AMQP_BASIC_QOS_OK_METHOD};
+    amqp_frame_t response;
+    m_impl->GetMethodOnChannel(channels, response, QOS_OK);
+    m_impl->SetPrefetch(channel, message_prefetch_count);
+  }
 
-  amqp_basic_consume_ok_t *consume_ok =
-      (amqp_basic_consume_ok_t *)response.payload.method.decoded;
-  std::string tag((char *)consume_ok->consumer_tag.bytes,
-                  consume_ok->consumer_tag.len);
+  if (!nowait) {
+    const std::array<std::uint32_t, 1> CONSUME_OK = {
+        AMQP_BASIC_CONSUME_OK_METHOD};
+    amqp_frame_t response;
+    m_impl->GetMethodOnChannel(channels, response, CONSUME_OK);
+    amqp_basic_consume_ok_t *consume_ok =
+        (amqp_basic_consume_ok_t *)response.payload.method.decoded;
+    tag.assign((char *)consume_ok->consumer_tag.bytes,
+               consume_ok->consumer_tag.len);
+  }
   m_impl->MaybeReleaseBuffersOnChannel(channel);
 
-  m_impl->AddConsumer(tag, channel);
+  m_impl->AddConsumer(tag, channel, no_ack);
+
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->RecordConsumer(tag, queue, no_local, no_ack, exclusive,
+                             message_prefetch_count, ToFlatTable(arguments));
+  }
+  return tag;
+}
+
+std::string Channel::BasicConsume(const std::string &queue,
+                                  const std::string &consumer_tag,
+                                  bool no_local, bool no_ack, bool exclusive,
+                                  std::uint16_t message_prefetch_count,
+                                  const Table &arguments) {
+  return DoBasicConsume(queue, consumer_tag, no_local, no_ack, exclusive,
+                        message_prefetch_count, arguments, false);
+}
+
+std::string Channel::BasicConsume(const std::string &queue,
+                                  const std::string &consumer_tag,
+                                  bool no_local, bool no_ack, bool exclusive,
+                                  std::uint16_t message_prefetch_count,
+                                  const FlatTable &arguments) {
+  return DoBasicConsume(queue, consumer_tag, no_local, no_ack, exclusive,
+                        message_prefetch_count, arguments, false);
+}
+
+std::string Channel::BasicConsumeNoWait(const std::string &queue,
+                                        const std::string &consumer_tag,
+                                        bool no_local, bool no_ack,
+                                        bool exclusive,
+                                        std::uint16_t message_prefetch_count,
+                                        const Table &arguments) {
+  return DoBasicConsume(queue, consumer_tag, no_local, no_ack, exclusive,
+                        message_prefetch_count, arguments, true);
+}
+
+std::string Channel::BasicConsumeNoWait(const std::string &queue,
+                                        const std::string &consumer_tag,
+                                        bool no_local, bool no_ack,
+                                        bool exclusive,
+                                        std::uint16_t message_prefetch_count,
+                                        const FlatTable &arguments) {
+  return DoBasicConsume(queue, consumer_tag, no_local, no_ack, exclusive,
+                        message_prefetch_count, arguments, true);
+}
+
+std::string Channel::BasicConsume(const std::string &queue,
+                                  const consumer_handler_t &handler,
+                                  const std::string &consumer_tag,
+                                  bool no_local, bool no_ack, bool exclusive,
+                                  std::uint16_t message_prefetch_count,
+                                  const Table &arguments) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  std::string tag = BasicConsume(queue, consumer_tag, no_local, no_ack,
+                                 exclusive, message_prefetch_count, arguments);
+  m_impl->SetConsumerHandler(tag, handler);
+  return tag;
+}
 
+std::string Channel::BasicConsume(const std::string &queue,
+                                  const consumer_handler_t &handler,
+                                  const std::string &consumer_tag,
+                                  bool no_local, bool no_ack, bool exclusive,
+                                  std::uint16_t message_prefetch_count,
+                                  const FlatTable &arguments) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  std::string tag = BasicConsume(queue, consumer_tag, no_local, no_ack,
+                                 exclusive, message_prefetch_count, arguments);
+  m_impl->SetConsumerHandler(tag, handler);
   return tag;
 }
 
+std::size_t Channel::DispatchMessages(int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  return m_impl->DispatchMessages(
+      timeout >= 0 ? std::chrono::milliseconds(timeout)
+                   : std::chrono::microseconds::max());
+}
+
 void Channel::BasicQos(const std::string &consumer_tag,
                        std::uint16_t message_prefetch_count) {
-  m_impl->CheckIsConnected();
+  BasicQos(consumer_tag, message_prefetch_count, 0);
+}
+
+void Channel::BasicQos(const std::string &consumer_tag,
+                       std::uint16_t message_prefetch_count,
+                       std::uint32_t prefetch_size) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
   amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
+  if (0 == prefetch_size &&
+      m_impl->HasPrefetch(channel, message_prefetch_count)) {
+    return;
+  }
 
   const std::array<std::uint32_t, 1> QOS_OK = {AMQP_BASIC_QOS_OK_METHOD};
 
   amqp_basic_qos_t qos = {};
-  qos.prefetch_size = 0;
+  qos.prefetch_size = prefetch_size;
   qos.prefetch_count = message_prefetch_count;
   qos.global = m_impl->BrokerHasNewQosBehavior();
 
   m_impl->DoRpcOnChannel(channel, AMQP_BASIC_QOS_METHOD, &qos, QOS_OK);
   m_impl->MaybeReleaseBuffersOnChannel(channel);
+  if (0 == prefetch_size) {
+    m_impl->SetPrefetch(channel, message_prefetch_count);
+  } else {
+    m_impl->ForgetPrefetch(channel);
+  }
+
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->SetConsumerPrefetch(consumer_tag, message_prefetch_count,
+                                  prefetch_size);
+  }
 }
 
 void Channel::BasicCancel(const std::string &consumer_tag) {
-  m_impl->CheckIsConnected();
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
   amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
 
   const std::array<std::uint32_t, 1> CANCEL_OK = {AMQP_BASIC_CANCEL_OK_METHOD};
@@ -1009,6 +2782,9 @@ void Channel::BasicCancel(const std::string &consumer_tag) {
   m_impl->DoRpcOnChannel(channel, AMQP_BASIC_CANCEL_METHOD, &cancel, CANCEL_OK);
 
   m_impl->RemoveConsumer(consumer_tag);
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->ForgetConsumer(consumer_tag);
+  }
 
   // Lets go hunting to make sure we don't have any queued frames lying around
   // Otherwise these frames will potentially hang around when we don't want them
@@ -1018,6 +2794,26 @@ void Channel::BasicCancel(const std::string &consumer_tag) {
   m_impl->MaybeReleaseBuffersOnChannel(channel);
 }
 
+void Channel::BasicCancelNoWait(const std::string &consumer_tag) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
+
+  // The broker is still asked for a cancel-ok, it is what says the channel
+  // has seen its last delivery for the consumer and can be used again
+  amqp_basic_cancel_t cancel = {};
+  cancel.consumer_tag = StringToBytes(consumer_tag);
+  cancel.nowait = false;
+  m_impl->CheckForError(amqp_send_method(
+      m_impl->m_connection, channel, AMQP_BASIC_CANCEL_METHOD, &cancel));
+
+  m_impl->SetCancelPending(channel);
+  m_impl->RemoveConsumer(consumer_tag);
+  if (Detail::ConnectionRecovery *recovery = m_impl->TopologyRecorder()) {
+    recovery->ForgetConsumer(consumer_tag);
+  }
+}
+
 Envelope::ptr_t Channel::BasicConsumeMessage(const std::string &consumer_tag) {
   Envelope::ptr_t returnval;
   BasicConsumeMessage(consumer_tag, returnval);
@@ -1039,7 +2835,8 @@ Envelope::ptr_t Channel::BasicConsumeMessage() {
 
 bool Channel::BasicConsumeMessage(const std::string &consumer_tag,
                                   Envelope::ptr_t &message, int timeout) {
-  m_impl->CheckIsConnected();
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
   amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
 
   std::array<amqp_channel_t, 1> channels = {channel};
@@ -1047,31 +2844,161 @@ bool Channel::BasicConsumeMessage(const std::string &consumer_tag,
   return m_impl->ConsumeMessageOnChannel(channels, message, timeout);
 }
 
+bool Channel::BasicConsumeMessageStream(const std::string &consumer_tag,
+                                        Envelope::ptr_t &envelope,
+                                        const body_chunk_handler_t &on_chunk,
+                                        int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
+
+  return m_impl->ConsumeMessageStreamOnChannel(channel, envelope, on_chunk,
+                                               timeout);
+}
+
 bool Channel::BasicConsumeMessage(const std::vector<std::string> &consumer_tags,
                                   Envelope::ptr_t &message, int timeout) {
-  m_impl->CheckIsConnected();
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
 
-  std::vector<amqp_channel_t> channels;
-  channels.reserve(consumer_tags.size());
+  ChannelImpl::channel_filter_ptr_t channels =
+      m_impl->ConsumerChannels(consumer_tags);
+  return m_impl->ConsumeMessageOnChannel(*channels, message, timeout);
+}
 
-  for (std::vector<std::string>::const_iterator it = consumer_tags.begin();
-       it != consumer_tags.end(); ++it) {
-    channels.push_back(m_impl->GetConsumerChannel(*it));
-  }
+std::size_t Channel::BasicConsumeMessages(
+    const std::vector<std::string> &consumer_tags, std::size_t max_count,
+    int timeout, std::vector<Envelope::ptr_t> &envelopes, int linger) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
 
-  return m_impl->ConsumeMessageOnChannel(channels, message, timeout);
+  ChannelImpl::channel_filter_ptr_t channels =
+      m_impl->ConsumerChannels(consumer_tags);
+  return m_impl->ConsumeMessagesOnChannel(*channels, max_count, timeout,
+                                          linger, envelopes);
 }
 
 bool Channel::BasicConsumeMessage(Envelope::ptr_t &message, int timeout) {
-  m_impl->CheckIsConnected();
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
 
-  std::vector<amqp_channel_t> channels = m_impl->GetAllConsumerChannels();
+  if (m_impl->TakeAnyDeliveredMessage(message)) {
+    return true;
+  }
+
+  ChannelImpl::channel_filter_ptr_t channels = m_impl->AllConsumerChannels();
 
-  if (0 == channels.size()) {
+  if (0 == channels->size()) {
     throw ConsumerTagNotFoundException();
   }
 
-  return m_impl->ConsumeMessageOnChannel(channels, message, timeout);
+  return m_impl->ConsumeMessageOnChannel(*channels, message, timeout);
+}
+
+Channel::ConsumeResult Channel::TryBasicConsumeMessage(
+    const std::string &consumer_tag, int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  std::array<amqp_channel_t, 1> channels = {
+      m_impl->GetConsumerChannel(consumer_tag)};
+
+  Envelope::ptr_t envelope;
+  std::string cancelled_tag;
+  bool delivered = m_impl->ConsumeMessageOnChannel(channels, envelope, timeout,
+                                                   &cancelled_tag);
+  return MakeConsumeResult(delivered, envelope, cancelled_tag);
+}
+
+Channel::ConsumeResult Channel::TryBasicConsumeMessage(
+    const std::vector<std::string> &consumer_tags, int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  ChannelImpl::channel_filter_ptr_t channels =
+      m_impl->ConsumerChannels(consumer_tags);
+
+  Envelope::ptr_t envelope;
+  std::string cancelled_tag;
+  bool delivered = m_impl->ConsumeMessageOnChannel(*channels, envelope,
+                                                   timeout, &cancelled_tag);
+  return MakeConsumeResult(delivered, envelope, cancelled_tag);
+}
+
+std::string Channel::RpcSend(const std::string &exchange_name,
+                             const std::string &routing_key,
+                             const BasicMessage::ptr_t request) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  amqp_channel_t channel = m_impl->GetRpcChannel();
+
+  std::string correlation_id = m_impl->NextRpcCorrelationId();
+  m_impl->CheckForError(SendRpcRequest(m_impl->m_connection, channel,
+                                       exchange_name, routing_key, *request,
+                                       ChannelImpl::RPC_REPLY_QUEUE,
+                                       correlation_id));
+  m_impl->AddRpcCall(correlation_id);
+  return correlation_id;
+}
+
+bool Channel::RpcWaitForReply(const std::string &correlation_id,
+                              BasicMessage::ptr_t &reply, int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+  return m_impl->WaitForRpcReply(
+      correlation_id, reply,
+      timeout >= 0 ? std::chrono::milliseconds(timeout)
+                   : std::chrono::microseconds::max());
+}
+
+void Channel::RpcAbandon(const std::string &correlation_id) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  m_impl->AbandonRpcCall(correlation_id);
+}
+
+BasicMessage::ptr_t Channel::RpcCall(const std::string &exchange_name,
+                                     const std::string &routing_key,
+                                     const BasicMessage::ptr_t request,
+                                     int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  std::string correlation_id = RpcSend(exchange_name, routing_key, request);
+  BasicMessage::ptr_t reply;
+  if (!RpcWaitForReply(correlation_id, reply, timeout)) {
+    m_impl->AbandonRpcCall(correlation_id);
+  }
+  return reply;
+}
+
+std::size_t Channel::PendingRpcCalls() const {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  return m_impl->PendingRpcCalls();
+}
+
+void Channel::SetRpcReplyCallback(const rpc_reply_callback_t &callback) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  m_impl->SetRpcReplyCallback(callback);
+}
+
+void Channel::SetCodec(const Codec::ptr_t &codec, std::size_t min_size,
+                       std::size_t max_decoded_size) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  m_impl->SetCodec(codec, min_size, max_decoded_size);
+}
+
+Channel::ConsumeResult Channel::TryBasicConsumeMessage(int timeout) {
+  ChannelImpl::ScopedLock lock(*m_impl);
+  EnsureConnected();
+
+  Envelope::ptr_t envelope;
+  std::string cancelled_tag;
+  bool delivered = m_impl->TakeAnyDeliveredMessage(envelope);
+  if (!delivered) {
+    ChannelImpl::channel_filter_ptr_t channels = m_impl->AllConsumerChannels();
+    if (0 == channels->size()) {
+      throw ConsumerTagNotFoundException();
+    }
+    delivered = m_impl->ConsumeMessageOnChannel(*channels, envelope, timeout,
+                                                &cancelled_tag);
+  }
+  return MakeConsumeResult(delivered, envelope, cancelled_tag);
 }
 
 }  // namespace AmqpClient
@@ -33,6 +33,8 @@
 #endif
 #include <Winsock2.h>
 #else
+#include <errno.h>
+#include <sys/select.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #endif
@@ -42,7 +44,10 @@
 #include <array>
 #include <cassert>
 #include <chrono>
+#include <exception>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 
 #include "SimpleAmqpClient/AmqpException.h"
 #include "SimpleAmqpClient/AmqpLibraryException.h"
@@ -50,9 +55,8 @@
 #include "SimpleAmqpClient/ChannelImpl.h"
 #include "SimpleAmqpClient/ConnectionClosedException.h"
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
-#include "SimpleAmqpClient/TableImpl.h"
+#include "SimpleAmqpClient/MessageRejectedException.h"
 
-#define BROKER_HEARTBEAT 0
 
 namespace AmqpClient {
 
@@ -62,56 +66,68 @@ std::string BytesToString(amqp_bytes_t bytes) {
   return std::string(reinterpret_cast<char *>(bytes.bytes), bytes.len);
 }
 
-void SetMessageProperties(BasicMessage &mes,
-                          const amqp_basic_properties_t &props) {
-  if (0 != (props._flags & AMQP_BASIC_CONTENT_TYPE_FLAG)) {
-    mes.ContentType(BytesToString(props.content_type));
-  }
-  if (0 != (props._flags & AMQP_BASIC_CONTENT_ENCODING_FLAG)) {
-    mes.ContentEncoding(BytesToString(props.content_encoding));
-  }
-  if (0 != (props._flags & AMQP_BASIC_DELIVERY_MODE_FLAG)) {
-    mes.DeliveryMode(
-        static_cast<BasicMessage::delivery_mode_t>(props.delivery_mode));
-  }
-  if (0 != (props._flags & AMQP_BASIC_PRIORITY_FLAG)) {
-    mes.Priority(props.priority);
-  }
-  if (0 != (props._flags & AMQP_BASIC_CORRELATION_ID_FLAG)) {
-    mes.CorrelationId(BytesToString(props.correlation_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_REPLY_TO_FLAG)) {
-    mes.ReplyTo(BytesToString(props.reply_to));
-  }
-  if (0 != (props._flags & AMQP_BASIC_EXPIRATION_FLAG)) {
-    mes.Expiration(BytesToString(props.expiration));
-  }
-  if (0 != (props._flags & AMQP_BASIC_MESSAGE_ID_FLAG)) {
-    mes.MessageId(BytesToString(props.message_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_TIMESTAMP_FLAG)) {
-    mes.Timestamp(props.timestamp);
-  }
-  if (0 != (props._flags & AMQP_BASIC_TYPE_FLAG)) {
-    mes.Type(BytesToString(props.type));
-  }
-  if (0 != (props._flags & AMQP_BASIC_USER_ID_FLAG)) {
-    mes.UserId(BytesToString(props.user_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_APP_ID_FLAG)) {
-    mes.AppId(BytesToString(props.app_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_CLUSTER_ID_FLAG)) {
-    mes.ClusterId(BytesToString(props.cluster_id));
-  }
-  if (0 != (props._flags & AMQP_BASIC_HEADERS_FLAG)) {
-    mes.HeaderTable(Detail::TableValueImpl::CreateTable(props.headers));
+// The exception AmqpException::Throw() raises for close, to be rethrown later
+std::exception_ptr CloseError(const amqp_channel_close_t &close) {
+  try {
+    AmqpException::Throw(close);
+  } catch (...) {
+    return std::current_exception();
   }
+  return std::exception_ptr();
+}
+
+// The frame size asked for when OpenOpts::frame_max is 0, for a broker that
+// sets no limit of its own. rabbitmq-c keeps a read buffer this large.
+const int BROKER_FRAME_MAX_LIMIT = 16 * 1024 * 1024;
+
+// How much larger than its encoded form a body may decode to, unless
+// Channel::SetCodec() says otherwise
+const std::size_t CODEC_MAX_DECODE_RATIO = 64;
+
+void ToTimeval(std::chrono::microseconds timeout, struct timeval &tv) {
+  // std::chrono::seconds.count() returns std::int_atleast64_t,
+  // long can be 32 or 64 bit depending on the platform/arch
+  // unless the timeout is something absurd cast to long will be ok, but
+  // lets guard against the case where someone does something silly
+  assert(std::chrono::duration_cast<std::chrono::seconds>(timeout).count() <
+         static_cast<std::chrono::seconds::rep>(
+             std::numeric_limits<long>::max()));
+
+  tv.tv_sec = static_cast<long>(
+      std::chrono::duration_cast<std::chrono::seconds>(timeout).count());
+  tv.tv_usec =
+      static_cast<long>((timeout - std::chrono::seconds(tv.tv_sec)).count());
 }
 }  // namespace
 
 Channel::ChannelImpl::ChannelImpl()
-    : m_last_used_channel(0), m_is_connected(false) {
+    : m_buffered_bytes(0),
+      m_max_buffered_bytes(0),
+      m_posted_handlers(0),
+      m_last_used_channel(0),
+      m_next_consumer_tag(0),
+      m_confirm_channel(0),
+      m_next_publish_seq(1),
+      m_confirm_window(256),
+      m_batch_results(NULL),
+      m_batch_first_seq(0),
+      m_blocked(false),
+      m_blocked_publish_limit(0),
+      m_rpc_channel(0),
+      m_last_rpc_id(0),
+      m_publisher_confirms(true),
+      m_codec_min_size(0),
+      m_codec_max_decoded_size(0),
+      m_decode_failures(0),
+      m_ack_batch_size(0),
+      m_ack_batch_timeout(0),
+      m_is_connected(false),
+      m_thread_safe(false),
+      m_active_lock(NULL),
+      m_reader_active(false),
+      m_read_generation(0),
+      m_delivery_tag_offset(0),
+      m_last_delivery_tag(0) {
   m_channels.push_back(CS_Used);
 }
 
@@ -120,8 +136,8 @@ Channel::ChannelImpl::~ChannelImpl() {}
 void Channel::ChannelImpl::DoLogin(const std::string &username,
                                    const std::string &password,
                                    const std::string &vhost, int frame_max,
-                                   bool sasl_external) {
-  amqp_table_entry_t capabilties[1];
+                                   int heartbeat, bool sasl_external) {
+  amqp_table_entry_t capabilties[2];
   amqp_table_entry_t capability_entry;
   amqp_table_t client_properties;
 
@@ -129,6 +145,10 @@ void Channel::ChannelImpl::DoLogin(const std::string &username,
   capabilties[0].value.kind = AMQP_FIELD_KIND_BOOLEAN;
   capabilties[0].value.value.boolean = 1;
 
+  capabilties[1].key = amqp_cstring_bytes("connection.blocked");
+  capabilties[1].value.kind = AMQP_FIELD_KIND_BOOLEAN;
+  capabilties[1].value.value.boolean = 1;
+
   capability_entry.key = amqp_cstring_bytes("capabilities");
   capability_entry.value.kind = AMQP_FIELD_KIND_TABLE;
   capability_entry.value.value.table.num_entries =
@@ -138,15 +158,21 @@ void Channel::ChannelImpl::DoLogin(const std::string &username,
   client_properties.num_entries = 1;
   client_properties.entries = &capability_entry;
 
+  // rabbitmq-c settles on the smaller of what is asked for and the broker's
+  // frame_max, unless the broker's is 0 for no limit
+  if (frame_max <= 0) {
+    frame_max = BROKER_FRAME_MAX_LIMIT;
+  }
+
   if (sasl_external) {
     CheckRpcReply(0, amqp_login_with_properties(
                          m_connection, vhost.c_str(), 0, frame_max,
-                         BROKER_HEARTBEAT, &client_properties,
+                         heartbeat, &client_properties,
                          AMQP_SASL_METHOD_EXTERNAL, username.c_str()));
   } else {
     CheckRpcReply(
         0, amqp_login_with_properties(m_connection, vhost.c_str(), 0, frame_max,
-                                      BROKER_HEARTBEAT, &client_properties,
+                                      heartbeat, &client_properties,
                                       AMQP_SASL_METHOD_PLAIN, username.c_str(),
                                       password.c_str()));
   }
@@ -155,26 +181,70 @@ void Channel::ChannelImpl::DoLogin(const std::string &username,
 }
 
 amqp_channel_t Channel::ChannelImpl::GetNextChannelId() {
-  channel_state_list_t::iterator unused_channel =
-      std::find(m_channels.begin(), m_channels.end(), CS_Closed);
+  amqp_channel_t unused_channel;
+  if (m_closed_channels.Lowest(unused_channel)) {
+    return unused_channel;
+  }
+
+  int max_channels = amqp_get_channel_max(m_connection);
+  if (0 == max_channels) {
+    max_channels = std::numeric_limits<uint16_t>::max();
+  }
+  if (static_cast<size_t>(max_channels) < m_channels.size()) {
+    throw std::runtime_error("Too many channels open");
+  }
 
-  if (m_channels.end() == unused_channel) {
-    int max_channels = amqp_get_channel_max(m_connection);
-    if (0 == max_channels) {
-      max_channels = std::numeric_limits<uint16_t>::max();
+  unused_channel = static_cast<amqp_channel_t>(m_channels.size());
+  m_channels.push_back(CS_Closed);
+  m_closed_channels.Insert(unused_channel);
+  return unused_channel;
+}
+
+void Channel::ChannelImpl::SetChannelState(amqp_channel_t channel,
+                                           channel_state_t state) {
+  channel_state_t &current = m_channels.at(channel);
+  if (CS_Closed == current) {
+    m_closed_channels.Erase(channel);
+  } else if (CS_Open == current) {
+    m_open_channels.Erase(channel);
+  }
+  current = state;
+  if (CS_Closed == state) {
+    m_closed_channels.Insert(channel);
+    // The next channel to get this number starts with the broker's defaults
+    if (channel < m_channel_prefetch.size()) {
+      m_channel_prefetch[channel] = -1;
     }
-    if (static_cast<size_t>(max_channels) < m_channels.size()) {
-      throw std::runtime_error("Too many channels open");
+    if (channel < m_delivery_queues.size()) {
+      m_delivery_queues[channel].cancel_pending = false;
     }
+  } else if (CS_Open == state) {
+    m_open_channels.Insert(channel);
+  }
+}
+
+void Channel::ChannelImpl::HandleConsumerCancel(const amqp_frame_t &cancel,
+                                                std::string *cancelled_tag) {
+  amqp_basic_cancel_t *cancel_method =
+      reinterpret_cast<amqp_basic_cancel_t *>(cancel.payload.method.decoded);
+  std::string consumer_tag((char *)cancel_method->consumer_tag.bytes,
+                           cancel_method->consumer_tag.len);
 
-    m_channels.push_back(CS_Closed);
-    unused_channel = m_channels.end() - 1;
+  RemoveConsumer(consumer_tag);
+  if (m_recovery) {
+    m_recovery->ForgetConsumer(consumer_tag);
   }
+  ReturnChannel(cancel.channel);
+  MaybeReleaseBuffersOnChannel(cancel.channel);
 
-  return unused_channel - m_channels.begin();
+  if (NULL != cancelled_tag) {
+    cancelled_tag->swap(consumer_tag);
+    return;
+  }
+  throw ConsumerCancelledException(consumer_tag);
 }
 
-amqp_channel_t Channel::ChannelImpl::CreateNewChannel() {
+amqp_channel_t Channel::ChannelImpl::CreateNewChannel(bool confirm_select) {
   amqp_channel_t new_channel = GetNextChannelId();
 
   static const std::array<std::uint32_t, 1> OPEN_OK = {
@@ -183,38 +253,112 @@ amqp_channel_t Channel::ChannelImpl::CreateNewChannel() {
   DoRpcOnChannel<std::array<std::uint32_t, 1> >(
       new_channel, AMQP_CHANNEL_OPEN_METHOD, &channel_open, OPEN_OK);
 
-  static const std::array<std::uint32_t, 1> CONFIRM_OK = {
-      AMQP_CONFIRM_SELECT_OK_METHOD};
-  amqp_confirm_select_t confirm_select = {};
-  DoRpcOnChannel<std::array<std::uint32_t, 1> >(
-      new_channel, AMQP_CONFIRM_SELECT_METHOD, &confirm_select, CONFIRM_OK);
+  if (confirm_select) {
+    static const std::array<std::uint32_t, 1> CONFIRM_OK = {
+        AMQP_CONFIRM_SELECT_OK_METHOD};
+    amqp_confirm_select_t confirm_select = {};
+    DoRpcOnChannel<std::array<std::uint32_t, 1> >(
+        new_channel, AMQP_CONFIRM_SELECT_METHOD, &confirm_select, CONFIRM_OK);
+  }
 
-  m_channels.at(new_channel) = CS_Open;
+  SetChannelState(new_channel, CS_Open);
+  ResetAckState(new_channel);
+  if (m_stats) {
+    stats_t::Increment(m_stats->channels_opened);
+  }
 
   return new_channel;
 }
 
-amqp_channel_t Channel::ChannelImpl::GetChannel() {
-  if (CS_Open == m_channels.at(m_last_used_channel)) {
-    m_channels[m_last_used_channel] = CS_Used;
-    return m_last_used_channel;
-  }
+void Channel::ChannelImpl::PreopenChannels(std::size_t count) {
+  channel_list_t channels;
+  channels.reserve(count);
+  // Should opening stop partway, the numbers not yet open are handed back,
+  // or they would stay CS_Used for as long as the connection lasts
+  auto release_unopened = [this, &channels]() {
+    for (channel_list_t::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+      if (CS_Used == m_channels.at(*it)) {
+        SetChannelState(*it, CS_Closed);
+      }
+    }
+  };
+
+  try {
+    for (std::size_t i = 0; i < count; ++i) {
+      amqp_channel_t channel = GetNextChannelId();
+      // Keeps GetNextChannelId() from handing out the same number again
+      SetChannelState(channel, CS_Used);
+      channels.push_back(channel);
+    }
 
-  channel_state_list_t::iterator it =
-      std::find(m_channels.begin(), m_channels.end(), CS_Open);
+    for (channel_list_t::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+      amqp_channel_open_t channel_open = {};
+      CheckForError(amqp_send_method(m_connection, *it,
+                                     AMQP_CHANNEL_OPEN_METHOD, &channel_open));
+      if (m_publisher_confirms) {
+        amqp_confirm_select_t confirm_select = {};
+        CheckForError(amqp_send_method(m_connection, *it,
+                                       AMQP_CONFIRM_SELECT_METHOD,
+                                       &confirm_select));
+      }
+    }
+  } catch (...) {
+    release_unopened();
+    throw;
+  }
 
-  if (m_channels.end() == it) {
-    amqp_channel_t new_channel = CreateNewChannel();
-    m_channels.at(new_channel) = CS_Used;
-    return new_channel;
+  static const std::array<std::uint32_t, 1> OPEN_OK = {
+      AMQP_CHANNEL_OPEN_OK_METHOD};
+  static const std::array<std::uint32_t, 1> CONFIRM_OK = {
+      AMQP_CONFIRM_SELECT_OK_METHOD};
+  std::exception_ptr channel_error;
+  for (channel_list_t::const_iterator it = channels.begin();
+       it != channels.end(); ++it) {
+    // Replies for the channels further along are queued while waiting
+    std::array<amqp_channel_t, 1> channel = {*it};
+    amqp_frame_t response;
+    try {
+      GetMethodOnChannel(channel, response, OPEN_OK);
+      if (m_publisher_confirms) {
+        GetMethodOnChannel(channel, response, CONFIRM_OK);
+      }
+    } catch (const ChannelException &) {
+      // The broker closed only this channel. The others are open on its
+      // side, so their replies are still read before their numbers are
+      // settled.
+      if (!channel_error) {
+        channel_error = std::current_exception();
+      }
+      continue;
+    } catch (...) {
+      release_unopened();
+      throw;
+    }
+    SetChannelState(*it, CS_Open);
+    ResetAckState(*it);
+    if (m_stats) {
+      stats_t::Increment(m_stats->channels_opened);
+    }
   }
+  if (channel_error) {
+    release_unopened();
+    std::rethrow_exception(channel_error);
+  }
+}
 
-  *it = CS_Used;
-  return it - m_channels.begin();
+amqp_channel_t Channel::ChannelImpl::GetChannel() {
+  amqp_channel_t channel = m_last_used_channel;
+  if (CS_Open != m_channels.at(channel) && !m_open_channels.Lowest(channel)) {
+    channel = CreateNewChannel(m_publisher_confirms);
+  }
+  SetChannelState(channel, CS_Used);
+  return channel;
 }
 
 void Channel::ChannelImpl::ReturnChannel(amqp_channel_t channel) {
-  m_channels.at(channel) = CS_Open;
+  SetChannelState(channel, CS_Open);
   m_last_used_channel = channel;
 }
 
@@ -222,8 +366,25 @@ bool Channel::ChannelImpl::IsChannelOpen(amqp_channel_t channel) {
   return CS_Closed != m_channels.at(channel);
 }
 
-void Channel::ChannelImpl::FinishCloseChannel(amqp_channel_t channel) {
-  m_channels.at(channel) = CS_Closed;
+void Channel::ChannelImpl::FinishCloseChannel(
+    amqp_channel_t channel, const amqp_channel_close_t &close) {
+  SetChannelState(channel, CS_Closed);
+  if (m_stats) {
+    stats_t::Increment(m_stats->channels_closed);
+  }
+  if (channel == m_rpc_channel) {
+    // The calls' replies would have come back on this channel
+    m_rpc_channel = 0;
+    LoseRpcCalls(CloseError(close));
+  }
+  ResetContentAssembly(channel);
+  // Delivery tags die with the channel, so any batched acks are moot
+  ResetAckState(channel);
+
+  if (IsConfirmChannel(channel)) {
+    // Outstanding publishes will never be confirmed on a closed channel
+    LosePublishes(CloseError(close));
+  }
 
   amqp_channel_close_ok_t close_ok;
   CheckForError(amqp_send_method(m_connection, channel,
@@ -250,7 +411,8 @@ void Channel::ChannelImpl::CheckRpcReply(amqp_channel_t channel,
 
     case AMQP_RESPONSE_SERVER_EXCEPTION:
       if (reply.reply.id == AMQP_CHANNEL_CLOSE_METHOD) {
-        FinishCloseChannel(channel);
+        FinishCloseChannel(channel, *reinterpret_cast<amqp_channel_close_t *>(
+                                        reply.reply.decoded));
       } else if (reply.reply.id == AMQP_CONNECTION_CLOSE_METHOD) {
         FinishCloseConnection();
       }
@@ -264,25 +426,34 @@ void Channel::ChannelImpl::CheckRpcReply(amqp_channel_t channel,
 
 void Channel::ChannelImpl::CheckForError(int ret) {
   if (ret < 0) {
+    switch (ret) {
+      case AMQP_STATUS_HEARTBEAT_TIMEOUT:
+      case AMQP_STATUS_SOCKET_ERROR:
+      case AMQP_STATUS_SOCKET_CLOSED:
+      case AMQP_STATUS_CONNECTION_CLOSED:
+        // The connection is unusable, fail later calls straight away
+        SetIsConnected(false);
+        break;
+      default:
+        break;
+    }
     throw AmqpLibraryException::CreateException(ret);
   }
 }
 
-MessageReturnedException Channel::ChannelImpl::CreateMessageReturnedException(
+Channel::ReturnedMessage Channel::ChannelImpl::ReadReturnedMessage(
     amqp_basic_return_t &return_method, amqp_channel_t channel) {
-  const int reply_code = return_method.reply_code;
-  const std::string reply_text((char *)return_method.reply_text.bytes,
-                               return_method.reply_text.len);
-  const std::string exchange((char *)return_method.exchange.bytes,
-                             return_method.exchange.len);
-  const std::string routing_key((char *)return_method.routing_key.bytes,
-                                return_method.routing_key.len);
-  BasicMessage::ptr_t content = ReadContent(channel);
-  return MessageReturnedException(content, reply_code, reply_text, exchange,
-                                  routing_key);
+  ReturnedMessage returned;
+  returned.reply_code = return_method.reply_code;
+  returned.reply_text = BytesToString(return_method.reply_text);
+  returned.exchange = BytesToString(return_method.exchange);
+  returned.routing_key = BytesToString(return_method.routing_key);
+  returned.message = ReadContent(channel);
+  return returned;
 }
 
 BasicMessage::ptr_t Channel::ChannelImpl::ReadContent(amqp_channel_t channel) {
+  ResetContentAssembly(channel);
   amqp_frame_t frame;
 
   GetNextFrameOnChannel(channel, frame);
@@ -294,12 +465,6 @@ BasicMessage::ptr_t Channel::ChannelImpl::ReadContent(amqp_channel_t channel) {
         "expected AMQP_FRAME_HEADER)");
   }
 
-  // The memory for this is allocated in a pool associated with the connection
-  // The BasicMessage constructor does a deep copy of the properties structure
-  amqp_basic_properties_t *properties =
-      reinterpret_cast<amqp_basic_properties_t *>(
-          frame.payload.properties.decoded);
-
   // size_t could possibly be 32-bit, body_size is always 64-bit
   assert(frame.payload.properties.body_size <
          static_cast<uint64_t>(std::numeric_limits<size_t>::max()));
@@ -307,7 +472,13 @@ BasicMessage::ptr_t Channel::ChannelImpl::ReadContent(amqp_channel_t channel) {
   size_t body_size = static_cast<size_t>(frame.payload.properties.body_size);
   size_t received_size = 0;
 
-  BasicMessage::ptr_t message = BasicMessage::Create();
+  BasicMessage::ptr_t message = m_message_pool
+                                    ? m_message_pool->AcquireMessage()
+                                    : BasicMessage::Create();
+  // The encoded properties are copied out of the connection's pool and only
+  // decoded if the application reads them
+  message->SetEncodedProperties(frame.payload.properties.raw.bytes,
+                                frame.payload.properties.raw.len);
   message->Body().reserve(body_size);
 
   // frame #3 and up:
@@ -324,22 +495,184 @@ BasicMessage::ptr_t Channel::ChannelImpl::ReadContent(amqp_channel_t channel) {
         reinterpret_cast<char *>(frame.payload.body_fragment.bytes),
         frame.payload.body_fragment.len);
     received_size += frame.payload.body_fragment.len;
+
+    // Once a fragment has been copied into the body its frame is no longer
+    // needed, so hand the memory back rather than holding a second copy of a
+    // large message in the connection's pool until the last frame arrives
+    MaybeReleaseBuffersOnChannel(channel);
   }
 
-  SetMessageProperties(*message, *properties);
+  if (m_codec && message->ContentEncodingIsSet() &&
+      message->ContentEncoding() == m_codec->ContentEncoding()) {
+    if (m_codec->Decode(message->Body(), m_decode_buffer,
+                        0 != m_codec_max_decoded_size
+                            ? m_codec_max_decoded_size
+                            : CODEC_MAX_DECODE_RATIO *
+                                  message->Body().size())) {
+      message->Body().swap(m_decode_buffer);
+      message->ContentEncodingClear();
+    } else {
+      // Left as it arrived, encoding and all
+      ++m_decode_failures;
+    }
+  }
 
   return message;
 }
 
+Envelope::ptr_t Channel::ChannelImpl::ReadGetOk(
+    const amqp_basic_get_ok_t &get_ok, amqp_channel_t channel, bool no_ack) {
+  // The method's fields live in the connection's pool, copy them out before
+  // reading the content
+  std::uint64_t delivery_tag = get_ok.delivery_tag;
+  bool redelivered = (get_ok.redelivered == 0 ? false : true);
+  std::string exchange = BytesToString(get_ok.exchange);
+  std::string routing_key = BytesToString(get_ok.routing_key);
+
+  BasicMessage::ptr_t message = ReadContent(channel);
+  return Envelope::Create(std::move(message), std::string(),
+                          ClientDeliveryTag(channel, delivery_tag, no_ack),
+                          std::move(exchange), redelivered,
+                          std::move(routing_key), channel);
+}
+
+const Detail::encoded_body_t *Channel::ChannelImpl::EncodeBody(
+    const BasicMessage &message) {
+  if (!m_codec || message.Body().size() < m_codec_min_size ||
+      message.ContentEncodingIsSet()) {
+    return NULL;
+  }
+  m_codec->Encode(message.Body(), m_encode_buffer);
+  // Not worth the receiver decoding it
+  if (m_encode_buffer.size() >= message.Body().size()) {
+    return NULL;
+  }
+  m_encoded.content_encoding = m_codec->ContentEncoding();
+  m_encoded.body = m_encode_buffer;
+  return &m_encoded;
+}
+
+void Channel::ChannelImpl::GetNextStreamFrame(amqp_channel_t channel,
+                                              amqp_frame_t &frame) {
+  // Frames for every other channel go through the usual queues
+  GetNextFrameFromBroker(frame, std::chrono::microseconds::max());
+  while (frame.channel != channel) {
+    ProcessFrame(frame);
+    GetNextFrameFromBroker(frame, std::chrono::microseconds::max());
+  }
+}
+
+bool Channel::ChannelImpl::ConsumeMessageStreamOnChannel(
+    amqp_channel_t channel, Envelope::ptr_t &envelope,
+    const body_chunk_handler_t &on_chunk, int timeout) {
+  std::array<amqp_channel_t, 1> channels = {channel};
+  // Anything already buffered, or a message whose frames have started
+  // queueing, is handed over whole. So is everything in thread-safe mode,
+  // where frames can only be read by the thread leading the read.
+  if (m_thread_safe || HasDeliveredMessages(channel) ||
+      HasQueuedFrames(channel)) {
+    if (!ConsumeMessageOnChannel(channels, envelope, timeout)) {
+      return false;
+    }
+    on_chunk(envelope, envelope->Message()->Body(), 0);
+    return true;
+  }
+
+  Deadline deadline(timeout >= 0 ? std::chrono::milliseconds(timeout)
+                                : std::chrono::microseconds::max());
+  amqp_frame_t frame;
+  for (;;) {
+    if (!GetNextFrameFromBroker(frame, deadline.Remaining())) {
+      return false;
+    }
+    if (frame.channel == channel && AMQP_FRAME_METHOD == frame.frame_type &&
+        AMQP_BASIC_DELIVER_METHOD == frame.payload.method.id) {
+      break;
+    }
+    ProcessFrame(frame);
+    if (HasQueuedFrames(channel)) {
+      // Something other than a delivery arrived for channel, such as a
+      // basic.cancel, let the usual path deal with it
+      if (!ConsumeMessageOnChannel(channels, envelope,
+                                   deadline.RemainingMilliseconds())) {
+        return false;
+      }
+      on_chunk(envelope, envelope->Message()->Body(), 0);
+      return true;
+    }
+  }
+
+  amqp_basic_deliver_t *deliver =
+      reinterpret_cast<amqp_basic_deliver_t *>(frame.payload.method.decoded);
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  envelope = Envelope::Create(
+      message, BytesToString(deliver->consumer_tag),
+      ClientDeliveryTag(channel, deliver->delivery_tag,
+                        GetDeliveryQueue(channel).no_ack),
+      BytesToString(deliver->exchange), 0 != deliver->redelivered,
+      BytesToString(deliver->routing_key), channel);
+  MaybeReleaseBuffersOnChannel(channel);
+
+  GetNextStreamFrame(channel, frame);
+  if (frame.frame_type != AMQP_FRAME_HEADER) {
+    throw std::runtime_error(
+        "Channel::BasicConsumeMessageStream: received unexpected frame type "
+        "(was expected AMQP_FRAME_HEADER)");
+  }
+  message->SetEncodedProperties(frame.payload.properties.raw.bytes,
+                                frame.payload.properties.raw.len);
+  std::uint64_t remaining = frame.payload.properties.body_size;
+  MaybeReleaseBuffersOnChannel(channel);
+
+  if (0 == remaining) {
+    on_chunk(envelope, std::string_view(), 0);
+    return true;
+  }
+
+  // If the handler throws, the rest of the body is still read off the wire so
+  // the channel is left at a message boundary
+  std::exception_ptr handler_error;
+  while (remaining > 0) {
+    GetNextStreamFrame(channel, frame);
+    if (frame.frame_type != AMQP_FRAME_BODY ||
+        frame.payload.body_fragment.len > remaining) {
+      throw std::runtime_error(
+          "Channel::BasicConsumeMessageStream: received unexpected frame type "
+          "(was expecting AMQP_FRAME_BODY)");
+    }
+    remaining -= frame.payload.body_fragment.len;
+    if (!handler_error) {
+      try {
+        on_chunk(envelope,
+                 std::string_view(
+                     static_cast<char *>(frame.payload.body_fragment.bytes),
+                     frame.payload.body_fragment.len),
+                 remaining);
+      } catch (...) {
+        handler_error = std::current_exception();
+      }
+    }
+    MaybeReleaseBuffersOnChannel(channel);
+  }
+
+  if (handler_error) {
+    std::rethrow_exception(handler_error);
+  }
+  return true;
+}
+
 void Channel::ChannelImpl::CheckFrameForClose(amqp_frame_t &frame,
                                               amqp_channel_t channel) {
   if (frame.frame_type == AMQP_FRAME_METHOD) {
     switch (frame.payload.method.id) {
-      case AMQP_CHANNEL_CLOSE_METHOD:
-        FinishCloseChannel(channel);
-        AmqpException::Throw(*reinterpret_cast<amqp_channel_close_t *>(
-            frame.payload.method.decoded));
+      case AMQP_CHANNEL_CLOSE_METHOD: {
+        const amqp_channel_close_t &close =
+            *reinterpret_cast<amqp_channel_close_t *>(
+                frame.payload.method.decoded);
+        FinishCloseChannel(channel, close);
+        AmqpException::Throw(close);
         break;
+      }
 
       case AMQP_CONNECTION_CLOSE_METHOD:
         FinishCloseConnection();
@@ -351,8 +684,27 @@ void Channel::ChannelImpl::CheckFrameForClose(amqp_frame_t &frame,
 }
 
 void Channel::ChannelImpl::AddConsumer(const std::string &consumer_tag,
-                                       amqp_channel_t channel) {
+                                       amqp_channel_t channel, bool no_ack) {
   m_consumer_channel_map.insert(std::make_pair(consumer_tag, channel));
+  ConsumersChanged();
+  GetDeliveryQueue(channel).no_ack = no_ack;
+}
+
+void Channel::ChannelImpl::SetCancelPending(amqp_channel_t channel) {
+  // Those already buffered are sent back by RemoveConsumer()
+  GetDeliveryQueue(channel).cancel_pending = true;
+}
+
+std::string Channel::ChannelImpl::NextConsumerTag() {
+  return "sac.ctag-" + std::to_string(++m_next_consumer_tag);
+}
+
+void Channel::ChannelImpl::SetPrefetch(amqp_channel_t channel,
+                                       std::uint16_t count) {
+  if (channel >= m_channel_prefetch.size()) {
+    m_channel_prefetch.resize(channel + 1, -1);
+  }
+  m_channel_prefetch[channel] = count;
 }
 
 amqp_channel_t Channel::ChannelImpl::RemoveConsumer(
@@ -366,6 +718,27 @@ amqp_channel_t Channel::ChannelImpl::RemoveConsumer(
   amqp_channel_t result = it->second;
 
   m_consumer_channel_map.erase(it);
+  m_consumer_handlers.erase(consumer_tag);
+  ConsumersChanged();
+  // Nothing can consume these any more, and they must not be handed to the
+  // next consumer on the channel. Unless they were never going to be acked,
+  // the broker is told to give them to another consumer.
+  if (result < m_delivery_queues.size()) {
+    delivery_queue_t &deliveries = m_delivery_queues[result];
+    for (std::deque<Envelope::ptr_t>::const_iterator envelope =
+             deliveries.envelopes.begin();
+         envelope != deliveries.envelopes.end(); ++envelope) {
+      TakeBufferedBytes(*envelope);
+      std::uint64_t delivery_tag;
+      if (!deliveries.no_ack &&
+          BrokerDeliveryTag((*envelope)->DeliveryTag(), delivery_tag)) {
+        CheckForError(
+            amqp_basic_reject(m_connection, result, delivery_tag, true));
+        SettleDeliveries(result, delivery_tag, false);
+      }
+    }
+    deliveries.envelopes.clear();
+  }
 
   return result;
 }
@@ -380,72 +753,294 @@ amqp_channel_t Channel::ChannelImpl::GetConsumerChannel(
   return it->second;
 }
 
-std::vector<amqp_channel_t> Channel::ChannelImpl::GetAllConsumerChannels()
-    const {
-  std::vector<amqp_channel_t> ret;
-  for (consumer_map_t::const_iterator it = m_consumer_channel_map.begin();
-       it != m_consumer_channel_map.end(); ++it) {
-    ret.push_back(it->second);
+Channel::ChannelImpl::channel_filter_ptr_t
+Channel::ChannelImpl::ConsumerChannels(
+    const std::vector<std::string> &consumer_tags) {
+  if (!m_tags_filter || m_filter_tags != consumer_tags) {
+    std::shared_ptr<ChannelFilter> filter = std::make_shared<ChannelFilter>();
+    for (std::vector<std::string>::const_iterator it = consumer_tags.begin();
+         it != consumer_tags.end(); ++it) {
+      filter->Insert(GetConsumerChannel(*it));
+    }
+    m_filter_tags = consumer_tags;
+    m_tags_filter = filter;
   }
+  return m_tags_filter;
+}
 
-  return ret;
+Channel::ChannelImpl::channel_filter_ptr_t
+Channel::ChannelImpl::AllConsumerChannels() {
+  if (!m_all_consumers_filter) {
+    std::shared_ptr<ChannelFilter> filter = std::make_shared<ChannelFilter>();
+    for (consumer_map_t::const_iterator it = m_consumer_channel_map.begin();
+         it != m_consumer_channel_map.end(); ++it) {
+      // Deliveries to these never reach BasicConsumeMessage
+      if (m_consumer_handlers.end() == m_consumer_handlers.find(it->first)) {
+        filter->Insert(it->second);
+      }
+    }
+    m_all_consumers_filter = filter;
+  }
+  return m_all_consumers_filter;
 }
 
-bool Channel::ChannelImpl::CheckForQueuedMessageOnChannel(
-    amqp_channel_t channel) const {
-  frame_queue_t::const_iterator it = std::find_if(
-      m_frame_queue.begin(), m_frame_queue.end(), [channel](auto &frame) {
-        return ChannelImpl::is_method_on_channel(
-            frame, AMQP_BASIC_DELIVER_METHOD, channel);
-      });
+void Channel::ChannelImpl::SetConsumerHandler(
+    const std::string &consumer_tag, const consumer_handler_t &handler) {
+  m_consumer_handlers[consumer_tag] =
+      std::make_shared<consumer_handler_t>(handler);
+  ConsumersChanged();
 
-  if (it == m_frame_queue.end()) {
+  // Deliveries may have been read along with the basic.consume-ok
+  Envelope::ptr_t envelope;
+  while (TakeDeliveredMessage(GetConsumerChannel(consumer_tag), envelope)) {
+    DispatchDelivery(envelope);
+  }
+}
+
+void Channel::ChannelImpl::AddDeliveredMessage(
+    const Envelope::ptr_t &envelope) {
+  const amqp_channel_t channel = envelope->DeliveryChannel();
+  delivery_queue_t &queue = GetDeliveryQueue(channel);
+  queue.envelopes.push_back(envelope);
+  m_buffered_bytes += envelope->Message()->Body().size();
+  if (!queue.ready) {
+    queue.ready = true;
+    m_ready_channels.push_back(channel);
+  }
+}
+
+bool Channel::ChannelImpl::TakeReadyDelivery(amqp_channel_t channel,
+                                             Envelope::ptr_t &message) {
+  delivery_queue_t &queue = GetDeliveryQueue(channel);
+  if (queue.envelopes.empty()) {
+    queue.ready = false;
     return false;
   }
+  message = queue.envelopes.front();
+  queue.envelopes.pop_front();
+  TakeBufferedBytes(message);
+  // Go to the back of the line so other channels get a turn
+  if (queue.envelopes.empty()) {
+    queue.ready = false;
+  } else {
+    m_ready_channels.push_back(channel);
+  }
+  return true;
+}
 
-  it = std::find_if(it + 1, m_frame_queue.end(), [channel](auto &frame) {
-    return Channel::ChannelImpl::is_on_channel(frame, channel);
-  });
+bool Channel::ChannelImpl::TakeDeliveredMessage(amqp_channel_t channel,
+                                                Envelope::ptr_t &message) {
+  if (channel >= m_delivery_queues.size() ||
+      m_delivery_queues[channel].envelopes.empty()) {
+    return false;
+  }
+  // The channel's place in m_ready_channels is dropped lazily
+  delivery_queue_t &queue = m_delivery_queues[channel];
+  message = queue.envelopes.front();
+  queue.envelopes.pop_front();
+  TakeBufferedBytes(message);
+  return true;
+}
 
-  if (it == m_frame_queue.end()) {
+bool Channel::ChannelImpl::TakeAnyDeliveredMessage(Envelope::ptr_t &message) {
+  while (!m_ready_channels.empty()) {
+    amqp_channel_t channel = m_ready_channels.front();
+    m_ready_channels.pop_front();
+    if (TakeReadyDelivery(channel, message)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Channel::ChannelImpl::DispatchDelivery(const Envelope::ptr_t &envelope) {
+  if (m_consumer_handlers.empty()) {
     return false;
   }
-  if (it->frame_type != AMQP_FRAME_HEADER) {
-    throw std::runtime_error("Protocol error");
+  handler_map_t::const_iterator it =
+      m_consumer_handlers.find(envelope->ConsumerTag());
+  if (m_consumer_handlers.end() == it) {
+    return false;
   }
 
-  uint64_t body_length = it->payload.properties.body_size;
-  uint64_t body_received = 0;
+  if (m_dispatcher) {
+    m_dispatcher->Post(it->second, envelope);
+    ++m_posted_handlers;
+  } else {
+    m_pending_handlers.push_back(std::make_pair(it->second, envelope));
+  }
+  return true;
+}
 
-  while (body_received < body_length) {
-    it = std::find_if(it + 1, m_frame_queue.end(), [channel](auto &frame) {
-      return Channel::ChannelImpl::is_on_channel(frame, channel);
-    });
+std::size_t Channel::ChannelImpl::RunPendingHandlers() {
+  std::size_t count = 0;
+  // A handler may call back into the Channel and queue more deliveries
+  while (!m_pending_handlers.empty()) {
+    std::pair<handler_ptr_t, Envelope::ptr_t> next =
+        m_pending_handlers.front();
+    m_pending_handlers.pop_front();
+    ++count;
+    (*next.first)(next.second);
+  }
+  return count;
+}
 
-    if (it == m_frame_queue.end()) {
-      return false;
+void Channel::ChannelImpl::CheckHandlerConsumers() {
+  const std::array<std::uint32_t, 1> CANCEL = {AMQP_BASIC_CANCEL_METHOD};
+  for (handler_map_t::const_iterator it = m_consumer_handlers.begin();
+       it != m_consumer_handlers.end(); ++it) {
+    std::array<amqp_channel_t, 1> channels = {GetConsumerChannel(it->first)};
+    amqp_frame_t cancel;
+    if (TakeQueuedMethod(channels, cancel, CANCEL)) {
+      HandleConsumerCancel(cancel);
     }
-    if (it->frame_type != AMQP_FRAME_BODY) {
-      throw std::runtime_error("Protocol error");
-    }
-    body_received += it->payload.body_fragment.len;
+    CheckForQueuedChannelClose(channels[0]);
   }
+}
 
-  return true;
+std::size_t Channel::ChannelImpl::DispatchMessages(
+    std::chrono::microseconds timeout) {
+  const std::uint64_t posted = m_posted_handlers;
+  Deadline deadline(timeout);
+  for (;;) {
+    RunConfirmCallbacks();
+    std::size_t count = RunPendingHandlers();
+    count += static_cast<std::size_t>(m_posted_handlers - posted);
+    if (count > 0) {
+      return count;
+    }
+    CheckHandlerConsumers();
+
+    if (m_thread_safe) {
+      if (!WaitForProgress(deadline.Remaining())) {
+        return 0;
+      }
+    } else {
+      amqp_frame_t frame;
+      if (!GetNextFrameFromBroker(frame, deadline.Remaining())) {
+        return 0;
+      }
+      ProcessFrame(frame);
+    }
+  }
 }
 
 void Channel::ChannelImpl::AddToFrameQueue(const amqp_frame_t &frame) {
-  m_frame_queue.push_back(frame);
+  if (IsConfirmChannel(frame.channel) &&
+      AMQP_FRAME_METHOD == frame.frame_type &&
+      (AMQP_BASIC_ACK_METHOD == frame.payload.method.id ||
+       AMQP_BASIC_NACK_METHOD == frame.payload.method.id)) {
+    HandlePublisherConfirm(frame);
+    return;
+  }
 
-  if (CheckForQueuedMessageOnChannel(frame.channel)) {
-    std::array<amqp_channel_t, 1> channel = {frame.channel};
+  const amqp_channel_t channel = frame.channel;
+  if (AMQP_FRAME_METHOD == frame.frame_type &&
+      AMQP_BASIC_CANCEL_OK_METHOD == frame.payload.method.id &&
+      channel < m_delivery_queues.size() &&
+      m_delivery_queues[channel].cancel_pending) {
+    // Nothing more will be delivered for the cancelled consumer
+    m_delivery_queues[channel].cancel_pending = false;
+    ReturnChannel(channel);
+    MaybeReleaseBuffersOnChannel(channel);
+    return;
+  }
+
+  channel_frames_t &queued = GetChannelFrames(channel);
+  queued.frames.push_back(frame);
+
+  // Advance the assembly state by one frame, a message is complete once its
+  // header has arrived and its body bytes are all accounted for
+  bool complete = false;
+  switch (queued.assembly) {
+    case CA_Idle:
+      if (AMQP_FRAME_METHOD == frame.frame_type &&
+          (AMQP_BASIC_DELIVER_METHOD == frame.payload.method.id ||
+           AMQP_BASIC_RETURN_METHOD == frame.payload.method.id)) {
+        queued.assembly = CA_Header;
+        queued.content_method = frame.payload.method.id;
+      }
+      break;
+    case CA_Header:
+      if (AMQP_FRAME_HEADER != frame.frame_type) {
+        throw std::runtime_error("Protocol error");
+      }
+      queued.body_remaining = frame.payload.properties.body_size;
+      queued.assembly = CA_Body;
+      complete = (0 == queued.body_remaining);
+      break;
+    case CA_Body:
+      if (AMQP_FRAME_BODY != frame.frame_type ||
+          frame.payload.body_fragment.len > queued.body_remaining) {
+        throw std::runtime_error("Protocol error");
+      }
+      queued.body_remaining -= frame.payload.body_fragment.len;
+      complete = (0 == queued.body_remaining);
+      break;
+  }
+
+  if (!complete) {
+    return;
+  }
+  const amqp_method_number_t content_method = queued.content_method;
+  queued.assembly = CA_Idle;
+
+  if (AMQP_BASIC_DELIVER_METHOD == content_method) {
+    std::array<amqp_channel_t, 1> channels = {channel};
     Envelope::ptr_t envelope;
-    if (!ConsumeMessageOnChannelInner(channel, envelope, -1)) {
+    if (!ConsumeMessageOnChannelInner(channels, envelope, -1)) {
       throw std::logic_error(
           "ConsumeMessageOnChannelInner returned false unexpectedly");
     }
 
-    m_delivered_messages.push_back(envelope);
+    const delivery_queue_t &deliveries = GetDeliveryQueue(channel);
+    if (deliveries.cancel_pending) {
+      // The consumer is gone, let another have the message
+      std::uint64_t delivery_tag;
+      if (!deliveries.no_ack &&
+          BrokerDeliveryTag(envelope->DeliveryTag(), delivery_tag)) {
+        CheckForError(
+            amqp_basic_reject(m_connection, channel, delivery_tag, true));
+        SettleDeliveries(channel, delivery_tag, false);
+      }
+      return;
+    }
+    if (channel == m_rpc_channel) {
+      AddRpcReply(envelope);
+    } else if (!DispatchDelivery(envelope)) {
+      AddDeliveredMessage(envelope);
+    }
+  } else if (!m_publisher_confirms && !IsConfirmChannel(channel)) {
+    // Returns on the confirm channel are matched up with their basic.ack in
+    // HandlePublisherConfirm, otherwise they wait for GetReturnedMessage()
+    frame_queue_t &frames = GetFrameQueue(channel);
+    frame_queue_t::iterator it =
+        std::find_if(frames.begin(), frames.end(), [channel](auto &frame) {
+          return ChannelImpl::is_method_on_channel(
+              frame, AMQP_BASIC_RETURN_METHOD, channel);
+        });
+    amqp_frame_t return_frame = *it;
+    frames.erase(it);
+    m_returned_messages.push_back(ReadReturnedMessage(
+        *reinterpret_cast<amqp_basic_return_t *>(
+            return_frame.payload.method.decoded),
+        channel));
+    MaybeReleaseBuffersOnChannel(channel);
+  }
+}
+
+void Channel::ChannelImpl::ProcessFrame(const amqp_frame_t &frame) {
+  if (frame.channel == 0) {
+    // Only thing we care to handle on the channel0 is the connection.close
+    // method
+    if (AMQP_FRAME_METHOD == frame.frame_type &&
+        AMQP_CONNECTION_CLOSE_METHOD == frame.payload.method.id) {
+      FinishCloseConnection();
+      AmqpException::Throw(*reinterpret_cast<amqp_connection_close_t *>(
+          frame.payload.method.decoded));
+    }
+  } else {
+    AddToFrameQueue(frame);
   }
 }
 
@@ -456,48 +1051,98 @@ bool Channel::ChannelImpl::GetNextFrameFromBroker(
   memset(&tv_timeout, 0, sizeof(tv_timeout));
 
   if (timeout != std::chrono::microseconds::max()) {
-    // std::chrono::seconds.count() returns std::int_atleast64_t,
-    // long can be 32 or 64 bit depending on the platform/arch
-    // unless the timeout is something absurd cast to long will be ok, but
-    // lets guard against the case where someone does something silly
-    assert(std::chrono::duration_cast<std::chrono::seconds>(timeout).count() <
-           static_cast<std::chrono::seconds::rep>(
-               std::numeric_limits<long>::max()));
-
-    tv_timeout.tv_sec = static_cast<long>(
-        std::chrono::duration_cast<std::chrono::seconds>(timeout).count());
-    tv_timeout.tv_usec = static_cast<long>(
-        (timeout - std::chrono::seconds(tv_timeout.tv_sec)).count());
-
+    ToTimeval(timeout, tv_timeout);
     tvp = &tv_timeout;
   }
 
+  // Batched acks must not sit unsent while we block waiting on the broker
+  if (HasPendingAcks() && timeout != std::chrono::microseconds::zero() &&
+      !amqp_frames_enqueued(m_connection) &&
+      !amqp_data_in_buffer(m_connection)) {
+    FlushAcks();
+  }
+  // rabbitmq-c sends heartbeats only once a wait times out, which a consumer
+  // that is never short of messages does not reach
+  if (timeout != std::chrono::microseconds::zero()) {
+    ServiceHeartbeats(false);
+  }
+
+  std::chrono::steady_clock::time_point wait_start;
+  if (m_stats) {
+    wait_start = std::chrono::steady_clock::now();
+  }
   int ret = amqp_simple_wait_frame_noblock(m_connection, &frame, tvp);
+  if (m_stats) {
+    stats_t::Increment(
+        m_stats->read_wait_us,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - wait_start)
+            .count());
+  }
 
   if (AMQP_STATUS_TIMEOUT == ret) {
     return false;
   }
   CheckForError(ret);
+
+  if (m_stats) {
+    stats_t::Increment(m_stats->frames_read);
+    if (AMQP_FRAME_HEADER == frame.frame_type) {
+      stats_t::Increment(m_stats->content_bytes_read,
+                         frame.payload.properties.raw.len);
+    } else if (AMQP_FRAME_BODY == frame.frame_type) {
+      stats_t::Increment(m_stats->content_bytes_read,
+                         frame.payload.body_fragment.len);
+    }
+  }
+
+  // connection.blocked and unblocked are left for ProcessFrame to ignore,
+  // wherever a caller happens to read them
+  if (0 == frame.channel && AMQP_FRAME_METHOD == frame.frame_type) {
+    if (AMQP_CONNECTION_BLOCKED_METHOD == frame.payload.method.id) {
+      m_blocked = true;
+      m_blocked_reason = BytesToString(
+          reinterpret_cast<amqp_connection_blocked_t *>(
+              frame.payload.method.decoded)
+              ->reason);
+      if (m_blocked_callback) {
+        m_blocked_callback(true, m_blocked_reason);
+      }
+    } else if (AMQP_CONNECTION_UNBLOCKED_METHOD == frame.payload.method.id) {
+      m_blocked = false;
+      m_blocked_reason.clear();
+      if (m_blocked_callback) {
+        m_blocked_callback(false, std::string());
+      }
+    }
+  }
   return true;
 }
 
 bool Channel::ChannelImpl::GetNextFrameOnChannel(
     amqp_channel_t channel, amqp_frame_t &frame,
     std::chrono::microseconds timeout) {
-  frame_queue_t::iterator it = std::find_if(
-      m_frame_queue.begin(), m_frame_queue.end(), [channel](auto &frame) {
-        return ChannelImpl::is_on_channel(frame, channel);
-      });
+  if (m_thread_safe) {
+    Deadline deadline(timeout);
+    while (!HasQueuedFrames(channel)) {
+      if (!WaitForProgress(deadline.Remaining())) {
+        return false;
+      }
+    }
+  }
 
-  if (m_frame_queue.end() != it) {
-    frame = *it;
-    m_frame_queue.erase(it);
+  if (HasQueuedFrames(channel)) {
+    frame_queue_t &queue = GetFrameQueue(channel);
+    frame = queue.front();
+    queue.pop_front();
 
     if (AMQP_FRAME_METHOD == frame.frame_type &&
         AMQP_CHANNEL_CLOSE_METHOD == frame.payload.method.id) {
-      FinishCloseChannel(channel);
-      AmqpException::Throw(*reinterpret_cast<amqp_channel_close_t *>(
-          frame.payload.method.decoded));
+      const amqp_channel_close_t &close =
+          *reinterpret_cast<amqp_channel_close_t *>(
+              frame.payload.method.decoded);
+      FinishCloseChannel(channel, close);
+      AmqpException::Throw(close);
     }
     return true;
   }
@@ -506,17 +1151,883 @@ bool Channel::ChannelImpl::GetNextFrameOnChannel(
   return GetNextFrameFromBrokerOnChannel(channels, frame, timeout);
 }
 
+Channel::ChannelImpl::ScopedLock::ScopedLock(ChannelImpl &impl)
+    : m_impl(impl) {
+  if (m_impl.m_thread_safe &&
+      m_impl.m_lock_owner.load() != std::this_thread::get_id()) {
+    m_lock = std::unique_lock<std::mutex>(m_impl.m_mutex);
+    m_impl.m_lock_owner = std::this_thread::get_id();
+    m_impl.m_active_lock = &m_lock;
+  }
+}
+
+Channel::ChannelImpl::ScopedLock::~ScopedLock() {
+  if (m_lock.owns_lock()) {
+    m_impl.m_active_lock = NULL;
+    m_impl.m_lock_owner = std::thread::id();
+  }
+}
+
+Channel::ChannelImpl::ScopedUnlock::ScopedUnlock(ChannelImpl &impl)
+    : m_impl(impl), m_lock(impl.m_active_lock) {
+  assert(NULL != m_lock);
+  m_impl.m_active_lock = NULL;
+  m_impl.m_lock_owner = std::thread::id();
+}
+
+Channel::ChannelImpl::ScopedUnlock::~ScopedUnlock() {
+  m_impl.m_lock_owner = std::this_thread::get_id();
+  m_impl.m_active_lock = m_lock;
+}
+
+bool Channel::ChannelImpl::WaitForProgress(std::chrono::microseconds timeout) {
+  const bool progressed =
+      m_reader_active ? WaitForReader(timeout) : ReadAsReader(timeout);
+  // Nothing is reading now, so a callback that waits on the broker becomes
+  // the reader rather than waiting on itself
+  RunConfirmCallbacks();
+  return progressed;
+}
+
+bool Channel::ChannelImpl::WaitForReader(std::chrono::microseconds timeout) {
+  // Another thread is on the socket, it will queue anything it reads
+  if (timeout == std::chrono::microseconds::zero()) {
+    return false;
+  }
+  const std::uint64_t generation = m_read_generation;
+  auto progressed = [this, generation]() {
+    return generation != m_read_generation || !m_reader_active;
+  };
+  ScopedUnlock unlock(*this);
+  if (timeout == std::chrono::microseconds::max()) {
+    m_read_done.wait(unlock.Lock(), progressed);
+    return true;
+  }
+  // The reader giving up without reading anything still counts, the caller
+  // loops around and takes over the socket if it has time left
+  return m_read_done.wait_for(unlock.Lock(), timeout, progressed);
+}
+
+bool Channel::ChannelImpl::ReadAsReader(std::chrono::microseconds timeout) {
+  // Batched acks must not sit unsent while we block waiting on the broker
+  if (HasPendingAcks() && timeout != std::chrono::microseconds::zero()) {
+    FlushAcks();
+  }
+
+  struct ReaderGuard {
+    explicit ReaderGuard(ChannelImpl &impl) : m_impl(impl) {
+      m_impl.m_reader_active = true;
+    }
+    ~ReaderGuard() {
+      m_impl.m_reader_active = false;
+      m_impl.m_read_done.notify_all();
+    }
+    ChannelImpl &m_impl;
+  } reader(*this);
+
+  bool idle = false;
+  if (!amqp_frames_enqueued(m_connection) &&
+      !amqp_data_in_buffer(m_connection)) {
+    int sockfd = amqp_get_sockfd(m_connection);
+    if (sockfd < 0) {
+      throw AmqpLibraryException::CreateException(AMQP_STATUS_SOCKET_CLOSED);
+    }
+
+    // Heartbeats are only serviced by the reading thread, so on a quiet
+    // connection it must still wake up at least twice per interval
+    std::chrono::microseconds wait = timeout;
+    const std::chrono::microseconds heartbeat_wait =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::seconds(amqp_get_heartbeat(m_connection))) /
+        2;
+    const bool heartbeat_wake =
+        heartbeat_wait > std::chrono::microseconds::zero() &&
+        wait > heartbeat_wait;
+    if (heartbeat_wake) {
+      wait = heartbeat_wait;
+    }
+
+    struct timeval *tvp = NULL;
+    struct timeval tv_timeout;
+    memset(&tv_timeout, 0, sizeof(tv_timeout));
+    if (wait != std::chrono::microseconds::max()) {
+      ToTimeval(wait, tv_timeout);
+      tvp = &tv_timeout;
+    }
+
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(sockfd, &read_fds);
+
+    int ready;
+    {
+      ScopedUnlock unlock(*this);
+      unlock.Lock().unlock();
+      ready = select(sockfd + 1, &read_fds, NULL, NULL, tvp);
+      unlock.Lock().lock();
+    }
+    if (0 == ready && !heartbeat_wake) {
+      return false;
+    }
+    idle = 0 == ready;
+    // On EINTR or a socket error fall through, reading will either find
+    // nothing or report the error
+  }
+
+  ServiceHeartbeats(idle);
+  ReadAvailableFrames();
+  ++m_read_generation;
+  return true;
+}
+
+std::size_t Channel::ChannelImpl::ReadAvailableFrames() {
+  std::size_t count = 0;
+  amqp_frame_t frame;
+  while (GetNextFrameFromBroker(frame, std::chrono::microseconds::zero())) {
+    ProcessFrame(frame);
+    ++count;
+  }
+  return count;
+}
+
+std::size_t Channel::ChannelImpl::ServiceHeartbeats(bool idle) {
+  const int heartbeat = amqp_get_heartbeat(m_connection);
+  if (heartbeat <= 0) {
+    return 0;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now >= m_next_heartbeat) {
+    m_next_heartbeat = now + std::chrono::seconds(heartbeat) / 2;
+    amqp_frame_t frame;
+    frame.frame_type = AMQP_FRAME_HEARTBEAT;
+    frame.channel = 0;
+    CheckForError(amqp_send_frame(m_connection, &frame));
+  }
+
+  if (!idle || amqp_frames_enqueued(m_connection) ||
+      amqp_data_in_buffer(m_connection)) {
+    return 0;
+  }
+  // The shortest wait that is not a zero timeout
+  amqp_frame_t frame;
+  if (!GetNextFrameFromBroker(frame, std::chrono::microseconds(1))) {
+    return 0;
+  }
+  ProcessFrame(frame);
+  return 1;
+}
+
 void Channel::ChannelImpl::MaybeReleaseBuffersOnChannel(
     amqp_channel_t channel) {
-  if (m_frame_queue.end() ==
-      std::find_if(m_frame_queue.begin(), m_frame_queue.end(),
-                   [channel](auto &frame) {
-                     return Channel::ChannelImpl::is_on_channel(frame, channel);
-                   })) {
+  if (!HasQueuedFrames(channel)) {
     amqp_maybe_release_buffers_on_channel(m_connection, channel);
   }
 }
 
+amqp_channel_t Channel::ChannelImpl::GetConfirmChannel() {
+  if (0 == m_confirm_channel) {
+    amqp_channel_t channel = CreateNewChannel(true);
+    // Keep the channel out of GetChannel()'s hands for as long as it is open
+    SetChannelState(channel, CS_Used);
+    m_confirm_channel = channel;
+    m_next_publish_seq = 1;
+  }
+  return m_confirm_channel;
+}
+
+void Channel::ChannelImpl::AtomicHistogram::Add(
+    std::chrono::steady_clock::duration latency) {
+  std::uint64_t us = static_cast<std::uint64_t>(std::max<std::int64_t>(
+      0, std::chrono::duration_cast<std::chrono::microseconds>(latency)
+             .count()));
+  std::size_t bucket = 0;
+  while (bucket + 1 < m_buckets.size() && 0 != (us >> bucket)) {
+    ++bucket;
+  }
+  m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_total_us.fetch_add(us, std::memory_order_relaxed);
+}
+
+Channel::LatencyHistogram Channel::ChannelImpl::AtomicHistogram::Snapshot()
+    const {
+  LatencyHistogram histogram;
+  for (std::size_t i = 0; i < m_buckets.size(); ++i) {
+    histogram.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+  }
+  histogram.count = m_count.load(std::memory_order_relaxed);
+  histogram.total_us = m_total_us.load(std::memory_order_relaxed);
+  return histogram;
+}
+
+Channel::Stats Channel::ChannelImpl::GetStats() const {
+  Stats stats;
+  for (std::vector<channel_frames_t>::const_iterator it =
+           m_frame_queues.begin();
+       it != m_frame_queues.end(); ++it) {
+    stats.queued_frames += it->frames.size();
+  }
+  for (std::vector<delivery_queue_t>::const_iterator it =
+           m_delivery_queues.begin();
+       it != m_delivery_queues.end(); ++it) {
+    stats.delivered_messages += it->envelopes.size();
+  }
+  stats.buffered_bytes = m_buffered_bytes;
+  stats.decode_failures = m_decode_failures;
+  if (!m_stats) {
+    return stats;
+  }
+
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  stats.frames_read = m_stats->frames_read.load(relaxed);
+  stats.content_bytes_read = m_stats->content_bytes_read.load(relaxed);
+  stats.messages_published = m_stats->messages_published.load(relaxed);
+  stats.acks_sent = m_stats->acks_sent.load(relaxed);
+  stats.read_wait_us = m_stats->read_wait_us.load(relaxed);
+  stats.channels_opened = m_stats->channels_opened.load(relaxed);
+  stats.channels_closed = m_stats->channels_closed.load(relaxed);
+  stats.confirm_latency = m_stats->confirm_latency.Snapshot();
+  for (std::map<std::uint32_t, AtomicHistogram>::const_iterator it =
+           m_stats->rpc_latency.begin();
+       it != m_stats->rpc_latency.end(); ++it) {
+    stats.rpc_latency[it->first] = it->second.Snapshot();
+  }
+  return stats;
+}
+
+amqp_channel_t Channel::ChannelImpl::GetRpcChannel() {
+  if (0 != m_rpc_channel) {
+    return m_rpc_channel;
+  }
+  // Not in confirm mode, so requests go out without waiting for the broker
+  amqp_channel_t channel = CreateNewChannel(false);
+  SetChannelState(channel, CS_Used);
+
+  static const std::array<std::uint32_t, 1> CONSUME_OK = {
+      AMQP_BASIC_CONSUME_OK_METHOD};
+  amqp_basic_consume_t consume = {};
+  consume.queue = amqp_cstring_bytes(RPC_REPLY_QUEUE);
+  consume.no_local = false;
+  // The broker requires as much of a direct reply-to consumer
+  consume.no_ack = true;
+  consume.exclusive = false;
+  DoRpcOnChannel(channel, AMQP_BASIC_CONSUME_METHOD, &consume, CONSUME_OK);
+  MaybeReleaseBuffersOnChannel(channel);
+
+  m_rpc_channel = channel;
+  return channel;
+}
+
+void Channel::ChannelImpl::AddRpcReply(const Envelope::ptr_t &envelope) {
+  const BasicMessage::ptr_t &reply = envelope->Message();
+  if (!reply->CorrelationIdIsSet()) {
+    return;
+  }
+  rpc_call_map_t::iterator it = m_rpc_calls.find(reply->CorrelationId());
+  if (m_rpc_calls.end() == it || it->second) {
+    return;
+  }
+  if (m_rpc_reply_callback) {
+    const std::string correlation_id = it->first;
+    m_rpc_calls.erase(it);
+    m_rpc_reply_callback(correlation_id, reply);
+  } else {
+    it->second = reply;
+  }
+}
+
+void Channel::ChannelImpl::LoseRpcCalls(const std::exception_ptr &cause) {
+  for (rpc_call_map_t::iterator it = m_rpc_calls.begin();
+       it != m_rpc_calls.end();) {
+    // A reply already received can still be collected
+    if (it->second) {
+      ++it;
+      continue;
+    }
+    // With a reply callback nobody waits for the call, so nobody would
+    // collect the error either
+    if (!m_rpc_reply_callback) {
+      m_lost_rpc_calls[it->first] = cause;
+    }
+    it = m_rpc_calls.erase(it);
+  }
+}
+
+bool Channel::ChannelImpl::WaitForRpcReply(const std::string &correlation_id,
+                                           BasicMessage::ptr_t &reply,
+                                           std::chrono::microseconds timeout) {
+  Deadline deadline(timeout);
+  for (;;) {
+    rpc_call_map_t::iterator it = m_rpc_calls.find(correlation_id);
+    if (m_rpc_calls.end() == it) {
+      lost_rpc_call_map_t::iterator lost =
+          m_lost_rpc_calls.find(correlation_id);
+      if (m_lost_rpc_calls.end() != lost) {
+        std::exception_ptr cause = lost->second;
+        m_lost_rpc_calls.erase(lost);
+        std::rethrow_exception(cause);
+      }
+      throw std::invalid_argument(
+          "Channel::RpcWaitForReply: no call is waiting with this correlation "
+          "id");
+    }
+    if (it->second) {
+      reply = it->second;
+      m_rpc_calls.erase(it);
+      return true;
+    }
+    CheckForQueuedChannelClose(m_rpc_channel);
+
+    if (m_thread_safe) {
+      if (!WaitForProgress(deadline.Remaining())) {
+        return false;
+      }
+    } else {
+      amqp_frame_t frame;
+      if (!GetNextFrameFromBroker(frame, deadline.Remaining())) {
+        return false;
+      }
+      ProcessFrame(frame);
+    }
+  }
+}
+
+std::uint64_t Channel::ChannelImpl::HoldBlockedPublish(
+    const blocked_publish_t &publish) {
+  if (m_blocked_publishes.size() >= m_blocked_publish_limit) {
+    return 0;
+  }
+  m_blocked_publishes.push_back(publish);
+  // GetConfirmChannel() starts a new channel's sequence at 1
+  return (0 == m_confirm_channel ? 1 : m_next_publish_seq) +
+         m_blocked_publishes.size() - 1;
+}
+
+std::uint64_t Channel::ChannelImpl::AddUnconfirmedPublish(
+    bool mandatory, const std::string &exchange,
+    const std::string &routing_key) {
+  std::uint64_t sequence_number = m_next_publish_seq++;
+  unconfirmed_t &publish = m_unconfirmed_publishes[sequence_number];
+  publish.mandatory = mandatory;
+  if (mandatory) {
+    publish.exchange = exchange;
+    publish.routing_key = routing_key;
+  }
+  if (m_stats) {
+    stats_t::Increment(m_stats->messages_published);
+    publish.sent = std::chrono::steady_clock::now();
+  }
+  return sequence_number;
+}
+
+void Channel::ChannelImpl::AddPendingReturn(const ReturnedMessage &returned) {
+  // The broker returns messages in the order they were published, each ahead
+  // of its own basic.ack. So it belongs to the oldest unconfirmed mandatory
+  // publish to the same exchange and routing key that has no return yet.
+  unconfirmed_map_t::const_iterator fallback = m_unconfirmed_publishes.end();
+  for (unconfirmed_map_t::const_iterator it = m_unconfirmed_publishes.begin();
+       it != m_unconfirmed_publishes.end(); ++it) {
+    if (!it->second.mandatory || m_pending_returns.count(it->first) > 0) {
+      continue;
+    }
+    if (it->second.exchange == returned.exchange &&
+        it->second.routing_key == returned.routing_key) {
+      m_pending_returns[it->first] = returned;
+      return;
+    }
+    if (m_unconfirmed_publishes.end() == fallback) {
+      fallback = it;
+    }
+  }
+  if (m_unconfirmed_publishes.end() != fallback) {
+    m_pending_returns[fallback->first] = returned;
+  } else {
+    // Not from any publish still awaiting a confirm
+    m_returned_messages.push_back(returned);
+  }
+}
+
+void Channel::ChannelImpl::CompletePublish(amqp_channel_t channel) {
+  ThrowPublishFailure(TryCompletePublish(channel));
+}
+
+void Channel::ChannelImpl::ThrowPublishFailure(const PublishConfirm &result) {
+  if (PublishConfirm::pc_nacked == result.status) {
+    throw MessageRejectedException(result.sequence_number);
+  }
+  if (PublishConfirm::pc_returned == result.status) {
+    const ReturnedMessage &returned = result.returned;
+    throw MessageReturnedException(returned.message, returned.reply_code,
+                                   returned.reply_text, returned.exchange,
+                                   returned.routing_key);
+  }
+}
+
+Channel::PublishConfirm Channel::ChannelImpl::TryCompletePublish(
+    amqp_channel_t channel) {
+  PublishConfirm result;
+  std::chrono::steady_clock::time_point sent;
+  if (m_stats) {
+    stats_t::Increment(m_stats->messages_published);
+    sent = std::chrono::steady_clock::now();
+  }
+  if (!PublisherConfirms()) {
+    // Fire-and-forget: returns are queued for GetReturnedMessage() and channel
+    // errors surface on a later call that reads from the broker
+    ReturnChannel(channel);
+    return result;
+  }
+
+  // If we've done things correctly we can get one of 4 things back from the
+  // broker
+  // - basic.ack - our channel is in confirm mode, messsage was 'dealt with' by
+  // the broker
+  // - basic.nack - our channel is in confirm mode, queue has max-length set and
+  // is full, queue overflow stratege is reject-publish
+  // - basic.return then basic.ack - the message wasn't delievered, but was
+  // dealt with
+  // - channel.close - probably tried to publish to a non-existant exchange, in
+  // any case error!
+  // - connection.clsoe - something really bad happened
+  const std::array<std::uint32_t, 3> PUBLISH_ACK = {
+      AMQP_BASIC_ACK_METHOD, AMQP_BASIC_RETURN_METHOD, AMQP_BASIC_NACK_METHOD};
+  amqp_frame_t response;
+  std::array<amqp_channel_t, 1> channels = {channel};
+  GetMethodOnChannel(channels, response, PUBLISH_ACK);
+  if (m_stats && AMQP_BASIC_RETURN_METHOD != response.payload.method.id) {
+    m_stats->confirm_latency.Add(std::chrono::steady_clock::now() - sent);
+  }
+
+  if (AMQP_BASIC_NACK_METHOD == response.payload.method.id) {
+    result.status = PublishConfirm::pc_nacked;
+    result.sequence_number =
+        reinterpret_cast<amqp_basic_nack_t *>(response.payload.method.decoded)
+            ->delivery_tag;
+  } else {
+    if (AMQP_BASIC_RETURN_METHOD == response.payload.method.id) {
+      result.status = PublishConfirm::pc_returned;
+      result.returned = ReadReturnedMessage(
+          *(reinterpret_cast<amqp_basic_return_t *>(
+              response.payload.method.decoded)),
+          channel);
+
+      const std::array<std::uint32_t, 1> BASIC_ACK = {AMQP_BASIC_ACK_METHOD};
+      GetMethodOnChannel(channels, response, BASIC_ACK);
+    }
+    result.sequence_number =
+        reinterpret_cast<amqp_basic_ack_t *>(response.payload.method.decoded)
+            ->delivery_tag;
+  }
+
+  ReturnChannel(channel);
+  MaybeReleaseBuffersOnChannel(channel);
+  return result;
+}
+
+bool Channel::ChannelImpl::WaitForPublishConfirms(
+    std::size_t max_unconfirmed, std::chrono::microseconds timeout) {
+  Deadline deadline(timeout);
+  for (;;) {
+    const bool confirmed =
+        ReadPublishConfirms(max_unconfirmed, deadline.Remaining());
+    // A callback that published again may have used up the room
+    if (0 == RunConfirmCallbacks() || !confirmed) {
+      return confirmed;
+    }
+  }
+}
+
+bool Channel::ChannelImpl::ReadPublishConfirms(
+    std::size_t max_unconfirmed, std::chrono::microseconds timeout) {
+  const std::array<std::uint32_t, 3> CONFIRM_METHODS = {
+      AMQP_BASIC_ACK_METHOD, AMQP_BASIC_RETURN_METHOD, AMQP_BASIC_NACK_METHOD};
+
+  std::chrono::steady_clock::time_point end_point;
+  std::chrono::microseconds timeout_left = timeout;
+  if (timeout != std::chrono::microseconds::max()) {
+    end_point = std::chrono::steady_clock::now() + timeout;
+  }
+
+  if (m_thread_safe) {
+    // Confirms are handled as AddToFrameQueue sees them
+    Deadline deadline(timeout);
+    while (m_unconfirmed_publishes.size() > max_unconfirmed) {
+      CheckForQueuedChannelClose(m_confirm_channel);
+      if (!WaitForProgress(deadline.Remaining())) {
+        return m_unconfirmed_publishes.size() <= max_unconfirmed;
+      }
+    }
+    return true;
+  }
+
+  while (m_unconfirmed_publishes.size() > max_unconfirmed) {
+    CheckForQueuedChannelClose(m_confirm_channel);
+
+    std::array<amqp_channel_t, 1> channels = {m_confirm_channel};
+    amqp_frame_t frame;
+    if (!GetMethodOnChannel(channels, frame, CONFIRM_METHODS, timeout_left)) {
+      return false;
+    }
+
+    if (AMQP_BASIC_RETURN_METHOD == frame.payload.method.id) {
+      AddPendingReturn(ReadReturnedMessage(
+          *reinterpret_cast<amqp_basic_return_t *>(frame.payload.method.decoded),
+          frame.channel));
+      MaybeReleaseBuffersOnChannel(frame.channel);
+    } else {
+      HandlePublisherConfirm(frame);
+    }
+
+    if (timeout != std::chrono::microseconds::max()) {
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now();
+      if (now >= end_point) {
+        return m_unconfirmed_publishes.size() <= max_unconfirmed;
+      }
+      timeout_left =
+          std::chrono::duration_cast<std::chrono::microseconds>(end_point - now);
+    }
+  }
+  return true;
+}
+
+void Channel::ChannelImpl::HandlePublisherConfirm(const amqp_frame_t &frame) {
+  const amqp_channel_t channel = frame.channel;
+
+  std::uint64_t delivery_tag;
+  bool multiple;
+  PublishConfirm::status_t status;
+  if (AMQP_BASIC_ACK_METHOD == frame.payload.method.id) {
+    amqp_basic_ack_t *ack =
+        reinterpret_cast<amqp_basic_ack_t *>(frame.payload.method.decoded);
+    delivery_tag = ack->delivery_tag;
+    multiple = (0 != ack->multiple);
+    status = PublishConfirm::pc_acked;
+  } else {
+    amqp_basic_nack_t *nack =
+        reinterpret_cast<amqp_basic_nack_t *>(frame.payload.method.decoded);
+    delivery_tag = nack->delivery_tag;
+    multiple = (0 != nack->multiple);
+    status = PublishConfirm::pc_nacked;
+  }
+
+  // A basic.return and its content always arrive ahead of the basic.ack for
+  // the same message, so pick up any that were queued while waiting on another
+  // channel.
+  for (;;) {
+    // ReadReturnedMessage may queue frames, so don't hold on to the reference
+    frame_queue_t &queue = GetFrameQueue(channel);
+    frame_queue_t::iterator it =
+        std::find_if(queue.begin(), queue.end(), [channel](auto &frame) {
+          return ChannelImpl::is_method_on_channel(
+              frame, AMQP_BASIC_RETURN_METHOD, channel);
+        });
+    if (queue.end() == it) {
+      break;
+    }
+    amqp_frame_t return_frame = *it;
+    queue.erase(it);
+    AddPendingReturn(ReadReturnedMessage(
+        *reinterpret_cast<amqp_basic_return_t *>(
+            return_frame.payload.method.decoded),
+        channel));
+  }
+  MaybeReleaseBuffersOnChannel(channel);
+
+  unconfirmed_map_t::iterator first;
+  unconfirmed_map_t::iterator last;
+  if (multiple) {
+    first = m_unconfirmed_publishes.begin();
+    last = m_unconfirmed_publishes.upper_bound(delivery_tag);
+  } else {
+    first = m_unconfirmed_publishes.find(delivery_tag);
+    last = first;
+    if (m_unconfirmed_publishes.end() != last) {
+      ++last;
+    }
+  }
+
+  std::vector<PublishConfirm> confirms;
+  for (unconfirmed_map_t::iterator it = first; it != last; ++it) {
+    PublishConfirm confirm;
+    confirm.sequence_number = it->first;
+    confirm.status = status;
+    if (m_stats) {
+      m_stats->confirm_latency.Add(std::chrono::steady_clock::now() -
+                                   it->second.sent);
+    }
+    std::map<std::uint64_t, ReturnedMessage>::iterator returned =
+        m_pending_returns.find(it->first);
+    if (m_pending_returns.end() != returned) {
+      confirm.status = PublishConfirm::pc_returned;
+      confirm.returned = returned->second;
+      m_pending_returns.erase(returned);
+    }
+    confirms.push_back(confirm);
+  }
+  m_unconfirmed_publishes.erase(first, last);
+
+  // This may be the middle of a read, the callback is left for
+  // RunConfirmCallbacks
+  for (std::vector<PublishConfirm>::const_iterator it = confirms.begin();
+       it != confirms.end(); ++it) {
+    if (NULL != m_batch_results && it->sequence_number >= m_batch_first_seq &&
+        it->sequence_number - m_batch_first_seq < m_batch_results->size()) {
+      (*m_batch_results)[it->sequence_number - m_batch_first_seq] = *it;
+    } else if (m_confirm_callback) {
+      m_pending_confirms.push_back(*it);
+    }
+  }
+}
+
+std::size_t Channel::ChannelImpl::RunConfirmCallbacks() {
+  std::size_t count = 0;
+  // The callback may publish again, and its confirms are queued behind these
+  while (!m_pending_confirms.empty()) {
+    PublishConfirm next = m_pending_confirms.front();
+    m_pending_confirms.pop_front();
+    ++count;
+    if (m_confirm_callback) {
+      m_confirm_callback(next);
+    }
+  }
+  return count;
+}
+
+void Channel::ChannelImpl::LosePublishes(const std::exception_ptr &cause) {
+  std::vector<std::uint64_t> lost;
+  for (unconfirmed_map_t::const_iterator it = m_unconfirmed_publishes.begin();
+       it != m_unconfirmed_publishes.end(); ++it) {
+    lost.push_back(it->first);
+  }
+  // Held publishes were promised the sequence numbers following on
+  const std::uint64_t first_held =
+      0 == m_confirm_channel ? 1 : m_next_publish_seq;
+  for (std::size_t i = 0; i < m_blocked_publishes.size(); ++i) {
+    lost.push_back(first_held + i);
+  }
+  m_confirm_channel = 0;
+  m_unconfirmed_publishes.clear();
+  m_pending_returns.clear();
+  m_blocked_publishes.clear();
+
+  if (!m_confirm_callback) {
+    return;
+  }
+  for (std::vector<std::uint64_t>::const_iterator it = lost.begin();
+       it != lost.end(); ++it) {
+    PublishConfirm confirm;
+    confirm.sequence_number = *it;
+    confirm.status = PublishConfirm::pc_lost;
+    confirm.error = cause;
+    m_pending_confirms.push_back(confirm);
+  }
+}
+
+void Channel::ChannelImpl::CheckForQueuedChannelClose(amqp_channel_t channel) {
+  if (!HasQueuedFrames(channel)) {
+    return;
+  }
+  frame_queue_t &queue = GetFrameQueue(channel);
+  frame_queue_t::iterator it =
+      std::find_if(queue.begin(), queue.end(), [channel](auto &frame) {
+        return ChannelImpl::is_method_on_channel(
+            frame, AMQP_CHANNEL_CLOSE_METHOD, channel);
+      });
+  if (queue.end() == it) {
+    return;
+  }
+  amqp_frame_t frame = *it;
+  queue.erase(it);
+  const amqp_channel_close_t &close =
+      *reinterpret_cast<amqp_channel_close_t *>(frame.payload.method.decoded);
+  FinishCloseChannel(channel, close);
+  AmqpException::Throw(close);
+}
+
+bool Channel::ChannelImpl::GetReturnedMessage(
+    ReturnedMessage &returned, std::chrono::microseconds timeout) {
+  std::chrono::steady_clock::time_point end_point;
+  std::chrono::microseconds timeout_left = timeout;
+  if (timeout != std::chrono::microseconds::max()) {
+    end_point = std::chrono::steady_clock::now() + timeout;
+  }
+
+  for (;;) {
+    if (!m_returned_messages.empty()) {
+      returned = m_returned_messages.front();
+      m_returned_messages.pop_front();
+      return true;
+    }
+
+    if (m_thread_safe) {
+      if (!WaitForProgress(timeout_left)) {
+        return false;
+      }
+    } else {
+      amqp_frame_t frame;
+      if (!GetNextFrameFromBroker(frame, timeout_left)) {
+        return false;
+      }
+      ProcessFrame(frame);
+    }
+
+    if (timeout != std::chrono::microseconds::max()) {
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now();
+      if (now >= end_point) {
+        timeout_left = std::chrono::microseconds::zero();
+      } else {
+        timeout_left = std::chrono::duration_cast<std::chrono::microseconds>(
+            end_point - now);
+      }
+    }
+  }
+}
+
+void Channel::ChannelImpl::QueueAck(amqp_channel_t channel,
+                                    std::uint64_t delivery_tag) {
+  ack_state_t &state = GetAckState(channel);
+  if (delivery_tag != state.contiguous + 1) {
+    // Acking this with multiple=true would also ack unsettled deliveries
+    SendAck(channel, delivery_tag, false);
+    SettleDeliveries(channel, delivery_tag, false);
+    return;
+  }
+
+  state.contiguous = delivery_tag;
+  AdvanceContiguous(state);
+
+  std::chrono::steady_clock::time_point now;
+  if (m_ack_batch_timeout != std::chrono::microseconds::zero()) {
+    now = std::chrono::steady_clock::now();
+  }
+  if (0 == state.pending_count) {
+    state.first_pending = now;
+    m_ack_pending_channels.push_back(channel);
+  }
+  state.pending_tag = delivery_tag;
+  ++state.pending_count;
+
+  if (state.pending_count >= m_ack_batch_size ||
+      (m_ack_batch_timeout != std::chrono::microseconds::zero() &&
+       now - state.first_pending >= m_ack_batch_timeout)) {
+    FlushAcksOnChannel(channel);
+  }
+}
+
+void Channel::ChannelImpl::SettleDeliveries(amqp_channel_t channel,
+                                            std::uint64_t delivery_tag,
+                                            bool multiple) {
+  if (!AckBatchingEnabled()) {
+    return;
+  }
+  ack_state_t &state = GetAckState(channel);
+  if (multiple) {
+    state.contiguous = std::max(state.contiguous, delivery_tag);
+  } else if (delivery_tag == state.contiguous + 1) {
+    state.contiguous = delivery_tag;
+  } else if (delivery_tag > state.contiguous) {
+    state.settled.insert(delivery_tag);
+  }
+  AdvanceContiguous(state);
+}
+
+void Channel::ChannelImpl::AdvanceContiguous(ack_state_t &state) {
+  while (!state.settled.empty() &&
+         *state.settled.begin() <= state.contiguous + 1) {
+    state.contiguous = std::max(state.contiguous, *state.settled.begin());
+    state.settled.erase(state.settled.begin());
+  }
+}
+
+void Channel::ChannelImpl::FlushAcks() {
+  while (!m_ack_pending_channels.empty()) {
+    FlushAcksOnChannel(m_ack_pending_channels.back());
+  }
+}
+
+void Channel::ChannelImpl::FlushAcksOnChannel(amqp_channel_t channel) {
+  channel_list_t::iterator it = std::find(
+      m_ack_pending_channels.begin(), m_ack_pending_channels.end(), channel);
+  if (m_ack_pending_channels.end() == it) {
+    return;
+  }
+  m_ack_pending_channels.erase(it);
+
+  ack_state_t &state = GetAckState(channel);
+  state.pending_count = 0;
+  SendAck(channel, state.pending_tag, true);
+}
+
+void Channel::ChannelImpl::SendAck(amqp_channel_t channel,
+                                   std::uint64_t delivery_tag, bool multiple) {
+  CheckForError(amqp_basic_ack(m_connection, channel, delivery_tag, multiple));
+  if (m_stats) {
+    stats_t::Increment(m_stats->acks_sent);
+  }
+}
+
+void Channel::ChannelImpl::ResetAckState(amqp_channel_t channel) {
+  if (channel >= m_ack_states.size()) {
+    return;
+  }
+  m_ack_states[channel] = ack_state_t();
+  channel_list_t::iterator it = std::find(
+      m_ack_pending_channels.begin(), m_ack_pending_channels.end(), channel);
+  if (m_ack_pending_channels.end() != it) {
+    m_ack_pending_channels.erase(it);
+  }
+}
+
+void Channel::ChannelImpl::AdoptConnection(ChannelImpl &fresh) {
+  amqp_destroy_connection(m_connection);
+  m_connection = fresh.m_connection;
+  fresh.m_connection = NULL;
+  m_brokerVersion = fresh.m_brokerVersion;
+
+  m_channels.assign(1, CS_Used);
+  m_closed_channels = Detail::ChannelSet();
+  m_open_channels = Detail::ChannelSet();
+  m_last_used_channel = 0;
+  m_channel_prefetch.clear();
+  m_frame_queues.clear();
+  // Unacked deliveries are requeued by the broker and delivered again
+  m_delivery_queues.clear();
+  m_buffered_bytes = 0;
+  m_ready_channels.clear();
+  m_pending_handlers.clear();
+  m_consumer_channel_map.clear();
+  ConsumersChanged();
+  // As when the confirm channel closes, outstanding publishes are lost
+  LosePublishes(std::make_exception_ptr(ConnectionClosedException()));
+  // A new connection starts out unblocked
+  m_blocked = false;
+  m_blocked_reason.clear();
+  m_rpc_channel = 0;
+  LoseRpcCalls(std::make_exception_ptr(ConnectionClosedException()));
+  m_ack_states.clear();
+  m_ack_pending_channels.clear();
+  m_next_heartbeat = std::chrono::steady_clock::time_point();
+
+  m_delivery_tag_offset += m_last_delivery_tag;
+  m_last_delivery_tag = 0;
+  SetIsConnected(true);
+}
+
+void Channel::ChannelImpl::RemoveOrphanedHandlers() {
+  for (handler_map_t::iterator it = m_consumer_handlers.begin();
+       it != m_consumer_handlers.end();) {
+    if (0 == m_consumer_channel_map.count(it->first)) {
+      it = m_consumer_handlers.erase(it);
+      ConsumersChanged();
+    } else {
+      ++it;
+    }
+  }
+}
+
 void Channel::ChannelImpl::CheckIsConnected() {
   if (!m_is_connected) {
     throw ConnectionClosedException();
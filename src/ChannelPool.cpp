@@ -0,0 +1,316 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef _WIN32
+#define NOMINMAX
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Winsock2.h>
+#else
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#endif
+
+#include <amqp.h>
+
+#include "SimpleAmqpClient/ChannelPool.h"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include "SimpleAmqpClient/ChannelImpl.h"
+#include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
+
+namespace AmqpClient {
+
+struct ChannelPool::Impl {
+  Impl(const std::vector<Channel::ptr_t> &channels, shard_policy_t policy)
+      : channels(channels),
+        policy(policy),
+        consumer_counts(channels.size(), 0),
+        next_publish(0),
+        next_consumer(0),
+        next_poll(0) {}
+
+  std::size_t PublishIndex(const std::string &routing_key) {
+    if (sp_routing_key == policy) {
+      return std::hash<std::string>()(routing_key) % channels.size();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return next_publish++ % channels.size();
+  }
+
+  std::size_t ConsumerIndex(const std::string &consumer_tag) {
+    std::lock_guard<std::mutex> lock(mutex);
+    consumer_map_t::const_iterator it = consumers.find(consumer_tag);
+    if (consumers.end() == it || it->second.cancelled) {
+      throw ConsumerTagNotFoundException();
+    }
+    return it->second.index;
+  }
+
+  // Counts envelope against its consumer, so that the consumer's connection
+  // is remembered until the message has been acked or rejected
+  void AddDelivery(const Envelope::ptr_t &envelope) {
+    std::lock_guard<std::mutex> lock(mutex);
+    consumer_map_t::iterator it = consumers.find(envelope->ConsumerTag());
+    if (consumers.end() != it && !it->second.no_ack) {
+      ++it->second.unsettled;
+    }
+  }
+
+  // The connection that delivered envelope. A cancelled consumer is
+  // forgotten once the last of its messages is settled.
+  std::size_t TakeDelivery(const Envelope::ptr_t &envelope) {
+    std::lock_guard<std::mutex> lock(mutex);
+    consumer_map_t::iterator it = consumers.find(envelope->ConsumerTag());
+    if (consumers.end() == it) {
+      throw ConsumerTagNotFoundException();
+    }
+    const std::size_t index = it->second.index;
+    if (it->second.unsettled > 0) {
+      --it->second.unsettled;
+    }
+    if (it->second.cancelled && 0 == it->second.unsettled) {
+      consumers.erase(it);
+    }
+    return index;
+  }
+
+  // Copies consumer_counts and returns next_poll, both are changed by
+  // BasicConsume and BasicCancel on other threads
+  std::size_t SnapshotConsumers(std::vector<std::size_t> &counts) {
+    std::lock_guard<std::mutex> lock(mutex);
+    counts = consumer_counts;
+    return next_poll;
+  }
+
+  // Blocks until one of the connections with consumers in counts has data to
+  // read, or the timeout passes
+  void WaitForReadable(const std::vector<std::size_t> &counts,
+                       std::chrono::microseconds timeout) {
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    int max_fd = -1;
+    for (std::size_t i = 0; i < channels.size(); ++i) {
+      if (0 == counts[i]) {
+        continue;
+      }
+      Channel::ChannelImpl &impl = *channels[i]->m_impl;
+      Channel::ChannelImpl::ScopedLock lock(impl);
+      if (impl.HasBufferedFrames()) {
+        // Already off the socket, so it would never poll readable
+        return;
+      }
+      int fd = amqp_get_sockfd(impl.m_connection);
+      FD_SET(fd, &read_fds);
+      if (fd > max_fd) {
+        max_fd = fd;
+      }
+    }
+
+    struct timeval *tvp = NULL;
+    struct timeval tv_timeout;
+    if (timeout != std::chrono::microseconds::max()) {
+      tv_timeout.tv_sec = static_cast<long>(
+          std::chrono::duration_cast<std::chrono::seconds>(timeout).count());
+      tv_timeout.tv_usec = static_cast<long>(
+          (timeout - std::chrono::seconds(tv_timeout.tv_sec)).count());
+      tvp = &tv_timeout;
+    }
+    // Errors and interruptions just end the wait, the next read reports them
+    select(max_fd + 1, &read_fds, NULL, NULL, tvp);
+  }
+
+  std::vector<Channel::ptr_t> channels;
+  const shard_policy_t policy;
+
+  // Guards the members below
+  std::mutex mutex;
+  std::vector<std::size_t> consumer_counts;
+  std::size_t next_publish;
+  std::size_t next_consumer;
+  std::size_t next_poll;
+  struct consumer_t {
+    consumer_t() : index(0), no_ack(false), cancelled(false), unsettled(0) {}
+    std::size_t index;
+    bool no_ack;
+    // Kept after BasicCancel() while unsettled is not 0, so that its
+    // messages can still be acked on the right connection
+    bool cancelled;
+    // Messages received through the pool yet to be acked or rejected
+    std::size_t unsettled;
+  };
+  typedef std::map<std::string, consumer_t> consumer_map_t;
+  consumer_map_t consumers;
+};
+
+ChannelPool::ptr_t ChannelPool::Open(const Channel::OpenOpts &opts,
+                                     std::size_t connections,
+                                     shard_policy_t policy) {
+  if (0 == connections) {
+    throw std::runtime_error("connections must be at least 1");
+  }
+  return std::make_shared<ChannelPool>(Channel::OpenMany(opts, connections),
+                                       policy);
+}
+
+ChannelPool::ChannelPool(const std::vector<Channel::ptr_t> &channels,
+                         shard_policy_t policy)
+    : m_impl(new Impl(channels, policy)) {
+  if (channels.empty()) {
+    throw std::runtime_error("a ChannelPool needs at least one channel");
+  }
+}
+
+ChannelPool::~ChannelPool() {}
+
+std::size_t ChannelPool::Size() const { return m_impl->channels.size(); }
+
+Channel::ptr_t ChannelPool::GetChannel(std::size_t index) const {
+  return m_impl->channels.at(index);
+}
+
+Channel::ptr_t ChannelPool::GetPublishChannel(const std::string &routing_key) {
+  return m_impl->channels[m_impl->PublishIndex(routing_key)];
+}
+
+void ChannelPool::BasicPublish(const std::string &exchange_name,
+                               const std::string &routing_key,
+                               const BasicMessage::ptr_t message,
+                               bool mandatory, bool immediate) {
+  GetPublishChannel(routing_key)
+      ->BasicPublish(exchange_name, routing_key, message, mandatory,
+                     immediate);
+}
+
+std::string ChannelPool::BasicConsume(const std::string &queue,
+                                      const std::string &consumer_tag,
+                                      bool no_local, bool no_ack,
+                                      bool exclusive,
+                                      std::uint16_t message_prefetch_count) {
+  std::size_t index;
+  {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    index = m_impl->next_consumer++ % m_impl->channels.size();
+  }
+  std::string tag = m_impl->channels[index]->BasicConsume(
+      queue, consumer_tag, no_local, no_ack, exclusive,
+      message_prefetch_count);
+
+  std::lock_guard<std::mutex> lock(m_impl->mutex);
+  Impl::consumer_t &consumer = m_impl->consumers[tag];
+  consumer = Impl::consumer_t();
+  consumer.index = index;
+  consumer.no_ack = no_ack;
+  ++m_impl->consumer_counts[index];
+  return tag;
+}
+
+void ChannelPool::BasicCancel(const std::string &consumer_tag) {
+  std::size_t index = m_impl->ConsumerIndex(consumer_tag);
+  m_impl->channels[index]->BasicCancel(consumer_tag);
+
+  std::lock_guard<std::mutex> lock(m_impl->mutex);
+  Impl::consumer_map_t::iterator it = m_impl->consumers.find(consumer_tag);
+  if (m_impl->consumers.end() != it) {
+    if (0 == it->second.unsettled) {
+      m_impl->consumers.erase(it);
+    } else {
+      it->second.cancelled = true;
+    }
+  }
+  --m_impl->consumer_counts[index];
+}
+
+bool ChannelPool::BasicConsumeMessage(Envelope::ptr_t &envelope, int timeout) {
+  const std::size_t size = m_impl->channels.size();
+  const std::chrono::steady_clock::time_point end_point =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  std::vector<std::size_t> counts;
+  for (;;) {
+    const std::size_t next_poll = m_impl->SnapshotConsumers(counts);
+    bool have_consumers = false;
+    for (std::size_t i = 0; i < size; ++i) {
+      std::size_t index = (next_poll + i) % size;
+      if (0 == counts[index]) {
+        continue;
+      }
+      have_consumers = true;
+      if (m_impl->channels[index]->BasicConsumeMessage(envelope, 0)) {
+        m_impl->AddDelivery(envelope);
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->next_poll = index + 1;
+        return true;
+      }
+    }
+    if (!have_consumers) {
+      throw ConsumerTagNotFoundException();
+    }
+
+    std::chrono::microseconds timeout_left = std::chrono::microseconds::max();
+    if (timeout >= 0) {
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now();
+      if (now >= end_point) {
+        return false;
+      }
+      timeout_left = std::chrono::duration_cast<std::chrono::microseconds>(
+          end_point - now);
+    }
+    m_impl->WaitForReadable(counts, timeout_left);
+  }
+}
+
+bool ChannelPool::BasicConsumeMessage(const std::string &consumer_tag,
+                                      Envelope::ptr_t &envelope, int timeout) {
+  const std::size_t index = m_impl->ConsumerIndex(consumer_tag);
+  if (!m_impl->channels[index]->BasicConsumeMessage(consumer_tag, envelope,
+                                                    timeout)) {
+    return false;
+  }
+  m_impl->AddDelivery(envelope);
+  return true;
+}
+
+void ChannelPool::BasicAck(const Envelope::ptr_t &message) {
+  m_impl->channels[m_impl->TakeDelivery(message)]->BasicAck(message);
+}
+
+void ChannelPool::BasicReject(const Envelope::ptr_t &message, bool requeue) {
+  m_impl->channels[m_impl->TakeDelivery(message)]->BasicReject(message,
+                                                               requeue);
+}
+
+}  // namespace AmqpClient
@@ -0,0 +1,152 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Codec.h"
+
+#include <stdexcept>
+
+#ifdef SAC_ZLIB_SUPPORT_ENABLED
+#include <zlib.h>
+
+#include <algorithm>
+#include <limits>
+#include <new>
+#endif
+
+namespace AmqpClient {
+
+#ifdef SAC_ZLIB_SUPPORT_ENABLED
+namespace {
+
+Bytef *ToBytef(const char *data) {
+  return reinterpret_cast<Bytef *>(const_cast<char *>(data));
+}
+
+// zlib counts in uInt, which may be narrower than std::size_t
+void CheckInputSize(std::string_view input) {
+  if (input.size() > std::numeric_limits<uInt>::max() / 2) {
+    throw std::length_error("Codec::Deflate: body too large for zlib");
+  }
+}
+
+// One stream each way, reset rather than reinitialised for every body
+class DeflateCodec : public Codec {
+ public:
+  explicit DeflateCodec(int level) : m_encoding("deflate") {
+    m_deflate = z_stream();
+    m_inflate = z_stream();
+    if (Z_OK != deflateInit(&m_deflate, level)) {
+      throw std::invalid_argument("Codec::Deflate: invalid level");
+    }
+    if (Z_OK != inflateInit(&m_inflate)) {
+      deflateEnd(&m_deflate);
+      throw std::bad_alloc();
+    }
+  }
+
+  virtual ~DeflateCodec() {
+    deflateEnd(&m_deflate);
+    inflateEnd(&m_inflate);
+  }
+
+  DeflateCodec(const DeflateCodec &) = delete;
+  DeflateCodec &operator=(const DeflateCodec &) = delete;
+
+  virtual const std::string &ContentEncoding() const { return m_encoding; }
+
+  virtual void Encode(std::string_view input, std::string &output) {
+    CheckInputSize(input);
+    deflateReset(&m_deflate);
+    output.resize(
+        deflateBound(&m_deflate, static_cast<uLong>(input.size())));
+    m_deflate.next_in = ToBytef(input.data());
+    m_deflate.avail_in = static_cast<uInt>(input.size());
+    m_deflate.next_out = ToBytef(output.data());
+    m_deflate.avail_out = static_cast<uInt>(output.size());
+    // deflateBound() leaves room for the whole stream in one call
+    if (Z_STREAM_END != deflate(&m_deflate, Z_FINISH)) {
+      throw std::runtime_error("Codec::Deflate: deflate failed");
+    }
+    output.resize(output.size() - m_deflate.avail_out);
+  }
+
+  virtual bool Decode(std::string_view input, std::string &output,
+                      std::size_t max_size) {
+    CheckInputSize(input);
+    inflateReset(&m_inflate);
+    m_inflate.next_in = ToBytef(input.data());
+    m_inflate.avail_in = static_cast<uInt>(input.size());
+    output.resize(
+        std::min(std::max<std::size_t>(4 * input.size(), 256), max_size));
+    std::size_t produced = 0;
+    for (;;) {
+      const uInt room = static_cast<uInt>(std::min<std::size_t>(
+          output.size() - produced, std::numeric_limits<uInt>::max()));
+      m_inflate.next_out = ToBytef(output.data() + produced);
+      m_inflate.avail_out = room;
+      const int ret = inflate(&m_inflate, Z_NO_FLUSH);
+      produced += room - m_inflate.avail_out;
+      if (Z_STREAM_END == ret) {
+        output.resize(produced);
+        // Anything after the end of the stream is not ours to drop
+        return 0 == m_inflate.avail_in;
+      }
+      if (Z_OK != ret && Z_BUF_ERROR != ret) {
+        return false;
+      }
+      if (0 != m_inflate.avail_out) {
+        // No more input, yet the stream has not ended
+        return false;
+      }
+      if (output.size() >= max_size) {
+        // A body that inflates this far is more likely a bomb than a message
+        return false;
+      }
+      output.resize(std::min(2 * output.size(), max_size));
+    }
+  }
+
+ private:
+  const std::string m_encoding;
+  z_stream m_deflate;
+  z_stream m_inflate;
+};
+
+}  // namespace
+
+Codec::ptr_t Codec::Deflate(int level) {
+  return std::make_shared<DeflateCodec>(level);
+}
+#else
+Codec::ptr_t Codec::Deflate(int) {
+  throw std::logic_error(
+      "Codec::Deflate: SimpleAmqpClient was built without zlib support");
+}
+#endif
+
+}  // namespace AmqpClient
@@ -0,0 +1,231 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include "SimpleAmqpClient/ConnectionRecovery.h"
+
+#include <algorithm>
+
+namespace AmqpClient {
+namespace Detail {
+
+ConnectionRecovery::ConnectionRecovery(const Channel::OpenOpts &opts,
+                                       const EndpointSelector &endpoints)
+    : m_opts(opts),
+      m_endpoints(endpoints),
+      m_replaying(false),
+      m_backoff(std::chrono::milliseconds(opts.recovery_interval)) {}
+
+void ConnectionRecovery::AttemptFailed(
+    std::chrono::steady_clock::time_point now) {
+  m_next_attempt = now + m_backoff;
+  m_backoff = std::min(m_backoff * 2, std::chrono::milliseconds(
+                                          m_opts.recovery_max_interval));
+}
+
+void ConnectionRecovery::AttemptSucceeded() {
+  m_backoff = std::chrono::milliseconds(m_opts.recovery_interval);
+  m_next_attempt = std::chrono::steady_clock::time_point();
+}
+
+void ConnectionRecovery::RecordExchange(const std::string &name,
+                                        const std::string &type, bool durable,
+                                        bool auto_delete,
+                                        const FlatTable &arguments) {
+  exchange_t &exchange = m_exchanges[name];
+  exchange.type = type;
+  exchange.durable = durable;
+  exchange.auto_delete = auto_delete;
+  exchange.arguments = arguments;
+}
+
+void ConnectionRecovery::ForgetExchange(const std::string &name) {
+  m_exchanges.erase(name);
+  m_bindings.erase(
+      std::remove_if(m_bindings.begin(), m_bindings.end(),
+                     [&name](const binding_t &binding) {
+                       return binding.source == name ||
+                              (binding.exchange_binding &&
+                               binding.destination == name);
+                     }),
+      m_bindings.end());
+}
+
+void ConnectionRecovery::RecordQueue(const std::string &name,
+                                     bool server_named, bool durable,
+                                     bool exclusive, bool auto_delete,
+                                     const FlatTable &arguments) {
+  queue_t &queue = m_queues[name];
+  queue.server_named = server_named;
+  queue.durable = durable;
+  queue.exclusive = exclusive;
+  queue.auto_delete = auto_delete;
+  queue.arguments = arguments;
+}
+
+void ConnectionRecovery::ForgetQueue(const std::string &name) {
+  m_queues.erase(name);
+  m_bindings.erase(
+      std::remove_if(m_bindings.begin(), m_bindings.end(),
+                     [&name](const binding_t &binding) {
+                       return !binding.exchange_binding &&
+                              binding.destination == name;
+                     }),
+      m_bindings.end());
+  for (consumer_map_t::iterator it = m_consumers.begin();
+       it != m_consumers.end();) {
+    if (it->second.queue == name) {
+      it = m_consumers.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ConnectionRecovery::RenameQueue(const std::string &name,
+                                     const std::string &new_name) {
+  queue_map_t::iterator it = m_queues.find(name);
+  if (m_queues.end() == it || name == new_name) {
+    return;
+  }
+  queue_t queue = it->second;
+  m_queues.erase(it);
+  m_queues[new_name] = queue;
+
+  for (binding_list_t::iterator binding = m_bindings.begin();
+       binding != m_bindings.end(); ++binding) {
+    if (!binding->exchange_binding && binding->destination == name) {
+      binding->destination = new_name;
+    }
+  }
+  for (consumer_map_t::iterator consumer = m_consumers.begin();
+       consumer != m_consumers.end(); ++consumer) {
+    if (consumer->second.queue == name) {
+      consumer->second.queue = new_name;
+    }
+  }
+}
+
+void ConnectionRecovery::RecordBinding(bool exchange_binding,
+                                       const std::string &destination,
+                                       const std::string &source,
+                                       const std::string &routing_key,
+                                       const FlatTable &arguments) {
+  ForgetBinding(exchange_binding, destination, source, routing_key,
+                arguments);
+  binding_t binding;
+  binding.exchange_binding = exchange_binding;
+  binding.destination = destination;
+  binding.source = source;
+  binding.routing_key = routing_key;
+  binding.arguments = arguments;
+  m_bindings.push_back(binding);
+}
+
+void ConnectionRecovery::ForgetBinding(bool exchange_binding,
+                                       const std::string &destination,
+                                       const std::string &source,
+                                       const std::string &routing_key,
+                                       const FlatTable &arguments) {
+  m_bindings.erase(
+      std::remove_if(m_bindings.begin(), m_bindings.end(),
+                     [&](const binding_t &binding) {
+                       return binding.exchange_binding == exchange_binding &&
+                              binding.destination == destination &&
+                              binding.source == source &&
+                              binding.routing_key == routing_key &&
+                              binding.arguments == arguments;
+                     }),
+      m_bindings.end());
+}
+
+void ConnectionRecovery::RecordConsumer(const std::string &consumer_tag,
+                                        const std::string &queue,
+                                        bool no_local, bool no_ack,
+                                        bool exclusive,
+                                        std::uint16_t prefetch_count,
+                                        const FlatTable &arguments) {
+  consumer_t &consumer = m_consumers[consumer_tag];
+  consumer.queue = queue;
+  consumer.no_local = no_local;
+  consumer.no_ack = no_ack;
+  consumer.exclusive = exclusive;
+  consumer.prefetch_count = prefetch_count;
+  consumer.prefetch_size = 0;
+  consumer.arguments = arguments;
+}
+
+void ConnectionRecovery::SetConsumerPrefetch(const std::string &consumer_tag,
+                                             std::uint16_t prefetch_count,
+                                             std::uint32_t prefetch_size) {
+  consumer_map_t::iterator it = m_consumers.find(consumer_tag);
+  if (m_consumers.end() != it) {
+    it->second.prefetch_count = prefetch_count;
+    it->second.prefetch_size = prefetch_size;
+  }
+}
+
+void ConnectionRecovery::ForgetConsumer(const std::string &consumer_tag) {
+  consumer_map_t::iterator it = m_consumers.find(consumer_tag);
+  if (m_consumers.end() == it) {
+    return;
+  }
+  const std::string queue = it->second.queue;
+  m_consumers.erase(it);
+
+  queue_map_t::const_iterator recorded = m_queues.find(queue);
+  if (m_queues.end() == recorded || !recorded->second.auto_delete) {
+    return;
+  }
+  for (it = m_consumers.begin(); it != m_consumers.end(); ++it) {
+    if (it->second.queue == queue) {
+      return;
+    }
+  }
+  ForgetQueue(queue);
+}
+
+bool ConnectionRecovery::BufferPublish(const std::string &exchange,
+                                       const std::string &routing_key,
+                                       const BasicMessage::ptr_t &message,
+                                       bool mandatory, bool immediate) {
+  if (m_publishes.size() >= m_opts.recovery_buffer_size) {
+    return false;
+  }
+  publish_t publish;
+  publish.exchange = exchange;
+  publish.routing_key = routing_key;
+  publish.message = message;
+  publish.mandatory = mandatory;
+  publish.immediate = immediate;
+  m_publishes.push_back(publish);
+  return true;
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
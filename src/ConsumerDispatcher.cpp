@@ -0,0 +1,107 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/ConsumerDispatcher.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+ConsumerDispatcher::ConsumerDispatcher(std::size_t threads) {
+  m_workers.reserve(threads);
+  try {
+    for (std::size_t i = 0; i < threads; ++i) {
+      m_workers.push_back(std::unique_ptr<worker_t>(new worker_t));
+      worker_t &worker = *m_workers.back();
+      worker.thread = std::thread([&worker]() { Run(worker); });
+    }
+  } catch (...) {
+    // The destructor does not run, and a joinable std::thread destroyed
+    // would call std::terminate
+    Stop();
+    throw;
+  }
+}
+
+ConsumerDispatcher::~ConsumerDispatcher() { Stop(); }
+
+void ConsumerDispatcher::Stop() {
+  for (std::vector<std::unique_ptr<worker_t> >::iterator it =
+           m_workers.begin();
+       it != m_workers.end(); ++it) {
+    std::lock_guard<std::mutex> lock((*it)->mutex);
+    (*it)->stopping = true;
+    (*it)->ready.notify_one();
+  }
+  for (std::vector<std::unique_ptr<worker_t> >::iterator it =
+           m_workers.begin();
+       it != m_workers.end(); ++it) {
+    if ((*it)->thread.joinable()) {
+      (*it)->thread.join();
+    }
+  }
+}
+
+void ConsumerDispatcher::Post(const handler_ptr_t &handler,
+                              const Envelope::ptr_t &envelope) {
+  const std::size_t shard =
+      std::hash<std::string>()(envelope->ConsumerTag()) % m_workers.size();
+  worker_t &worker = *m_workers[shard];
+  task_t task;
+  task.handler = handler;
+  task.envelope = envelope;
+
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  worker.tasks.push_back(task);
+  worker.ready.notify_one();
+}
+
+void ConsumerDispatcher::Run(worker_t &worker) {
+  std::unique_lock<std::mutex> lock(worker.mutex);
+  for (;;) {
+    worker.ready.wait(
+        lock, [&worker]() { return worker.stopping || !worker.tasks.empty(); });
+    if (worker.stopping) {
+      return;
+    }
+    task_t task = worker.tasks.front();
+    worker.tasks.pop_front();
+
+    lock.unlock();
+    try {
+      (*task.handler)(task.envelope);
+    } catch (...) {
+      // There is no caller to report to, the handler is expected to deal
+      // with its own errors
+    }
+    task = task_t();
+    lock.lock();
+  }
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
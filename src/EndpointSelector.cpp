@@ -0,0 +1,101 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include "SimpleAmqpClient/EndpointSelector.h"
+
+#include <algorithm>
+
+namespace AmqpClient {
+namespace Detail {
+
+const std::chrono::seconds EndpointSelector::FAILURE_PENALTY(5);
+
+EndpointSelector::EndpointSelector(const Channel::OpenOpts &opts) {
+  std::vector<endpoint_t> endpoints = opts.endpoints;
+  if (endpoints.empty()) {
+    endpoints.push_back(endpoint_t(opts.host, opts.port));
+  }
+  m_endpoints.resize(endpoints.size());
+  for (std::size_t i = 0; i < endpoints.size(); ++i) {
+    m_endpoints[i].endpoint = endpoints[i];
+    m_endpoints[i].handshake = std::chrono::microseconds::zero();
+  }
+}
+
+std::vector<std::size_t> EndpointSelector::Candidates(
+    std::chrono::steady_clock::time_point now) const {
+  std::vector<std::size_t> candidates(m_endpoints.size());
+  for (std::size_t i = 0; i < candidates.size(); ++i) {
+    candidates[i] = i;
+  }
+  // Stable, so that endpoints nothing is known about keep the order given
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [&](std::size_t a, std::size_t b) {
+                     const state_t &left = m_endpoints[a];
+                     const state_t &right = m_endpoints[b];
+                     // A broker that is down goes after every one that may
+                     // be up, however near it is
+                     if (Penalized(a, now) != Penalized(b, now)) {
+                       return Penalized(b, now);
+                     }
+                     if (left.endpoint.locality != right.endpoint.locality) {
+                       return left.endpoint.locality <
+                              right.endpoint.locality;
+                     }
+                     // Measured endpoints go before unmeasured ones
+                     if (left.handshake.count() == 0 ||
+                         right.handshake.count() == 0) {
+                       return right.handshake.count() == 0 &&
+                              left.handshake.count() != 0;
+                     }
+                     return left.handshake < right.handshake;
+                   });
+  return candidates;
+}
+
+bool EndpointSelector::SameTier(
+    std::size_t a, std::size_t b,
+    std::chrono::steady_clock::time_point now) const {
+  return m_endpoints[a].endpoint.locality == m_endpoints[b].endpoint.locality &&
+         Penalized(a, now) == Penalized(b, now);
+}
+
+void EndpointSelector::Succeeded(std::size_t index,
+                                 std::chrono::microseconds handshake) {
+  m_endpoints[index].handshake = handshake;
+  m_endpoints[index].failed_until = std::chrono::steady_clock::time_point();
+}
+
+void EndpointSelector::Failed(std::size_t index,
+                              std::chrono::steady_clock::time_point now) {
+  m_endpoints[index].failed_until = now + FAILURE_PENALTY;
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
@@ -28,20 +28,20 @@
 
 #include "SimpleAmqpClient/Envelope.h"
 
+#include <utility>
+
 namespace AmqpClient {
 
-Envelope::Envelope(const BasicMessage::ptr_t message,
-                   const std::string &consumer_tag,
-                   const std::uint64_t delivery_tag,
-                   const std::string &exchange, bool redelivered,
-                   const std::string &routing_key,
+Envelope::Envelope(BasicMessage::ptr_t message, std::string consumer_tag,
+                   const std::uint64_t delivery_tag, std::string exchange,
+                   bool redelivered, std::string routing_key,
                    const std::uint16_t delivery_channel)
-    : m_message(message),
-      m_consumerTag(consumer_tag),
+    : m_message(std::move(message)),
+      m_consumerTag(std::move(consumer_tag)),
       m_deliveryTag(delivery_tag),
-      m_exchange(exchange),
+      m_exchange(std::move(exchange)),
       m_redelivered(redelivered),
-      m_routingKey(routing_key),
+      m_routingKey(std::move(routing_key)),
       m_deliveryChannel(delivery_channel) {}
 
 Envelope::~Envelope() {}
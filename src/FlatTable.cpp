@@ -0,0 +1,478 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/FlatTable.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <variant>
+
+#include "SimpleAmqpClient/TableImpl.h"
+
+namespace AmqpClient {
+
+FlatTable::FlatTable() {}
+
+FlatTable::FlatTable(const Table &table) {
+  m_entries.reserve(table.size());
+  for (Table::const_iterator it = table.begin(); it != table.end(); ++it) {
+    field_t field = MakeField(it->second);
+    field.key = AppendBytes(it->first);
+    // Table is already sorted by key
+    m_entries.push_back(field);
+  }
+}
+
+Table FlatTable::ToTable() const {
+  Table table;
+  for (std::vector<field_t>::const_iterator it = m_entries.begin();
+       it != m_entries.end(); ++it) {
+    table.insert(table.end(),
+                 TableEntry(std::string(Bytes(it->key)), GetField(*it)));
+  }
+  return table;
+}
+
+void FlatTable::clear() {
+  m_entries.clear();
+  m_nested.clear();
+  m_bytes.clear();
+}
+
+void FlatTable::reserve(std::size_t entries, std::size_t bytes) {
+  m_entries.reserve(entries);
+  m_bytes.reserve(bytes);
+}
+
+bool FlatTable::Contains(std::string_view key) const {
+  return NULL != Find(key);
+}
+
+TableValue FlatTable::Get(std::string_view key) const {
+  const field_t *field = Find(key);
+  if (NULL == field) {
+    throw std::out_of_range("FlatTable::Get: no entry for key");
+  }
+  return GetField(*field);
+}
+
+std::optional<std::string_view> FlatTable::GetString(
+    std::string_view key) const {
+  const field_t *field = Find(key);
+  if (NULL == field || TableValue::VT_string != field->type) {
+    return std::nullopt;
+  }
+  return Bytes(field->value.range);
+}
+
+void FlatTable::SetVoid(std::string_view key) {
+  field_t field = {};
+  field.type = TableValue::VT_void;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, bool value) {
+  field_t field = {};
+  field.type = TableValue::VT_bool;
+  field.value.boolean = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, std::uint8_t value) {
+  field_t field = {};
+  field.type = TableValue::VT_uint8;
+  field.value.u8 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, std::int8_t value) {
+  field_t field = {};
+  field.type = TableValue::VT_int8;
+  field.value.i8 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, std::uint16_t value) {
+  field_t field = {};
+  field.type = TableValue::VT_uint16;
+  field.value.u16 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, std::int16_t value) {
+  field_t field = {};
+  field.type = TableValue::VT_int16;
+  field.value.i16 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, std::uint32_t value) {
+  field_t field = {};
+  field.type = TableValue::VT_uint32;
+  field.value.u32 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, std::int32_t value) {
+  field_t field = {};
+  field.type = TableValue::VT_int32;
+  field.value.i32 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, std::int64_t value) {
+  field_t field = {};
+  field.type = TableValue::VT_int64;
+  field.value.i64 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, float value) {
+  field_t field = {};
+  field.type = TableValue::VT_float;
+  field.value.f32 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, double value) {
+  field_t field = {};
+  field.type = TableValue::VT_double;
+  field.value.f64 = value;
+  Emplace(key, field);
+}
+
+void FlatTable::SetTimestamp(std::string_view key, std::time_t value) {
+  field_t field = {};
+  field.type = TableValue::VT_timestamp;
+  field.value.u64 = static_cast<std::uint64_t>(value);
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, std::string_view value) {
+  field_t field = {};
+  field.type = TableValue::VT_string;
+  field.value.range = AppendBytes(value);
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, const char *value) {
+  Set(key, std::string_view(value));
+}
+
+void FlatTable::Set(std::string_view key, const std::string &value) {
+  Set(key, std::string_view(value));
+}
+
+void FlatTable::Set(std::string_view key, const FlatTable &value) {
+  if (&value == this) {
+    Set(key, FlatTable(value));
+    return;
+  }
+  field_t field = {};
+  field.type = TableValue::VT_table;
+  field.value.range = AppendNested(value.m_entries.size());
+  for (std::size_t i = 0; i < value.m_entries.size(); ++i) {
+    field_t entry = CopyField(value, value.m_entries[i]);
+    entry.key = AppendBytes(value.Bytes(value.m_entries[i].key));
+    m_nested[field.value.range.first + i] = entry;
+  }
+  Emplace(key, field);
+}
+
+void FlatTable::Set(std::string_view key, const TableValue &value) {
+  Emplace(key, MakeField(value));
+}
+
+bool FlatTable::Erase(std::string_view key) {
+  std::vector<field_t>::const_iterator it = LowerBound(key);
+  if (m_entries.end() == it || Bytes(it->key) != key) {
+    return false;
+  }
+  m_entries.erase(it);
+  return true;
+}
+
+bool FlatTable::operator==(const FlatTable &other) const {
+  if (m_entries.size() != other.m_entries.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < m_entries.size(); ++i) {
+    if (Bytes(m_entries[i].key) != other.Bytes(other.m_entries[i].key) ||
+        !FieldEquals(m_entries[i], other, other.m_entries[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+FlatTable::range_t FlatTable::AppendBytes(std::string_view bytes) {
+  range_t range;
+  range.first = static_cast<std::uint32_t>(m_bytes.size());
+  range.count = static_cast<std::uint32_t>(bytes.size());
+  m_bytes.append(bytes.data(), bytes.size());
+  return range;
+}
+
+FlatTable::range_t FlatTable::AppendNested(std::size_t count) {
+  range_t range;
+  range.first = static_cast<std::uint32_t>(m_nested.size());
+  range.count = static_cast<std::uint32_t>(count);
+  m_nested.resize(m_nested.size() + count);
+  return range;
+}
+
+std::vector<FlatTable::field_t>::const_iterator FlatTable::LowerBound(
+    std::string_view key) const {
+  return std::lower_bound(m_entries.begin(), m_entries.end(), key,
+                          [this](const field_t &field, std::string_view key) {
+                            return Bytes(field.key) < key;
+                          });
+}
+
+const FlatTable::field_t *FlatTable::Find(std::string_view key) const {
+  std::vector<field_t>::const_iterator it = LowerBound(key);
+  if (m_entries.end() == it || Bytes(it->key) != key) {
+    return NULL;
+  }
+  return &*it;
+}
+
+void FlatTable::Emplace(std::string_view key, const field_t &field) {
+  std::vector<field_t>::const_iterator it = LowerBound(key);
+  if (m_entries.end() != it && Bytes(it->key) == key) {
+    field_t &existing = m_entries[it - m_entries.begin()];
+    const range_t existing_key = existing.key;
+    existing = field;
+    existing.key = existing_key;
+    return;
+  }
+  std::vector<field_t>::iterator pos =
+      m_entries.insert(m_entries.begin() + (it - m_entries.begin()), field);
+  pos->key = AppendBytes(key);
+}
+
+FlatTable::field_t FlatTable::MakeField(const TableValue &value) {
+  const Detail::value_t &v = Detail::TableValueImpl::GetValue(value);
+  field_t field = {};
+  field.type = value.GetType();
+  switch (field.type) {
+    case TableValue::VT_void:
+      break;
+    case TableValue::VT_bool:
+      field.value.boolean = std::get<bool>(v);
+      break;
+    case TableValue::VT_int8:
+      field.value.i8 = std::get<std::int8_t>(v);
+      break;
+    case TableValue::VT_int16:
+      field.value.i16 = std::get<std::int16_t>(v);
+      break;
+    case TableValue::VT_int32:
+      field.value.i32 = std::get<std::int32_t>(v);
+      break;
+    case TableValue::VT_int64:
+      field.value.i64 = std::get<std::int64_t>(v);
+      break;
+    case TableValue::VT_float:
+      field.value.f32 = std::get<float>(v);
+      break;
+    case TableValue::VT_double:
+      field.value.f64 = std::get<double>(v);
+      break;
+    case TableValue::VT_string:
+      field.value.range = AppendBytes(std::get<std::string>(v));
+      break;
+    case TableValue::VT_array: {
+      const Detail::array_t &array = std::get<Detail::array_t>(v);
+      field.value.range = AppendNested(array.size());
+      for (std::size_t i = 0; i < array.size(); ++i) {
+        field_t element = MakeField(array[i]);
+        m_nested[field.value.range.first + i] = element;
+      }
+      break;
+    }
+    case TableValue::VT_table: {
+      const Table &table = std::get<Table>(v);
+      field.value.range = AppendNested(table.size());
+      std::uint32_t i = field.value.range.first;
+      for (Table::const_iterator it = table.begin(); it != table.end();
+           ++it, ++i) {
+        field_t entry = MakeField(it->second);
+        entry.key = AppendBytes(it->first);
+        m_nested[i] = entry;
+      }
+      break;
+    }
+    case TableValue::VT_uint8:
+      field.value.u8 = std::get<std::uint8_t>(v);
+      break;
+    case TableValue::VT_uint16:
+      field.value.u16 = std::get<std::uint16_t>(v);
+      break;
+    case TableValue::VT_uint32:
+      field.value.u32 = std::get<std::uint32_t>(v);
+      break;
+    case TableValue::VT_timestamp:
+      field.value.u64 = std::get<std::uint64_t>(v);
+      break;
+  }
+  return field;
+}
+
+FlatTable::field_t FlatTable::CopyField(const FlatTable &other,
+                                        const field_t &field) {
+  field_t copy = field;
+  switch (field.type) {
+    case TableValue::VT_string:
+      copy.value.range = AppendBytes(other.Bytes(field.value.range));
+      break;
+    case TableValue::VT_array:
+    case TableValue::VT_table: {
+      const range_t range = field.value.range;
+      copy.value.range = AppendNested(range.count);
+      for (std::uint32_t i = 0; i < range.count; ++i) {
+        const field_t &child = other.m_nested[range.first + i];
+        field_t child_copy = CopyField(other, child);
+        if (TableValue::VT_table == field.type) {
+          child_copy.key = AppendBytes(other.Bytes(child.key));
+        }
+        m_nested[copy.value.range.first + i] = child_copy;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return copy;
+}
+
+TableValue FlatTable::GetField(const field_t &field) const {
+  switch (field.type) {
+    case TableValue::VT_void:
+      return TableValue();
+    case TableValue::VT_bool:
+      return TableValue(field.value.boolean);
+    case TableValue::VT_int8:
+      return TableValue(field.value.i8);
+    case TableValue::VT_int16:
+      return TableValue(field.value.i16);
+    case TableValue::VT_int32:
+      return TableValue(field.value.i32);
+    case TableValue::VT_int64:
+      return TableValue(field.value.i64);
+    case TableValue::VT_float:
+      return TableValue(field.value.f32);
+    case TableValue::VT_double:
+      return TableValue(field.value.f64);
+    case TableValue::VT_string:
+      return TableValue(std::string(Bytes(field.value.range)));
+    case TableValue::VT_array: {
+      Detail::array_t array;
+      array.reserve(field.value.range.count);
+      for (std::uint32_t i = 0; i < field.value.range.count; ++i) {
+        array.push_back(GetField(m_nested[field.value.range.first + i]));
+      }
+      return TableValue(array);
+    }
+    case TableValue::VT_table: {
+      Table table;
+      for (std::uint32_t i = 0; i < field.value.range.count; ++i) {
+        const field_t &entry = m_nested[field.value.range.first + i];
+        table.insert(
+            TableEntry(std::string(Bytes(entry.key)), GetField(entry)));
+      }
+      return TableValue(table);
+    }
+    case TableValue::VT_uint8:
+      return TableValue(field.value.u8);
+    case TableValue::VT_uint16:
+      return TableValue(field.value.u16);
+    case TableValue::VT_uint32:
+      return TableValue(field.value.u32);
+    case TableValue::VT_timestamp:
+      return TableValue::Timestamp(static_cast<std::time_t>(field.value.u64));
+  }
+  return TableValue();
+}
+
+bool FlatTable::FieldEquals(const field_t &field, const FlatTable &other,
+                            const field_t &other_field) const {
+  if (field.type != other_field.type) {
+    return false;
+  }
+  switch (field.type) {
+    case TableValue::VT_void:
+      return true;
+    case TableValue::VT_bool:
+      return field.value.boolean == other_field.value.boolean;
+    case TableValue::VT_int8:
+      return field.value.i8 == other_field.value.i8;
+    case TableValue::VT_int16:
+      return field.value.i16 == other_field.value.i16;
+    case TableValue::VT_int32:
+      return field.value.i32 == other_field.value.i32;
+    case TableValue::VT_int64:
+      return field.value.i64 == other_field.value.i64;
+    case TableValue::VT_float:
+      return field.value.f32 == other_field.value.f32;
+    case TableValue::VT_double:
+      return field.value.f64 == other_field.value.f64;
+    case TableValue::VT_string:
+      return Bytes(field.value.range) == other.Bytes(other_field.value.range);
+    case TableValue::VT_array:
+    case TableValue::VT_table: {
+      const range_t &range = field.value.range;
+      const range_t &other_range = other_field.value.range;
+      if (range.count != other_range.count) {
+        return false;
+      }
+      // Nested tables are kept sorted by key too, so entries line up
+      for (std::uint32_t i = 0; i < range.count; ++i) {
+        const field_t &child = m_nested[range.first + i];
+        const field_t &other_child = other.m_nested[other_range.first + i];
+        if ((TableValue::VT_table == field.type &&
+             Bytes(child.key) != other.Bytes(other_child.key)) ||
+            !FieldEquals(child, other, other_child)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case TableValue::VT_uint8:
+      return field.value.u8 == other_field.value.u8;
+    case TableValue::VT_uint16:
+      return field.value.u16 == other_field.value.u16;
+    case TableValue::VT_uint32:
+      return field.value.u32 == other_field.value.u32;
+    case TableValue::VT_timestamp:
+      return field.value.u64 == other_field.value.u64;
+  }
+  return false;
+}
+
+}  // namespace AmqpClient
@@ -0,0 +1,163 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include "SimpleAmqpClient/MessagePool.h"
+
+#include <new>
+
+namespace AmqpClient {
+namespace Detail {
+
+MessagePool::~MessagePool() {
+  for (std::vector<BasicMessage *>::iterator it = m_idle_messages.begin();
+       it != m_idle_messages.end(); ++it) {
+    delete *it;
+  }
+  for (std::vector<Envelope *>::iterator it = m_idle_envelopes.begin();
+       it != m_idle_envelopes.end(); ++it) {
+    delete *it;
+  }
+  for (block_map_t::iterator it = m_idle_blocks.begin();
+       it != m_idle_blocks.end(); ++it) {
+    for (std::vector<void *>::iterator block = it->second.begin();
+         block != it->second.end(); ++block) {
+      ::operator delete(*block);
+    }
+  }
+}
+
+BasicMessage::ptr_t MessagePool::AcquireMessage() {
+  BasicMessage *message = NULL;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_idle_messages.empty()) {
+      message = m_idle_messages.back();
+      m_idle_messages.pop_back();
+    }
+  }
+  if (NULL == message) {
+    message = new BasicMessage();
+  }
+  MessageDeleter deleter = {this};
+  return BasicMessage::ptr_t(
+      message, deleter,
+      MessagePoolAllocator<BasicMessage>(shared_from_this()));
+}
+
+Envelope::ptr_t MessagePool::AcquireEnvelope() {
+  Envelope *envelope = NULL;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_idle_envelopes.empty()) {
+      envelope = m_idle_envelopes.back();
+      m_idle_envelopes.pop_back();
+    }
+  }
+  if (NULL == envelope) {
+    envelope = new Envelope(BasicMessage::ptr_t(), std::string(), 0,
+                            std::string(), false, std::string(), 0);
+  }
+  EnvelopeDeleter deleter = {this};
+  return Envelope::ptr_t(envelope, deleter,
+                         MessagePoolAllocator<Envelope>(shared_from_this()));
+}
+
+void MessagePool::SetDeliveryInfo(Envelope &envelope,
+                                  const amqp_bytes_t &consumer_tag,
+                                  std::uint64_t delivery_tag,
+                                  const amqp_bytes_t &exchange,
+                                  bool redelivered,
+                                  const amqp_bytes_t &routing_key,
+                                  std::uint16_t delivery_channel) {
+  envelope.m_consumerTag.assign(static_cast<char *>(consumer_tag.bytes),
+                                consumer_tag.len);
+  envelope.m_deliveryTag = delivery_tag;
+  envelope.m_exchange.assign(static_cast<char *>(exchange.bytes),
+                             exchange.len);
+  envelope.m_redelivered = redelivered;
+  envelope.m_routingKey.assign(static_cast<char *>(routing_key.bytes),
+                               routing_key.len);
+  envelope.m_deliveryChannel = delivery_channel;
+}
+
+void *MessagePool::AllocateBlock(std::size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    block_map_t::iterator it = m_idle_blocks.find(size);
+    if (m_idle_blocks.end() != it && !it->second.empty()) {
+      void *block = it->second.back();
+      it->second.pop_back();
+      return block;
+    }
+  }
+  return ::operator new(size);
+}
+
+void MessagePool::DeallocateBlock(void *block, std::size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<void *> &idle = m_idle_blocks[size];
+    if (idle.size() < 2 * m_max_idle) {
+      idle.push_back(block);
+      return;
+    }
+  }
+  ::operator delete(block);
+}
+
+void MessagePool::ReleaseMessage(BasicMessage *message) {
+  // Clearing leaves the strings' buffers in place for the next delivery
+  message->Reset();
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle_messages.size() < m_max_idle) {
+      m_idle_messages.push_back(message);
+      return;
+    }
+  }
+  delete message;
+}
+
+void MessagePool::ReleaseEnvelope(Envelope *envelope) {
+  // Done outside of the lock, it may hand the message back to this pool
+  envelope->m_message.reset();
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle_envelopes.size() < m_max_idle) {
+      m_idle_envelopes.push_back(envelope);
+      return;
+    }
+  }
+  delete envelope;
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
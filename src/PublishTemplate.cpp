@@ -0,0 +1,119 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/PublishTemplate.h"
+
+#include "SimpleAmqpClient/Bytes.h"
+#include "SimpleAmqpClient/PublishTemplateImpl.h"
+
+namespace AmqpClient {
+
+namespace {
+
+struct string_property_t {
+  amqp_flags_t flag;
+  amqp_bytes_t amqp_basic_properties_t::*field;
+};
+
+const string_property_t STRING_PROPERTIES[] = {
+    {AMQP_BASIC_CONTENT_TYPE_FLAG, &amqp_basic_properties_t::content_type},
+    {AMQP_BASIC_CONTENT_ENCODING_FLAG,
+     &amqp_basic_properties_t::content_encoding},
+    {AMQP_BASIC_CORRELATION_ID_FLAG, &amqp_basic_properties_t::correlation_id},
+    {AMQP_BASIC_REPLY_TO_FLAG, &amqp_basic_properties_t::reply_to},
+    {AMQP_BASIC_EXPIRATION_FLAG, &amqp_basic_properties_t::expiration},
+    {AMQP_BASIC_MESSAGE_ID_FLAG, &amqp_basic_properties_t::message_id},
+    {AMQP_BASIC_TYPE_FLAG, &amqp_basic_properties_t::type},
+    {AMQP_BASIC_USER_ID_FLAG, &amqp_basic_properties_t::user_id},
+    {AMQP_BASIC_APP_ID_FLAG, &amqp_basic_properties_t::app_id},
+    {AMQP_BASIC_CLUSTER_ID_FLAG, &amqp_basic_properties_t::cluster_id}};
+
+}  // namespace
+
+PublishTemplate::PublishTemplate() : m_impl(new Impl) {}
+
+PublishTemplate::~PublishTemplate() {}
+
+PublishTemplate::ptr_t PublishTemplate::Create(const std::string &exchange_name,
+                                               const std::string &routing_key,
+                                               const BasicMessage &properties,
+                                               bool mandatory, bool immediate) {
+  ptr_t publish(new PublishTemplate);
+  Impl &impl = *publish->m_impl;
+  impl.exchange_name = exchange_name;
+  impl.routing_key = routing_key;
+  impl.mandatory = mandatory;
+  impl.immediate = immediate;
+
+  impl.properties = Detail::CreateAmqpProperties(properties, impl.headers_pool);
+  // The header table was copied into headers_pool, the strings still point
+  // into the caller's message
+  for (std::size_t i = 0;
+       i < sizeof(STRING_PROPERTIES) / sizeof(STRING_PROPERTIES[0]); ++i) {
+    const string_property_t &property = STRING_PROPERTIES[i];
+    if (0 != (impl.properties._flags & property.flag)) {
+      amqp_bytes_t &bytes = impl.properties.*property.field;
+      impl.strings.push_back(
+          std::string(static_cast<const char *>(bytes.bytes), bytes.len));
+      bytes = StringToBytes(impl.strings.back());
+    }
+  }
+  return publish;
+}
+
+const std::string &PublishTemplate::ExchangeName() const {
+  return m_impl->exchange_name;
+}
+
+const std::string &PublishTemplate::RoutingKey() const {
+  return m_impl->routing_key;
+}
+
+bool PublishTemplate::Mandatory() const { return m_impl->mandatory; }
+
+bool PublishTemplate::Immediate() const { return m_impl->immediate; }
+
+amqp_basic_properties_t PublishTemplate::Impl::Properties(
+    const Overrides &overrides) const {
+  amqp_basic_properties_t ret = properties;
+  if (overrides.message_id) {
+    ret.message_id = StringRefToBytes(*overrides.message_id);
+    ret._flags |= AMQP_BASIC_MESSAGE_ID_FLAG;
+  }
+  if (overrides.correlation_id) {
+    ret.correlation_id = StringRefToBytes(*overrides.correlation_id);
+    ret._flags |= AMQP_BASIC_CORRELATION_ID_FLAG;
+  }
+  if (overrides.timestamp) {
+    ret.timestamp = *overrides.timestamp;
+    ret._flags |= AMQP_BASIC_TIMESTAMP_FLAG;
+  }
+  return ret;
+}
+
+}  // namespace AmqpClient
@@ -0,0 +1,492 @@
+#ifndef SIMPLEAMQPCLIENT_ASYNCCHANNEL_H
+#define SIMPLEAMQPCLIENT_ASYNCCHANNEL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/// @file SimpleAmqpClient/AsyncChannel.h
+/// The AmqpClient::AsyncChannel class is defined in this header file. It
+/// requires C++20 coroutines and is empty when compiled without them; the
+/// library itself does not need to be built as C++20 to use it.
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/ConsumerCancelledException.h"
+#include "SimpleAmqpClient/Envelope.h"
+
+namespace AmqpClient {
+
+/**
+ * Awaitable publish, consume and RPC calls on a Channel
+ *
+ * Lets C++20 coroutines wait on the broker without a thread each:
+ * `co_await async.AsyncPublish(...)` suspends the coroutine until the broker
+ * confirms the message, `co_await async.AsyncConsume(tag)` until a message
+ * is delivered to the consumer and `co_await async.AsyncRpc(...)` until the
+ * reply to a request arrives. Any number of operations can be waiting on the
+ * one connection. The awaitables work with any coroutine type.
+ *
+ * Operations complete, and their coroutines are resumed, inside Poll(),
+ * which is meant to be called from an event loop whenever
+ * Channel::GetSocketFD() polls readable, or writable while
+ * Channel::WantsWrite(), see Channel::OnReadable().
+ *
+ * The AsyncChannel takes over the Channel's publish confirm and RPC reply
+ * callbacks; publishes and requests made on the Channel directly should be
+ * waited for as usual. It is not thread safe: start operations and call
+ * Poll() from one thread. Coroutines still waiting when the AsyncChannel is
+ * destroyed are never resumed.
+ */
+class AsyncChannel {
+ public:
+  /// Suspended coroutine of an operation, and the error to resume it with
+  class Operation {
+   protected:
+    Operation() {}
+    void RethrowIfFailed() const {
+      if (m_error) {
+        std::rethrow_exception(m_error);
+      }
+    }
+
+    std::coroutine_handle<> m_handle;
+    std::exception_ptr m_error;
+
+   private:
+    friend class AsyncChannel;
+  };
+
+  /// What AsyncPublish() returns, `co_await` gives the PublishConfirm
+  class PublishOp : public Operation {
+   public:
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      m_handle = handle;
+      // Publishing into a full window would block until the broker confirms,
+      // so the message waits its turn for Poll() instead
+      if (!m_owner.m_waiting_publishes.empty() || !m_owner.HasPublishRoom()) {
+        m_owner.m_waiting_publishes.push_back(this);
+        return;
+      }
+      m_owner.Publish(this);
+    }
+    Channel::PublishConfirm await_resume() const {
+      RethrowIfFailed();
+      return m_confirm;
+    }
+
+   private:
+    friend class AsyncChannel;
+    PublishOp(AsyncChannel &owner, const std::string &exchange_name,
+              const std::string &routing_key,
+              const BasicMessage::ptr_t &message, bool mandatory,
+              bool immediate)
+        : m_owner(owner),
+          m_exchange(exchange_name),
+          m_routing_key(routing_key),
+          m_message(message),
+          m_mandatory(mandatory),
+          m_immediate(immediate) {}
+
+    AsyncChannel &m_owner;
+    std::string m_exchange;
+    std::string m_routing_key;
+    BasicMessage::ptr_t m_message;
+    bool m_mandatory;
+    bool m_immediate;
+    Channel::PublishConfirm m_confirm;
+  };
+
+  /// What AsyncConsume() returns, `co_await` gives the delivered message
+  class ConsumeOp : public Operation {
+   public:
+    bool await_ready() {
+      // Earlier waiters get the consumer's messages first
+      if (m_owner.m_consumes.count(m_consumer_tag) > 0) {
+        return false;
+      }
+      m_result = m_owner.m_channel->TryBasicConsumeMessage(m_consumer_tag, 0);
+      return Channel::ConsumeResult::cr_timeout != m_result.status;
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+      m_handle = handle;
+      m_owner.m_consumes[m_consumer_tag].push_back(this);
+    }
+    /// @throws ConsumerCancelledException if the broker cancelled the
+    /// consumer
+    Envelope::ptr_t await_resume() const {
+      RethrowIfFailed();
+      if (Channel::ConsumeResult::cr_cancelled == m_result.status) {
+        throw ConsumerCancelledException(m_consumer_tag);
+      }
+      return m_result.envelope;
+    }
+
+   private:
+    friend class AsyncChannel;
+    ConsumeOp(AsyncChannel &owner, const std::string &consumer_tag)
+        : m_owner(owner), m_consumer_tag(consumer_tag) {}
+
+    AsyncChannel &m_owner;
+    std::string m_consumer_tag;
+    Channel::ConsumeResult m_result;
+  };
+
+  /// What AsyncRpc() returns, `co_await` gives the reply
+  class RpcOp : public Operation {
+   public:
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      m_handle = handle;
+      m_owner.m_rpcs[m_owner.m_channel->RpcSend(m_exchange, m_routing_key,
+                                                m_request)] = this;
+    }
+    BasicMessage::ptr_t await_resume() const {
+      RethrowIfFailed();
+      return m_reply;
+    }
+
+   private:
+    friend class AsyncChannel;
+    RpcOp(AsyncChannel &owner, const std::string &exchange_name,
+          const std::string &routing_key, const BasicMessage::ptr_t &request)
+        : m_owner(owner),
+          m_exchange(exchange_name),
+          m_routing_key(routing_key),
+          m_request(request) {}
+
+    AsyncChannel &m_owner;
+    std::string m_exchange;
+    std::string m_routing_key;
+    BasicMessage::ptr_t m_request;
+    BasicMessage::ptr_t m_reply;
+  };
+
+  /**
+   * Wraps a Channel, replacing its publish confirm and RPC reply callbacks
+   */
+  explicit AsyncChannel(const Channel::ptr_t &channel) : m_channel(channel) {
+    m_channel->SetPublishConfirmCallback(
+        [this](const Channel::PublishConfirm &confirm) {
+          publish_map_t::iterator it =
+              m_publishes.find(confirm.sequence_number);
+          if (m_publishes.end() == it) {
+            return;
+          }
+          if (Channel::PublishConfirm::pc_lost == confirm.status) {
+            Fail(it->second, confirm.error);
+          } else {
+            it->second->m_confirm = confirm;
+            m_ready.push_back(it->second);
+          }
+          m_publishes.erase(it);
+        });
+    m_channel->SetRpcReplyCallback([this](const std::string &correlation_id,
+                                          const BasicMessage::ptr_t &reply) {
+      rpc_map_t::iterator it = m_rpcs.find(correlation_id);
+      if (m_rpcs.end() != it) {
+        it->second->m_reply = reply;
+        m_ready.push_back(it->second);
+        m_rpcs.erase(it);
+      }
+    });
+  }
+
+  // Non-copyable, operations refer back to their AsyncChannel
+  AsyncChannel(const AsyncChannel &) = delete;
+  AsyncChannel &operator=(const AsyncChannel &) = delete;
+
+  ~AsyncChannel() {
+    m_channel->SetPublishConfirmCallback(Channel::confirm_callback_t());
+    m_channel->SetRpcReplyCallback(Channel::rpc_reply_callback_t());
+  }
+
+  /// The Channel operations are made on
+  const Channel::ptr_t &GetChannel() const { return m_channel; }
+
+  /**
+   * Publishes a message and waits for the broker to confirm it
+   *
+   * The message is published with Channel::BasicPublishAsync() once the
+   * coroutine awaits the result. Should the publisher confirm window be
+   * full, the coroutine is suspended without publishing, and Poll()
+   * publishes the message once the broker's confirms make room. Messages are
+   * published in the order they were awaited. The arguments are copied.
+   */
+  PublishOp AsyncPublish(const std::string &exchange_name,
+                         const std::string &routing_key,
+                         const BasicMessage::ptr_t &message,
+                         bool mandatory = false, bool immediate = false) {
+    return PublishOp(*this, exchange_name, routing_key, message, mandatory,
+                     immediate);
+  }
+
+  /**
+   * Waits for a message delivered to a consumer started with
+   * Channel::BasicConsume()
+   *
+   * Several coroutines may wait on the same consumer, they are handed its
+   * messages in the order they started waiting.
+   */
+  ConsumeOp AsyncConsume(const std::string &consumer_tag) {
+    return ConsumeOp(*this, consumer_tag);
+  }
+
+  /**
+   * Sends a request through direct reply-to and waits for its reply
+   *
+   * See Channel::RpcSend(). The request is sent once the coroutine awaits
+   * the result. The arguments are copied.
+   */
+  RpcOp AsyncRpc(const std::string &exchange_name,
+                 const std::string &routing_key,
+                 const BasicMessage::ptr_t &request) {
+    return RpcOp(*this, exchange_name, routing_key, request);
+  }
+
+  /**
+   * Does whatever I/O is possible without blocking and resumes the
+   * coroutines whose operations have completed
+   *
+   * An operation that fails, for instance because its channel was closed by
+   * the broker, resumes its coroutine with the exception. Should the
+   * connection fail, every waiting coroutine is resumed with the exception,
+   * which is then rethrown from here.
+   *
+   * @returns the number of coroutines resumed
+   */
+  std::size_t Poll() {
+    try {
+      if (m_channel->WantsWrite()) {
+        m_channel->OnWritable();
+      }
+      if (m_channel->WantsRead()) {
+        m_channel->OnReadable();
+      }
+    } catch (...) {
+      FailAll(std::current_exception());
+      Resume();
+      throw;
+    }
+    PollPublishes();
+    PollConsumes();
+    PollRpcs();
+    return Resume();
+  }
+
+  /// The number of operations whose coroutines are waiting to be resumed
+  std::size_t Pending() const {
+    std::size_t pending = m_publishes.size() + m_waiting_publishes.size() +
+                          m_rpcs.size() + m_ready.size();
+    for (consume_map_t::const_iterator it = m_consumes.begin();
+         it != m_consumes.end(); ++it) {
+      pending += it->second.size();
+    }
+    return pending;
+  }
+
+ private:
+  typedef std::unordered_map<std::uint64_t, PublishOp *> publish_map_t;
+  typedef std::map<std::string, std::deque<ConsumeOp *> > consume_map_t;
+  typedef std::unordered_map<std::string, RpcOp *> rpc_map_t;
+
+  template <class OpType>
+  void Fail(OpType *op, const std::exception_ptr &error) {
+    op->m_error = error;
+    m_ready.push_back(op);
+  }
+
+  void FailAll(const std::exception_ptr &error) {
+    for (publish_map_t::iterator it = m_publishes.begin();
+         it != m_publishes.end(); ++it) {
+      Fail(it->second, error);
+    }
+    m_publishes.clear();
+    for (std::size_t i = 0; i < m_waiting_publishes.size(); ++i) {
+      Fail(m_waiting_publishes[i], error);
+    }
+    m_waiting_publishes.clear();
+    for (consume_map_t::iterator it = m_consumes.begin();
+         it != m_consumes.end(); ++it) {
+      for (std::size_t i = 0; i < it->second.size(); ++i) {
+        Fail(it->second[i], error);
+      }
+    }
+    m_consumes.clear();
+    for (rpc_map_t::iterator it = m_rpcs.begin(); it != m_rpcs.end(); ++it) {
+      Fail(it->second, error);
+    }
+    m_rpcs.clear();
+  }
+
+  bool HasPublishRoom() const {
+    return m_channel->UnconfirmedPublishCount() <
+           m_channel->GetPublishConfirmWindow();
+  }
+
+  void Publish(PublishOp *op) {
+    std::uint64_t sequence_number = m_channel->BasicPublishAsync(
+        op->m_exchange, op->m_routing_key, op->m_message, op->m_mandatory,
+        op->m_immediate);
+    m_publishes[sequence_number] = op;
+  }
+
+  // Confirms, and publishes lost with their channel, come in through the
+  // callback; this publishes the messages waiting for room in the window
+  void PollPublishes() {
+    while (!m_waiting_publishes.empty() && HasPublishRoom()) {
+      PublishOp *op = m_waiting_publishes.front();
+      m_waiting_publishes.pop_front();
+      try {
+        Publish(op);
+      } catch (...) {
+        Fail(op, std::current_exception());
+      }
+    }
+    if (m_publishes.empty()) {
+      return;
+    }
+    std::exception_ptr error;
+    try {
+      // Sends on messages held back while the connection was blocked
+      m_channel->WaitForConfirms(0);
+      return;
+    } catch (...) {
+      error = std::current_exception();
+    }
+    for (publish_map_t::iterator it = m_publishes.begin();
+         it != m_publishes.end(); ++it) {
+      Fail(it->second, error);
+    }
+    m_publishes.clear();
+  }
+
+  void PollConsumes() {
+    for (consume_map_t::iterator it = m_consumes.begin();
+         it != m_consumes.end();) {
+      std::deque<ConsumeOp *> &waiters = it->second;
+      try {
+        while (!waiters.empty()) {
+          Channel::ConsumeResult result =
+              m_channel->TryBasicConsumeMessage(it->first, 0);
+          if (Channel::ConsumeResult::cr_timeout == result.status) {
+            break;
+          }
+          if (Channel::ConsumeResult::cr_cancelled == result.status) {
+            // Nothing more will be delivered to any of them
+            for (std::size_t i = 0; i < waiters.size(); ++i) {
+              waiters[i]->m_result = result;
+              m_ready.push_back(waiters[i]);
+            }
+            waiters.clear();
+            break;
+          }
+          waiters.front()->m_result = result;
+          m_ready.push_back(waiters.front());
+          waiters.pop_front();
+        }
+      } catch (...) {
+        for (std::size_t i = 0; i < waiters.size(); ++i) {
+          Fail(waiters[i], std::current_exception());
+        }
+        waiters.clear();
+      }
+      if (waiters.empty()) {
+        it = m_consumes.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // Replies come in through the callback, this only notices the reply
+  // channel closing and taking the waiting calls with it
+  void PollRpcs() {
+    if (m_rpcs.empty()) {
+      return;
+    }
+    try {
+      // With the callback in place the reply is never kept, but should it
+      // have been, it is handed over here instead
+      rpc_map_t::iterator first = m_rpcs.begin();
+      if (m_channel->RpcWaitForReply(first->first, first->second->m_reply,
+                                     0)) {
+        m_ready.push_back(first->second);
+        m_rpcs.erase(first);
+      }
+      return;
+    } catch (...) {
+      std::exception_ptr error = std::current_exception();
+      for (rpc_map_t::iterator it = m_rpcs.begin(); it != m_rpcs.end();
+           ++it) {
+        Fail(it->second, error);
+      }
+      m_rpcs.clear();
+    }
+  }
+
+  // Resumed coroutines may complete more operations before suspending again
+  std::size_t Resume() {
+    std::size_t count = 0;
+    while (!m_ready.empty()) {
+      std::vector<Operation *> ready;
+      ready.swap(m_ready);
+      for (std::size_t i = 0; i < ready.size(); ++i) {
+        ++count;
+        ready[i]->m_handle.resume();
+      }
+    }
+    return count;
+  }
+
+  Channel::ptr_t m_channel;
+  publish_map_t m_publishes;
+  // Publishes held back until the confirm window has room
+  std::deque<PublishOp *> m_waiting_publishes;
+  consume_map_t m_consumes;
+  rpc_map_t m_rpcs;
+  // Completed operations whose coroutines are yet to be resumed
+  std::vector<Operation *> m_ready;
+};
+
+}  // namespace AmqpClient
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // SIMPLEAMQPCLIENT_ASYNCCHANNEL_H
@@ -28,10 +28,13 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <utility>
 
+#include "SimpleAmqpClient/FlatTable.h"
 #include "SimpleAmqpClient/Table.h"
 #include "SimpleAmqpClient/Util.h"
 
@@ -45,8 +48,19 @@
 
 namespace AmqpClient {
 
+namespace Detail {
+class MessagePool;
+class TableValueImpl;
+}
+
 /**
  * An AMQP BasicMessage
+ *
+ * The properties of a message received from the broker are decoded the first
+ * time one of them is read, and the header table only once HeaderTable() is
+ * called. That decoding is serialized internally, so several threads may read
+ * the same message at once; modifying a message while another thread reads it
+ * is not safe.
  */
 class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
  public:
@@ -74,11 +88,17 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
   static ptr_t Create(const std::string& body) {
     return std::make_shared<BasicMessage>(body);
   }
+  /// \overload that moves from body
+  static ptr_t Create(std::string&& body) {
+    return std::make_shared<BasicMessage>(std::move(body));
+  }
 
   /// Construct empty BasicMessage
   BasicMessage();
   /// Construct BasicMessage with given body
   BasicMessage(const std::string& body);
+  /// Construct BasicMessage with given body, moved from
+  BasicMessage(std::string&& body);
 
  public:
   // Non-copyable
@@ -100,6 +120,17 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the message body as a std::string
    */
   void Body(const std::string& body);
+  /// \overload that moves from body
+  void Body(std::string&& body);
+
+  /**
+   * Moves the body out of the message, leaving it empty
+   *
+   * Hands over a consumed message's body without copying it. A pooled
+   * message (see OpenOpts::message_pool_size) gives up its body's storage
+   * along with it.
+   */
+  std::string ReleaseBody();
 
   /**
    * Gets the content type property
@@ -109,6 +140,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the content type property
    */
   void ContentType(const std::string& content_type);
+  /// \overload that moves from content_type
+  void ContentType(std::string&& content_type);
   /**
    * Determines whether the content type property is set
    */
@@ -126,6 +159,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the content encoding property
    */
   void ContentEncoding(const std::string& content_encoding);
+  /// \overload that moves from content_encoding
+  void ContentEncoding(std::string&& content_encoding);
   /**
    * Determines whether the content encoding property is set
    */
@@ -177,6 +212,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the correlation id property
    */
   void CorrelationId(const std::string& correlation_id);
+  /// \overload that moves from correlation_id
+  void CorrelationId(std::string&& correlation_id);
   /**
    * Determines whether the correlation id property is set
    */
@@ -194,6 +231,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the reply to property
    */
   void ReplyTo(const std::string& reply_to);
+  /// \overload that moves from reply_to
+  void ReplyTo(std::string&& reply_to);
   /**
    * Determines whether the reply to property is set
    */
@@ -211,6 +250,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the expiration property
    */
   void Expiration(const std::string& expiration);
+  /// \overload that moves from expiration
+  void Expiration(std::string&& expiration);
   /**
    * Determines whether the expiration property is set
    */
@@ -228,6 +269,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the message id property
    */
   void MessageId(const std::string& message_id);
+  /// \overload that moves from message_id
+  void MessageId(std::string&& message_id);
   /**
    * Determines if the message id property is set
    */
@@ -262,6 +305,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the type property
    */
   void Type(const std::string& type);
+  /// \overload that moves from type
+  void Type(std::string&& type);
   /**
    * Determines whether the type property is set
    */
@@ -279,6 +324,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the user id property
    */
   void UserId(const std::string& user_id);
+  /// \overload that moves from user_id
+  void UserId(std::string&& user_id);
   /**
    * Determines whether the user id property is set
    */
@@ -296,6 +343,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the app id property
    */
   void AppId(const std::string& app_id);
+  /// \overload that moves from app_id
+  void AppId(std::string&& app_id);
   /**
    * Determines whether the app id property is set
    */
@@ -313,6 +362,8 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the custer id property
    */
   void ClusterId(const std::string& cluster_id);
+  /// \overload that moves from cluster_id
+  void ClusterId(std::string&& cluster_id);
   /**
    * Determines if the cluster id property is set
    */
@@ -331,6 +382,19 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    * Sets the header table property
    */
   void HeaderTable(const Table& header_table);
+  /**
+   * Sets the header table property from a FlatTable
+   *
+   * The headers are kept in this form, and encoded straight from it when the
+   * message is published, unless HeaderTable() is later asked for a Table.
+   */
+  void HeaderTable(const FlatTable& header_table);
+  /**
+   * Gets the header table property as a FlatTable
+   *
+   * For a received message this is built straight from the encoded headers.
+   */
+  FlatTable HeaderFlatTable() const;
   /**
    * Is there a header table associated with the message
    */
@@ -340,10 +404,33 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage {
    */
   void HeaderTableClear();
 
+  /**
+   * Looks up a single entry in the header table
+   *
+   * For a received message this searches the encoded headers directly,
+   * without building the whole header table or decoding the other
+   * properties, see Channel::BasicRelay().
+   *
+   * @param key the header to look for
+   * @param value set to the header's value if it is present
+   * @returns `true` if the header is present, `false` otherwise
+   */
+  bool FindHeader(const std::string& key, TableValue& value) const;
+
  protected:
   struct Impl;
   /// PIMPL idiom
   std::unique_ptr<Impl> m_impl;
+
+ private:
+  friend class Channel;
+  friend class Detail::MessagePool;
+  friend class Detail::TableValueImpl;
+
+  // Stores the properties exactly as received in a content header frame
+  void SetEncodedProperties(const void* data, std::size_t len);
+  // Clears the body and all properties, keeping allocated storage
+  void Reset();
 };
 
 }  // namespace AmqpClient
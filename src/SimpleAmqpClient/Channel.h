@@ -28,16 +28,26 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 #include <variant>
 #include <optional>
 
 #include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Codec.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/FlatTable.h"
+#include "SimpleAmqpClient/PublishTemplate.h"
 #include "SimpleAmqpClient/Table.h"
 #include "SimpleAmqpClient/Util.h"
 
@@ -51,6 +61,12 @@
 
 namespace AmqpClient {
 
+class ChannelPool;
+
+namespace Detail {
+class EndpointSelector;
+}
+
 /**
  * A single channel multiplexed in an AMQP connection
  *
@@ -96,19 +112,173 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
       std::string ca_cert_path;      ///< Path to CA cert.
       bool verify_hostname;  ///< Verify host matches certificate. Default: true
       bool verify_peer;      ///< Verify presented certificate. Default: true
-
-      TLSParams() : verify_hostname(true), verify_peer(true) {}
+      /// OpenSSL cipher list for TLS 1.2 and below, e.g.
+      /// "ECDHE-ECDSA-AES128-GCM-SHA256". Default empty, OpenSSL's choice.
+      std::string cipher_list;
+      /// Key exchange groups in order of preference, e.g. "X25519:P-256".
+      /// Default empty, OpenSSL's choice.
+      std::string groups;
+      /// Keep the TLS session of each broker connected to and resume it the
+      /// next time any Channel in the process connects to that broker with
+      /// the same certificates and verification settings, which costs both
+      /// sides far less than a full handshake. Default false.
+      bool resume_sessions;
+
+      TLSParams()
+          : verify_hostname(true), verify_peer(true), resume_sessions(false) {}
       bool operator==(const TLSParams &) const;
     };
 
-    std::string host;   ///< Broker hostname. Required.
+    /// Options set on the socket before it connects. With TLS, and on
+    /// Windows, they are set once the TCP connection is made, before the
+    /// AMQP handshake.
+    struct SIMPLEAMQPCLIENT_EXPORT SocketOptions {
+      /// Send small frames straight away rather than waiting to coalesce
+      /// them (TCP_NODELAY). Default true, as rabbitmq-c sets it.
+      bool tcp_nodelay;
+      /// SO_SNDBUF in bytes. Default 0, the system's.
+      int send_buffer_size;
+      /// SO_RCVBUF in bytes. The TCP window is scaled for the buffer when
+      /// connecting, so where the option is set after connecting a larger
+      /// buffer only helps as far as the system's default maximum (e.g.
+      /// net.ipv4.tcp_rmem). Default 0, the system's.
+      int receive_buffer_size;
+      /// SO_BUSY_POLL in microseconds to spin on the device queue when
+      /// reading, where the system supports it. Default 0, none.
+      int busy_poll;
+
+      SocketOptions()
+          : tcp_nodelay(true),
+            send_buffer_size(0),
+            receive_buffer_size(0),
+            busy_poll(0) {}
+      bool operator==(const SocketOptions &) const;
+    };
+
+    /// A broker to connect to, see endpoints
+    struct SIMPLEAMQPCLIENT_EXPORT Endpoint {
+      std::string host;  ///< Broker hostname.
+      int port;          ///< Port to connect to, default is 5672.
+      /// Lower is tried first, e.g. 0 for brokers in the local rack and 1
+      /// for the others. Default 0.
+      int locality;
+
+      Endpoint() : port(5672), locality(0) {}
+      explicit Endpoint(const std::string &host, int port = 5672,
+                        int locality = 0)
+          : host(host), port(port), locality(locality) {}
+      bool operator==(const Endpoint &) const;
+    };
+
+    std::string host;   ///< Broker hostname. Required unless endpoints is set
     std::string vhost;  ///< Virtualhost on the broker. Default '/', required.
     int port;           ///< Port to connect to, default is 5672.
-    int frame_max;      ///< Max frame size in bytes. Default 128KB.
+    /// Brokers to choose from, in place of host and port. Endpoints are
+    /// tried by locality, then by how long the handshake took the last time
+    /// the Channel connected to them, and those that failed within the last
+    /// few seconds are tried last. The same choice is made again when
+    /// automatic_recovery reconnects.
+    std::vector<Endpoint> endpoints;
+    /// When true, the endpoints that share the best locality are connected
+    /// to all at once; the first to complete the handshake is used and the
+    /// other connections are closed. Default false, one at a time. Requires
+    /// a positive connect_timeout, which bounds how long the losing attempts
+    /// can outlive Open().
+    bool race_endpoints;
+    /// How long in milliseconds to wait for the TCP connection to a broker
+    /// before moving on to the next endpoint, however many addresses its
+    /// host name resolves to. Default 0, the system's timeout for each
+    /// address.
+    int connect_timeout;
+    /// Max frame size in bytes to ask the broker for, the broker may lower
+    /// it; see GetFrameMax(). Bodies are sent and received in frames of up
+    /// to this size, so larger frames mean fewer of them for large messages.
+    /// 0 takes the broker's own limit, or 16MB if it has none. Default 128KB.
+    int frame_max;
+    /// Heartbeat interval in seconds to ask the broker for, the broker may
+    /// lower it. A connection that hears nothing from the broker for two
+    /// intervals is treated as closed. Default 0, no heartbeats.
+    int heartbeat;
     /// One of BasicAuth or ExternalSaslAuth is required.
     std::variant<std::monostate, BasicAuth, ExternalSaslAuth> auth;
     /// Connect using TLS/SSL when set, otherwise use an unencrypted channel.
     std::optional<TLSParams> tls_params;
+    /// Options for the socket of every connection, TLS or not.
+    SocketOptions socket_options;
+    /// Put channels used by BasicPublish() in confirm mode, default true.
+    /// When false BasicPublish() returns as soon as the message is written to
+    /// the socket, and unroutable mandatory messages are retrieved with
+    /// GetReturnedMessage().
+    bool publisher_confirms;
+    /// How many channels to open as part of connecting, so the first calls
+    /// made on the Channel do not wait for channel.open (and confirm.select)
+    /// round trips. They are requested all at once, costing one round trip
+    /// however many there are. Default 0, channels are opened as needed.
+    std::size_t preopen_channels;
+    /// When non-zero, Envelope and BasicMessage objects for received messages
+    /// are recycled once the application releases them, keeping up to this
+    /// many idle objects of each kind. Default 0, no pooling.
+    std::size_t message_pool_size;
+    /// For event loops driving the Channel with OnReadable(): when
+    /// non-zero, once the bodies of received messages waiting to be consumed
+    /// add up to this many bytes, OnReadable() stops reading the socket and
+    /// WantsRead() returns false, so the broker is held back by TCP flow
+    /// control until the application catches up. It does not limit the
+    /// blocking calls: those that wait on the broker, such as
+    /// BasicConsumeMessage() or an RPC like DeclareQueue(), read whatever
+    /// comes before the frame they wait for and buffer it regardless, as
+    /// that frame cannot be reached otherwise. Default 0, no limit.
+    std::size_t max_buffered_bytes;
+    /// When greater than 1, BasicAck() of a single message is held back and
+    /// consecutive acks on a channel are sent as one `multiple` ack once this
+    /// many have accumulated. Default 0, every ack is sent immediately.
+    std::size_t ack_batch_size;
+    /// With ack batching, the longest time in microseconds, measured from the
+    /// first held-back ack, before a batch is sent on the next BasicAck().
+    /// Pending acks are also sent before any call that waits on the broker
+    /// and by Channel::FlushAcks(). Default 0, no time limit.
+    int ack_batch_timeout;
+    /// When true, the Channel may be used from several threads at once; each
+    /// call is serialized and a thread waiting on the broker releases the
+    /// channel so that others can publish, ack or consume in the meantime.
+    /// Callbacks are run with the channel locked. Default false.
+    bool thread_safe;
+    /// When non-zero, consumer handlers run on this many threads owned by
+    /// the Channel instead of inside DispatchMessages() and OnReadable().
+    /// Each consumer is always handled by the same thread, so its messages
+    /// are still handled in order. Requires thread_safe. Default 0.
+    std::size_t consumer_threads;
+    /// When true, a Channel that loses its connection reconnects by itself on
+    /// the next call made on it, then declares again the exchanges, queues,
+    /// bindings and consumers that were declared through it and sends the
+    /// publishes buffered in the meantime. The call that saw the connection
+    /// fail still throws. Default false.
+    bool automatic_recovery;
+    /// With automatic_recovery, the first reconnect is attempted straight
+    /// away after the connection is lost. Should it fail, calls wait this
+    /// many milliseconds before trying again, doubling each time up to
+    /// recovery_max_interval. Until the connection is back, calls throw
+    /// ConnectionClosedException. Default 50.
+    int recovery_interval;
+    /// The longest wait in milliseconds between reconnect attempts. Default
+    /// 1000.
+    int recovery_max_interval;
+    /// With automatic_recovery, how many messages BasicPublish() holds while
+    /// there is no connection. They are published, in order, once the
+    /// connection is back; once the buffer is full BasicPublish() throws
+    /// ConnectionClosedException. Default 1000.
+    std::size_t recovery_buffer_size;
+    /// How many messages BasicPublishAsync() holds back while the broker has
+    /// blocked the connection (connection.blocked), rather than writing them
+    /// to a socket the broker has stopped reading. They are sent, in order,
+    /// as soon as a call on the Channel sees the connection unblocked; once
+    /// the buffer is full BasicPublishAsync() throws
+    /// ConnectionBlockedException. Default 0, publishes are always written.
+    std::size_t blocked_publish_buffer_size;
+    /// When true, the Channel counts frames, publishes, acks and channels, and
+    /// times confirms, reads and RPCs, for GetStats(). Default false, which
+    /// costs a pointer test at each of those places.
+    bool collect_stats;
 
     /**
      * Create an OpenOpts struct from a URI.
@@ -125,10 +295,267 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
      */
     static OpenOpts FromUri(const std::string &uri);
 
-    OpenOpts() : vhost("/"), port(5672), frame_max(131072) {}
+    /**
+     * Create an OpenOpts struct from URIs for the nodes of a cluster.
+     *
+     * Each URI adds an endpoint with a locality of 0. The credentials, vhost
+     * and scheme are taken from the first one. See FromUri() for the syntax.
+     *
+     * @throws BadUriException if any of the URIs cannot be parsed, or there
+     * are none
+     */
+    static OpenOpts FromUris(const std::vector<std::string> &uris);
+
+    OpenOpts()
+        : vhost("/"),
+          port(5672),
+          race_endpoints(false),
+          connect_timeout(0),
+          frame_max(131072),
+          heartbeat(0),
+          publisher_confirms(true),
+          preopen_channels(0),
+          message_pool_size(0),
+          max_buffered_bytes(0),
+          ack_batch_size(0),
+          ack_batch_timeout(0),
+          thread_safe(false),
+          consumer_threads(0),
+          automatic_recovery(false),
+          recovery_interval(50),
+          recovery_max_interval(1000),
+          recovery_buffer_size(1000),
+          blocked_publish_buffer_size(0),
+          collect_stats(false) {}
     bool operator==(const OpenOpts &) const;
   };
 
+  /// A message that the broker could not route and sent back (basic.return)
+  struct SIMPLEAMQPCLIENT_EXPORT ReturnedMessage {
+    BasicMessage::ptr_t message;  ///< The message that was returned
+    std::uint32_t reply_code;     ///< Reason the message was returned
+    std::string reply_text;       ///< Human readable version of reply_code
+    std::string exchange;         ///< Exchange the message was published to
+    std::string routing_key;      ///< Routing key the message was published to
+
+    ReturnedMessage() : reply_code(0) {}
+  };
+
+  /// The outcome of a message published with \ref BasicPublishAsync
+  struct SIMPLEAMQPCLIENT_EXPORT PublishConfirm {
+    /// How the broker dealt with the message
+    enum status_t {
+      pc_acked = 0,  ///< The broker has taken responsibility for the message
+      pc_nacked,     ///< The broker rejected the message (basic.nack)
+      pc_returned,   ///< The message could not be routed (basic.return)
+      /// Held by automatic recovery until the connection is back, the broker
+      /// has not seen it yet
+      pc_buffered,
+      /// The channel or connection closed before the broker confirmed the
+      /// message, which it may or may not have received
+      pc_lost
+    };
+
+    /// The sequence number returned by \ref BasicPublishAsync
+    std::uint64_t sequence_number;
+    status_t status;  ///< How the broker dealt with the message
+    /// The returned message, only set when status is `pc_returned`
+    ReturnedMessage returned;
+    /// Why the channel closed, only set when status is `pc_lost`
+    std::exception_ptr error;
+
+    PublishConfirm() : sequence_number(0), status(pc_acked) {}
+  };
+
+  /// The outcome of \ref TryBasicConsumeMessage
+  struct SIMPLEAMQPCLIENT_EXPORT ConsumeResult {
+    /// What TryBasicConsumeMessage() came back with
+    enum status_t {
+      cr_delivered = 0,  ///< A message was delivered
+      cr_timeout,        ///< No message was delivered before the timeout
+      cr_cancelled       ///< The broker cancelled a consumer (basic.cancel)
+    };
+
+    status_t status;  ///< What TryBasicConsumeMessage() came back with
+    /// The message delivered, only set when status is `cr_delivered`
+    Envelope::ptr_t envelope;
+    /// The consumer the broker cancelled, only set when status is
+    /// `cr_cancelled`
+    std::string consumer_tag;
+
+    ConsumeResult() : status(cr_timeout) {}
+  };
+
+  /// One declaration in a batch passed to DeclareTopology()
+  struct SIMPLEAMQPCLIENT_EXPORT TopologyOp {
+    /// What the declaration does
+    enum kind_t {
+      to_declare_exchange = 0,  ///< Declares an exchange
+      to_declare_queue,         ///< Declares a queue
+      to_bind_queue,            ///< Binds a queue to an exchange
+      to_bind_exchange          ///< Binds an exchange to another
+    };
+
+    kind_t kind;  ///< What the declaration does
+    /// The exchange or queue declared, or the queue or exchange bound
+    std::string name;
+    std::string source;         ///< For bindings, the exchange bound to
+    std::string exchange_type;  ///< For exchanges, the type of exchange
+    std::string routing_key;    ///< For bindings, the routing key
+    bool durable;               ///< See DeclareExchange() and DeclareQueue()
+    bool exclusive;             ///< See DeclareQueue()
+    bool auto_delete;           ///< See DeclareExchange() and DeclareQueue()
+    FlatTable arguments;        ///< Arguments of the declaration or binding
+
+    /// Declares an exchange, see Channel::DeclareExchange()
+    static TopologyOp DeclareExchange(
+        const std::string &exchange_name,
+        const std::string &exchange_type = Channel::EXCHANGE_TYPE_DIRECT,
+        bool durable = false, bool auto_delete = false,
+        const FlatTable &arguments = FlatTable());
+    /// Declares a queue, see Channel::DeclareQueue()
+    static TopologyOp DeclareQueue(const std::string &queue_name,
+                                   bool durable = false, bool exclusive = true,
+                                   bool auto_delete = true,
+                                   const FlatTable &arguments = FlatTable());
+    /// Binds a queue to an exchange, see Channel::BindQueue()
+    static TopologyOp BindQueue(const std::string &queue_name,
+                                const std::string &exchange_name,
+                                const std::string &routing_key = "",
+                                const FlatTable &arguments = FlatTable());
+    /// Binds an exchange to another, see Channel::BindExchange()
+    static TopologyOp BindExchange(const std::string &destination,
+                                   const std::string &source,
+                                   const std::string &routing_key,
+                                   const FlatTable &arguments = FlatTable());
+
+    TopologyOp()
+        : kind(to_declare_exchange),
+          durable(false),
+          exclusive(false),
+          auto_delete(false) {}
+  };
+
+  /// How one declaration in a DeclareTopology() batch went
+  struct SIMPLEAMQPCLIENT_EXPORT TopologyResult {
+    /// For queues, the name of the queue. The broker makes one up for a
+    /// queue declared with an empty name.
+    std::string queue_name;
+    std::uint32_t message_count;   ///< For queues, the messages it holds
+    std::uint32_t consumer_count;  ///< For queues, its active consumers
+    /// What the declaration would have thrown made on its own, typically a
+    /// ChannelException. Empty when it succeeded.
+    std::exception_ptr error;
+
+    /// Did the broker accept the declaration
+    bool Succeeded() const { return !error; }
+
+    TopologyResult() : message_count(0), consumer_count(0) {}
+  };
+
+  /// Latencies counted in buckets of powers of two microseconds, see
+  /// GetStats()
+  struct SIMPLEAMQPCLIENT_EXPORT LatencyHistogram {
+    static const std::size_t BUCKETS = 32;
+
+    /// buckets[0] counts latencies under 1us, buckets[i] those of at least
+    /// 2^(i-1)us and under 2^i us. The last bucket also counts anything
+    /// longer.
+    std::array<std::uint64_t, BUCKETS> buckets;
+    std::uint64_t count;     ///< How many latencies were recorded
+    std::uint64_t total_us;  ///< Their sum in microseconds
+
+    /// The upper end in microseconds of the bucket holding the given
+    /// fraction (0 to 1) of the latencies, 0 when none were recorded
+    std::uint64_t Percentile(double fraction) const;
+
+    LatencyHistogram() : buckets(), count(0), total_us(0) {}
+  };
+
+  /// A snapshot of what the Channel has been doing, see GetStats()
+  struct SIMPLEAMQPCLIENT_EXPORT Stats {
+    /// Frames read from the broker, of any kind, heartbeats included
+    std::uint64_t frames_read;
+    /// Bytes of content header and body frames read from the broker
+    std::uint64_t content_bytes_read;
+    /// Messages published, whether or not the broker has confirmed them
+    std::uint64_t messages_published;
+    /// basic.ack methods sent, a batch of acks (OpenOpts::ack_batch_size)
+    /// counting once
+    std::uint64_t acks_sent;
+    /// Microseconds spent waiting for the broker's next frame
+    std::uint64_t read_wait_us;
+    std::uint64_t channels_opened;  ///< AMQP channels opened
+    /// AMQP channels closed, by the client or the broker
+    std::uint64_t channels_closed;
+    /// Frames read but not yet taken by whatever is waiting for them
+    std::size_t queued_frames;
+    /// Messages delivered to consumers but not yet consumed
+    std::size_t delivered_messages;
+    /// Bytes of body of delivered_messages
+    std::size_t buffered_bytes;
+    /// Messages in the codec's content-encoding passed on undecoded, as the
+    /// codec failed or the body would have decoded too large, see SetCodec()
+    std::uint64_t decode_failures;
+    /// From publishing a message to the broker confirming it
+    LatencyHistogram confirm_latency;
+    /// From sending a synchronous method, keyed by its method id such as
+    /// AMQP_QUEUE_DECLARE_METHOD, to reading the broker's reply
+    std::map<std::uint32_t, LatencyHistogram> rpc_latency;
+
+    Stats()
+        : frames_read(0),
+          content_bytes_read(0),
+          messages_published(0),
+          acks_sent(0),
+          read_wait_us(0),
+          channels_opened(0),
+          channels_closed(0),
+          queued_frames(0),
+          delivered_messages(0),
+          buffered_bytes(0),
+          decode_failures(0) {}
+  };
+
+  /// TLS handshakes completed by the process, see GetTlsHandshakeStats()
+  struct SIMPLEAMQPCLIENT_EXPORT TlsHandshakeStats {
+    std::uint64_t full;     ///< Handshakes that set up a new session
+    std::uint64_t resumed;  ///< Handshakes that resumed a kept session
+
+    TlsHandshakeStats() : full(0), resumed(0) {}
+  };
+
+  /// Callback invoked as publisher confirms arrive from the broker
+  typedef std::function<void(const PublishConfirm &)> confirm_callback_t;
+
+  /// Callback invoked with the reply to a request sent with RpcSend(), see
+  /// SetRpcReplyCallback()
+  typedef std::function<void(const std::string &correlation_id,
+                             const BasicMessage::ptr_t &reply)>
+      rpc_reply_callback_t;
+
+  /// Callback invoked when the broker blocks or unblocks the connection.
+  /// `reason` is the broker's explanation, empty when unblocking.
+  typedef std::function<void(bool blocked, const std::string &reason)>
+      connection_blocked_callback_t;
+
+  /// Handler invoked with each message delivered to a consumer, see
+  /// BasicConsume(const std::string &, const consumer_handler_t &, ...)
+  typedef std::function<void(const Envelope::ptr_t &)> consumer_handler_t;
+
+  /// Receives a message body piece by piece, see BasicConsumeMessageStream().
+  /// `remaining` is the number of body bytes still to come after `chunk`.
+  typedef std::function<void(const Envelope::ptr_t &envelope,
+                             std::string_view chunk, std::uint64_t remaining)>
+      body_chunk_handler_t;
+
+  /// Supplies a message body piece by piece, see BasicPublish(const
+  /// std::string &, const std::string &, const BasicMessage::ptr_t,
+  /// std::uint64_t, const body_source_t &, bool, bool). Copies at most
+  /// `size` bytes into `buffer` and returns how many it copied.
+  typedef std::function<std::size_t(char *buffer, std::size_t size)>
+      body_source_t;
+
   /**
    * Open a new channel to the broker.
    *
@@ -137,6 +564,28 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
    */
   static ptr_t Open(const OpenOpts &opts);
 
+  /**
+   * Open a new channel to the broker on another thread.
+   *
+   * The connection is made as by Open(), while the calling thread gets on
+   * with other work. Any exception Open() would throw is thrown by the
+   * future's get().
+   */
+  static std::future<ptr_t> OpenAsync(const OpenOpts &opts);
+
+  /**
+   * Open several connections to the broker at once.
+   *
+   * The TCP, TLS and AMQP handshakes of all the connections run
+   * concurrently, so this takes about as long as opening one of them.
+   *
+   * @param opts options used for each of the connections
+   * @param count how many connections to open
+   * @returns the new channels. If any of the connections fails, those that
+   * succeeded are closed and the first failure is thrown.
+   */
+  static std::vector<ptr_t> OpenMany(const OpenOpts &opts, std::size_t count);
+
   /**
    * Creates a new channel object
    *
@@ -346,6 +795,80 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
    */
   int GetSocketFD() const;
 
+  /**
+   * The heartbeat interval agreed with the broker
+   *
+   * Heartbeats are sent and checked whenever the Channel reads from the
+   * broker, including while it waits in calls such as BasicConsumeMessage().
+   * If the broker goes silent for two intervals the connection is closed and
+   * the call fails with an AmqpLibraryException, later calls throw
+   * ConnectionClosedException.
+   *
+   * @returns the interval in seconds, 0 if heartbeats are off
+   */
+  int GetHeartbeat() const;
+
+  /**
+   * The frame size limit agreed with the broker
+   *
+   * The smaller of OpenOpts::frame_max and the broker's limit, the most a
+   * frame sent or received on this connection can hold, headers included.
+   *
+   * @returns the limit in bytes
+   */
+  int GetFrameMax() const;
+
+  /**
+   * Reads and dispatches whatever the broker has sent, without blocking
+   *
+   * For driving the Channel from an external event loop: call this when
+   * GetSocketFD() polls readable. Every frame that can be read without
+   * waiting is decoded. Completed deliveries are queued for
+   * BasicConsumeMessage() with a timeout of 0, publisher confirms are passed
+   * to the confirm callback and returned messages are queued for
+   * GetReturnedMessage(). Messages for consumers that have a handler are
+   * passed to it before this returns.
+   *
+   * A readable socket may hold only part of a frame, in which case nothing
+   * is dispatched until the rest arrives on a later call.
+   *
+   * Heartbeats are sent and checked from here too. When GetHeartbeat() is
+   * non-zero, also call this whenever the socket has not polled readable
+   * for half that many seconds.
+   *
+   * @returns true if at least one frame was read
+   */
+  bool OnReadable();
+
+  /**
+   * Whether the Channel is ready for more input
+   *
+   * False while received messages waiting to be consumed are over
+   * OpenOpts::max_buffered_bytes. Poll GetSocketFD() for readability only
+   * while this returns true, so that the socket is left unread.
+   */
+  bool WantsRead() const;
+
+  /**
+   * The bytes of message bodies received but not yet consumed
+   */
+  std::size_t GetBufferedBytes() const;
+
+  /**
+   * Whether the Channel has output waiting to be sent
+   *
+   * Only acknowledgements held back by ack batching, and messages that
+   * BasicPublishAsync() held back while the connection was blocked, are ever
+   * deferred; all other methods are written as they are called. When this
+   * returns true, poll GetSocketFD() for writability and call OnWritable().
+   */
+  bool WantsWrite() const;
+
+  /**
+   * Sends any deferred output, see WantsWrite()
+   */
+  void OnWritable();
+
   /**
    * Checks to see if an exchange exists on the broker.
    *
@@ -397,6 +920,12 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
                        const std::string &exchange_type, bool passive,
                        bool durable, bool auto_delete, const Table &arguments);
 
+  /// \overload with the arguments given as a FlatTable
+  void DeclareExchange(const std::string &exchange_name,
+                       const std::string &exchange_type, bool passive,
+                       bool durable, bool auto_delete,
+                       const FlatTable &arguments);
+
   /**
    * Deletes an exchange on the AMQP broker
    *
@@ -427,6 +956,10 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
   void BindExchange(const std::string &destination, const std::string &source,
                     const std::string &routing_key, const Table &arguments);
 
+  /// \overload with the arguments given as a FlatTable
+  void BindExchange(const std::string &destination, const std::string &source,
+                    const std::string &routing_key, const FlatTable &arguments);
+
   /**
    * Unbind an existing exchange-exchange binding
    * @see BindExchange
@@ -449,6 +982,11 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
   void UnbindExchange(const std::string &destination, const std::string &source,
                       const std::string &routing_key, const Table &arguments);
 
+  /// \overload with the arguments given as a FlatTable
+  void UnbindExchange(const std::string &destination, const std::string &source,
+                      const std::string &routing_key,
+                      const FlatTable &arguments);
+
   /**
    * Checks to see if a queue exists on the broker.
    *
@@ -504,6 +1042,11 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
                            bool durable, bool exclusive, bool auto_delete,
                            const Table &arguments);
 
+  /// \overload with the arguments given as a FlatTable
+  std::string DeclareQueue(const std::string &queue_name, bool passive,
+                           bool durable, bool exclusive, bool auto_delete,
+                           const FlatTable &arguments);
+
   /**
    * Declares a queue and returns current message- and consumer counts
    *
@@ -564,6 +1107,14 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
                                      bool passive, bool durable, bool exclusive,
                                      bool auto_delete, const Table &arguments);
 
+  /// \overload with the arguments given as a FlatTable
+  std::string DeclareQueueWithCounts(const std::string &queue_name,
+                                     std::uint32_t &message_count,
+                                     std::uint32_t &consumer_count,
+                                     bool passive, bool durable, bool exclusive,
+                                     bool auto_delete,
+                                     const FlatTable &arguments);
+
   /**
    * Deletes a queue
    *
@@ -607,6 +1158,11 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
                  const std::string &exchange_name,
                  const std::string &routing_key, const Table &arguments);
 
+  /// \overload with the arguments given as a FlatTable
+  void BindQueue(const std::string &queue_name,
+                 const std::string &exchange_name,
+                 const std::string &routing_key, const FlatTable &arguments);
+
   /**
    * Unbinds a queue from an exchange
    *
@@ -634,6 +1190,11 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
                    const std::string &exchange_name,
                    const std::string &routing_key, const Table &arguments);
 
+  /// \overload with the arguments given as a FlatTable
+  void UnbindQueue(const std::string &queue_name,
+                   const std::string &exchange_name,
+                   const std::string &routing_key, const FlatTable &arguments);
+
   /**
    * Purges a queue
    *
@@ -642,6 +1203,30 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
    */
   void PurgeQueue(const std::string &queue_name);
 
+  /**
+   * Declares several exchanges, queues and bindings in one go
+   *
+   * Every declaration is written to the socket before any reply is read, so
+   * a batch of any size takes about one round trip to the broker. They are
+   * made in order, a binding may refer to an exchange or queue declared
+   * earlier in the same batch.
+   *
+   * A declaration the broker refuses does not stop the batch: its error is
+   * reported in its result and the declarations after it are carried on
+   * with on another channel.
+   *
+   * @param ops the declarations to make
+   * @param nowait when true, the broker is asked not to reply to any but the
+   * last declaration, whose reply then stands for the whole batch. Every
+   * queue must be named. Should any declaration be refused, the batch is
+   * made again with replies, to find out which. Default false.
+   * @returns how each declaration went, in the same order as `ops`
+   * @throws std::invalid_argument if `nowait` is set and a queue has an
+   * empty name
+   */
+  std::vector<TopologyResult> DeclareTopology(
+      const std::vector<TopologyOp> &ops, bool nowait = false);
+
   /**
    * Acknowledges a Basic message
    *
@@ -678,6 +1263,15 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
    */
   void BasicAck(const Envelope::DeliveryInfo &info, bool multiple);
 
+  /**
+   * Sends any acknowledgements held back by ack batching
+   *
+   * See OpenOpts::ack_batch_size. This is done automatically before waiting
+   * on the broker, so an explicit call is only needed when the application
+   * will not call into the Channel for a while.
+   */
+  void FlushAcks();
+
   /**
    * Reject (NAck) a Basic message
    *
@@ -723,6 +1317,392 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
                     const BasicMessage::ptr_t message, bool mandatory = false,
                     bool immediate = false);
 
+  /**
+   * Publishes a Basic message using a PublishTemplate
+   *
+   * Behaves like BasicPublish() with the template's exchange, routing key,
+   * flags and properties, but without encoding the properties again.
+   *
+   * @param publish The exchange, routing key, flags and properties to use
+   * @param body The message body
+   * @param overrides Properties that replace the template's for this message
+   */
+  void BasicPublish(const PublishTemplate &publish, std::string_view body,
+                    const PublishTemplate::Overrides &overrides =
+                        PublishTemplate::Overrides());
+
+  /**
+   * Publishes a Basic message, reporting a nack or return rather than
+   * throwing
+   *
+   * Behaves like BasicPublish(), except that a message the broker rejects or
+   * cannot route comes back as the result instead of as a
+   * MessageRejectedException or MessageReturnedException, for callers to
+   * whom unroutable messages are routine. Channel and connection errors are
+   * still thrown.
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message The \ref BasicMessage object to publish to the queue.
+   * @param mandatory See BasicPublish()
+   * @param immediate See BasicPublish()
+   * @returns the outcome; `sequence_number` holds the broker's delivery tag
+   * for the confirm. Without publisher confirms the status is always
+   * `pc_acked`. While automatic recovery buffers the message it is
+   * `pc_buffered`, with no sequence number.
+   */
+  PublishConfirm TryBasicPublish(const std::string &exchange_name,
+                                 const std::string &routing_key,
+                                 const BasicMessage::ptr_t message,
+                                 bool mandatory = false,
+                                 bool immediate = false);
+
+  /**
+   * Publishes a Basic message using a PublishTemplate, reporting a nack or
+   * return rather than throwing
+   *
+   * See TryBasicPublish(const std::string &, const std::string &,
+   * const BasicMessage::ptr_t, bool, bool).
+   */
+  PublishConfirm TryBasicPublish(const PublishTemplate &publish,
+                                 std::string_view body,
+                                 const PublishTemplate::Overrides &overrides =
+                                     PublishTemplate::Overrides());
+
+  /**
+   * Publishes a Basic message whose body is made up of several buffers
+   *
+   * The segments are sent one after another as the message body without
+   * being joined first, so large payloads assembled from parts are not
+   * copied. Otherwise behaves like BasicPublish().
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message Supplies the message properties, its body is ignored
+   * @param body The parts of the body, in order
+   * @param mandatory See BasicPublish()
+   * @param immediate See BasicPublish()
+   */
+  void BasicPublish(const std::string &exchange_name,
+                    const std::string &routing_key,
+                    const BasicMessage::ptr_t message,
+                    const std::vector<std::string_view> &body,
+                    bool mandatory = false, bool immediate = false);
+
+  /**
+   * Publishes a Basic message whose body is read from a source as it is sent
+   *
+   * The body is pulled from `source` one frame's worth at a time, so at most
+   * a frame of it is held in memory. `source` must supply exactly
+   * `body_size` bytes: the broker has been told the size before the body is
+   * sent, so if `source` runs dry early the connection is closed.
+   * Otherwise behaves like BasicPublish().
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message Supplies the message properties, its body is ignored
+   * @param body_size The size of the body in bytes
+   * @param source Called repeatedly to fill a buffer with the next part of
+   * the body
+   * @param mandatory See BasicPublish()
+   * @param immediate See BasicPublish()
+   * @throws std::runtime_error if `source` returns 0 before the whole body
+   * has been supplied
+   */
+  void BasicPublish(const std::string &exchange_name,
+                    const std::string &routing_key,
+                    const BasicMessage::ptr_t message, std::uint64_t body_size,
+                    const body_source_t &source, bool mandatory = false,
+                    bool immediate = false);
+
+  /**
+   * Publishes a Basic message with a body made up of several buffers using a
+   * PublishTemplate
+   *
+   * See BasicPublish(const std::string &, const std::string &,
+   * const BasicMessage::ptr_t, const std::vector<std::string_view> &, ...).
+   */
+  void BasicPublish(const PublishTemplate &publish,
+                    const std::vector<std::string_view> &body,
+                    const PublishTemplate::Overrides &overrides =
+                        PublishTemplate::Overrides());
+
+  /**
+   * Publishes a Basic message without waiting for the broker to confirm it
+   *
+   * The message is published on a channel dedicated to asynchronous
+   * publishing; up to \ref SetPublishConfirmWindow messages may be awaiting
+   * confirmation at a time, once the window is full this call blocks until
+   * the broker confirms enough messages to make room.
+   *
+   * The outcome of the publish is reported to the callback set with
+   * \ref SetPublishConfirmCallback, which is invoked from whichever call on
+   * this Channel happens to read the confirm from the broker. Use
+   * \ref WaitForConfirms to wait for all outstanding confirms.
+   *
+   * While the broker has blocked the connection, see IsBlocked(), and
+   * OpenOpts::blocked_publish_buffer_size is non-zero, the message is held
+   * back instead of being written and this returns straight away. It still
+   * counts as unconfirmed and keeps the returned sequence number.
+   *
+   * @note A basic.return carries no delivery tag; as the broker returns
+   * messages in the order they were published, it is attributed to the
+   * oldest unconfirmed mandatory publish to the same exchange and routing key
+   * that has not been returned yet.
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with, this is used to route
+   * to corresponding queue(s).
+   * @param message The \ref BasicMessage object to publish to the queue.
+   * @param mandatory Requires the message to be delivered to a queue. The
+   * message is reported as `pc_returned` if it cannot be routed to a queue.
+   * @param immediate Requires the message to be both routed to a queue, and
+   * immediately delivered to a consumer. This has no effect when using
+   * RabbitMQ v3.0 and newer.
+   * @returns the sequence number of the message, used to match it to its
+   * \ref PublishConfirm
+   * @throws ConnectionBlockedException if the message is to be held back but
+   * OpenOpts::blocked_publish_buffer_size messages already are
+   */
+  std::uint64_t BasicPublishAsync(const std::string &exchange_name,
+                                  const std::string &routing_key,
+                                  const BasicMessage::ptr_t message,
+                                  bool mandatory = false,
+                                  bool immediate = false);
+
+  /**
+   * Publishes a Basic message using a PublishTemplate without waiting for
+   * its confirm
+   *
+   * Behaves like BasicPublishAsync() with the template's exchange, routing
+   * key, flags and properties, see BasicPublish(const PublishTemplate &, ...).
+   * The body is not copied, so it cannot be held back while the connection
+   * is blocked.
+   *
+   * @returns the sequence number of the message, used to match it to its
+   * \ref PublishConfirm
+   * @throws ConnectionBlockedException if the connection is blocked and
+   * OpenOpts::blocked_publish_buffer_size is non-zero
+   */
+  std::uint64_t BasicPublishAsync(const PublishTemplate &publish,
+                                  std::string_view body,
+                                  const PublishTemplate::Overrides &overrides =
+                                      PublishTemplate::Overrides());
+
+  /**
+   * Publishes a Basic message with a body made up of several buffers using a
+   * PublishTemplate, without waiting for its confirm
+   *
+   * @returns the sequence number of the message, used to match it to its
+   * \ref PublishConfirm
+   * @throws ConnectionBlockedException if the connection is blocked and
+   * OpenOpts::blocked_publish_buffer_size is non-zero
+   */
+  std::uint64_t BasicPublishAsync(const PublishTemplate &publish,
+                                  const std::vector<std::string_view> &body,
+                                  const PublishTemplate::Overrides &overrides =
+                                      PublishTemplate::Overrides());
+
+  /**
+   * Republishes a received message, optionally editing its headers
+   *
+   * Meant for routing proxies that forward what they consume. As long as
+   * none of its properties have been read or set, other than through the
+   * `IsSet()` methods and BasicMessage::FindHeader(), a received message is
+   * sent with its properties as they arrived: they are never converted to
+   * strings and Tables and back, and the body is sent from the message
+   * without being copied. BasicPublish() and BasicPublishAsync() treat such
+   * messages the same way.
+   *
+   * Otherwise behaves like BasicPublish(const std::string &, ...).
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message The message to publish, typically from an Envelope
+   * @param header_edits Headers to add, replacing any of the same name the
+   * message already has. May be empty.
+   * @param mandatory Requires the message to be delivered to a queue. A
+   * MessageReturnedException is thrown if the message cannot be routed.
+   * @param immediate Requires the message to be both routed to a queue, and
+   * immediately delivered to a consumer. This has no effect when using
+   * RabbitMQ v3.0 and newer.
+   */
+  void BasicRelay(const std::string &exchange_name,
+                  const std::string &routing_key,
+                  const BasicMessage::ptr_t message,
+                  const FlatTable &header_edits = FlatTable(),
+                  bool mandatory = false, bool immediate = false);
+
+  /**
+   * Republishes a received message without waiting for its confirm
+   *
+   * Sends the message as BasicRelay() does, and reports its outcome as
+   * BasicPublishAsync() does. The edited message is not held on to, so it
+   * cannot be held back while the connection is blocked.
+   *
+   * @returns the sequence number of the message, used to match it to its
+   * \ref PublishConfirm
+   * @throws ConnectionBlockedException if the connection is blocked and
+   * OpenOpts::blocked_publish_buffer_size is non-zero
+   */
+  std::uint64_t BasicRelayAsync(const std::string &exchange_name,
+                                const std::string &routing_key,
+                                const BasicMessage::ptr_t message,
+                                const FlatTable &header_edits = FlatTable(),
+                                bool mandatory = false, bool immediate = false);
+
+  /**
+   * Publishes a batch of Basic messages and waits once for all confirms
+   *
+   * Every message is written to the broker before any confirm is read, then
+   * the confirms for the whole batch are collected in a single pass. Unlike
+   * \ref BasicPublish a rejected or returned message does not throw, its
+   * outcome is reported in the result instead. The batch is not limited by
+   * \ref SetPublishConfirmWindow, and its confirms are not passed to the
+   * \ref SetPublishConfirmCallback callback.
+   *
+   * @param exchange_name The name of the exchange to publish the messages to
+   * @param routing_key The routing key to publish every message with
+   * @param messages The messages to publish, in order
+   * @param mandatory Requires each message to be delivered to a queue,
+   * messages that cannot be routed are reported as `pc_returned`.
+   * @returns one \ref PublishConfirm per message, in the same order as
+   * `messages`
+   * @throws ConnectionBlockedException if the connection is blocked and
+   * OpenOpts::blocked_publish_buffer_size is non-zero
+   */
+  std::vector<PublishConfirm> BasicPublishBatch(
+      const std::string &exchange_name, const std::string &routing_key,
+      const std::vector<BasicMessage::ptr_t> &messages, bool mandatory = false);
+
+  /**
+   * Publishes a batch of Basic messages and waits once for all confirms
+   *
+   * Works like the overload above, with a routing key per message.
+   *
+   * @param exchange_name The name of the exchange to publish the messages to
+   * @param messages Pairs of routing key and message to publish, in order
+   * @param mandatory Requires each message to be delivered to a queue,
+   * messages that cannot be routed are reported as `pc_returned`.
+   * @returns one \ref PublishConfirm per message, in the same order as
+   * `messages`
+   * @throws ConnectionBlockedException if the connection is blocked and
+   * OpenOpts::blocked_publish_buffer_size is non-zero
+   */
+  std::vector<PublishConfirm> BasicPublishBatch(
+      const std::string &exchange_name,
+      const std::vector<std::pair<std::string, BasicMessage::ptr_t> >
+          &messages,
+      bool mandatory = false);
+
+  /**
+   * Sets the maximum number of unconfirmed messages in flight
+   *
+   * Limits how many messages published with \ref BasicPublishAsync may be
+   * awaiting a confirm from the broker. Defaults to 256.
+   *
+   * @param max_unconfirmed the window size, must be at least 1
+   */
+  void SetPublishConfirmWindow(std::size_t max_unconfirmed);
+
+  /// The window set with \ref SetPublishConfirmWindow
+  std::size_t GetPublishConfirmWindow() const;
+
+  /**
+   * Sets the callback that receives publisher confirms
+   *
+   * The callback is never called in the middle of reading from the socket.
+   * Confirms read by any call are held until that read is done, and are
+   * passed on before BasicPublishAsync(), WaitForConfirms(), OnReadable()
+   * or DispatchMessages() returns, or by whichever call next waits on the
+   * broker in thread-safe mode. The Channel is locked while it runs. It may
+   * call back into the Channel, including to publish again.
+   *
+   * Messages still unconfirmed when the confirm channel or the connection
+   * closes are reported as `pc_lost`, along with the reason.
+   *
+   * @param callback invoked once for each message published with
+   * \ref BasicPublishAsync. May be empty to discard confirms.
+   */
+  void SetPublishConfirmCallback(const confirm_callback_t &callback);
+
+  /**
+   * Waits for confirms for all messages published with \ref BasicPublishAsync
+   *
+   * Messages held back while the connection is blocked are sent first if
+   * it has since been unblocked.
+   *
+   * @param timeout The timeout in milliseconds. 0 processes any confirms
+   * already received without blocking, -1 is an infinite timeout.
+   * @returns `true` when every message has been confirmed, `false` on timeout
+   * or while messages are still held back.
+   */
+  bool WaitForConfirms(int timeout = -1);
+
+  /**
+   * Number of messages published with \ref BasicPublishAsync that the broker
+   * has not yet confirmed
+   */
+  std::size_t UnconfirmedPublishCount() const;
+
+  /**
+   * Whether the broker has blocked the connection
+   *
+   * A broker short of memory or disk space sends connection.blocked and
+   * stops reading from connections that publish, until it sends
+   * connection.unblocked. The state is updated as those notifications are
+   * read, by whichever call on this Channel reads them.
+   */
+  bool IsBlocked() const;
+
+  /**
+   * Sets the callback invoked when the broker blocks or unblocks the
+   * connection
+   *
+   * The callback runs inside whichever call reads the notification, with
+   * the Channel locked. It should only record the change or hand it off,
+   * not call methods that wait on the broker.
+   *
+   * @param callback May be empty to stop being notified
+   */
+  void SetConnectionBlockedCallback(
+      const connection_blocked_callback_t &callback);
+
+  /**
+   * Takes a snapshot of the Channel's counters
+   *
+   * The counters and histograms are only kept when the Channel was opened
+   * with OpenOpts::collect_stats, and count from then on, across
+   * reconnections. queued_frames, delivered_messages, buffered_bytes and
+   * decode_failures are always filled in.
+   */
+  Stats GetStats() const;
+
+  /**
+   * Counts the TLS handshakes of every Channel in the process
+   *
+   * Connections whose OpenOpts::TLSParams::resume_sessions is set offer the
+   * session kept from the last connection to the same broker, a handshake
+   * the broker accepts it for counts as resumed.
+   */
+  static TlsHandshakeStats GetTlsHandshakeStats();
+
+  /**
+   * Retrieve a message that was returned by the broker
+   *
+   * When the Channel was opened with OpenOpts::publisher_confirms set to
+   * `false`, BasicPublish() does not wait for the broker, so mandatory or
+   * immediate messages that cannot be routed are returned asynchronously.
+   * This method hands back the next such message, reading from the broker
+   * for up to `timeout` milliseconds if none has been received yet.
+   *
+   * @param returned the returned message and the broker's reply
+   * @param timeout the number of milliseconds to wait; 0 only processes data
+   * already received, -1 waits indefinitely
+   * @returns `true` if a returned message was retrieved, `false` otherwise
+   */
+  bool GetReturnedMessage(ReturnedMessage &returned, int timeout = 0);
+
   /**
    * Synchronously consume a message from a queue
    *
@@ -741,6 +1721,30 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
   bool BasicGet(Envelope::ptr_t &message, const std::string &queue,
                 bool no_ack = true);
 
+  /**
+   * Synchronously consume up to `max` messages from a queue
+   *
+   * Like calling BasicGet() until it returns `false` or `max` messages have
+   * been got, but the basic.get requests are sent several at a time without
+   * waiting for each reply, starting with 16 and doubling while the queue
+   * keeps them coming. Draining N messages takes about log2(N / 16) round
+   * trips rather than N.
+   *
+   * A channel error, such as the queue not existing, is thrown once the
+   * envelopes got before it have been appended.
+   *
+   * @param queue The name of the queue to get messages from.
+   * @param max The most messages to get.
+   * @param [out] envelopes The messages got are appended here, in queue order.
+   * @param no_ack Can the messages be un-ack'ed. Default `true` (messages do
+   * not need to be acked).
+   * @returns the number of messages got, fewer than `max` if the queue ran
+   * empty
+   */
+  std::size_t BasicGetMany(const std::string &queue, std::size_t max,
+                           std::vector<Envelope::ptr_t> &envelopes,
+                           bool no_ack = true);
+
   /**
    * Redeliver unacknowledged messages from the broker
    * @param consumer The consumer to recover message from
@@ -804,6 +1808,97 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
                            std::uint16_t message_prefetch_count,
                            const Table &arguments);
 
+  /// \overload with the arguments given as a FlatTable
+  std::string BasicConsume(const std::string &queue,
+                           const std::string &consumer_tag, bool no_local,
+                           bool no_ack, bool exclusive,
+                           std::uint16_t message_prefetch_count,
+                           const FlatTable &arguments);
+
+  /**
+   * Starts consuming Basic messages on a queue without waiting for the broker
+   *
+   * Behaves like BasicConsume(), except that the broker is not asked to
+   * confirm the consumer, so many consumers can be started in a row for
+   * about the cost of one. Should the broker refuse the consumer, e.g.
+   * because the queue does not exist, the error is thrown by a later call.
+   *
+   * @param consumer_tag The name of the consumer, generated by the client
+   * when empty, as the broker does not get the chance to.
+   * @returns the consumer tag
+   */
+  std::string BasicConsumeNoWait(const std::string &queue,
+                                 const std::string &consumer_tag = "",
+                                 bool no_local = true, bool no_ack = true,
+                                 bool exclusive = true,
+                                 std::uint16_t message_prefetch_count = 1,
+                                 const Table &arguments = Table());
+
+  /// \overload with the arguments given as a FlatTable
+  std::string BasicConsumeNoWait(const std::string &queue,
+                                 const std::string &consumer_tag,
+                                 bool no_local, bool no_ack, bool exclusive,
+                                 std::uint16_t message_prefetch_count,
+                                 const FlatTable &arguments);
+
+  /**
+   * Starts consuming Basic messages on a queue, pushing them to a handler
+   *
+   * Behaves like the other BasicConsume() overloads, except that messages
+   * delivered to this consumer are passed to `handler` as soon as they have
+   * been received, and are never returned by BasicConsumeMessage(). Handlers
+   * are called from DispatchMessages() or OnReadable(); messages read during
+   * any other call wait for the next of those. When OpenOpts::consumer_threads
+   * is set they run on the Channel's consumer threads instead, as soon as
+   * they are read. A handler may call back into the Channel, e.g. to
+   * BasicAck() the message.
+   *
+   * @param queue The name of the queue to subscribe to.
+   * @param handler Called with each message delivered to the consumer.
+   * @param consumer_tag The name of the consumer. This is used to do
+   * operations with a consumer.
+   * @param no_local Defaults to true
+   * @param no_ack If `true`, ack'ing the message is automatically done when the
+   * message is delivered. Defaults to `true` (message does not have to be
+   * ack'ed).
+   * @param exclusive Means only this consumer can access the queue.
+   * @param message_prefetch_count Number of unacked messages the broker will
+   * deliver. A value of 0 means no limit. This option is ignored if
+   * `no_ack = true`.
+   * @param arguments A table of additional arguments when creating the consumer
+   * @returns the consumer tag
+   */
+  std::string BasicConsume(const std::string &queue,
+                           const consumer_handler_t &handler,
+                           const std::string &consumer_tag = "",
+                           bool no_local = true, bool no_ack = true,
+                           bool exclusive = true,
+                           std::uint16_t message_prefetch_count = 1,
+                           const Table &arguments = Table());
+
+  /// \overload with the arguments given as a FlatTable
+  std::string BasicConsume(const std::string &queue,
+                           const consumer_handler_t &handler,
+                           const std::string &consumer_tag, bool no_local,
+                           bool no_ack, bool exclusive,
+                           std::uint16_t message_prefetch_count,
+                           const FlatTable &arguments);
+
+  /**
+   * Waits for messages and passes them to their consumer's handler
+   *
+   * The event loop for consumers started with a handler: waits until at
+   * least one message has been handled, or handed to a consumer thread, then
+   * returns.
+   *
+   * @param timeout The maximum time to wait in milliseconds, -1 (the
+   * default) waits indefinitely.
+   * @returns the number of messages dispatched, 0 if the timeout passed
+   * @throws ConsumerCancelledException if the broker cancelled one of the
+   * handler consumers
+   */
+  std::size_t DispatchMessages(int timeout = -1);
+
   /**
    * Modify consumer's message prefetch count
    *
@@ -819,6 +1914,26 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
   void BasicQos(const std::string &consumer_tag,
                 std::uint16_t message_prefetch_count);
 
+  /**
+   * Modify consumer's message prefetch count and size
+   *
+   * As BasicQos(const std::string &, std::uint16_t), also limiting the
+   * unacknowledged messages to `prefetch_size` bytes of body, where the
+   * broker supports it. RabbitMQ does not, and closes the connection with
+   * NotImplementedException for a non-zero `prefetch_size`; when consuming
+   * through OnReadable(), use OpenOpts::max_buffered_bytes to bound memory
+   * use with it.
+   *
+   * @param consumer_tag The consumer tag to adjust the prefetch for.
+   * @param message_prefetch_count The number of unacknowledged message the
+   * broker will deliver. A value of 0 means no limit.
+   * @param prefetch_size The bytes of unacknowledged messages the broker
+   * will deliver. A value of 0 means no limit.
+   */
+  void BasicQos(const std::string &consumer_tag,
+                std::uint16_t message_prefetch_count,
+                std::uint32_t prefetch_size);
+
   /**
    * Cancels a previously created Consumer
    *
@@ -830,6 +1945,19 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
    */
   void BasicCancel(const std::string &consumer_tag);
 
+  /**
+   * Cancels a consumer without waiting for the broker
+   *
+   * Returns as soon as the request is written. No more messages are
+   * returned for the consumer; those the broker had already sent are given
+   * back to the queue (unless the consumer was `no_ack`), and its channel is
+   * reused once the broker has confirmed the cancel.
+   *
+   * @param consumer_tag The same `consumer_tag` used when the consumer was
+   * created with \ref BasicConsume.
+   */
+  void BasicCancelNoWait(const std::string &consumer_tag);
+
   /**
    * Consumes a single message
    *
@@ -887,6 +2015,39 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
   bool BasicConsumeMessage(const std::string &consumer_tag,
                            Envelope::ptr_t &envelope, int timeout = -1);
 
+  /**
+   * Consumes a single message, passing its body on as it arrives
+   *
+   * Works like BasicConsumeMessage(const std::string &, Envelope::ptr_t &,
+   * int), except the body is never assembled: `on_chunk` is called with each
+   * body frame as it is read off the socket, together with the envelope,
+   * whose message has its properties but an empty body. A message with an
+   * empty body gets a single call with an empty chunk. This lets a consumer
+   * hash, inflate or store a large message in constant memory.
+   *
+   * A message that had already been read in full when this is called, and
+   * every message in \ref OpenOpts::thread_safe mode, is passed on as a
+   * single chunk holding its whole body.
+   *
+   * Only such a whole body is decoded by the codec set with SetCodec(); the
+   * chunks of a body read frame by frame are passed on as they arrived. The
+   * envelope's message keeps the codec's content-encoding when its body is
+   * still encoded, check it before using the chunks.
+   *
+   * If `on_chunk` throws the rest of the body is still read and discarded,
+   * then the exception is rethrown.
+   *
+   * @param consumer_tag Consumer ID (returned from \ref BasicConsume).
+   * @param [out] envelope The delivered message, without its body.
+   * @param on_chunk Called with each part of the body in order.
+   * @param timeout Timeout, in ms, for the message to start arriving.
+   * @returns `false` on timeout, `true` on message delivery
+   */
+  bool BasicConsumeMessageStream(const std::string &consumer_tag,
+                                 Envelope::ptr_t &envelope,
+                                 const body_chunk_handler_t &on_chunk,
+                                 int timeout = -1);
+
   /**
    * Consumes a single message with a timeout from multiple consumers
    *
@@ -920,19 +2081,254 @@ class SIMPLEAMQPCLIENT_EXPORT Channel {
    */
   bool BasicConsumeMessage(Envelope::ptr_t &envelope, int timeout = -1);
 
+  /**
+   * Consumes a single message, reporting a cancelled consumer rather than
+   * throwing
+   *
+   * Behaves like BasicConsumeMessage(const std::string &, Envelope::ptr_t &,
+   * int), except that a basic.cancel from the broker comes back as a
+   * `cr_cancelled` result instead of as a ConsumerCancelledException.
+   * Channel and connection errors are still thrown.
+   *
+   * @param consumer_tag The consumer tag to wait for a message from.
+   * @param timeout The timeout in milliseconds, 0 works like a non-blocking
+   * read, -1 is an infinite timeout.
+   */
+  ConsumeResult TryBasicConsumeMessage(const std::string &consumer_tag,
+                                       int timeout = -1);
+
+  /**
+   * Consumes a single message from multiple consumers, reporting a cancelled
+   * consumer rather than throwing
+   *
+   * See TryBasicConsumeMessage(const std::string &, int).
+   */
+  ConsumeResult TryBasicConsumeMessage(
+      const std::vector<std::string> &consumer_tags, int timeout = -1);
+
+  /**
+   * Consumes a single message from any consumer on a Channel, reporting a
+   * cancelled consumer rather than throwing
+   *
+   * See TryBasicConsumeMessage(const std::string &, int).
+   *
+   * @throws ConsumerTagNotFoundException if there are no consumers
+   */
+  ConsumeResult TryBasicConsumeMessage(int timeout = -1);
+
+  /**
+   * Consumes a batch of messages from multiple consumers
+   *
+   * Waits for a first message to be delivered to one of the listed consumer
+   * tags, then takes every further message that has already been received or
+   * can be read from the socket without blocking, up to `max_count`. A
+   * non-zero `linger` keeps waiting up to that many milliseconds for the
+   * batch to fill.
+   *
+   * This function only works after `BasicConsume` has been successfully called.
+   *
+   * @param consumer_tags A list of the consumer tags to wait from.
+   * @param max_count The maximum number of messages to return.
+   * @param timeout The timeout in milliseconds for the first message to be
+   * delivered. 0 works like a non-blocking read, -1 is an infinite timeout.
+   * @param [out] envelopes Delivered messages are appended to this.
+   * @param linger The time in milliseconds, after the first message, to wait
+   * for more messages.
+   * @returns the number of messages appended, 0 on timeout.
+   */
+  std::size_t BasicConsumeMessages(
+      const std::vector<std::string> &consumer_tags, std::size_t max_count,
+      int timeout, std::vector<Envelope::ptr_t> &envelopes, int linger = 0);
+
+  /**
+   * Sends a request to be answered through RabbitMQ's direct reply-to
+   *
+   * The request is published with `reply_to` set to the
+   * `amq.rabbitmq.reply-to` pseudo-queue and a `correlation_id` chosen by the
+   * Channel, replacing any the message has. The server is expected to
+   * publish its reply to the default exchange with the request's `reply_to`
+   * as the routing key and its `correlation_id` copied over.
+   *
+   * Every call made on a Channel shares one reply consumer, started by the
+   * first request on a channel it uses for requests too, so no queue is
+   * declared per call. Replies are matched to calls by correlation id as
+   * they are read; any number of calls may be waiting at once.
+   *
+   * Requests are not confirmed by the broker and are not mandatory. Should
+   * the reply channel close, for instance because the exchange does not
+   * exist, the calls waiting on it are forgotten and the next request starts
+   * a new reply consumer.
+   *
+   * @param exchange_name The name of the exchange to publish the request to
+   * @param routing_key The routing key to publish with
+   * @param request The request message
+   * @returns the correlation id to pass to RpcWaitForReply()
+   */
+  std::string RpcSend(const std::string &exchange_name,
+                      const std::string &routing_key,
+                      const BasicMessage::ptr_t request);
+
+  /**
+   * Waits for the reply to a request sent with RpcSend()
+   *
+   * @param correlation_id What RpcSend() returned
+   * @param [out] reply The reply
+   * @param timeout The timeout in milliseconds, 0 works like a non-blocking
+   * read, -1 is an infinite timeout. The call is still pending after a
+   * timeout; wait again, or RpcAbandon() it.
+   * @returns `true` once the reply has arrived, `false` on timeout
+   * @throws std::invalid_argument if no call with `correlation_id` is
+   * pending: its reply was already taken or it was abandoned
+   * @throws AmqpException if the reply channel was closed by the broker
+   * while the call was pending, the error it was closed with
+   * @throws ConnectionClosedException if automatic recovery replaced the
+   * connection while the call was pending
+   */
+  bool RpcWaitForReply(const std::string &correlation_id,
+                       BasicMessage::ptr_t &reply, int timeout = -1);
+
+  /**
+   * Gives up on a request sent with RpcSend(), its reply is dropped if it
+   * arrives later
+   */
+  void RpcAbandon(const std::string &correlation_id);
+
+  /**
+   * Sends a request and waits for its reply
+   *
+   * RpcSend() and RpcWaitForReply() in one, the call is abandoned if it
+   * times out.
+   *
+   * @returns the reply, or null on timeout
+   */
+  BasicMessage::ptr_t RpcCall(const std::string &exchange_name,
+                              const std::string &routing_key,
+                              const BasicMessage::ptr_t request,
+                              int timeout = -1);
+
+  /// The number of requests sent with RpcSend() still awaiting their reply
+  std::size_t PendingRpcCalls() const;
+
+  /**
+   * Sets the callback that receives RPC replies as they are read
+   *
+   * While set, the reply to a pending call is passed to the callback and the
+   * call is no longer pending, rather than the reply being kept for
+   * RpcWaitForReply(). The callback runs inside whichever call reads the
+   * reply, such as OnReadable(), with the Channel locked.
+   *
+   * @param callback May be empty to go back to keeping replies
+   */
+  void SetRpcReplyCallback(const rpc_reply_callback_t &callback);
+
+  /**
+   * Sets the codec that compresses message bodies
+   *
+   * Messages published with BasicPublish(), TryBasicPublish(),
+   * BasicPublishAsync(), BasicRelay(), BasicRelayAsync() and
+   * BasicPublishBatch() whose body is at least `min_size` bytes, and that
+   * have no content-encoding of their own, are sent encoded by the codec
+   * with its content-encoding set. The message itself is left untouched. A
+   * body the codec does not shrink is sent as it is.
+   *
+   * Messages consumed, got or returned whose content-encoding is the
+   * codec's are decoded before they reach the application, and their
+   * content-encoding is cleared. One the codec fails to decode, or that
+   * would decode to more than `max_decoded_size` bytes, is passed on as it
+   * arrived with its content-encoding still set, and counted in
+   * Stats::decode_failures.
+   *
+   * PublishTemplate and segmented publishes and RPC requests are never
+   * encoded, and a body BasicConsumeMessageStream() hands over frame by
+   * frame is not decoded: check its message's content-encoding there.
+   *
+   * @param codec The codec, called with the Channel locked. May be null to
+   * stop encoding and decoding.
+   * @param min_size The smallest body worth encoding
+   * @param max_decoded_size The largest body to decode a message to, 0 for
+   * 64 times its encoded size
+   */
+  void SetCodec(const Codec::ptr_t &codec, std::size_t min_size = 1024,
+                std::size_t max_decoded_size = 0);
+
  private:
+  // The bodies of the overloads taking their arguments as a Table or as a
+  // FlatTable, only instantiated in Channel.cpp
+  template <class ArgumentTable>
+  void DoDeclareExchange(const std::string &exchange_name,
+                         const std::string &exchange_type, bool passive,
+                         bool durable, bool auto_delete,
+                         const ArgumentTable &arguments);
+  template <class ArgumentTable>
+  void DoBindExchange(const std::string &destination, const std::string &source,
+                      const std::string &routing_key,
+                      const ArgumentTable &arguments);
+  template <class ArgumentTable>
+  void DoUnbindExchange(const std::string &destination,
+                        const std::string &source,
+                        const std::string &routing_key,
+                        const ArgumentTable &arguments);
+  template <class ArgumentTable>
+  std::string DoDeclareQueueWithCounts(
+      const std::string &queue_name, std::uint32_t &message_count,
+      std::uint32_t &consumer_count, bool passive, bool durable,
+      bool exclusive, bool auto_delete, const ArgumentTable &arguments);
+  template <class ArgumentTable>
+  void DoBindQueue(const std::string &queue_name,
+                   const std::string &exchange_name,
+                   const std::string &routing_key,
+                   const ArgumentTable &arguments);
+  template <class ArgumentTable>
+  void DoUnbindQueue(const std::string &queue_name,
+                     const std::string &exchange_name,
+                     const std::string &routing_key,
+                     const ArgumentTable &arguments);
+  template <class ArgumentTable>
+  std::string DoBasicConsume(const std::string &queue,
+                             const std::string &consumer_tag, bool no_local,
+                             bool no_ack, bool exclusive,
+                             std::uint16_t message_prefetch_count,
+                             const ArgumentTable &arguments, bool nowait);
+
+  // Checks the connection is up, reconnecting first if it is down and
+  // automatic recovery is on
+  void EnsureConnected();
+  void Recover();
+  void ReplayTopology();
+  void PublishBuffered();
+  // Sends the publishes held back by BasicPublishAsync() while blocked, once
+  // the connection is no longer blocked
+  void SendBlockedPublishes();
+
+  // Opens a connection to the first of the endpoints that will have one
+  static ChannelImpl *Connect(const OpenOpts &opts,
+                              Detail::EndpointSelector &endpoints);
+  // Connects to several endpoints at once, returns the first to finish the
+  // handshake or NULL, with error set, if none did
+  static ChannelImpl *RaceEndpoints(const OpenOpts &opts,
+                                    Detail::EndpointSelector &endpoints,
+                                    const std::vector<std::size_t> &candidates,
+                                    std::exception_ptr &error);
+  static ChannelImpl *ConnectToEndpoint(const OpenOpts &opts,
+                                        const OpenOpts::Endpoint &endpoint);
+
   static ChannelImpl *OpenChannel(const std::string &host, int port,
+                                  int connect_timeout,
+                                  const OpenOpts::SocketOptions &socket_options,
                                   const std::string &username,
                                   const std::string &password,
                                   const std::string &vhost, int frame_max,
-                                  bool sasl_external);
+                                  int heartbeat, bool sasl_external);
 
-  static ChannelImpl *OpenSecureChannel(const std::string &host, int port,
-                                        const std::string &username,
-                                        const std::string &password,
-                                        const std::string &vhost, int frame_max,
-                                        const OpenOpts::TLSParams &tls_params,
-                                        bool sasl_external);
+  static ChannelImpl *OpenSecureChannel(
+      const std::string &host, int port, int connect_timeout,
+      const OpenOpts::SocketOptions &socket_options,
+      const std::string &username, const std::string &password,
+      const std::string &vhost, int frame_max, int heartbeat,
+      const OpenOpts::TLSParams &tls_params, bool sasl_external);
+
+  // Checks for frames buffered by rabbitmq-c before polling the sockets
+  friend class ChannelPool;
 
   /// PIMPL idiom
   std::unique_ptr<ChannelImpl> m_impl;
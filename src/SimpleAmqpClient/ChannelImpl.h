@@ -35,16 +35,40 @@
 #include "SimpleAmqpClient/AmqpException.h"
 #include "SimpleAmqpClient/BasicMessage.h"
 #include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/ChannelSet.h"
+#include "SimpleAmqpClient/ConnectionRecovery.h"
 #include "SimpleAmqpClient/ConsumerCancelledException.h"
+#include "SimpleAmqpClient/ConsumerDispatcher.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/MessagePool.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace AmqpClient {
+namespace Detail {
+
+// A message body as sent once compressed by the Channel's codec
+struct encoded_body_t {
+  std::string_view content_encoding;
+  std::string_view body;
+};
+
+}  // namespace Detail
 
 class Channel::ChannelImpl {
  public:
@@ -57,26 +81,132 @@ class Channel::ChannelImpl {
   virtual ~ChannelImpl();
 
   typedef std::vector<amqp_channel_t> channel_list_t;
-  typedef std::vector<amqp_frame_t> frame_queue_t;
+  typedef std::deque<amqp_frame_t> frame_queue_t;
   typedef std::map<amqp_channel_t, frame_queue_t> channel_map_t;
   typedef channel_map_t::iterator channel_map_iterator_t;
 
+  // Held by every Channel method while OpenOpts::thread_safe is set, so only
+  // one thread at a time drives the connection. Taking it again on a thread
+  // that already holds it is a no-op, and when thread safety is off it does
+  // nothing at all.
+  class ScopedLock {
+   public:
+    explicit ScopedLock(ChannelImpl &impl);
+    ~ScopedLock();
+
+    ScopedLock(const ScopedLock &) = delete;
+    ScopedLock &operator=(const ScopedLock &) = delete;
+
+   private:
+    ChannelImpl &m_impl;
+    std::unique_lock<std::mutex> m_lock;
+  };
+
+  // Channels to wait on, as a list to walk their queues in order and as a
+  // bit per channel, so matching a frame's channel is a single lookup
+  class ChannelFilter {
+   public:
+    typedef channel_list_t::const_iterator const_iterator;
+
+    void Insert(amqp_channel_t channel) {
+      if (Contains(channel)) {
+        return;
+      }
+      const std::size_t word = channel / 64;
+      if (word >= m_bits.size()) {
+        m_bits.resize(word + 1, 0);
+      }
+      m_bits[word] |= static_cast<std::uint64_t>(1) << (channel % 64);
+      m_channels.push_back(channel);
+    }
+    bool Contains(amqp_channel_t channel) const {
+      const std::size_t word = channel / 64;
+      return word < m_bits.size() &&
+             0 != ((m_bits[word] >> (channel % 64)) & 1);
+    }
+    std::size_t size() const { return m_channels.size(); }
+    const_iterator begin() const { return m_channels.begin(); }
+    const_iterator end() const { return m_channels.end(); }
+
+   private:
+    channel_list_t m_channels;
+    std::vector<std::uint64_t> m_bits;
+  };
+  // Shared so that a wait can keep using a filter the cache has replaced
+  typedef std::shared_ptr<const ChannelFilter> channel_filter_ptr_t;
+
+  // Most waits are on a single channel for one to three methods, these are
+  // resolved at compile time for the std::array lists they are given
+  template <std::size_t N>
+  static bool HasChannel(const std::array<amqp_channel_t, N> &channels,
+                         amqp_channel_t channel) {
+    if constexpr (1 == N) {
+      return channels[0] == channel;
+    } else {
+      return channels.end() !=
+             std::find(channels.begin(), channels.end(), channel);
+    }
+  }
+  static bool HasChannel(const ChannelFilter &channels,
+                         amqp_channel_t channel) {
+    return channels.Contains(channel);
+  }
+  template <std::size_t N>
+  static bool HasMethod(const std::array<std::uint32_t, N> &methods,
+                        amqp_method_number_t method) {
+    if constexpr (1 == N) {
+      return methods[0] == method;
+    } else if constexpr (2 == N) {
+      return methods[0] == method || methods[1] == method;
+    } else if constexpr (3 == N) {
+      return methods[0] == method || methods[1] == method ||
+             methods[2] == method;
+    } else {
+      return methods.end() != std::find(methods.begin(), methods.end(), method);
+    }
+  }
+
+  void SetThreadSafe(bool enabled) { m_thread_safe = enabled; }
+  bool ThreadSafe() const { return m_thread_safe; }
+
   void DoLogin(const std::string &username, const std::string &password,
-               const std::string &vhost, int frame_max,
+               const std::string &vhost, int frame_max, int heartbeat,
                bool sasl_external = false);
   amqp_channel_t GetChannel();
   void ReturnChannel(amqp_channel_t channel);
+  // Opens count channels ready for GetChannel(), in confirm mode when
+  // publisher confirms are on. Every request is sent before any reply is
+  // read, so the whole batch costs a single round trip.
+  void PreopenChannels(std::size_t count);
   bool IsChannelOpen(amqp_channel_t channel);
 
   bool GetNextFrameFromBroker(amqp_frame_t &frame,
                               std::chrono::microseconds timeout);
 
-  bool CheckForQueuedMessageOnChannel(amqp_channel_t message_on_channel) const;
   void AddToFrameQueue(const amqp_frame_t &frame);
+  void ProcessFrame(const amqp_frame_t &frame);
+
+  // Frames are queued per channel, indexed by channel number, so finding the
+  // next frame for a channel does not require walking frames for any other
+  frame_queue_t &GetFrameQueue(amqp_channel_t channel) {
+    return GetChannelFrames(channel).frames;
+  }
+  bool HasQueuedFrames(amqp_channel_t channel) const {
+    return channel < m_frame_queues.size() &&
+           !m_frame_queues[channel].frames.empty();
+  }
+  // Called once the method frame of a content-carrying message has been taken
+  // off the queue, from then on its header and body frames belong to the
+  // reader rather than to the assembler in AddToFrameQueue
+  void ResetContentAssembly(amqp_channel_t channel) {
+    if (channel < m_frame_queues.size()) {
+      m_frame_queues[channel].assembly = CA_Idle;
+    }
+  }
 
   template <class ChannelListType>
   bool GetNextFrameFromBrokerOnChannel(
-      const ChannelListType channels, amqp_frame_t &frame_out,
+      const ChannelListType &channels, amqp_frame_t &frame_out,
       std::chrono::microseconds timeout = std::chrono::microseconds::max()) {
     std::chrono::steady_clock::time_point end_point;
     std::chrono::microseconds timeout_left = timeout;
@@ -86,24 +216,12 @@ class Channel::ChannelImpl {
 
     amqp_frame_t frame;
     while (GetNextFrameFromBroker(frame, timeout_left)) {
-      if (channels.end() !=
-          std::find(channels.begin(), channels.end(), frame.channel)) {
+      if (HasChannel(channels, frame.channel)) {
         frame_out = frame;
         return true;
       }
 
-      if (frame.channel == 0) {
-        // Only thing we care to handle on the channel0 is the connection.close
-        // method
-        if (AMQP_FRAME_METHOD == frame.frame_type &&
-            AMQP_CONNECTION_CLOSE_METHOD == frame.payload.method.id) {
-          FinishCloseConnection();
-          AmqpException::Throw(*reinterpret_cast<amqp_connection_close_t *>(
-              frame.payload.method.decoded));
-        }
-      } else {
-        AddToFrameQueue(frame);
-      }
+      ProcessFrame(frame);
 
       if (timeout != std::chrono::microseconds::max()) {
         std::chrono::steady_clock::time_point now =
@@ -122,6 +240,37 @@ class Channel::ChannelImpl {
       amqp_channel_t channel, amqp_frame_t &frame,
       std::chrono::microseconds timeout = std::chrono::microseconds::max());
 
+  // Thread-safe mode only: reads whatever frames can be had within timeout
+  // and routes them through ProcessFrame. Only one thread reads the socket at
+  // a time, and it does so with the lock released; any other thread waits
+  // here for it to finish. Returns false if the timeout passed without any
+  // frames being read. With heartbeats on, the reader wakes up at least every
+  // half interval to service them and may return true having read nothing,
+  // callers re-check their condition and wait again. Queued confirm
+  // callbacks are run before returning, once the socket is free.
+  bool WaitForProgress(std::chrono::microseconds timeout);
+  // The two halves of WaitForProgress: waiting for the thread that is
+  // reading, and reading as the only thread on the socket
+  bool WaitForReader(std::chrono::microseconds timeout);
+  bool ReadAsReader(std::chrono::microseconds timeout);
+
+  // Routes every frame that is already buffered or can be read without
+  // blocking through ProcessFrame, returns how many there were
+  std::size_t ReadAvailableFrames();
+
+  // Whether rabbitmq-c holds data it has read off the socket, which polling
+  // the socket would not report
+  bool HasBufferedFrames() const {
+    return amqp_frames_enqueued(m_connection) ||
+           amqp_data_in_buffer(m_connection);
+  }
+
+  // With heartbeats on, sends one if half an interval has passed since the
+  // last. When idle is set, also gives rabbitmq-c the chance to notice that
+  // the broker's heartbeats have stopped: it only checks when a wait times
+  // out, which a zero timeout never does. Returns how many frames were read.
+  std::size_t ServiceHeartbeats(bool idle);
+
   static bool is_on_channel(const amqp_frame_t frame, amqp_channel_t channel) {
     return channel == frame.channel;
   }
@@ -141,35 +290,41 @@ class Channel::ChannelImpl {
 
   template <class ChannelListType, class ResponseListType>
   static bool is_expected_method_on_channel(
-      const amqp_frame_t &frame, const ChannelListType channels,
+      const amqp_frame_t &frame, const ChannelListType &channels,
       const ResponseListType &expected_responses) {
-    return channels.end() !=
-               std::find(channels.begin(), channels.end(), frame.channel) &&
-           AMQP_FRAME_METHOD == frame.frame_type &&
-           expected_responses.end() != std::find(expected_responses.begin(),
-                                                 expected_responses.end(),
-                                                 frame.payload.method.id);
+    return AMQP_FRAME_METHOD == frame.frame_type &&
+           HasMethod(expected_responses, frame.payload.method.id) &&
+           HasChannel(channels, frame.channel);
   }
 
   template <class ChannelListType, class ResponseListType>
   bool GetMethodOnChannel(
-      const ChannelListType channels, amqp_frame_t &frame,
+      const ChannelListType &channels, amqp_frame_t &frame,
       const ResponseListType &expected_responses,
       std::chrono::microseconds timeout = std::chrono::microseconds::max()) {
-    frame_queue_t::iterator desired_frame = std::find_if(
-        m_frame_queue.begin(), m_frame_queue.end(),
-        [channels, expected_responses](auto &frame) {
-          return ChannelImpl::is_expected_method_on_channel<ChannelListType,
-                                                            ResponseListType>(
-              frame, channels, expected_responses);
-        });
-
-    if (m_frame_queue.end() != desired_frame) {
-      frame = *desired_frame;
-      m_frame_queue.erase(desired_frame);
+    if (TakeQueuedMethod(channels, frame, expected_responses)) {
       return true;
     }
 
+    if (m_thread_safe) {
+      // Everything read off the socket goes through the frame queues, so
+      // keep checking them until the frame or a channel.close turns up
+      Deadline deadline(timeout);
+      for (;;) {
+        for (typename ChannelListType::const_iterator channel =
+                 channels.begin();
+             channel != channels.end(); ++channel) {
+          CheckForQueuedChannelClose(*channel);
+        }
+        if (!WaitForProgress(deadline.Remaining())) {
+          return false;
+        }
+        if (TakeQueuedMethod(channels, frame, expected_responses)) {
+          return true;
+        }
+      }
+    }
+
     std::chrono::steady_clock::time_point end_point;
     std::chrono::microseconds timeout_left = timeout;
     if (timeout != std::chrono::microseconds::max()) {
@@ -186,16 +341,18 @@ class Channel::ChannelImpl {
       }
       if (AMQP_FRAME_METHOD == incoming_frame.frame_type &&
           AMQP_CHANNEL_CLOSE_METHOD == incoming_frame.payload.method.id) {
-        FinishCloseChannel(incoming_frame.channel);
+        const amqp_channel_close_t &close =
+            *reinterpret_cast<amqp_channel_close_t *>(
+                incoming_frame.payload.method.decoded);
+        FinishCloseChannel(incoming_frame.channel, close);
         try {
-          AmqpException::Throw(*reinterpret_cast<amqp_channel_close_t *>(
-              incoming_frame.payload.method.decoded));
+          AmqpException::Throw(close);
         } catch (AmqpException &) {
           MaybeReleaseBuffersOnChannel(incoming_frame.channel);
           throw;
         }
       }
-      m_frame_queue.push_back(incoming_frame);
+      AddToFrameQueue(incoming_frame);
 
       if (timeout != std::chrono::microseconds::max()) {
         std::chrono::steady_clock::time_point now =
@@ -210,16 +367,50 @@ class Channel::ChannelImpl {
     return false;
   }
 
+  template <class ChannelListType, class ResponseListType>
+  bool TakeQueuedMethod(const ChannelListType &channels, amqp_frame_t &frame,
+                        const ResponseListType &expected_responses) {
+    for (typename ChannelListType::const_iterator channel = channels.begin();
+         channel != channels.end(); ++channel) {
+      if (!HasQueuedFrames(*channel)) {
+        continue;
+      }
+      // Every frame in the queue is on the channel, only the method is left
+      // to match
+      frame_queue_t &queue = GetFrameQueue(*channel);
+      frame_queue_t::iterator desired_frame = std::find_if(
+          queue.begin(), queue.end(), [&expected_responses](auto &f) {
+            return AMQP_FRAME_METHOD == f.frame_type &&
+                   HasMethod(expected_responses, f.payload.method.id);
+          });
+
+      if (queue.end() != desired_frame) {
+        frame = *desired_frame;
+        queue.erase(desired_frame);
+        return true;
+      }
+    }
+    return false;
+  }
+
   template <class ResponseListType>
   amqp_frame_t DoRpcOnChannel(amqp_channel_t channel, std::uint32_t method_id,
                               void *decoded,
                               const ResponseListType &expected_responses) {
+    std::chrono::steady_clock::time_point start;
+    if (m_stats) {
+      start = std::chrono::steady_clock::now();
+    }
     CheckForError(amqp_send_method(m_connection, channel, method_id, decoded));
 
     amqp_frame_t response;
     std::array<amqp_channel_t, 1> channels = {channel};
 
     GetMethodOnChannel(channels, response, expected_responses);
+    if (m_stats) {
+      m_stats->rpc_latency[method_id].Add(std::chrono::steady_clock::now() -
+                                          start);
+    }
     return response;
   }
 
@@ -233,35 +424,119 @@ class Channel::ChannelImpl {
     return ret;
   }
 
+  // When cancelled_tag is set, a consumer cancelled by the broker is stored
+  // there, see HandleConsumerCancel, and false returned
   template <class ChannelListType>
-  static bool envelope_on_channel(const Envelope::ptr_t &envelope,
-                                  const ChannelListType channels) {
-    return channels.end() != std::find(channels.begin(), channels.end(),
-                                       envelope->DeliveryChannel());
+  bool ConsumeMessageOnChannel(const ChannelListType &channels,
+                               Envelope::ptr_t &message, int timeout,
+                               std::string *cancelled_tag = NULL) {
+    if (TakeDeliveredMessage(channels, message)) {
+      return true;
+    }
+
+    if (m_thread_safe) {
+      // Deliveries are assembled into envelopes as their frames are read, so
+      // only the delivered list and consumer cancellations need watching
+      const std::array<std::uint32_t, 1> CANCEL = {AMQP_BASIC_CANCEL_METHOD};
+      Deadline deadline(timeout >= 0 ? std::chrono::milliseconds(timeout)
+                                     : std::chrono::microseconds::max());
+      for (;;) {
+        amqp_frame_t cancel;
+        if (TakeQueuedMethod(channels, cancel, CANCEL)) {
+          HandleConsumerCancel(cancel, cancelled_tag);
+          return false;
+        }
+        for (typename ChannelListType::const_iterator channel =
+                 channels.begin();
+             channel != channels.end(); ++channel) {
+          CheckForQueuedChannelClose(*channel);
+        }
+        if (!WaitForProgress(deadline.Remaining())) {
+          return false;
+        }
+        if (TakeDeliveredMessage(channels, message)) {
+          return true;
+        }
+      }
+    }
+
+    return ConsumeMessageOnChannelInner(channels, message, timeout,
+                                        cancelled_tag);
   }
 
+  // Takes the next message delivered on any of channels. With more than one
+  // channel, channels take turns in the order they became ready.
   template <class ChannelListType>
-  bool ConsumeMessageOnChannel(const ChannelListType channels,
-                               Envelope::ptr_t &message, int timeout) {
-    envelope_list_t::iterator it =
-        std::find_if(m_delivered_messages.begin(), m_delivered_messages.end(),
-                     [channels](auto &message) {
-                       return ChannelImpl::envelope_on_channel<ChannelListType>(
-                           message, channels);
-                     });
-
-    if (it != m_delivered_messages.end()) {
-      message = *it;
-      m_delivered_messages.erase(it);
-      return true;
+  bool TakeDeliveredMessage(const ChannelListType &channels,
+                            Envelope::ptr_t &message) {
+    if (1 == channels.size()) {
+      return TakeDeliveredMessage(*channels.begin(), message);
     }
+    for (std::deque<amqp_channel_t>::iterator it = m_ready_channels.begin();
+         it != m_ready_channels.end();) {
+      if (!HasChannel(channels, *it)) {
+        ++it;
+        continue;
+      }
+      amqp_channel_t channel = *it;
+      it = m_ready_channels.erase(it);
+      if (TakeReadyDelivery(channel, message)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  bool TakeDeliveredMessage(amqp_channel_t channel, Envelope::ptr_t &message);
+  bool HasDeliveredMessages(amqp_channel_t channel) const {
+    return channel < m_delivery_queues.size() &&
+           !m_delivery_queues[channel].envelopes.empty();
+  }
+  // Takes the next message delivered to any consumer without a handler
+  bool TakeAnyDeliveredMessage(Envelope::ptr_t &message);
 
-    return ConsumeMessageOnChannelInner(channels, message, timeout);
+  // Waits up to timeout ms for a first message, then takes whatever else is
+  // already buffered or readable without blocking, and for up to linger ms
+  // more to fill the batch.
+  template <class ChannelListType>
+  std::size_t ConsumeMessagesOnChannel(const ChannelListType &channels,
+                                       std::size_t max_count, int timeout,
+                                       int linger,
+                                       std::vector<Envelope::ptr_t> &out) {
+    Envelope::ptr_t message;
+    if (0 == max_count ||
+        !ConsumeMessageOnChannel(channels, message, timeout)) {
+      return 0;
+    }
+    out.push_back(message);
+    std::size_t count = 1;
+
+    const std::chrono::steady_clock::time_point end_point =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(linger);
+    while (count < max_count) {
+      int wait = 0;
+      if (linger > 0) {
+        std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        if (now < end_point) {
+          std::chrono::milliseconds left =
+              std::chrono::duration_cast<std::chrono::milliseconds>(end_point -
+                                                                    now);
+          wait = static_cast<int>(left.count());
+        }
+      }
+      if (!ConsumeMessageOnChannel(channels, message, wait)) {
+        break;
+      }
+      out.push_back(message);
+      ++count;
+    }
+    return count;
   }
 
   template <class ChannelListType>
-  bool ConsumeMessageOnChannelInner(const ChannelListType channels,
-                                    Envelope::ptr_t &message, int timeout) {
+  bool ConsumeMessageOnChannelInner(const ChannelListType &channels,
+                                    Envelope::ptr_t &message, int timeout,
+                                    std::string *cancelled_tag = NULL) {
     const std::array<std::uint32_t, 2> DELIVER_OR_CANCEL = {
         AMQP_BASIC_DELIVER_METHOD, AMQP_BASIC_CANCEL_METHOD};
 
@@ -276,30 +551,38 @@ class Channel::ChannelImpl {
     }
 
     if (AMQP_BASIC_CANCEL_METHOD == deliver.payload.method.id) {
-      amqp_basic_cancel_t *cancel_method =
-          reinterpret_cast<amqp_basic_cancel_t *>(
-              deliver.payload.method.decoded);
-      std::string consumer_tag((char *)cancel_method->consumer_tag.bytes,
-                               cancel_method->consumer_tag.len);
-
-      RemoveConsumer(consumer_tag);
-      ReturnChannel(deliver.channel);
-      MaybeReleaseBuffersOnChannel(deliver.channel);
-
-      throw ConsumerCancelledException(consumer_tag);
+      HandleConsumerCancel(deliver, cancelled_tag);
+      return false;
     }
 
     amqp_basic_deliver_t *deliver_method =
         reinterpret_cast<amqp_basic_deliver_t *>(
             deliver.payload.method.decoded);
 
-    const std::string exchange((char *)deliver_method->exchange.bytes,
-                               deliver_method->exchange.len);
-    const std::string routing_key((char *)deliver_method->routing_key.bytes,
-                                  deliver_method->routing_key.len);
-    const std::string in_consumer_tag(
-        (char *)deliver_method->consumer_tag.bytes,
-        deliver_method->consumer_tag.len);
+    if (m_message_pool) {
+      Envelope::ptr_t envelope = m_message_pool->AcquireEnvelope();
+      Detail::MessagePool::SetDeliveryInfo(
+          *envelope, deliver_method->consumer_tag,
+          ClientDeliveryTag(deliver.channel, deliver_method->delivery_tag,
+                            GetDeliveryQueue(deliver.channel).no_ack),
+          deliver_method->exchange,
+          0 != deliver_method->redelivered, deliver_method->routing_key,
+          deliver.channel);
+      MaybeReleaseBuffersOnChannel(deliver.channel);
+
+      Detail::MessagePool::SetMessage(*envelope, ReadContent(deliver.channel));
+      MaybeReleaseBuffersOnChannel(deliver.channel);
+
+      message = envelope;
+      return true;
+    }
+
+    std::string exchange((char *)deliver_method->exchange.bytes,
+                         deliver_method->exchange.len);
+    std::string routing_key((char *)deliver_method->routing_key.bytes,
+                            deliver_method->routing_key.len);
+    std::string in_consumer_tag((char *)deliver_method->consumer_tag.bytes,
+                                deliver_method->consumer_tag.len);
     const std::uint64_t delivery_tag = deliver_method->delivery_tag;
     const bool redelivered = (deliver_method->redelivered == 0 ? false : true);
     MaybeReleaseBuffersOnChannel(deliver.channel);
@@ -307,33 +590,307 @@ class Channel::ChannelImpl {
     BasicMessage::ptr_t content = ReadContent(deliver.channel);
     MaybeReleaseBuffersOnChannel(deliver.channel);
 
-    message = Envelope::Create(content, in_consumer_tag, delivery_tag, exchange,
-                               redelivered, routing_key, deliver.channel);
+    message = Envelope::Create(
+        std::move(content), std::move(in_consumer_tag),
+        ClientDeliveryTag(deliver.channel, delivery_tag,
+                          GetDeliveryQueue(deliver.channel).no_ack),
+        std::move(exchange), redelivered, std::move(routing_key),
+        deliver.channel);
     return true;
   }
 
-  amqp_channel_t CreateNewChannel();
+  // Forgets the consumer named by a broker-sent basic.cancel and throws
+  // ConsumerCancelledException, or when cancelled_tag is set stores the
+  // consumer's tag there instead
+  void HandleConsumerCancel(const amqp_frame_t &cancel,
+                            std::string *cancelled_tag = NULL);
+
+  amqp_channel_t CreateNewChannel(bool confirm_select);
   amqp_channel_t GetNextChannelId();
 
   void CheckRpcReply(amqp_channel_t channel, const amqp_rpc_reply_t &reply);
   void CheckForError(int ret);
 
   void CheckFrameForClose(amqp_frame_t &frame, amqp_channel_t channel);
-  void FinishCloseChannel(amqp_channel_t channel);
+  // close is the broker's reason, RPC calls lost with the channel are
+  // failed with it
+  void FinishCloseChannel(amqp_channel_t channel,
+                          const amqp_channel_close_t &close);
   void FinishCloseConnection();
 
-  MessageReturnedException CreateMessageReturnedException(
-      amqp_basic_return_t &return_method, amqp_channel_t channel);
+  ReturnedMessage ReadReturnedMessage(amqp_basic_return_t &return_method,
+                                      amqp_channel_t channel);
   AmqpClient::BasicMessage::ptr_t ReadContent(amqp_channel_t channel);
+  // Reads the message that follows a basic.get-ok
+  Envelope::ptr_t ReadGetOk(const amqp_basic_get_ok_t &get_ok,
+                            amqp_channel_t channel, bool no_ack);
+  // Like ConsumeMessageOnChannel, but passes the body to on_chunk a frame at
+  // a time as it is read rather than assembling it first
+  bool ConsumeMessageStreamOnChannel(amqp_channel_t channel,
+                                     Envelope::ptr_t &envelope,
+                                     const body_chunk_handler_t &on_chunk,
+                                     int timeout);
+  // Reads frames until one arrives on channel, queueing any others
+  void GetNextStreamFrame(amqp_channel_t channel, amqp_frame_t &frame);
 
-  void AddConsumer(const std::string &consumer_tag, amqp_channel_t channel);
+  void AddConsumer(const std::string &consumer_tag, amqp_channel_t channel,
+                   bool no_ack);
+  // For BasicCancelNoWait(): channel stays out of GetChannel()'s hands until
+  // the broker's cancel-ok turns up, and deliveries that were already on
+  // their way are sent back to the queue
+  void SetCancelPending(amqp_channel_t channel);
+  // Tags for consumers started without waiting for the broker to name them
+  std::string NextConsumerTag();
+
+  // The prefetch count last set with basic.qos on each channel is
+  // remembered, so that a consumer taking over a channel only sets it when
+  // it differs
+  bool HasPrefetch(amqp_channel_t channel, std::uint16_t count) const {
+    return channel < m_channel_prefetch.size() &&
+           count == m_channel_prefetch[channel];
+  }
+  void SetPrefetch(amqp_channel_t channel, std::uint16_t count);
+  void ForgetPrefetch(amqp_channel_t channel) {
+    if (channel < m_channel_prefetch.size()) {
+      m_channel_prefetch[channel] = -1;
+    }
+  }
+
+  // Bodies of the messages in the delivery queues, see
+  // OpenOpts::max_buffered_bytes
+  void SetMaxBufferedBytes(std::size_t bytes) { m_max_buffered_bytes = bytes; }
+  std::size_t BufferedBytes() const { return m_buffered_bytes; }
+  bool OverBufferBudget() const {
+    return 0 != m_max_buffered_bytes &&
+           m_buffered_bytes >= m_max_buffered_bytes;
+  }
   amqp_channel_t RemoveConsumer(const std::string &consumer_tag);
   amqp_channel_t GetConsumerChannel(const std::string &consumer_tag);
-  std::vector<amqp_channel_t> GetAllConsumerChannels() const;
+  // The channels of the named consumers, and of every consumer without a
+  // handler. Both are kept until the set of consumers changes, so that
+  // repeated calls with the same consumers cost no allocations.
+  channel_filter_ptr_t ConsumerChannels(
+      const std::vector<std::string> &consumer_tags);
+  channel_filter_ptr_t AllConsumerChannels();
+
+  amqp_channel_t GetConfirmChannel();
+  bool IsConfirmChannel(amqp_channel_t channel) const {
+    return 0 != m_confirm_channel && channel == m_confirm_channel;
+  }
+  std::uint64_t AddUnconfirmedPublish(bool mandatory,
+                                      const std::string &exchange,
+                                      const std::string &routing_key);
+  // Holds a basic.return read on the confirm channel for the basic.ack that
+  // follows it, against the publish it came from
+  void AddPendingReturn(const ReturnedMessage &returned);
+  // Called once a BasicPublish has been sent on channel, waits for the
+  // broker's confirm if publisher confirms are on and returns the channel
+  void CompletePublish(amqp_channel_t channel);
+  // As CompletePublish, but reports a nack or return rather than throwing
+  // MessageRejectedException or MessageReturnedException
+  PublishConfirm TryCompletePublish(amqp_channel_t channel);
+  static void ThrowPublishFailure(const PublishConfirm &result);
+  std::size_t UnconfirmedPublishCount() const {
+    return m_unconfirmed_publishes.size() + m_blocked_publishes.size();
+  }
+  bool WaitForPublishConfirms(
+      std::size_t max_unconfirmed,
+      std::chrono::microseconds timeout = std::chrono::microseconds::max());
+  // WaitForPublishConfirms without running the confirm callbacks
+  bool ReadPublishConfirms(std::size_t max_unconfirmed,
+                           std::chrono::microseconds timeout);
+  void HandlePublisherConfirm(const amqp_frame_t &frame);
+  // Passes the confirms queued by HandlePublisherConfirm to the confirm
+  // callback. Only called once nothing is reading from the socket, so the
+  // callback may itself wait on the broker.
+  std::size_t RunConfirmCallbacks();
+  // Forgets the publishes still awaiting a confirm, queueing a pc_lost
+  // confirm with cause for each of them
+  void LosePublishes(const std::exception_ptr &cause);
+
+  // Publishes count messages back to back on the confirm channel, then waits
+  // for all of their confirms. publish_one(channel, i) must send the i-th
+  // message and register it with AddUnconfirmedPublish.
+  template <class PublishFunction>
+  std::vector<PublishConfirm> PublishBatch(std::size_t count,
+                                           PublishFunction publish_one) {
+    std::vector<PublishConfirm> results(count);
+    amqp_channel_t channel = GetConfirmChannel();
+
+    m_batch_results = &results;
+    m_batch_first_seq = m_next_publish_seq;
+    try {
+      for (std::size_t i = 0; i < count; ++i) {
+        publish_one(channel, i);
+      }
+      WaitForPublishConfirms(0);
+    } catch (...) {
+      m_batch_results = NULL;
+      throw;
+    }
+    m_batch_results = NULL;
+    return results;
+  }
+  void CheckForQueuedChannelClose(amqp_channel_t channel);
+  void SetConfirmWindow(std::size_t window) { m_confirm_window = window; }
+  std::size_t ConfirmWindow() const { return m_confirm_window; }
+  void SetConfirmCallback(const confirm_callback_t &callback) {
+    m_confirm_callback = callback;
+  }
+
+  // connection.blocked state, updated as the notifications are read
+  bool IsBlocked() const { return m_blocked; }
+  const std::string &BlockedReason() const { return m_blocked_reason; }
+  void SetBlockedCallback(const connection_blocked_callback_t &callback) {
+    m_blocked_callback = callback;
+  }
+  // Async publishes held back while blocked, see
+  // OpenOpts::blocked_publish_buffer_size
+  typedef Detail::ConnectionRecovery::publish_t blocked_publish_t;
+  void SetBlockedPublishLimit(std::size_t limit) {
+    m_blocked_publish_limit = limit;
+  }
+  // Whether async publishes are being held back rather than sent
+  bool HoldingPublishes() const {
+    return m_blocked && 0 != m_blocked_publish_limit;
+  }
+  bool HasBlockedPublishes() const { return !m_blocked_publishes.empty(); }
+  // Returns the sequence number the publish will be confirmed with, or 0 if
+  // the buffer is already full
+  std::uint64_t HoldBlockedPublish(const blocked_publish_t &publish);
+  const blocked_publish_t &FrontBlockedPublish() const {
+    return m_blocked_publishes.front();
+  }
+  void PopBlockedPublish() { m_blocked_publishes.pop_front(); }
+
+  // Direct reply-to RPC, see Channel::RpcSend(). The reply consumer has a
+  // channel of its own, set up by the first request; it is not in
+  // m_consumer_channel_map, so BasicConsumeMessage() never sees the replies.
+  static constexpr const char *RPC_REPLY_QUEUE = "amq.rabbitmq.reply-to";
+  amqp_channel_t GetRpcChannel();
+  std::string NextRpcCorrelationId() {
+    return std::to_string(++m_last_rpc_id);
+  }
+  void AddRpcCall(const std::string &correlation_id) {
+    m_rpc_calls[correlation_id];
+  }
+  void AbandonRpcCall(const std::string &correlation_id) {
+    m_rpc_calls.erase(correlation_id);
+    m_lost_rpc_calls.erase(correlation_id);
+  }
+  std::size_t PendingRpcCalls() const { return m_rpc_calls.size(); }
+  void SetRpcReplyCallback(const rpc_reply_callback_t &callback) {
+    m_rpc_reply_callback = callback;
+  }
+  // Returns false on timeout, the call is then still pending. Throws the
+  // error that closed the reply channel or connection if that lost the call.
+  bool WaitForRpcReply(const std::string &correlation_id,
+                       BasicMessage::ptr_t &reply,
+                       std::chrono::microseconds timeout);
+
+  // See OpenOpts::collect_stats, must be called before the Channel is used
+  void EnableStats() { m_stats.reset(new stats_t); }
+  Channel::Stats GetStats() const;
+
+  void SetPublisherConfirms(bool enabled) { m_publisher_confirms = enabled; }
+  bool PublisherConfirms() const { return m_publisher_confirms; }
+  bool GetReturnedMessage(ReturnedMessage &returned,
+                          std::chrono::microseconds timeout);
+
+  // Ack batching: single acks that extend a channel's run of settled
+  // delivery tags are held back and sent as one multiple=true basic.ack
+  void SetAckBatching(std::size_t batch_size,
+                      std::chrono::microseconds batch_timeout) {
+    m_ack_batch_size = batch_size;
+    m_ack_batch_timeout = batch_timeout;
+  }
+  bool AckBatchingEnabled() const { return m_ack_batch_size > 1; }
+  void QueueAck(amqp_channel_t channel, std::uint64_t delivery_tag);
+  // Sends a basic.ack, counted in Stats::acks_sent
+  void SendAck(amqp_channel_t channel, std::uint64_t delivery_tag,
+               bool multiple);
+  void SettleDeliveries(amqp_channel_t channel, std::uint64_t delivery_tag,
+                        bool multiple);
+  bool HasPendingAcks() const { return !m_ack_pending_channels.empty(); }
+  void FlushAcks();
+  void FlushAcksOnChannel(amqp_channel_t channel);
+
+  // Consumers with a handler: completed deliveries are handed to
+  // DispatchDelivery rather than queued for BasicConsumeMessage
+  void SetConsumerHandler(const std::string &consumer_tag,
+                          const consumer_handler_t &handler);
+  bool DispatchDelivery(const Envelope::ptr_t &envelope);
+  std::size_t RunPendingHandlers();
+  std::size_t DispatchMessages(std::chrono::microseconds timeout);
+  void SetConsumerThreads(std::size_t threads) {
+    m_dispatcher.reset(0 == threads ? NULL
+                                    : new Detail::ConsumerDispatcher(threads));
+  }
+  void StopConsumerThreads() { m_dispatcher.reset(); }
+
+  void SetMessagePoolSize(std::size_t max_idle) {
+    if (0 == max_idle) {
+      m_message_pool.reset();
+    } else {
+      m_message_pool = Detail::MessagePool::Create(max_idle);
+    }
+  }
+
+  void SetCodec(const Codec::ptr_t &codec, std::size_t min_size,
+                std::size_t max_decoded_size) {
+    m_codec = codec;
+    m_codec_min_size = min_size;
+    m_codec_max_decoded_size = max_decoded_size;
+  }
+  // The body to publish in place of message's, valid until the next call,
+  // or NULL to publish message as it is
+  const Detail::encoded_body_t *EncodeBody(const BasicMessage &message);
+
+  // Automatic recovery, see OpenOpts::automatic_recovery
+  void EnableRecovery(const OpenOpts &opts,
+                      const Detail::EndpointSelector &endpoints) {
+    m_recovery.reset(new Detail::ConnectionRecovery(opts, endpoints));
+  }
+  Detail::ConnectionRecovery *Recovery() { return m_recovery.get(); }
+  // Where declarations are recorded: nowhere when recovery is off or the
+  // recorded ones are being replayed
+  Detail::ConnectionRecovery *TopologyRecorder() {
+    return m_recovery && !m_recovery->Replaying() ? m_recovery.get() : NULL;
+  }
+  bool ReaderActive() const { return m_reader_active; }
+  // Takes over the connection fresh has just opened in place of the lost
+  // one, along with a clean slate for everything that lived on its channels
+  void AdoptConnection(ChannelImpl &fresh);
+  // Drops the handlers of consumers that did not come back after recovery
+  void RemoveOrphanedHandlers();
+
+  // Delivery tags handed to the application keep growing across recoveries,
+  // so acks for deliveries made on an earlier connection can be told apart.
+  // A no_ack delivery is settled as it arrives, as nothing will ever ack it.
+  std::uint64_t ClientDeliveryTag(amqp_channel_t channel,
+                                  std::uint64_t broker_tag, bool no_ack) {
+    if (broker_tag > m_last_delivery_tag) {
+      m_last_delivery_tag = broker_tag;
+    }
+    if (no_ack) {
+      SettleDeliveries(channel, broker_tag, false);
+    }
+    return broker_tag + m_delivery_tag_offset;
+  }
+  // Returns false if client_tag was delivered on an earlier connection
+  bool BrokerDeliveryTag(std::uint64_t client_tag,
+                         std::uint64_t &broker_tag) const {
+    if (0 != client_tag && client_tag <= m_delivery_tag_offset) {
+      return false;
+    }
+    broker_tag = 0 == client_tag ? 0 : client_tag - m_delivery_tag_offset;
+    return true;
+  }
 
   void MaybeReleaseBuffersOnChannel(amqp_channel_t channel);
   void CheckIsConnected();
   void SetIsConnected(bool state) { m_is_connected = state; }
+  bool IsConnected() const { return m_is_connected; }
 
   // The RabbitMQ broker changed the way that basic.qos worked as of v3.3.0.
   // See: http://www.rabbitmq.com/consumer-prefetch.html
@@ -348,23 +905,305 @@ class Channel::ChannelImpl {
   static std::uint32_t ComputeBrokerVersion(
       const amqp_connection_state_t state);
 
-  frame_queue_t m_frame_queue;
+  // A timeout turned into a point in time, so that loops can work out how
+  // much of it is left. microseconds::max() never expires.
+  class Deadline {
+   public:
+    explicit Deadline(std::chrono::microseconds timeout)
+        : m_infinite(timeout == std::chrono::microseconds::max()) {
+      if (!m_infinite) {
+        m_end = std::chrono::steady_clock::now() + timeout;
+      }
+    }
+    std::chrono::microseconds Remaining() const {
+      if (m_infinite) {
+        return std::chrono::microseconds::max();
+      }
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now();
+      if (now >= m_end) {
+        return std::chrono::microseconds::zero();
+      }
+      return std::chrono::duration_cast<std::chrono::microseconds>(m_end -
+                                                                   now);
+    }
+    // Remaining() in the int milliseconds the public API takes, rounded up,
+    // -1 when the deadline never expires
+    int RemainingMilliseconds() const {
+      if (m_infinite) {
+        return -1;
+      }
+      std::chrono::microseconds left = Remaining();
+      return static_cast<int>((left.count() + 999) / 1000);
+    }
+
+   private:
+    bool m_infinite;
+    std::chrono::steady_clock::time_point m_end;
+  };
+
+  // Gives up the lock held by the current thread for as long as it is in
+  // scope, e.g. while blocked in select()
+  class ScopedUnlock {
+   public:
+    explicit ScopedUnlock(ChannelImpl &impl);
+    ~ScopedUnlock();
+
+    ScopedUnlock(const ScopedUnlock &) = delete;
+    ScopedUnlock &operator=(const ScopedUnlock &) = delete;
 
-  typedef std::vector<Envelope::ptr_t> envelope_list_t;
-  envelope_list_t m_delivered_messages;
+    std::unique_lock<std::mutex> &Lock() { return *m_lock; }
+
+   private:
+    ChannelImpl &m_impl;
+    std::unique_lock<std::mutex> *m_lock;
+  };
+
+  // Tracks how far along the message at the tail of a channel's frame queue
+  // is: method seen, header seen, then body bytes outstanding
+  enum content_assembly_t { CA_Idle = 0, CA_Header, CA_Body };
+  struct channel_frames_t {
+    channel_frames_t()
+        : assembly(CA_Idle), content_method(0), body_remaining(0) {}
+    frame_queue_t frames;
+    content_assembly_t assembly;
+    amqp_method_number_t content_method;
+    std::uint64_t body_remaining;
+  };
+  channel_frames_t &GetChannelFrames(amqp_channel_t channel) {
+    if (channel >= m_frame_queues.size()) {
+      m_frame_queues.resize(channel + 1);
+    }
+    return m_frame_queues[channel];
+  }
+  std::vector<channel_frames_t> m_frame_queues;
+
+  // Messages delivered while no one was consuming, queued per channel.
+  // m_ready_channels holds each channel whose queue is marked ready once, in
+  // round-robin order; a queue may have been emptied since it was marked.
+  struct delivery_queue_t {
+    delivery_queue_t() : ready(false), no_ack(false), cancel_pending(false) {}
+    std::deque<Envelope::ptr_t> envelopes;
+    bool ready;
+    // Of the channel's consumer
+    bool no_ack;
+    // See SetCancelPending()
+    bool cancel_pending;
+  };
+  delivery_queue_t &GetDeliveryQueue(amqp_channel_t channel) {
+    if (channel >= m_delivery_queues.size()) {
+      m_delivery_queues.resize(channel + 1);
+    }
+    return m_delivery_queues[channel];
+  }
+  void AddDeliveredMessage(const Envelope::ptr_t &envelope);
+  // channel has just been removed from m_ready_channels
+  bool TakeReadyDelivery(amqp_channel_t channel, Envelope::ptr_t &message);
+  std::vector<delivery_queue_t> m_delivery_queues;
+  std::deque<amqp_channel_t> m_ready_channels;
+  std::size_t m_buffered_bytes;
+  std::size_t m_max_buffered_bytes;
+  void TakeBufferedBytes(const Envelope::ptr_t &envelope) {
+    m_buffered_bytes -= envelope->Message()->Body().size();
+  }
 
   typedef std::map<std::string, amqp_channel_t> consumer_map_t;
   consumer_map_t m_consumer_channel_map;
+  // See ConsumerChannels(), reset by ConsumersChanged()
+  std::vector<std::string> m_filter_tags;
+  channel_filter_ptr_t m_tags_filter;
+  channel_filter_ptr_t m_all_consumers_filter;
+  void ConsumersChanged() {
+    m_tags_filter.reset();
+    m_all_consumers_filter.reset();
+  }
+
+  typedef Detail::ConsumerDispatcher::handler_ptr_t handler_ptr_t;
+  typedef std::map<std::string, handler_ptr_t> handler_map_t;
+  handler_map_t m_consumer_handlers;
+  // Deliveries waiting for RunPendingHandlers when there are no consumer
+  // threads
+  std::deque<std::pair<handler_ptr_t, Envelope::ptr_t> > m_pending_handlers;
+  std::unique_ptr<Detail::ConsumerDispatcher> m_dispatcher;
+  std::uint64_t m_posted_handlers;
+  void CheckHandlerConsumers();
 
   enum channel_state_t { CS_Closed = 0, CS_Open, CS_Used };
   typedef std::vector<channel_state_t> channel_state_list_t;
 
+  void SetChannelState(amqp_channel_t channel, channel_state_t state);
+
   channel_state_list_t m_channels;
+  // Channels in the CS_Closed and CS_Open states
+  Detail::ChannelSet m_closed_channels;
+  Detail::ChannelSet m_open_channels;
   std::uint32_t m_brokerVersion;
   // A channel that is likely to be an CS_Open state
   amqp_channel_t m_last_used_channel;
+  // See HasPrefetch(), -1 when not known
+  std::vector<std::int32_t> m_channel_prefetch;
+  std::uint64_t m_next_consumer_tag;
+
+  // Messages published with BasicPublishAsync all go out on one channel, so
+  // the broker's delivery tags for confirms form a single sequence.
+  amqp_channel_t m_confirm_channel;
+  std::uint64_t m_next_publish_seq;
+  struct unconfirmed_t {
+    bool mandatory;
+    // Only set when collecting stats
+    std::chrono::steady_clock::time_point sent;
+    // Only set for mandatory publishes, to match a basic.return to them
+    std::string exchange;
+    std::string routing_key;
+  };
+  // Sequence number -> the publish
+  typedef std::map<std::uint64_t, unconfirmed_t> unconfirmed_map_t;
+  unconfirmed_map_t m_unconfirmed_publishes;
+  // Sequence number -> the basic.return waiting for its basic.ack
+  std::map<std::uint64_t, ReturnedMessage> m_pending_returns;
+  std::size_t m_confirm_window;
+  confirm_callback_t m_confirm_callback;
+  // Confirms waiting for RunConfirmCallbacks
+  std::deque<PublishConfirm> m_pending_confirms;
+  // Confirms for a PublishBatch in progress are collected here rather than
+  // being passed to m_confirm_callback
+  std::vector<PublishConfirm> *m_batch_results;
+  std::uint64_t m_batch_first_seq;
+
+  bool m_blocked;
+  std::string m_blocked_reason;
+  connection_blocked_callback_t m_blocked_callback;
+  // Numbered after the publishes already sent on the confirm channel
+  std::deque<blocked_publish_t> m_blocked_publishes;
+  std::size_t m_blocked_publish_limit;
+
+  // 0 until the reply consumer is started
+  amqp_channel_t m_rpc_channel;
+  std::uint64_t m_last_rpc_id;
+  // Correlation id -> the reply, null while it is awaited. Replies to calls
+  // not in here, abandoned or timed out, are dropped.
+  typedef std::unordered_map<std::string, BasicMessage::ptr_t> rpc_call_map_t;
+  rpc_call_map_t m_rpc_calls;
+  // Calls still awaited when their reply channel or the connection went,
+  // with the error to throw from WaitForRpcReply()
+  typedef std::unordered_map<std::string, std::exception_ptr>
+      lost_rpc_call_map_t;
+  lost_rpc_call_map_t m_lost_rpc_calls;
+  // Moves the calls still awaited from m_rpc_calls to m_lost_rpc_calls
+  void LoseRpcCalls(const std::exception_ptr &cause);
+  rpc_reply_callback_t m_rpc_reply_callback;
+  // Files a delivery on m_rpc_channel under its correlation id
+  void AddRpcReply(const Envelope::ptr_t &envelope);
+
+  // When false, channels from GetChannel() are not put in confirm mode and
+  // basic.return frames received on them are queued here
+  bool m_publisher_confirms;
+  std::deque<ReturnedMessage> m_returned_messages;
+
+  // Set when OpenOpts::message_pool_size is non-zero
+  Detail::MessagePool::ptr_t m_message_pool;
+
+  // See Channel::SetCodec(). The buffers keep their capacity from one
+  // message to the next.
+  Codec::ptr_t m_codec;
+  std::size_t m_codec_min_size;
+  // 0 for CODEC_MAX_DECODE_RATIO times the encoded size
+  std::size_t m_codec_max_decoded_size;
+  // Bodies in the codec's encoding that were passed on undecoded
+  std::uint64_t m_decode_failures;
+  std::string m_encode_buffer;
+  std::string m_decode_buffer;
+  Detail::encoded_body_t m_encoded;
+
+  // Counts a latency in a Channel::LatencyHistogram bucket
+  class AtomicHistogram {
+   public:
+    AtomicHistogram() : m_buckets(), m_count(0), m_total_us(0) {}
+    void Add(std::chrono::steady_clock::duration latency);
+    Channel::LatencyHistogram Snapshot() const;
+
+   private:
+    std::array<std::atomic<std::uint64_t>, Channel::LatencyHistogram::BUCKETS>
+        m_buckets;
+    std::atomic<std::uint64_t> m_count;
+    std::atomic<std::uint64_t> m_total_us;
+  };
+  // Updated with relaxed ordering: they are only read by GetStats(), and
+  // nothing else depends on them
+  struct stats_t {
+    stats_t()
+        : frames_read(0),
+          content_bytes_read(0),
+          messages_published(0),
+          acks_sent(0),
+          read_wait_us(0),
+          channels_opened(0),
+          channels_closed(0) {}
+    static void Increment(std::atomic<std::uint64_t> &counter,
+                          std::uint64_t by = 1) {
+      counter.fetch_add(by, std::memory_order_relaxed);
+    }
+    std::atomic<std::uint64_t> frames_read;
+    std::atomic<std::uint64_t> content_bytes_read;
+    std::atomic<std::uint64_t> messages_published;
+    std::atomic<std::uint64_t> acks_sent;
+    std::atomic<std::uint64_t> read_wait_us;
+    std::atomic<std::uint64_t> channels_opened;
+    std::atomic<std::uint64_t> channels_closed;
+    AtomicHistogram confirm_latency;
+    // Entries are added with the Channel locked
+    std::map<std::uint32_t, AtomicHistogram> rpc_latency;
+  };
+  // Null unless OpenOpts::collect_stats is set
+  std::unique_ptr<stats_t> m_stats;
+
+  struct ack_state_t {
+    ack_state_t() : contiguous(0), pending_tag(0), pending_count(0) {}
+    // Every delivery tag up to and including this one has been settled,
+    // either sent or waiting in the pending batch
+    std::uint64_t contiguous;
+    // Highest tag of the pending batch, sent as a multiple=true ack
+    std::uint64_t pending_tag;
+    std::size_t pending_count;
+    std::chrono::steady_clock::time_point first_pending;
+    // Tags above contiguous that were settled out of order
+    std::set<std::uint64_t> settled;
+  };
+  ack_state_t &GetAckState(amqp_channel_t channel) {
+    if (channel >= m_ack_states.size()) {
+      m_ack_states.resize(channel + 1);
+    }
+    return m_ack_states[channel];
+  }
+  void ResetAckState(amqp_channel_t channel);
+  static void AdvanceContiguous(ack_state_t &state);
+
+  std::size_t m_ack_batch_size;
+  std::chrono::microseconds m_ack_batch_timeout;
+  std::vector<ack_state_t> m_ack_states;
+  channel_list_t m_ack_pending_channels;
 
   bool m_is_connected;
+
+  bool m_thread_safe;
+  std::mutex m_mutex;
+  // The thread holding m_mutex through a ScopedLock, and that lock
+  std::atomic<std::thread::id> m_lock_owner;
+  std::unique_lock<std::mutex> *m_active_lock;
+  // Set while a thread is waiting on the socket with the lock released,
+  // m_read_generation is bumped each time it finishes reading
+  bool m_reader_active;
+  std::uint64_t m_read_generation;
+  std::condition_variable m_read_done;
+  // When ServiceHeartbeats() next sends a heartbeat
+  std::chrono::steady_clock::time_point m_next_heartbeat;
+
+  // Set when OpenOpts::automatic_recovery is
+  std::unique_ptr<Detail::ConnectionRecovery> m_recovery;
+  // Added to the broker's delivery tags, and the highest broker tag seen on
+  // the current connection
+  std::uint64_t m_delivery_tag_offset;
+  std::uint64_t m_last_delivery_tag;
 };
 
 }  // namespace AmqpClient
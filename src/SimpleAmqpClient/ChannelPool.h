@@ -0,0 +1,185 @@
+#ifndef SIMPLEAMQPCLIENT_CHANNELPOOL_H
+#define SIMPLEAMQPCLIENT_CHANNELPOOL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/Util.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4275 4251)
+#endif
+
+/// @file SimpleAmqpClient/ChannelPool.h
+/// The AmqpClient::ChannelPool class is defined in this header file.
+
+namespace AmqpClient {
+
+/**
+ * Several connections to the broker used as one
+ *
+ * A single connection is limited to one TCP stream and one broker-side
+ * connection process. ChannelPool opens several and spreads publishes and
+ * consumers across them. Messages published through the pool are only
+ * ordered with respect to each other when they go over the same connection,
+ * see shard_policy_t.
+ *
+ * Topology (exchanges, queues, bindings) can be declared through any of the
+ * connections, see GetChannel(). Exclusive queues belong to the connection
+ * that declared them, so queues consumed through the pool must not be
+ * exclusive.
+ */
+class SIMPLEAMQPCLIENT_EXPORT ChannelPool {
+ public:
+  /// a `shared_ptr` to ChannelPool
+  typedef std::shared_ptr<ChannelPool> ptr_t;
+
+  /// How BasicPublish() picks a connection
+  enum shard_policy_t {
+    /// Each publish goes out on the next connection in turn
+    sp_round_robin = 0,
+    /// Publishes with the same routing key always use the same connection,
+    /// so their order is kept
+    sp_routing_key
+  };
+
+  /**
+   * Opens a pool of connections to the broker
+   *
+   * The connections are opened concurrently, see Channel::OpenMany().
+   *
+   * @param opts options used for each of the connections
+   * @param connections the number of connections to open, at least 1
+   * @param policy how publishes are spread over the connections
+   */
+  static ptr_t Open(const Channel::OpenOpts &opts, std::size_t connections,
+                    shard_policy_t policy = sp_round_robin);
+
+  /// Builds a pool from channels that are already open
+  explicit ChannelPool(const std::vector<Channel::ptr_t> &channels,
+                       shard_policy_t policy = sp_round_robin);
+
+  // Non-copyable
+  ChannelPool(const ChannelPool &) = delete;
+  ChannelPool &operator=(const ChannelPool &) = delete;
+
+  ~ChannelPool();
+
+  /// The number of connections in the pool
+  std::size_t Size() const;
+
+  /// The Channel for the index-th connection
+  Channel::ptr_t GetChannel(std::size_t index) const;
+
+  /// The Channel a publish with routing_key would go out on next
+  Channel::ptr_t GetPublishChannel(const std::string &routing_key);
+
+  /**
+   * Publishes a Basic message on one of the connections
+   *
+   * See Channel::BasicPublish() for the parameters and the exceptions thrown.
+   */
+  void BasicPublish(const std::string &exchange_name,
+                    const std::string &routing_key,
+                    const BasicMessage::ptr_t message, bool mandatory = false,
+                    bool immediate = false);
+
+  /**
+   * Starts consuming a queue on one of the connections
+   *
+   * Consumers are assigned to connections in turn. See
+   * Channel::BasicConsume() for the parameters. Consumer tags must be unique
+   * across the pool, including those of cancelled consumers whose messages
+   * have yet to be acked or rejected.
+   *
+   * @returns the consumer tag
+   */
+  std::string BasicConsume(const std::string &queue,
+                           const std::string &consumer_tag = "",
+                           bool no_local = true, bool no_ack = true,
+                           bool exclusive = true,
+                           std::uint16_t message_prefetch_count = 1);
+
+  /// Stops a consumer started with BasicConsume()
+  void BasicCancel(const std::string &consumer_tag);
+
+  /**
+   * Waits for a message delivered to any of the pool's consumers
+   *
+   * Connections are checked in turn, so one busy connection does not starve
+   * the others.
+   *
+   * @param envelope set to the delivered message
+   * @param timeout the maximum time to wait in milliseconds, -1 waits
+   * indefinitely
+   * @returns true if a message was delivered, false on timeout
+   */
+  bool BasicConsumeMessage(Envelope::ptr_t &envelope, int timeout = -1);
+
+  /**
+   * Waits for a message delivered to one consumer
+   *
+   * @returns true if a message was delivered, false on timeout
+   */
+  bool BasicConsumeMessage(const std::string &consumer_tag,
+                           Envelope::ptr_t &envelope, int timeout = -1);
+
+  /**
+   * Acks a message received through the pool, on the connection it came in
+   *
+   * The message may still be acked after its consumer has been cancelled.
+   * The pool remembers a cancelled consumer until each message received
+   * through it has been acked or rejected.
+   */
+  void BasicAck(const Envelope::ptr_t &message);
+
+  /// Rejects a message received through the pool, see Channel::BasicReject()
+  void BasicReject(const Envelope::ptr_t &message, bool requeue);
+
+ protected:
+  struct Impl;
+  /// PIMPL idiom
+  std::unique_ptr<Impl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_CHANNELPOOL_H
@@ -0,0 +1,101 @@
+#ifndef SIMPLEAMQPCLIENT_CHANNELSET_H
+#define SIMPLEAMQPCLIENT_CHANNELSET_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace AmqpClient {
+namespace Detail {
+
+/**
+ * A set of channel numbers with constant time insert, erase and lowest
+ * member lookup: a bit per channel, plus a summary bit per 64 channels
+ */
+class ChannelSet {
+ public:
+  void Insert(amqp_channel_t channel) {
+    const std::size_t word = channel / 64;
+    if (word >= m_words.size()) {
+      m_words.resize(word + 1, 0);
+      m_summary.resize(word / 64 + 1, 0);
+    }
+    m_words[word] |= Bit(channel % 64);
+    m_summary[word / 64] |= Bit(word % 64);
+  }
+  void Erase(amqp_channel_t channel) {
+    const std::size_t word = channel / 64;
+    if (word < m_words.size()) {
+      m_words[word] &= ~Bit(channel % 64);
+      if (0 == m_words[word]) {
+        m_summary[word / 64] &= ~Bit(word % 64);
+      }
+    }
+  }
+  bool Lowest(amqp_channel_t &channel) const {
+    for (std::size_t i = 0; i < m_summary.size(); ++i) {
+      if (0 != m_summary[i]) {
+        const std::size_t word = i * 64 + LowestBit(m_summary[i]);
+        channel =
+            static_cast<amqp_channel_t>(word * 64 + LowestBit(m_words[word]));
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  static std::uint64_t Bit(std::size_t n) {
+    return static_cast<std::uint64_t>(1) << n;
+  }
+  static std::size_t LowestBit(std::uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#else
+    return __builtin_ctzll(word);
+#endif
+  }
+
+  std::vector<std::uint64_t> m_words;
+  std::vector<std::uint64_t> m_summary;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_CHANNELSET_H
@@ -0,0 +1,96 @@
+#ifndef SIMPLEAMQPCLIENT_CODEC_H
+#define SIMPLEAMQPCLIENT_CODEC_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "SimpleAmqpClient/Util.h"
+
+/// @file SimpleAmqpClient/Codec.h
+/// The AmqpClient::Codec class is defined in this header file
+
+namespace AmqpClient {
+
+/**
+ * Compresses message bodies, see Channel::SetCodec()
+ *
+ * A Channel calls its codec with the Channel locked, so one instance need
+ * not be thread-safe unless it is shared by several Channels. An instance
+ * may keep its compression contexts and buffers from one call to the next.
+ */
+class SIMPLEAMQPCLIENT_EXPORT Codec {
+ public:
+  typedef std::shared_ptr<Codec> ptr_t;
+
+  virtual ~Codec() {}
+
+  /**
+   * The content-encoding property a message body encoded by this codec
+   * carries, and that marks the bodies it decodes, e.g. `zstd`
+   */
+  virtual const std::string &ContentEncoding() const = 0;
+
+  /**
+   * Encodes a body
+   *
+   * @param [in] input the body to encode
+   * @param [out] output receives the encoded body, replacing what it held.
+   * Its capacity may be reused.
+   */
+  virtual void Encode(std::string_view input, std::string &output) = 0;
+
+  /**
+   * Decodes a body encoded by Encode()
+   *
+   * @param [in] input the encoded body
+   * @param [out] output receives the decoded body, replacing what it held
+   * @param max_size the largest decoded body to accept
+   * @returns `false` if input is not a valid encoding or decodes to more
+   * than `max_size` bytes, in which case the contents of output are
+   * unspecified
+   */
+  virtual bool Decode(std::string_view input, std::string &output,
+                      std::size_t max_size) = 0;
+
+  /**
+   * Creates a zlib codec, its content-encoding is `deflate`
+   *
+   * @param level the zlib compression level, 1 for the fastest to 9 for the
+   * smallest, -1 for zlib's default
+   * @throws std::logic_error if the library was built without zlib, see
+   * the ENABLE_ZLIB_SUPPORT CMake option
+   */
+  static ptr_t Deflate(int level = -1);
+};
+
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_CODEC_H
@@ -0,0 +1,72 @@
+#ifndef SIMPLEAMQPCLIENT_CONNECTIONBLOCKEDEXCEPTION_H
+#define SIMPLEAMQPCLIENT_CONNECTIONBLOCKEDEXCEPTION_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdexcept>
+#include <string>
+
+#include "SimpleAmqpClient/Util.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+/// @file SimpleAmqpClient/ConnectionBlockedException.h
+/// Defines AmqpClient::ConnectionBlockedException
+
+namespace AmqpClient {
+
+/**
+ * "Connection is blocked" exception
+ *
+ * Thrown by Channel::BasicPublishAsync() when the broker has blocked the
+ * connection and no more messages can be held back until it is unblocked.
+ */
+class SIMPLEAMQPCLIENT_EXPORT ConnectionBlockedException
+    : public std::runtime_error {
+ public:
+  /// Constructor
+  explicit ConnectionBlockedException(const std::string &reason)
+      : std::runtime_error("Connection is blocked: " + reason),
+        m_reason(reason) {}
+
+  /// Why the broker blocked the connection, as it reported it
+  const std::string &reason() const { return m_reason; }
+
+ private:
+  std::string m_reason;
+};
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_CONNECTIONBLOCKEDEXCEPTION_H
@@ -0,0 +1,186 @@
+#ifndef SIMPLEAMQPCLIENT_CONNECTIONRECOVERY_H
+#define SIMPLEAMQPCLIENT_CONNECTIONRECOVERY_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/EndpointSelector.h"
+#include "SimpleAmqpClient/FlatTable.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+/**
+ * What a Channel needs to come back by itself after losing its connection
+ *
+ * Holds the options the connection was opened with and what is known about
+ * its endpoints, the exchanges, queues, bindings and consumers declared
+ * through the Channel so they can be declared again on a new connection, the
+ * reconnect backoff, and the publishes made while there was no connection.
+ */
+class ConnectionRecovery {
+ public:
+  struct exchange_t {
+    std::string type;
+    bool durable;
+    bool auto_delete;
+    FlatTable arguments;
+  };
+  struct queue_t {
+    // Declared with an empty name, the broker picks a new one each time
+    bool server_named;
+    bool durable;
+    bool exclusive;
+    bool auto_delete;
+    FlatTable arguments;
+  };
+  struct binding_t {
+    // Exchange to exchange rather than exchange to queue
+    bool exchange_binding;
+    std::string destination;
+    std::string source;
+    std::string routing_key;
+    FlatTable arguments;
+  };
+  struct consumer_t {
+    std::string queue;
+    bool no_local;
+    bool no_ack;
+    bool exclusive;
+    std::uint16_t prefetch_count;
+    // Set by a later BasicQos(), the consumer starts out without one
+    std::uint32_t prefetch_size;
+    FlatTable arguments;
+  };
+  struct publish_t {
+    std::string exchange;
+    std::string routing_key;
+    BasicMessage::ptr_t message;
+    bool mandatory;
+    bool immediate;
+  };
+
+  typedef std::map<std::string, exchange_t> exchange_map_t;
+  typedef std::map<std::string, queue_t> queue_map_t;
+  typedef std::vector<binding_t> binding_list_t;
+  typedef std::map<std::string, consumer_t> consumer_map_t;
+
+  ConnectionRecovery(const Channel::OpenOpts &opts,
+                     const EndpointSelector &endpoints);
+
+  // Non-copyable
+  ConnectionRecovery(const ConnectionRecovery &) = delete;
+  ConnectionRecovery &operator=(const ConnectionRecovery &) = delete;
+
+  const Channel::OpenOpts &Options() const { return m_opts; }
+  // Carries what was learned about the endpoints from one connect to the next
+  EndpointSelector &Endpoints() { return m_endpoints; }
+
+  // Set while the topology is being declared again, so that it is not
+  // recorded a second time and a failure does not start another recovery
+  bool Replaying() const { return m_replaying; }
+  void SetReplaying(bool replaying) { m_replaying = replaying; }
+
+  // Reconnect backoff: the first attempt after a failure is made straight
+  // away, each failed one doubles the wait before the next
+  bool AttemptDue(std::chrono::steady_clock::time_point now) const {
+    return now >= m_next_attempt;
+  }
+  void AttemptFailed(std::chrono::steady_clock::time_point now);
+  void AttemptSucceeded();
+
+  void RecordExchange(const std::string &name, const std::string &type,
+                      bool durable, bool auto_delete,
+                      const FlatTable &arguments);
+  // Forgets the exchange and the bindings it is part of
+  void ForgetExchange(const std::string &name);
+  void RecordQueue(const std::string &name, bool server_named, bool durable,
+                   bool exclusive, bool auto_delete,
+                   const FlatTable &arguments);
+  // Forgets the queue, its bindings and its consumers
+  void ForgetQueue(const std::string &name);
+  // A server named queue came back under a new name
+  void RenameQueue(const std::string &name, const std::string &new_name);
+  void RecordBinding(bool exchange_binding, const std::string &destination,
+                     const std::string &source, const std::string &routing_key,
+                     const FlatTable &arguments);
+  void ForgetBinding(bool exchange_binding, const std::string &destination,
+                     const std::string &source, const std::string &routing_key,
+                     const FlatTable &arguments);
+  void RecordConsumer(const std::string &consumer_tag, const std::string &queue,
+                      bool no_local, bool no_ack, bool exclusive,
+                      std::uint16_t prefetch_count, const FlatTable &arguments);
+  void SetConsumerPrefetch(const std::string &consumer_tag,
+                           std::uint16_t prefetch_count,
+                           std::uint32_t prefetch_size);
+  // Forgets the consumer, and its queue when that is auto-delete and this
+  // was the last consumer of it, as the broker will have deleted it
+  void ForgetConsumer(const std::string &consumer_tag);
+
+  const exchange_map_t &Exchanges() const { return m_exchanges; }
+  const queue_map_t &Queues() const { return m_queues; }
+  const binding_list_t &Bindings() const { return m_bindings; }
+  const consumer_map_t &Consumers() const { return m_consumers; }
+
+  // Holds a publish made while disconnected, returns false if the buffer is
+  // already full
+  bool BufferPublish(const std::string &exchange,
+                     const std::string &routing_key,
+                     const BasicMessage::ptr_t &message, bool mandatory,
+                     bool immediate);
+  bool HasBufferedPublishes() const { return !m_publishes.empty(); }
+  const publish_t &FrontPublish() const { return m_publishes.front(); }
+  void PopPublish() { m_publishes.pop_front(); }
+
+ private:
+  const Channel::OpenOpts m_opts;
+  EndpointSelector m_endpoints;
+  bool m_replaying;
+  std::chrono::milliseconds m_backoff;
+  std::chrono::steady_clock::time_point m_next_attempt;
+
+  exchange_map_t m_exchanges;
+  queue_map_t m_queues;
+  binding_list_t m_bindings;
+  consumer_map_t m_consumers;
+  std::deque<publish_t> m_publishes;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_CONNECTIONRECOVERY_H
@@ -0,0 +1,93 @@
+#ifndef SIMPLEAMQPCLIENT_CONSUMERDISPATCHER_H
+#define SIMPLEAMQPCLIENT_CONSUMERDISPATCHER_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SimpleAmqpClient/Envelope.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+/**
+ * A fixed set of threads that run consumer handlers
+ *
+ * Each consumer tag is always handled by the same thread, so deliveries to
+ * one consumer are handled one at a time and in the order they arrived, while
+ * different consumers proceed in parallel.
+ */
+class ConsumerDispatcher {
+ public:
+  typedef std::function<void(const Envelope::ptr_t &)> handler_t;
+  typedef std::shared_ptr<handler_t> handler_ptr_t;
+
+  explicit ConsumerDispatcher(std::size_t threads);
+  /// Waits for handlers already running, deliveries not yet started are
+  /// dropped
+  ~ConsumerDispatcher();
+
+  // Non-copyable
+  ConsumerDispatcher(const ConsumerDispatcher &) = delete;
+  ConsumerDispatcher &operator=(const ConsumerDispatcher &) = delete;
+
+  void Post(const handler_ptr_t &handler, const Envelope::ptr_t &envelope);
+
+ private:
+  struct task_t {
+    handler_ptr_t handler;
+    Envelope::ptr_t envelope;
+  };
+  struct worker_t {
+    worker_t() : stopping(false) {}
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<task_t> tasks;
+    bool stopping;
+    std::thread thread;
+  };
+
+  static void Run(worker_t &worker);
+  // Tells every worker to stop and joins those whose thread was started
+  void Stop();
+
+  std::vector<std::unique_ptr<worker_t> > m_workers;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_CONSUMERDISPATCHER_H
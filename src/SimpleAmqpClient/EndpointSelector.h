@@ -0,0 +1,91 @@
+#ifndef SIMPLEAMQPCLIENT_ENDPOINTSELECTOR_H
+#define SIMPLEAMQPCLIENT_ENDPOINTSELECTOR_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Util.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+/**
+ * Decides which broker a Channel connects to, see OpenOpts::endpoints
+ *
+ * Remembers how long the last handshake with each endpoint took and which
+ * endpoints failed recently, so that a reconnect goes to the nearest broker
+ * that is still up without waiting on those that are down.
+ */
+class SIMPLEAMQPCLIENT_EXPORT EndpointSelector {
+ public:
+  typedef Channel::OpenOpts::Endpoint endpoint_t;
+
+  // A broker that fails is tried last for this long
+  static const std::chrono::seconds FAILURE_PENALTY;
+
+  // Uses opts.endpoints, or opts.host and opts.port when there are none
+  explicit EndpointSelector(const Channel::OpenOpts &opts);
+
+  // Indexes of the endpoints in the order to try them: those that have not
+  // failed recently first, then by locality, then by last handshake time
+  std::vector<std::size_t> Candidates(
+      std::chrono::steady_clock::time_point now) const;
+  const endpoint_t &Endpoint(std::size_t index) const {
+    return m_endpoints[index].endpoint;
+  }
+  // Whether two candidates would be as good as each other but for timing,
+  // and so can be raced
+  bool SameTier(std::size_t a, std::size_t b,
+                std::chrono::steady_clock::time_point now) const;
+
+  void Succeeded(std::size_t index, std::chrono::microseconds handshake);
+  void Failed(std::size_t index, std::chrono::steady_clock::time_point now);
+
+ private:
+  struct state_t {
+    endpoint_t endpoint;
+    // Zero until the first successful handshake
+    std::chrono::microseconds handshake;
+    std::chrono::steady_clock::time_point failed_until;
+  };
+  bool Penalized(std::size_t index,
+                 std::chrono::steady_clock::time_point now) const {
+    return now < m_endpoints[index].failed_until;
+  }
+
+  std::vector<state_t> m_endpoints;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_ENDPOINTSELECTOR_H
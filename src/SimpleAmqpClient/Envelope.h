@@ -31,6 +31,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "SimpleAmqpClient/BasicMessage.h"
 #include "SimpleAmqpClient/Util.h"
@@ -45,6 +46,10 @@
 
 namespace AmqpClient {
 
+namespace Detail {
+class MessagePool;
+}
+
 /**
  * A "message envelope" object containing the message body and delivery metadata
  */
@@ -66,15 +71,14 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope {
    * @param delivery_channel channel ID of the delivery (see DeliveryInfo)
    * @returns a std::shared_ptr to an envelope object
    */
-  static ptr_t Create(const BasicMessage::ptr_t message,
-                      const std::string &consumer_tag,
-                      const std::uint64_t delivery_tag,
-                      const std::string &exchange, bool redelivered,
-                      const std::string &routing_key,
+  static ptr_t Create(BasicMessage::ptr_t message, std::string consumer_tag,
+                      const std::uint64_t delivery_tag, std::string exchange,
+                      bool redelivered, std::string routing_key,
                       const std::uint16_t delivery_channel) {
-    return std::make_shared<Envelope>(message, consumer_tag, delivery_tag,
-                                      exchange, redelivered, routing_key,
-                                      delivery_channel);
+    return std::make_shared<Envelope>(
+        std::move(message), std::move(consumer_tag), delivery_tag,
+        std::move(exchange), redelivered, std::move(routing_key),
+        delivery_channel);
   }
 
   /**
@@ -89,11 +93,9 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope {
    * @param routing_key the routing key that the message was published with
    * @param delivery_channel channel ID of the delivery (see DeliveryInfo)
    */
-  explicit Envelope(const BasicMessage::ptr_t message,
-                    const std::string &consumer_tag,
-                    const std::uint64_t delivery_tag,
-                    const std::string &exchange, bool redelivered,
-                    const std::string &routing_key,
+  explicit Envelope(BasicMessage::ptr_t message, std::string consumer_tag,
+                    const std::uint64_t delivery_tag, std::string exchange,
+                    bool redelivered, std::string routing_key,
                     const std::uint16_t delivery_channel);
 
  public:
@@ -118,7 +120,7 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope {
    *
    * @returns the consumer that delivered the message
    */
-  inline std::string ConsumerTag() const { return m_consumerTag; }
+  inline const std::string &ConsumerTag() const { return m_consumerTag; }
 
   /**
    * Get the delivery tag for the message.
@@ -136,7 +138,7 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope {
    *
    * @returns the name of the exchange the message was published to
    */
-  inline std::string Exchange() const { return m_exchange; }
+  inline const std::string &Exchange() const { return m_exchange; }
 
   /**
    * Get the flag that indicates whether the message was redelivered
@@ -156,7 +158,7 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope {
    * @returns a string containing the routing key the message was published
    * with
    */
-  inline std::string RoutingKey() const { return m_routingKey; }
+  inline const std::string &RoutingKey() const { return m_routingKey; }
 
   /**
    * Get the delivery channel
@@ -195,13 +197,16 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope {
   }
 
  private:
-  const BasicMessage::ptr_t m_message;
-  const std::string m_consumerTag;
-  const std::uint64_t m_deliveryTag;
-  const std::string m_exchange;
-  const bool m_redelivered;
-  const std::string m_routingKey;
-  const std::uint16_t m_deliveryChannel;
+  // Pooled envelopes are refilled in place to reuse their strings' storage
+  friend class Detail::MessagePool;
+
+  BasicMessage::ptr_t m_message;
+  std::string m_consumerTag;
+  std::uint64_t m_deliveryTag;
+  std::string m_exchange;
+  bool m_redelivered;
+  std::string m_routingKey;
+  std::uint16_t m_deliveryChannel;
 };
 
 }  // namespace AmqpClient
@@ -0,0 +1,235 @@
+#ifndef SIMPLEAMQPCLIENT_FLATTABLE_H
+#define SIMPLEAMQPCLIENT_FLATTABLE_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SimpleAmqpClient/Table.h"
+#include "SimpleAmqpClient/Util.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+
+/// @file SimpleAmqpClient/FlatTable.h
+/// The AmqpClient::FlatTable class is defined in this header file
+
+namespace AmqpClient {
+
+/**
+ * A compact AMQP field table
+ *
+ * Holds the same data as a \ref Table, but as one sorted vector of entries
+ * with every key and string value packed into a single buffer, so a table
+ * costs a handful of allocations however many entries it has. Converting
+ * to and from the wire format is a single pass over the entries.
+ *
+ * A FlatTable can be passed anywhere a message's header table or a method's
+ * `arguments` are accepted. Setting an existing key replaces its value; the
+ * storage of a replaced or erased value is only reclaimed by clear().
+ */
+class SIMPLEAMQPCLIENT_EXPORT FlatTable {
+ public:
+  /**
+   * Creates an empty table
+   */
+  FlatTable();
+
+  /**
+   * Creates a table holding the same entries as `table`
+   */
+  explicit FlatTable(const Table &table);
+
+  /**
+   * Converts to a \ref Table
+   */
+  Table ToTable() const;
+
+  /**
+   * The number of entries in the table
+   */
+  std::size_t size() const { return m_entries.size(); }
+
+  /**
+   * Is the table empty
+   */
+  bool empty() const { return m_entries.empty(); }
+
+  /**
+   * Removes every entry
+   */
+  void clear();
+
+  /**
+   * Makes room for `entries` top level entries and `bytes` of keys and
+   * string values without reallocating
+   */
+  void reserve(std::size_t entries, std::size_t bytes);
+
+  /**
+   * Is there an entry for `key`
+   */
+  bool Contains(std::string_view key) const;
+
+  /**
+   * Gets the value stored under `key`
+   *
+   * @throws std::out_of_range if there is no entry for `key`
+   */
+  TableValue Get(std::string_view key) const;
+
+  /**
+   * Gets the string stored under `key` without copying it
+   *
+   * The view is valid until the table is next modified.
+   *
+   * @returns the string, or nothing if `key` is missing or not a string
+   */
+  std::optional<std::string_view> GetString(std::string_view key) const;
+
+  /**
+   * Sets `key` to void
+   */
+  void SetVoid(std::string_view key);
+  /// Sets `key` to a boolean
+  void Set(std::string_view key, bool value);
+  /// Sets `key` to a uint8_t
+  void Set(std::string_view key, std::uint8_t value);
+  /// Sets `key` to an int8_t
+  void Set(std::string_view key, std::int8_t value);
+  /// Sets `key` to a uint16_t
+  void Set(std::string_view key, std::uint16_t value);
+  /// Sets `key` to an int16_t
+  void Set(std::string_view key, std::int16_t value);
+  /// Sets `key` to a uint32_t
+  void Set(std::string_view key, std::uint32_t value);
+  /// Sets `key` to an int32_t
+  void Set(std::string_view key, std::int32_t value);
+  /// Sets `key` to an int64_t
+  void Set(std::string_view key, std::int64_t value);
+  /// Sets `key` to a float
+  void Set(std::string_view key, float value);
+  /// Sets `key` to a double
+  void Set(std::string_view key, double value);
+  /// Sets `key` to a timestamp
+  void SetTimestamp(std::string_view key, std::time_t value);
+  /// Sets `key` to a string
+  void Set(std::string_view key, std::string_view value);
+  /// Sets `key` to a string
+  void Set(std::string_view key, const char *value);
+  /// Sets `key` to a string
+  void Set(std::string_view key, const std::string &value);
+  /// Sets `key` to a nested table
+  void Set(std::string_view key, const FlatTable &value);
+  /// Sets `key` to any value, including arrays
+  void Set(std::string_view key, const TableValue &value);
+
+  /**
+   * Removes the entry for `key`
+   *
+   * @returns `true` if there was an entry to remove
+   */
+  bool Erase(std::string_view key);
+
+  /**
+   * Equality operator, tables are equal if they hold the same entries
+   */
+  bool operator==(const FlatTable &other) const;
+  /**
+   * Inequality operator
+   */
+  bool operator!=(const FlatTable &other) const { return !(*this == other); }
+
+ private:
+  friend class Detail::TableValueImpl;
+
+  // A range of m_bytes, or of m_nested
+  struct range_t {
+    std::uint32_t first;
+    std::uint32_t count;
+  };
+
+  // One value, and its key when it is a table entry. Strings live in
+  // m_bytes, the contents of nested tables and arrays in m_nested.
+  struct field_t {
+    range_t key;
+    TableValue::ValueType type;
+    union {
+      bool boolean;
+      std::uint8_t u8;
+      std::int8_t i8;
+      std::uint16_t u16;
+      std::int16_t i16;
+      std::uint32_t u32;
+      std::int32_t i32;
+      std::uint64_t u64;
+      std::int64_t i64;
+      float f32;
+      double f64;
+      range_t range;
+    } value;
+  };
+
+  std::string_view Bytes(const range_t &range) const {
+    return std::string_view(m_bytes.data() + range.first, range.count);
+  }
+  range_t AppendBytes(std::string_view bytes);
+  range_t AppendNested(std::size_t count);
+  // Finds key among the top level entries, returns where it is or belongs
+  std::vector<field_t>::const_iterator LowerBound(std::string_view key) const;
+  const field_t *Find(std::string_view key) const;
+  // Adds or replaces the entry for key with field's value
+  void Emplace(std::string_view key, const field_t &field);
+  // Fields are built by value: building one may grow m_nested
+  field_t MakeField(const TableValue &value);
+  // Copies field from other, along with anything it refers to
+  field_t CopyField(const FlatTable &other, const field_t &field);
+  TableValue GetField(const field_t &field) const;
+  bool FieldEquals(const field_t &field, const FlatTable &other,
+                   const field_t &other_field) const;
+
+  std::vector<field_t> m_entries;
+  std::vector<field_t> m_nested;
+  std::string m_bytes;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_FLATTABLE_H
@@ -0,0 +1,156 @@
+#ifndef SIMPLEAMQPCLIENT_MESSAGEPOOL_H
+#define SIMPLEAMQPCLIENT_MESSAGEPOOL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Envelope.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+/**
+ * Recycles the Envelope and BasicMessage objects handed out for deliveries
+ *
+ * Objects are returned to the pool by the deleter of the last shared_ptr that
+ * refers to them, which may happen on any thread. Strings keep their capacity
+ * across reuses and the shared_ptr control blocks are recycled as well, so a
+ * consumer in a steady state does not touch the heap for each delivery.
+ */
+class MessagePool : public std::enable_shared_from_this<MessagePool> {
+ public:
+  typedef std::shared_ptr<MessagePool> ptr_t;
+
+  static ptr_t Create(std::size_t max_idle) {
+    return ptr_t(new MessagePool(max_idle));
+  }
+
+  ~MessagePool();
+
+  // Non-copyable
+  MessagePool(const MessagePool &) = delete;
+  MessagePool &operator=(const MessagePool &) = delete;
+
+  /// An empty message, with no properties set and an empty body
+  BasicMessage::ptr_t AcquireMessage();
+  /// An envelope with no message and empty delivery information
+  Envelope::ptr_t AcquireEnvelope();
+
+  static void SetDeliveryInfo(Envelope &envelope,
+                              const amqp_bytes_t &consumer_tag,
+                              std::uint64_t delivery_tag,
+                              const amqp_bytes_t &exchange, bool redelivered,
+                              const amqp_bytes_t &routing_key,
+                              std::uint16_t delivery_channel);
+  static void SetMessage(Envelope &envelope,
+                         const BasicMessage::ptr_t &message) {
+    envelope.m_message = message;
+  }
+
+  void *AllocateBlock(std::size_t size);
+  void DeallocateBlock(void *block, std::size_t size);
+
+ private:
+  explicit MessagePool(std::size_t max_idle) : m_max_idle(max_idle) {}
+
+  struct MessageDeleter {
+    MessagePool *pool;
+    void operator()(BasicMessage *message) const {
+      pool->ReleaseMessage(message);
+    }
+  };
+  struct EnvelopeDeleter {
+    MessagePool *pool;
+    void operator()(Envelope *envelope) const {
+      pool->ReleaseEnvelope(envelope);
+    }
+  };
+
+  void ReleaseMessage(BasicMessage *message);
+  void ReleaseEnvelope(Envelope *envelope);
+
+  const std::size_t m_max_idle;
+  std::mutex m_mutex;
+  std::vector<BasicMessage *> m_idle_messages;
+  std::vector<Envelope *> m_idle_envelopes;
+  typedef std::map<std::size_t, std::vector<void *> > block_map_t;
+  block_map_t m_idle_blocks;
+};
+
+/**
+ * Allocator for shared_ptr control blocks that draws from a MessagePool
+ *
+ * The allocator holds a reference to the pool, which keeps the pool alive for
+ * as long as any object it handed out is.
+ */
+template <class T>
+class MessagePoolAllocator {
+ public:
+  typedef T value_type;
+
+  explicit MessagePoolAllocator(const MessagePool::ptr_t &pool)
+      : m_pool(pool) {}
+  template <class U>
+  MessagePoolAllocator(const MessagePoolAllocator<U> &other)
+      : m_pool(other.Pool()) {}
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(m_pool->AllocateBlock(n * sizeof(T)));
+  }
+  void deallocate(T *p, std::size_t n) {
+    m_pool->DeallocateBlock(p, n * sizeof(T));
+  }
+
+  const MessagePool::ptr_t &Pool() const { return m_pool; }
+
+  template <class U>
+  bool operator==(const MessagePoolAllocator<U> &other) const {
+    return m_pool == other.Pool();
+  }
+  template <class U>
+  bool operator!=(const MessagePoolAllocator<U> &other) const {
+    return m_pool != other.Pool();
+  }
+
+ private:
+  MessagePool::ptr_t m_pool;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_MESSAGEPOOL_H
@@ -0,0 +1,117 @@
+#ifndef SIMPLEAMQPCLIENT_PUBLISHTEMPLATE_H
+#define SIMPLEAMQPCLIENT_PUBLISHTEMPLATE_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Util.h"
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4275 4251)
+#endif
+
+/// @file SimpleAmqpClient/PublishTemplate.h
+/// The AmqpClient::PublishTemplate class is defined in this header file.
+
+namespace AmqpClient {
+
+/**
+ * The parts of a publish that stay the same from message to message
+ *
+ * Holds the exchange, routing key, flags and message properties (including
+ * the header table) already encoded the way they go on the wire, so that
+ * Channel::BasicPublish(const PublishTemplate &, ...) only has to add the body
+ * and a few per-message properties.
+ *
+ * A PublishTemplate is immutable once created and may be shared between
+ * threads.
+ */
+class SIMPLEAMQPCLIENT_EXPORT PublishTemplate {
+ public:
+  /// a `shared_ptr` to PublishTemplate
+  typedef std::shared_ptr<PublishTemplate> ptr_t;
+
+  /// Properties that replace the template's for a single message
+  struct Overrides {
+    std::optional<std::string_view> message_id;      ///< message-id
+    std::optional<std::string_view> correlation_id;  ///< correlation-id
+    std::optional<std::uint64_t> timestamp;          ///< timestamp
+  };
+
+  /**
+   * Creates a new PublishTemplate
+   *
+   * @param exchange_name The name of the exchange to publish to
+   * @param routing_key The routing key to publish with
+   * @param properties A message whose properties are copied into the
+   * template, its body is ignored. Later changes to it do not affect the
+   * template.
+   * @param mandatory See Channel::BasicPublish()
+   * @param immediate See Channel::BasicPublish()
+   */
+  static ptr_t Create(const std::string &exchange_name,
+                      const std::string &routing_key,
+                      const BasicMessage &properties, bool mandatory = false,
+                      bool immediate = false);
+
+  // Non-copyable
+  PublishTemplate(const PublishTemplate &) = delete;
+  PublishTemplate &operator=(const PublishTemplate &) = delete;
+
+  ~PublishTemplate();
+
+  const std::string &ExchangeName() const;  ///< The exchange published to
+  const std::string &RoutingKey() const;    ///< The routing key published with
+  bool Mandatory() const;                   ///< The mandatory flag
+  bool Immediate() const;                   ///< The immediate flag
+
+ protected:
+  PublishTemplate();
+
+  struct Impl;
+  /// PIMPL idiom
+  std::unique_ptr<Impl> m_impl;
+
+ private:
+  friend class Channel;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_PUBLISHTEMPLATE_H
@@ -0,0 +1,68 @@
+#ifndef SIMPLEAMQPCLIENT_PUBLISHTEMPLATEIMPL_H
+#define SIMPLEAMQPCLIENT_PUBLISHTEMPLATEIMPL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include <deque>
+#include <string>
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/PublishTemplate.h"
+#include "SimpleAmqpClient/TableImpl.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+// Points the properties at the message's strings; the header table, if any,
+// is allocated from pool
+amqp_basic_properties_t CreateAmqpProperties(const BasicMessage &mes,
+                                             amqp_pool_ptr_t &pool);
+
+}  // namespace Detail
+
+struct PublishTemplate::Impl {
+  std::string exchange_name;
+  std::string routing_key;
+  bool mandatory;
+  bool immediate;
+
+  amqp_basic_properties_t properties;
+  // Own everything properties points to
+  std::deque<std::string> strings;
+  Detail::amqp_pool_ptr_t headers_pool;
+
+  // The template's properties with overrides applied, ready to send
+  amqp_basic_properties_t Properties(const Overrides &overrides) const;
+};
+
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_PUBLISHTEMPLATEIMPL_H
@@ -34,15 +34,21 @@
 #include "SimpleAmqpClient/AmqpException.h"
 #include "SimpleAmqpClient/AmqpLibraryException.h"
 #include "SimpleAmqpClient/AmqpResponseLibraryException.h"
+#include "SimpleAmqpClient/AsyncChannel.h"
 #include "SimpleAmqpClient/BadUriException.h"
 #include "SimpleAmqpClient/BasicMessage.h"
 #include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/ChannelPool.h"
+#include "SimpleAmqpClient/Codec.h"
+#include "SimpleAmqpClient/ConnectionBlockedException.h"
 #include "SimpleAmqpClient/ConnectionClosedException.h"
 #include "SimpleAmqpClient/ConsumerCancelledException.h"
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/FlatTable.h"
 #include "SimpleAmqpClient/MessageRejectedException.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
+#include "SimpleAmqpClient/PublishTemplate.h"
 #include "SimpleAmqpClient/Table.h"
 #include "SimpleAmqpClient/Version.h"
 
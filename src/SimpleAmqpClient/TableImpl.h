@@ -29,6 +29,7 @@
  */
 
 #include <amqp.h>
+#include <amqp_framing.h>
 
 #include <ctime>
 #include <cstdint>
@@ -37,6 +38,8 @@
 #include <variant>
 #include <vector>
 
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/FlatTable.h"
 #include "SimpleAmqpClient/Table.h"
 
 namespace AmqpClient {
@@ -62,18 +65,55 @@ class TableValueImpl {
 
   value_t m_value;
 
+  static const value_t &GetValue(const TableValue &value) {
+    return value.m_impl->m_value;
+  }
+
   static amqp_table_t CreateAmqpTable(const Table &table,
                                       amqp_pool_ptr_t &pool);
 
   static Table CreateTable(const amqp_table_t &table);
+  static TableValue CreateTableValue(const amqp_field_value_t &entry);
 
   static amqp_table_t CopyTable(const amqp_table_t &table,
                                 amqp_pool_ptr_t &pool);
 
+  // Conversions for FlatTable, each a single pass over the entries. The
+  // amqp_table_t shares one pool allocation for all of its keys and strings.
+  static amqp_table_t CreateAmqpTable(const FlatTable &table,
+                                      amqp_pool_ptr_t &pool);
+  static FlatTable CreateFlatTable(const amqp_table_t &table);
+
+  // Encodes message's headers from whichever form they are held in
+  static amqp_table_t CreateAmqpHeaders(const BasicMessage &message,
+                                        amqp_pool_ptr_t &pool);
+  // For a received message whose properties have not been touched, fills in
+  // properties as they came off the wire, pointing into the message. Returns
+  // false for any other message.
+  static bool GetReceivedProperties(const BasicMessage &message,
+                                    amqp_basic_properties_t &properties);
+  // The entries of table with those of edits replacing or added to them.
+  // Only the entry array is allocated, keys and values are shared with the
+  // two tables, which must outlive the result.
+  static amqp_table_t MergeAmqpTable(const amqp_table_t &table,
+                                     const amqp_table_t &edits,
+                                     amqp_pool_ptr_t &pool);
+
  private:
+  static amqp_field_value_t CreateAmqpFieldValue(
+      const FlatTable &table, const FlatTable::field_t &field,
+      amqp_pool_t &pool, char *bytes);
+  static FlatTable::field_t CreateFlatField(FlatTable &table,
+                                            const amqp_field_value_t &value);
+  // Sorts the nested table entries in [first, first + count) by key, keeping
+  // the first of any duplicates as Table does, and returns the new count
+  static std::uint32_t SortFlatEntries(FlatTable &table,
+                                       std::vector<FlatTable::field_t> &fields,
+                                       std::uint32_t first,
+                                       std::uint32_t count);
+
   static amqp_table_t CreateAmqpTableInner(const Table &table,
                                            amqp_pool_t &pool);
-  static TableValue CreateTableValue(const amqp_field_value_t &entry);
   static amqp_table_t CopyTableInner(const amqp_table_t &table,
                                      amqp_pool_t &pool);
   static amqp_field_value_t CopyValue(const amqp_field_value_t value,
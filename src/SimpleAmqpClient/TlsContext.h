@@ -0,0 +1,65 @@
+#ifndef SIMPLEAMQPCLIENT_TLSCONTEXT_H
+#define SIMPLEAMQPCLIENT_TLSCONTEXT_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <cstdint>
+#include <string>
+
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Util.h"
+
+namespace AmqpClient {
+namespace Detail {
+
+/**
+ * Sets up the OpenSSL context of a TLS socket, see OpenOpts::TLSParams
+ *
+ * Sessions are kept per endpoint and TLS parameters for the life of the
+ * process, so a Channel that reconnects, or another Channel connecting to
+ * the same broker with the same certificates, can resume one rather than
+ * pay for a full handshake. rabbitmq-c creates the
+ * SSL object and runs the handshake in a single call, so the session to
+ * resume is set on the SSL object as SSL_new() creates it, through an
+ * ex_data constructor.
+ */
+class SIMPLEAMQPCLIENT_EXPORT TlsContext {
+ public:
+  // Applies params to ssl_ctx, an SSL_CTX, for a connection to endpoint
+  static void Configure(void *ssl_ctx,
+                        const Channel::OpenOpts::TLSParams &params,
+                        const std::string &endpoint);
+
+  // Handshakes completed in this process, see Channel::GetTlsHandshakeStats()
+  static Channel::TlsHandshakeStats Stats();
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_TLSCONTEXT_H
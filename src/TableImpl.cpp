@@ -38,6 +38,7 @@
 #include <algorithm>
 #include <memory>
 #include <new>
+#include <string_view>
 #include <variant>
 
 #ifdef _MSC_VER
@@ -356,5 +357,306 @@ amqp_field_value_t TableValueImpl::CopyValue(const amqp_field_value_t value,
       return new_value;
   }
 }
+
+amqp_table_t TableValueImpl::MergeAmqpTable(const amqp_table_t &table,
+                                            const amqp_table_t &edits,
+                                            amqp_pool_ptr_t &pool) {
+  if (0 == edits.num_entries) {
+    return table;
+  }
+
+  pool = std::shared_ptr<amqp_pool_t>(new amqp_pool_t, free_pool);
+  init_amqp_pool(pool.get(), sizeof(amqp_table_entry_t) *
+                                 (table.num_entries + edits.num_entries));
+
+  amqp_table_t merged;
+  merged.num_entries = 0;
+  merged.entries = static_cast<amqp_table_entry_t *>(amqp_pool_alloc(
+      pool.get(),
+      sizeof(amqp_table_entry_t) * (table.num_entries + edits.num_entries)));
+  if (NULL == merged.entries) {
+    throw std::bad_alloc();
+  }
+  for (int i = 0; i < table.num_entries; ++i) {
+    const amqp_bytes_t &key = table.entries[i].key;
+    bool replaced = false;
+    for (int j = 0; j < edits.num_entries && !replaced; ++j) {
+      replaced = key.len == edits.entries[j].key.len &&
+                 0 == memcmp(key.bytes, edits.entries[j].key.bytes, key.len);
+    }
+    if (!replaced) {
+      merged.entries[merged.num_entries++] = table.entries[i];
+    }
+  }
+  for (int j = 0; j < edits.num_entries; ++j) {
+    merged.entries[merged.num_entries++] = edits.entries[j];
+  }
+  return merged;
+}
+
+amqp_table_t TableValueImpl::CreateAmqpTable(const FlatTable &table,
+                                             amqp_pool_ptr_t &pool) {
+  if (table.empty()) {
+    return AMQP_EMPTY_TABLE;
+  }
+
+  // Sized so the whole table fits in the pool's first page: the bytes, one
+  // block of entries per table or array, and 8 bytes of alignment for each
+  const std::size_t fields = table.m_entries.size() + table.m_nested.size();
+  const std::size_t page_size = table.m_bytes.size() +
+                                fields * sizeof(amqp_table_entry_t) +
+                                8 * (table.m_nested.size() + 2);
+  pool = std::shared_ptr<amqp_pool_t>(new amqp_pool_t, free_pool);
+  init_amqp_pool(pool.get(), page_size);
+
+  char *bytes = NULL;
+  if (!table.m_bytes.empty()) {
+    bytes = static_cast<char *>(
+        amqp_pool_alloc(pool.get(), table.m_bytes.size()));
+    if (NULL == bytes) {
+      throw std::bad_alloc();
+    }
+    memcpy(bytes, table.m_bytes.data(), table.m_bytes.size());
+  }
+
+  amqp_table_t new_table;
+  new_table.num_entries = static_cast<int>(table.m_entries.size());
+  new_table.entries = static_cast<amqp_table_entry_t *>(amqp_pool_alloc(
+      pool.get(), sizeof(amqp_table_entry_t) * table.m_entries.size()));
+  if (NULL == new_table.entries) {
+    throw std::bad_alloc();
+  }
+  for (std::size_t i = 0; i < table.m_entries.size(); ++i) {
+    const FlatTable::field_t &field = table.m_entries[i];
+    new_table.entries[i].key.bytes = bytes + field.key.first;
+    new_table.entries[i].key.len = field.key.count;
+    new_table.entries[i].value =
+        CreateAmqpFieldValue(table, field, *pool.get(), bytes);
+  }
+  return new_table;
+}
+
+amqp_field_value_t TableValueImpl::CreateAmqpFieldValue(
+    const FlatTable &table, const FlatTable::field_t &field,
+    amqp_pool_t &pool, char *bytes) {
+  amqp_field_value_t v;
+  switch (field.type) {
+    case TableValue::VT_void:
+      v.kind = AMQP_FIELD_KIND_VOID;
+      break;
+    case TableValue::VT_bool:
+      v.kind = AMQP_FIELD_KIND_BOOLEAN;
+      v.value.boolean = field.value.boolean;
+      break;
+    case TableValue::VT_int8:
+      v.kind = AMQP_FIELD_KIND_I8;
+      v.value.i8 = field.value.i8;
+      break;
+    case TableValue::VT_int16:
+      v.kind = AMQP_FIELD_KIND_I16;
+      v.value.i16 = field.value.i16;
+      break;
+    case TableValue::VT_int32:
+      v.kind = AMQP_FIELD_KIND_I32;
+      v.value.i32 = field.value.i32;
+      break;
+    case TableValue::VT_int64:
+      v.kind = AMQP_FIELD_KIND_I64;
+      v.value.i64 = field.value.i64;
+      break;
+    case TableValue::VT_float:
+      v.kind = AMQP_FIELD_KIND_F32;
+      v.value.f32 = field.value.f32;
+      break;
+    case TableValue::VT_double:
+      v.kind = AMQP_FIELD_KIND_F64;
+      v.value.f64 = field.value.f64;
+      break;
+    case TableValue::VT_string:
+      v.kind = AMQP_FIELD_KIND_UTF8;
+      v.value.bytes.bytes = bytes + field.value.range.first;
+      v.value.bytes.len = field.value.range.count;
+      break;
+    case TableValue::VT_array: {
+      const FlatTable::range_t &range = field.value.range;
+      v.kind = AMQP_FIELD_KIND_ARRAY;
+      v.value.array.num_entries = static_cast<int>(range.count);
+      v.value.array.entries = static_cast<amqp_field_value_t *>(
+          amqp_pool_alloc(&pool, sizeof(amqp_field_value_t) * range.count));
+      if (NULL == v.value.array.entries && 0 != range.count) {
+        throw std::bad_alloc();
+      }
+      for (std::uint32_t i = 0; i < range.count; ++i) {
+        v.value.array.entries[i] = CreateAmqpFieldValue(
+            table, table.m_nested[range.first + i], pool, bytes);
+      }
+      break;
+    }
+    case TableValue::VT_table: {
+      const FlatTable::range_t &range = field.value.range;
+      v.kind = AMQP_FIELD_KIND_TABLE;
+      v.value.table.num_entries = static_cast<int>(range.count);
+      v.value.table.entries = static_cast<amqp_table_entry_t *>(
+          amqp_pool_alloc(&pool, sizeof(amqp_table_entry_t) * range.count));
+      if (NULL == v.value.table.entries && 0 != range.count) {
+        throw std::bad_alloc();
+      }
+      for (std::uint32_t i = 0; i < range.count; ++i) {
+        const FlatTable::field_t &entry = table.m_nested[range.first + i];
+        v.value.table.entries[i].key.bytes = bytes + entry.key.first;
+        v.value.table.entries[i].key.len = entry.key.count;
+        v.value.table.entries[i].value =
+            CreateAmqpFieldValue(table, entry, pool, bytes);
+      }
+      break;
+    }
+    case TableValue::VT_uint8:
+      v.kind = AMQP_FIELD_KIND_U8;
+      v.value.u8 = field.value.u8;
+      break;
+    case TableValue::VT_uint16:
+      v.kind = AMQP_FIELD_KIND_U16;
+      v.value.u16 = field.value.u16;
+      break;
+    case TableValue::VT_uint32:
+      v.kind = AMQP_FIELD_KIND_U32;
+      v.value.u32 = field.value.u32;
+      break;
+    case TableValue::VT_timestamp:
+      v.kind = AMQP_FIELD_KIND_TIMESTAMP;
+      v.value.u64 = field.value.u64;
+      break;
+  }
+  return v;
+}
+
+FlatTable TableValueImpl::CreateFlatTable(const amqp_table_t &table) {
+  FlatTable flat;
+  flat.m_entries.resize(table.num_entries);
+  for (int i = 0; i < table.num_entries; ++i) {
+    const amqp_table_entry_t &entry = table.entries[i];
+    FlatTable::field_t field = CreateFlatField(flat, entry.value);
+    field.key = flat.AppendBytes(std::string_view(
+        static_cast<const char *>(entry.key.bytes), entry.key.len));
+    flat.m_entries[i] = field;
+  }
+  flat.m_entries.resize(
+      SortFlatEntries(flat, flat.m_entries, 0, table.num_entries));
+  return flat;
+}
+
+FlatTable::field_t TableValueImpl::CreateFlatField(
+    FlatTable &table, const amqp_field_value_t &value) {
+  FlatTable::field_t field = {};
+  switch (value.kind) {
+    case AMQP_FIELD_KIND_BOOLEAN:
+      field.type = TableValue::VT_bool;
+      field.value.boolean = 0 != value.value.boolean;
+      break;
+    case AMQP_FIELD_KIND_U8:
+      field.type = TableValue::VT_uint8;
+      field.value.u8 = value.value.u8;
+      break;
+    case AMQP_FIELD_KIND_I8:
+      field.type = TableValue::VT_int8;
+      field.value.i8 = value.value.i8;
+      break;
+    case AMQP_FIELD_KIND_U16:
+      field.type = TableValue::VT_uint16;
+      field.value.u16 = value.value.u16;
+      break;
+    case AMQP_FIELD_KIND_I16:
+      field.type = TableValue::VT_int16;
+      field.value.i16 = value.value.i16;
+      break;
+    case AMQP_FIELD_KIND_U32:
+      field.type = TableValue::VT_uint32;
+      field.value.u32 = value.value.u32;
+      break;
+    case AMQP_FIELD_KIND_I32:
+      field.type = TableValue::VT_int32;
+      field.value.i32 = value.value.i32;
+      break;
+    case AMQP_FIELD_KIND_TIMESTAMP:
+      field.type = TableValue::VT_timestamp;
+      field.value.u64 = value.value.u64;
+      break;
+    case AMQP_FIELD_KIND_I64:
+      field.type = TableValue::VT_int64;
+      field.value.i64 = value.value.i64;
+      break;
+    case AMQP_FIELD_KIND_F32:
+      field.type = TableValue::VT_float;
+      field.value.f32 = value.value.f32;
+      break;
+    case AMQP_FIELD_KIND_F64:
+      field.type = TableValue::VT_double;
+      field.value.f64 = value.value.f64;
+      break;
+    case AMQP_FIELD_KIND_UTF8:
+    case AMQP_FIELD_KIND_BYTES:
+      field.type = TableValue::VT_string;
+      field.value.range = table.AppendBytes(
+          std::string_view(static_cast<const char *>(value.value.bytes.bytes),
+                           value.value.bytes.len));
+      break;
+    case AMQP_FIELD_KIND_ARRAY: {
+      const amqp_array_t &array = value.value.array;
+      field.type = TableValue::VT_array;
+      field.value.range = table.AppendNested(array.num_entries);
+      for (int i = 0; i < array.num_entries; ++i) {
+        FlatTable::field_t element = CreateFlatField(table, array.entries[i]);
+        table.m_nested[field.value.range.first + i] = element;
+      }
+      break;
+    }
+    case AMQP_FIELD_KIND_TABLE: {
+      const amqp_table_t &nested = value.value.table;
+      field.type = TableValue::VT_table;
+      field.value.range = table.AppendNested(nested.num_entries);
+      for (int i = 0; i < nested.num_entries; ++i) {
+        const amqp_table_entry_t &entry = nested.entries[i];
+        FlatTable::field_t child = CreateFlatField(table, entry.value);
+        child.key = table.AppendBytes(std::string_view(
+            static_cast<const char *>(entry.key.bytes), entry.key.len));
+        table.m_nested[field.value.range.first + i] = child;
+      }
+      field.value.range.count =
+          SortFlatEntries(table, table.m_nested, field.value.range.first,
+                          field.value.range.count);
+      break;
+    }
+    case AMQP_FIELD_KIND_VOID:
+    case AMQP_FIELD_KIND_DECIMAL:
+    // uint64_t is unsupported by RabbitMQ.
+    case AMQP_FIELD_KIND_U64:
+    default:
+      field.type = TableValue::VT_void;
+      break;
+  }
+  return field;
+}
+
+std::uint32_t TableValueImpl::SortFlatEntries(
+    FlatTable &table, std::vector<FlatTable::field_t> &fields,
+    std::uint32_t first, std::uint32_t count) {
+  std::vector<FlatTable::field_t>::iterator begin = fields.begin() + first;
+  std::vector<FlatTable::field_t>::iterator end = begin + count;
+  auto less = [&table](const FlatTable::field_t &l,
+                       const FlatTable::field_t &r) {
+    return table.Bytes(l.key) < table.Bytes(r.key);
+  };
+  auto not_less = [&less](const FlatTable::field_t &l,
+                          const FlatTable::field_t &r) { return !less(l, r); };
+  // Tables coming off the wire are usually in order already
+  if (end == std::adjacent_find(begin, end, not_less)) {
+    return count;
+  }
+  std::stable_sort(begin, end, less);
+  std::vector<FlatTable::field_t>::iterator last =
+      std::unique(begin, end, not_less);
+  return static_cast<std::uint32_t>(last - begin);
+}
+
 }  // namespace Detail
 }  // namespace AmqpClient
@@ -0,0 +1,223 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+
+#include "SimpleAmqpClient/TlsContext.h"
+
+#ifdef SAC_SSL_SUPPORT_ENABLED
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+#include "SimpleAmqpClient/AmqpLibraryException.h"
+#endif
+
+namespace AmqpClient {
+namespace Detail {
+
+#ifdef SAC_SSL_SUPPORT_ENABLED
+namespace {
+
+struct session_cache_t {
+  session_cache_t() : full(0), resumed(0) {}
+  std::mutex mutex;
+  // The latest session for each CacheKey(), one reference held
+  std::map<std::string, SSL_SESSION *> sessions;
+  std::atomic<std::uint64_t> full;
+  std::atomic<std::uint64_t> resumed;
+};
+
+// Never destroyed, connections closed during static destruction may still
+// be handed new sessions
+session_cache_t &Cache() {
+  static session_cache_t *cache = new session_cache_t;
+  return *cache;
+}
+
+// A session is only resumed by a connection to the same endpoint that
+// would have trusted, and presented, the same certificates: the endpoint
+// followed by a digest of the TLS parameters
+std::string CacheKey(const Channel::OpenOpts::TLSParams &params,
+                     const std::string &endpoint) {
+  std::string identity;
+  const std::string *parts[] = {&params.ca_cert_path, &params.client_cert_path,
+                                &params.client_key_path, &params.cipher_list,
+                                &params.groups};
+  for (const std::string *part : parts) {
+    // Lengths first, so that no two parameter sets run together alike
+    identity.append(std::to_string(part->size())).append(":").append(*part);
+  }
+  identity.push_back(params.verify_peer ? 'P' : 'p');
+  identity.push_back(params.verify_hostname ? 'H' : 'h');
+
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len = 0;
+  if (1 != EVP_Digest(identity.data(), identity.size(), digest, &digest_len,
+                      EVP_sha256(), NULL)) {
+    throw AmqpLibraryException::CreateException(
+        AMQP_STATUS_SSL_ERROR, "Error computing the TLS session cache key");
+  }
+  std::string key = endpoint;
+  key.push_back('/');
+  for (unsigned int i = 0; i < digest_len; ++i) {
+    char hex[3];
+    std::snprintf(hex, sizeof(hex), "%02x", digest[i]);
+    key.append(hex, 2);
+  }
+  return key;
+}
+
+void FreeCacheKey(void *, void *key, CRYPTO_EX_DATA *, int, long, void *) {
+  delete static_cast<std::string *>(key);
+}
+
+// Where the cache key of a context is kept, freed along with the context
+int CacheKeyIndex() {
+  static const int index =
+      SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, FreeCacheKey);
+  return index;
+}
+
+const std::string *GetCacheKey(const SSL *ssl) {
+  return static_cast<const std::string *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), CacheKeyIndex()));
+}
+
+// Called for each new session, including the TLS 1.3 tickets the broker
+// sends once the handshake is done
+int OnNewSession(SSL *ssl, SSL_SESSION *session) {
+  const std::string *key = GetCacheKey(ssl);
+  if (NULL == key) {
+    return 0;
+  }
+  session_cache_t &cache = Cache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  SSL_SESSION *&cached = cache.sessions[*key];
+  if (NULL != cached) {
+    SSL_SESSION_free(cached);
+  }
+  cached = session;
+  // Keeps the reference OpenSSL passed in
+  return 1;
+}
+
+// Called by SSL_new() for each SSL object. rabbitmq-c creates the
+// connection's SSL object and runs the handshake in one call, so this is
+// where the session to resume is set, before SSL_connect() is reached.
+void OnNewSsl(void *parent, void *, CRYPTO_EX_DATA *, int, long, void *) {
+  SSL *ssl = static_cast<SSL *>(parent);
+  const std::string *key = GetCacheKey(ssl);
+  if (NULL == key) {
+    return;
+  }
+  session_cache_t &cache = Cache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  std::map<std::string, SSL_SESSION *>::iterator it =
+      cache.sessions.find(*key);
+  if (it == cache.sessions.end()) {
+    return;
+  }
+  if (!SSL_SESSION_is_resumable(it->second)) {
+    SSL_SESSION_free(it->second);
+    cache.sessions.erase(it);
+    return;
+  }
+  SSL_set_session(ssl, it->second);
+}
+
+// Registers OnNewSsl, which needs an SSL ex_data index of its own to be
+// called
+void RegisterNewSslCallback() {
+  static const int index =
+      SSL_get_ex_new_index(0, NULL, OnNewSsl, NULL, NULL);
+  (void)index;
+}
+
+void OnInfo(const SSL *ssl, int where, int) {
+  if (0 != (where & SSL_CB_HANDSHAKE_DONE)) {
+    session_cache_t &cache = Cache();
+    if (SSL_session_reused(ssl)) {
+      ++cache.resumed;
+    } else {
+      ++cache.full;
+    }
+  }
+}
+
+}  // namespace
+
+void TlsContext::Configure(void *ssl_ctx,
+                           const Channel::OpenOpts::TLSParams &params,
+                           const std::string &endpoint) {
+  SSL_CTX *ctx = static_cast<SSL_CTX *>(ssl_ctx);
+  if (!params.cipher_list.empty() &&
+      1 != SSL_CTX_set_cipher_list(ctx, params.cipher_list.c_str())) {
+    throw AmqpLibraryException::CreateException(
+        AMQP_STATUS_SSL_ERROR, "Error setting TLS cipher list");
+  }
+  if (!params.groups.empty() &&
+      1 != SSL_CTX_set1_groups_list(ctx, params.groups.c_str())) {
+    throw AmqpLibraryException::CreateException(
+        AMQP_STATUS_SSL_ERROR, "Error setting TLS key exchange groups");
+  }
+
+  // Handshakes are counted whether or not sessions are resumed
+  SSL_CTX_set_info_callback(ctx, OnInfo);
+  if (params.resume_sessions) {
+    RegisterNewSslCallback();
+    SSL_CTX_set_ex_data(ctx, CacheKeyIndex(),
+                        new std::string(CacheKey(params, endpoint)));
+    SSL_CTX_set_session_cache_mode(
+        ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, OnNewSession);
+  }
+}
+
+Channel::TlsHandshakeStats TlsContext::Stats() {
+  Channel::TlsHandshakeStats stats;
+  stats.full = Cache().full;
+  stats.resumed = Cache().resumed;
+  return stats;
+}
+#else
+void TlsContext::Configure(void *, const Channel::OpenOpts::TLSParams &,
+                           const std::string &) {}
+
+Channel::TlsHandshakeStats TlsContext::Stats() {
+  return Channel::TlsHandshakeStats();
+}
+#endif
+
+}  // namespace Detail
+}  // namespace AmqpClient
@@ -59,3 +59,69 @@ TEST_F(connected_test, basic_ack_deliveryinfo) {
 
   channel->BasicAck(info);
 }
+
+TEST_F(connected_test, basic_ack_batched) {
+  std::string queue = channel->DeclareQueue("", false, false, false, false);
+  for (int i = 0; i < 6; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  }
+
+  {
+    Channel::OpenOpts opts = GetTestOpenOpts();
+    opts.ack_batch_size = 4;
+    Channel::ptr_t batched = Channel::Open(opts);
+    std::string consumer =
+        batched->BasicConsume(queue, "", true, false, true, 6);
+
+    std::vector<Envelope::ptr_t> envelopes;
+    for (int i = 0; i < 6; ++i) {
+      envelopes.push_back(batched->BasicConsumeMessage(consumer));
+    }
+    // In order, then one out of order, then the gap is filled
+    batched->BasicAck(envelopes[0]);
+    batched->BasicAck(envelopes[1]);
+    batched->BasicAck(envelopes[2]);
+    batched->BasicAck(envelopes[5]);
+    batched->BasicAck(envelopes[3]);
+    batched->BasicAck(envelopes[4]);
+    batched->FlushAcks();
+    batched->BasicCancel(consumer);
+  }
+
+  // Anything left unacked would have been requeued when batched was closed
+  std::uint32_t message_count;
+  std::uint32_t consumer_count;
+  channel->DeclareQueueWithCounts(queue, message_count, consumer_count, true);
+  EXPECT_EQ(0, message_count);
+  channel->DeleteQueue(queue);
+}
+
+TEST_F(connected_test, basic_ack_batched_after_no_ack_get) {
+  std::string queue = channel->DeclareQueue("", false, false, false, false);
+  for (int i = 0; i < 5; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  }
+
+  Channel::OpenOpts opts = GetTestOpenOpts();
+  opts.ack_batch_size = 4;
+  opts.collect_stats = true;
+  Channel::ptr_t batched = Channel::Open(opts);
+  // Nothing acks the first delivery on the channel, which must not keep the
+  // consumer's acks that follow from being batched
+  Envelope::ptr_t got;
+  ASSERT_TRUE(batched->BasicGet(got, queue, true));
+  std::string consumer =
+      batched->BasicConsume(queue, "", true, false, true, 4);
+
+  std::vector<Envelope::ptr_t> envelopes;
+  for (int i = 0; i < 4; ++i) {
+    envelopes.push_back(batched->BasicConsumeMessage(consumer));
+  }
+  for (int i = 0; i < 4; ++i) {
+    batched->BasicAck(envelopes[i]);
+  }
+  EXPECT_EQ(1u, batched->GetStats().acks_sent);
+
+  batched->BasicCancel(consumer);
+  channel->DeleteQueue(queue);
+}
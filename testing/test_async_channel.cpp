@@ -0,0 +1,175 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <SimpleAmqpClient/AsyncChannel.h>
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+namespace {
+// Runs to completion without anyone awaiting it, the tests check what it
+// left behind
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return Detached(); }
+    std::suspend_never initial_suspend() { return std::suspend_never(); }
+    std::suspend_never final_suspend() noexcept {
+      return std::suspend_never();
+    }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+struct publish_result_t {
+  bool done = false;
+  Channel::PublishConfirm confirm;
+  std::exception_ptr error;
+};
+
+Detached Publish(AsyncChannel &async, const std::string &exchange,
+                 const std::string &routing_key, const std::string &body,
+                 publish_result_t &result) {
+  try {
+    result.confirm = co_await async.AsyncPublish(
+        exchange, routing_key, BasicMessage::Create(body), true);
+  } catch (...) {
+    result.error = std::current_exception();
+  }
+  result.done = true;
+}
+
+Detached Consume(AsyncChannel &async, const std::string &consumer,
+                 std::vector<std::string> &bodies) {
+  Envelope::ptr_t envelope = co_await async.AsyncConsume(consumer);
+  bodies.push_back(envelope->Message()->Body());
+}
+
+// Polls until every operation has completed, or 5 seconds have passed
+void PollAll(AsyncChannel &async) {
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (async.Pending() > 0 && std::chrono::steady_clock::now() < deadline) {
+    if (0 == async.Poll()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+}  // namespace
+
+TEST_F(connected_test, async_publish) {
+  std::string queue = channel->DeclareQueue("");
+  AsyncChannel async(channel);
+  publish_result_t result;
+  Publish(async, "", queue, "message", result);
+  EXPECT_FALSE(result.done);
+
+  PollAll(async);
+  ASSERT_TRUE(result.done);
+  EXPECT_FALSE(result.error);
+  EXPECT_EQ(Channel::PublishConfirm::pc_acked, result.confirm.status);
+  EXPECT_EQ("message", channel->BasicConsumeMessage(
+                           channel->BasicConsume(queue))->Message()->Body());
+}
+
+TEST_F(connected_test, async_publish_full_window) {
+  std::string queue = channel->DeclareQueue("");
+  channel->SetPublishConfirmWindow(1);
+  AsyncChannel async(channel);
+
+  // Only the first goes out, the others wait their turn without blocking
+  std::vector<publish_result_t> results(3);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    Publish(async, "", queue, std::to_string(i), results[i]);
+  }
+  EXPECT_EQ(1, channel->UnconfirmedPublishCount());
+  EXPECT_EQ(3, async.Pending());
+
+  PollAll(async);
+  EXPECT_EQ(0, async.Pending());
+  std::string consumer = channel->BasicConsume(queue);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    ASSERT_TRUE(results[i].done);
+    EXPECT_FALSE(results[i].error);
+    EXPECT_EQ(Channel::PublishConfirm::pc_acked, results[i].confirm.status);
+    EXPECT_EQ(std::to_string(i),
+              channel->BasicConsumeMessage(consumer)->Message()->Body());
+  }
+}
+
+TEST_F(connected_test, async_publish_returned) {
+  AsyncChannel async(channel);
+  publish_result_t result;
+  Publish(async, "", "async_publish_returned_no_such_queue", "message",
+          result);
+
+  PollAll(async);
+  ASSERT_TRUE(result.done);
+  EXPECT_FALSE(result.error);
+  EXPECT_EQ(Channel::PublishConfirm::pc_returned, result.confirm.status);
+}
+
+TEST_F(connected_test, async_publish_channel_closed) {
+  AsyncChannel async(channel);
+  publish_result_t result;
+  // Publishing to a missing exchange gets the confirm channel closed
+  Publish(async, "async_publish_channel_closed_no_such_exchange", "",
+          "message", result);
+
+  PollAll(async);
+  ASSERT_TRUE(result.done);
+  EXPECT_TRUE(result.error);
+  EXPECT_EQ(0, channel->UnconfirmedPublishCount());
+}
+
+TEST_F(connected_test, async_consume) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+  AsyncChannel async(channel);
+
+  // Waiters are handed messages in the order they started waiting
+  std::vector<std::string> bodies;
+  Consume(async, consumer, bodies);
+  Consume(async, consumer, bodies);
+  EXPECT_EQ(2, async.Pending());
+  channel->BasicPublish("", queue, BasicMessage::Create("first"));
+  channel->BasicPublish("", queue, BasicMessage::Create("second"));
+
+  PollAll(async);
+  ASSERT_EQ(2, bodies.size());
+  EXPECT_EQ("first", bodies[0]);
+  EXPECT_EQ("second", bodies[1]);
+}
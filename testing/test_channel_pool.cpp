@@ -0,0 +1,91 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <map>
+
+#include "SimpleAmqpClient/ChannelPool.h"
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+TEST(channel_pool, no_connections) {
+  EXPECT_THROW(ChannelPool::Open(connected_test::GetTestOpenOpts(), 0),
+               std::runtime_error);
+}
+
+TEST(channel_pool, publish_consume) {
+  ChannelPool::ptr_t pool =
+      ChannelPool::Open(connected_test::GetTestOpenOpts(), 3);
+  EXPECT_EQ(3, pool->Size());
+
+  std::string queue =
+      pool->GetChannel(0)->DeclareQueue("", false, false, false, true);
+  std::map<std::string, int> consumers;
+  for (int i = 0; i < 3; ++i) {
+    consumers[pool->BasicConsume(queue, "", true, false, false)] = 0;
+  }
+
+  for (int i = 0; i < 9; ++i) {
+    pool->BasicPublish("", queue, BasicMessage::Create("Message"));
+  }
+
+  Envelope::ptr_t envelope;
+  for (int i = 0; i < 9; ++i) {
+    ASSERT_TRUE(pool->BasicConsumeMessage(envelope, 1000));
+    EXPECT_EQ("Message", envelope->Message()->Body());
+    ++consumers[envelope->ConsumerTag()];
+    pool->BasicAck(envelope);
+  }
+  EXPECT_EQ(3, consumers.size());
+  EXPECT_FALSE(pool->BasicConsumeMessage(envelope, 0));
+}
+
+TEST(channel_pool, ack_after_cancel) {
+  Channel::ptr_t channel = Channel::Open(connected_test::GetTestOpenOpts());
+  std::string queue = channel->DeclareQueue("", false, false, false, false);
+  {
+    ChannelPool::ptr_t pool =
+        ChannelPool::Open(connected_test::GetTestOpenOpts(), 2);
+    std::string consumer = pool->BasicConsume(queue, "", true, false, false);
+    pool->BasicPublish("", queue, BasicMessage::Create("Message"));
+
+    Envelope::ptr_t envelope;
+    ASSERT_TRUE(pool->BasicConsumeMessage(envelope, 1000));
+    pool->BasicCancel(consumer);
+    EXPECT_NO_THROW(pool->BasicAck(envelope));
+    // With its last message settled, the consumer is forgotten
+    EXPECT_THROW(pool->BasicAck(envelope), ConsumerTagNotFoundException);
+  }
+
+  // Had the ack been lost, closing the pool would have requeued the message
+  std::uint32_t message_count = 0;
+  std::uint32_t consumer_count = 0;
+  channel->DeclareQueueWithCounts(queue, message_count, consumer_count, true);
+  EXPECT_EQ(0, message_count);
+  channel->DeleteQueue(queue);
+}
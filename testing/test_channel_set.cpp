@@ -0,0 +1,142 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <gtest/gtest.h>
+
+#include <limits>
+
+#include "SimpleAmqpClient/ChannelSet.h"
+
+using AmqpClient::Detail::ChannelSet;
+
+TEST(channel_set, empty) {
+  ChannelSet set;
+  amqp_channel_t channel;
+  EXPECT_FALSE(set.Lowest(channel));
+
+  // Erasing what was never inserted, even past the end, changes nothing
+  set.Erase(1);
+  set.Erase(4096);
+  EXPECT_FALSE(set.Lowest(channel));
+}
+
+TEST(channel_set, lowest_first) {
+  ChannelSet set;
+  set.Insert(9);
+  set.Insert(3);
+  set.Insert(5);
+
+  amqp_channel_t channel;
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(3, channel);
+  set.Erase(3);
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(5, channel);
+  set.Erase(5);
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(9, channel);
+  set.Erase(9);
+  EXPECT_FALSE(set.Lowest(channel));
+}
+
+TEST(channel_set, past_word_boundary) {
+  ChannelSet set;
+  for (amqp_channel_t i = 1; i <= 130; ++i) {
+    set.Insert(i);
+  }
+
+  // Emptying a word moves on to the next one
+  for (amqp_channel_t i = 1; i < 64; ++i) {
+    set.Erase(i);
+  }
+  amqp_channel_t channel;
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(64, channel);
+  for (amqp_channel_t i = 64; i < 128; ++i) {
+    set.Erase(i);
+  }
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(128, channel);
+
+  // A word that becomes non-empty again is found ahead of later ones
+  set.Insert(65);
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(65, channel);
+}
+
+TEST(channel_set, free_and_reuse) {
+  // As the set of closed channels: a freed number is handed out again, the
+  // lowest first, and leaves the set when it is reused
+  ChannelSet set;
+  set.Insert(200);
+  set.Insert(70);
+  set.Insert(2);
+
+  amqp_channel_t channel;
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(2, channel);
+  set.Erase(channel);
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(70, channel);
+  set.Erase(channel);
+
+  // Freed again while a higher number is still free
+  set.Insert(2);
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(2, channel);
+  set.Erase(channel);
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(200, channel);
+  set.Erase(channel);
+  EXPECT_FALSE(set.Lowest(channel));
+}
+
+TEST(channel_set, up_to_channel_max) {
+  // Every number up to the largest channel_max the protocol allows, which
+  // spans several summary words
+  const amqp_channel_t channel_max =
+      std::numeric_limits<amqp_channel_t>::max();
+  ChannelSet set;
+  for (amqp_channel_t i = 1; i != 0; ++i) {
+    set.Insert(i);
+  }
+
+  amqp_channel_t expected = 1;
+  amqp_channel_t channel;
+  while (set.Lowest(channel)) {
+    ASSERT_EQ(expected, channel);
+    set.Erase(channel);
+    ++expected;
+  }
+  // Wrapped around past channel_max, so every number was handed out once
+  EXPECT_EQ(0, expected);
+
+  set.Insert(channel_max);
+  ASSERT_TRUE(set.Lowest(channel));
+  EXPECT_EQ(channel_max, channel);
+}
@@ -0,0 +1,127 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include <stdexcept>
+#include <string>
+
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+#ifdef SAC_ZLIB_SUPPORT_ENABLED
+TEST(codec, deflate_round_trip) {
+  Codec::ptr_t codec = Codec::Deflate();
+  EXPECT_EQ("deflate", codec->ContentEncoding());
+
+  const std::string body(10000, 'x');
+  std::string encoded;
+  codec->Encode(body, encoded);
+  EXPECT_LT(encoded.size(), body.size());
+
+  std::string decoded;
+  EXPECT_TRUE(codec->Decode(encoded, decoded, body.size()));
+  EXPECT_EQ(body, decoded);
+
+  // The same codec is reused for the next body
+  codec->Encode("", encoded);
+  EXPECT_TRUE(codec->Decode(encoded, decoded, body.size()));
+  EXPECT_TRUE(decoded.empty());
+}
+
+TEST(codec, deflate_max_size) {
+  Codec::ptr_t codec = Codec::Deflate();
+  const std::string body(100000, 'x');
+  std::string encoded;
+  codec->Encode(body, encoded);
+
+  std::string decoded;
+  EXPECT_FALSE(codec->Decode(encoded, decoded, body.size() - 1));
+  EXPECT_FALSE(codec->Decode(encoded, decoded, 0));
+  EXPECT_TRUE(codec->Decode(encoded, decoded, body.size()));
+  EXPECT_EQ(body, decoded);
+}
+
+TEST(codec, deflate_invalid) {
+  Codec::ptr_t codec = Codec::Deflate(1);
+  std::string encoded;
+  codec->Encode(std::string(1000, 'y'), encoded);
+
+  const std::size_t max_size = 1000;
+  std::string decoded;
+  EXPECT_FALSE(codec->Decode("not deflate", decoded, max_size));
+  EXPECT_FALSE(codec->Decode(encoded.substr(0, encoded.size() / 2), decoded,
+                             max_size));
+  EXPECT_FALSE(codec->Decode(encoded + "trailing", decoded, max_size));
+  EXPECT_TRUE(codec->Decode(encoded, decoded, max_size));
+  EXPECT_EQ(std::string(1000, 'y'), decoded);
+}
+
+TEST_F(connected_test, publish_deflate) {
+  std::string queue = channel->DeclareQueue("");
+  Channel::ptr_t plain = Channel::Open(GetTestOpenOpts());
+  channel->SetCodec(Codec::Deflate(), 100);
+
+  const std::string large(4000, 'z');
+  channel->BasicPublish("", queue, BasicMessage::Create(large));
+  channel->BasicPublish("", queue, BasicMessage::Create("small"));
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(plain->BasicGet(envelope, queue, true));
+  EXPECT_EQ("deflate", envelope->Message()->ContentEncoding());
+  EXPECT_LT(envelope->Message()->Body().size(), large.size());
+  ASSERT_TRUE(plain->BasicGet(envelope, queue, true));
+  EXPECT_FALSE(envelope->Message()->ContentEncodingIsSet());
+  EXPECT_EQ("small", envelope->Message()->Body());
+
+  channel->BasicPublish("", queue, BasicMessage::Create(large));
+  ASSERT_TRUE(channel->BasicGet(envelope, queue, true));
+  EXPECT_FALSE(envelope->Message()->ContentEncodingIsSet());
+  EXPECT_EQ(large, envelope->Message()->Body());
+  EXPECT_EQ(0u, channel->GetStats().decode_failures);
+}
+
+TEST_F(connected_test, consume_deflate_over_max_size) {
+  std::string queue = channel->DeclareQueue("");
+  channel->SetCodec(Codec::Deflate(), 100, 1000);
+
+  const std::string large(4000, 'z');
+  channel->BasicPublish("", queue, BasicMessage::Create(large));
+
+  // Too large to decode, so it arrives as it was sent
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicGet(envelope, queue, true));
+  EXPECT_EQ("deflate", envelope->Message()->ContentEncoding());
+  EXPECT_LT(envelope->Message()->Body().size(), large.size());
+  EXPECT_EQ(1u, channel->GetStats().decode_failures);
+}
+#else
+TEST(codec, deflate_unavailable) {
+  EXPECT_THROW(Codec::Deflate(), std::logic_error);
+}
+#endif
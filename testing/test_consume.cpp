@@ -26,7 +26,10 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <thread>
 
 #include "connected_test.h"
 
@@ -66,6 +69,55 @@ TEST_F(connected_test, basic_cancel_cancelled_consumer) {
   EXPECT_THROW(channel->BasicCancel(consumer), ConsumerTagNotFoundException);
 }
 
+TEST_F(connected_test, basic_cancel_requeues_buffered) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer =
+      channel->BasicConsume(queue, "", true, false, true, 2);
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  channel->BasicAck(channel->BasicConsumeMessage(consumer));
+  // The second message is buffered, or arrives before the cancel-ok, either
+  // way it goes back to the queue rather than waiting for a close
+  channel->BasicCancel(consumer);
+
+  std::string next = channel->BasicConsume(queue, "", true, false);
+  Envelope::ptr_t delivered;
+  ASSERT_TRUE(channel->BasicConsumeMessage(next, delivered, 5000));
+  EXPECT_EQ(next, delivered->ConsumerTag());
+  channel->BasicAck(delivered);
+}
+
+TEST_F(connected_test, basic_consume_nowait) {
+  std::string queue = channel->DeclareQueue("");
+  std::vector<std::string> consumers;
+  for (int i = 0; i < 10; ++i) {
+    consumers.push_back(
+        channel->BasicConsumeNoWait(queue, "", true, false, false, 2));
+    EXPECT_FALSE(consumers.back().empty());
+  }
+  EXPECT_EQ("named_nowait", channel->BasicConsumeNoWait(queue, "named_nowait"));
+
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  Envelope::ptr_t delivered;
+  EXPECT_TRUE(channel->BasicConsumeMessage(delivered, -1));
+}
+
+TEST_F(connected_test, basic_cancel_nowait) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  // Whether or not it is already on its way to the cancelled consumer, the
+  // message ends up with the next one
+  channel->BasicCancelNoWait(consumer);
+  EXPECT_THROW(channel->BasicCancel(consumer), ConsumerTagNotFoundException);
+
+  std::string next = channel->BasicConsume(queue, "", true, false);
+  Envelope::ptr_t delivered;
+  ASSERT_TRUE(channel->BasicConsumeMessage(next, delivered, 5000));
+  EXPECT_EQ(next, delivered->ConsumerTag());
+  channel->BasicAck(delivered);
+}
+
 TEST_F(connected_test, basic_consume_message) {
   BasicMessage::ptr_t message = BasicMessage::Create("Message Body");
   std::string queue = channel->DeclareQueue("");
@@ -199,6 +251,26 @@ TEST_F(connected_test, consumer_cancelled) {
                ConsumerCancelledException);
 }
 
+TEST_F(connected_test, consumer_cancelled_try) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+
+  channel->BasicPublish("", queue, BasicMessage::Create("Message"));
+  Channel::ConsumeResult result = channel->TryBasicConsumeMessage(consumer);
+  EXPECT_EQ(Channel::ConsumeResult::cr_delivered, result.status);
+  ASSERT_TRUE(result.envelope);
+  EXPECT_EQ("Message", result.envelope->Message()->Body());
+
+  result = channel->TryBasicConsumeMessage(consumer, 0);
+  EXPECT_EQ(Channel::ConsumeResult::cr_timeout, result.status);
+
+  channel->DeleteQueue(queue);
+  result = channel->TryBasicConsumeMessage(consumer);
+  EXPECT_EQ(Channel::ConsumeResult::cr_cancelled, result.status);
+  EXPECT_EQ(consumer, result.consumer_tag);
+  EXPECT_FALSE(result.envelope);
+}
+
 TEST_F(connected_test, consumer_cancelled_one_message) {
   std::string queue = channel->DeclareQueue("");
   std::string consumer = channel->BasicConsume(queue, "", true, false);
@@ -226,3 +298,232 @@ TEST_F(connected_test, consume_multiple) {
 
   EXPECT_EQ(Body, env->Message()->Body());
 }
+
+TEST_F(connected_test, basic_consume_message_pool) {
+  Channel::OpenOpts opts = GetTestOpenOpts();
+  opts.message_pool_size = 4;
+  Channel::ptr_t pooled = Channel::Open(opts);
+  std::string queue = pooled->DeclareQueue("");
+  std::string consumer = pooled->BasicConsume(queue);
+
+  BasicMessage::ptr_t first = BasicMessage::Create("First message body");
+  first->ContentType("text/plain");
+  first->CorrelationId("first-correlation-id");
+  pooled->BasicPublish("", queue, first);
+  pooled->BasicPublish("", queue, BasicMessage::Create("Second"));
+
+  Envelope::ptr_t delivered = pooled->BasicConsumeMessage(consumer);
+  EXPECT_EQ(first->Body(), delivered->Message()->Body());
+  EXPECT_EQ("text/plain", delivered->Message()->ContentType());
+  delivered.reset();
+
+  // The recycled objects must not carry anything over from the first delivery
+  delivered = pooled->BasicConsumeMessage(consumer);
+  EXPECT_EQ(consumer, delivered->ConsumerTag());
+  EXPECT_EQ(queue, delivered->RoutingKey());
+  EXPECT_EQ("Second", delivered->Message()->Body());
+  EXPECT_FALSE(delivered->Message()->ContentTypeIsSet());
+  EXPECT_FALSE(delivered->Message()->CorrelationIdIsSet());
+}
+
+TEST_F(connected_test, basic_consume_messages) {
+  std::string queue = channel->DeclareQueue("");
+  for (int i = 0; i < 5; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message"));
+  }
+  std::vector<std::string> consumers;
+  consumers.push_back(channel->BasicConsume(queue));
+
+  std::vector<Envelope::ptr_t> envelopes;
+  std::size_t count = 0;
+  while (count < 5 &&
+         channel->BasicConsumeMessages(consumers, 3, 1000, envelopes) > 0) {
+    EXPECT_GE(3, envelopes.size() - count);
+    count = envelopes.size();
+  }
+  EXPECT_EQ(5, envelopes.size());
+  EXPECT_EQ(0, channel->BasicConsumeMessages(consumers, 3, 0, envelopes));
+}
+
+TEST_F(connected_test, thread_safe_publish_consume) {
+  Channel::OpenOpts opts = GetTestOpenOpts();
+  opts.thread_safe = true;
+  Channel::ptr_t shared = Channel::Open(opts);
+
+  std::string queue = shared->DeclareQueue("");
+  std::string consumer = shared->BasicConsume(queue, "", true, false);
+
+  const int count = 100;
+  int received = 0;
+  std::thread consumer_thread([&]() {
+    Envelope::ptr_t envelope;
+    while (received < count &&
+           shared->BasicConsumeMessage(consumer, envelope, 5000)) {
+      shared->BasicAck(envelope);
+      ++received;
+    }
+  });
+
+  for (int i = 0; i < count; ++i) {
+    shared->BasicPublish("", queue, BasicMessage::Create("Message"));
+  }
+  consumer_thread.join();
+  EXPECT_EQ(count, received);
+}
+
+TEST_F(connected_test, on_readable) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+  channel->BasicPublish("", queue, BasicMessage::Create("Message"));
+
+  Envelope::ptr_t envelope;
+  for (int i = 0; i < 100 && !envelope; ++i) {
+    if (!channel->OnReadable()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    channel->BasicConsumeMessage(consumer, envelope, 0);
+  }
+  ASSERT_TRUE(envelope);
+  EXPECT_EQ("Message", envelope->Message()->Body());
+  EXPECT_FALSE(channel->WantsWrite());
+}
+
+TEST_F(connected_test, max_buffered_bytes) {
+  Channel::OpenOpts opts = GetTestOpenOpts();
+  opts.max_buffered_bytes = 10;
+  Channel::ptr_t limited = Channel::Open(opts);
+  std::string queue = limited->DeclareQueue("");
+  std::string consumer = limited->BasicConsume(queue);
+  for (int i = 0; i < 3; ++i) {
+    limited->BasicPublish("", queue, BasicMessage::Create("12345678"));
+  }
+
+  for (int i = 0; i < 100 && limited->WantsRead(); ++i) {
+    if (!limited->OnReadable()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  EXPECT_GE(limited->GetBufferedBytes(), 10u);
+  EXPECT_FALSE(limited->WantsRead());
+  EXPECT_FALSE(limited->OnReadable());
+
+  Envelope::ptr_t envelope;
+  while (!limited->WantsRead()) {
+    ASSERT_TRUE(limited->BasicConsumeMessage(consumer, envelope, 0));
+  }
+  EXPECT_LT(limited->GetBufferedBytes(), 10u);
+}
+
+TEST_F(connected_test, basic_consume_handler) {
+  std::string queue = channel->DeclareQueue("");
+  std::vector<std::string> bodies;
+  std::string consumer = channel->BasicConsume(
+      queue, [&bodies](const Envelope::ptr_t &envelope) {
+        bodies.push_back(envelope->Message()->Body());
+      });
+  channel->BasicPublish("", queue, BasicMessage::Create("Message1"));
+  channel->BasicPublish("", queue, BasicMessage::Create("Message2"));
+
+  while (bodies.size() < 2 && channel->DispatchMessages(1000) > 0) {
+  }
+  ASSERT_EQ(2, bodies.size());
+  EXPECT_EQ("Message1", bodies[0]);
+  EXPECT_EQ("Message2", bodies[1]);
+
+  Envelope::ptr_t envelope;
+  EXPECT_FALSE(channel->BasicConsumeMessage(consumer, envelope, 0));
+}
+
+TEST(test_consume, consumer_threads_require_thread_safe) {
+  Channel::OpenOpts opts = connected_test::GetTestOpenOpts();
+  opts.consumer_threads = 2;
+  EXPECT_THROW(Channel::Open(opts), std::runtime_error);
+}
+
+TEST_F(connected_test, basic_consume_message_many_consumers) {
+  std::map<std::string, int> received;
+  std::vector<std::string> queues;
+  for (int i = 0; i < 3; ++i) {
+    queues.push_back(channel->DeclareQueue(""));
+    received[channel->BasicConsume(queues.back())] = 0;
+  }
+  for (int i = 0; i < 6; ++i) {
+    channel->BasicPublish("", queues[i % queues.size()],
+                          BasicMessage::Create("Message"));
+  }
+
+  Envelope::ptr_t envelope;
+  for (int i = 0; i < 6; ++i) {
+    ASSERT_TRUE(channel->BasicConsumeMessage(envelope, 1000));
+    ++received[envelope->ConsumerTag()];
+  }
+  for (std::map<std::string, int>::const_iterator it = received.begin();
+       it != received.end(); ++it) {
+    EXPECT_EQ(2, it->second);
+  }
+}
+
+TEST_F(connected_test, basic_consume_message_tags_change) {
+  std::string queue1 = channel->DeclareQueue("");
+  std::string queue2 = channel->DeclareQueue("");
+  std::vector<std::string> tags;
+  tags.push_back(channel->BasicConsume(queue1));
+  tags.push_back(channel->BasicConsume(queue2));
+
+  // The same list of consumers is looked up once and reused
+  Envelope::ptr_t envelope;
+  for (int i = 0; i < 4; ++i) {
+    channel->BasicPublish("", i % 2 ? queue2 : queue1,
+                          BasicMessage::Create("Message"));
+    ASSERT_TRUE(channel->BasicConsumeMessage(tags, envelope, 1000));
+    EXPECT_EQ(tags[i % 2], envelope->ConsumerTag());
+  }
+
+  channel->BasicCancel(tags[1]);
+  EXPECT_THROW(channel->BasicConsumeMessage(tags, envelope, 0),
+               ConsumerTagNotFoundException);
+}
+
+TEST_F(connected_test, basic_consume_message_stream) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+
+  // Several frames' worth of body, published from a source a piece at a time
+  const std::size_t body_size = 400 * 1024;
+  std::size_t produced = 0;
+  BasicMessage::ptr_t properties = BasicMessage::Create();
+  properties->MessageId("streamed");
+  channel->BasicPublish(
+      "", queue, properties, body_size,
+      [&produced](char *buffer, std::size_t size) {
+        std::size_t n = std::min<std::size_t>(size, 1000);
+        for (std::size_t i = 0; i < n; ++i) {
+          buffer[i] = static_cast<char>('a' + (produced + i) % 26);
+        }
+        produced += n;
+        return n;
+      });
+
+  Envelope::ptr_t envelope;
+  std::size_t received = 0;
+  std::size_t chunks = 0;
+  bool in_order = true;
+  ASSERT_TRUE(channel->BasicConsumeMessageStream(
+      consumer, envelope,
+      [&](const Envelope::ptr_t &env, std::string_view chunk,
+          std::uint64_t remaining) {
+        EXPECT_EQ("streamed", env->Message()->MessageId());
+        for (std::size_t i = 0; i < chunk.size(); ++i) {
+          in_order &= chunk[i] == static_cast<char>('a' + (received + i) % 26);
+        }
+        received += chunk.size();
+        EXPECT_EQ(body_size - received, remaining);
+        ++chunks;
+      },
+      1000));
+  EXPECT_EQ(body_size, received);
+  EXPECT_TRUE(in_order);
+  EXPECT_LT(1u, chunks);
+  EXPECT_TRUE(envelope->Message()->Body().empty());
+  channel->BasicAck(envelope);
+}
@@ -0,0 +1,109 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include "SimpleAmqpClient/EndpointSelector.h"
+
+using namespace AmqpClient;
+using Detail::EndpointSelector;
+
+namespace {
+Channel::OpenOpts TwoRacks() {
+  Channel::OpenOpts opts;
+  opts.endpoints.push_back(Channel::OpenOpts::Endpoint("near-a", 5672, 0));
+  opts.endpoints.push_back(Channel::OpenOpts::Endpoint("far", 5672, 1));
+  opts.endpoints.push_back(Channel::OpenOpts::Endpoint("near-b", 5672, 0));
+  return opts;
+}
+}  // namespace
+
+TEST(endpoint_selector, host_and_port_without_endpoints) {
+  Channel::OpenOpts opts;
+  opts.host = "broker";
+  opts.port = 5673;
+  EndpointSelector selector(opts);
+
+  std::vector<std::size_t> candidates =
+      selector.Candidates(std::chrono::steady_clock::now());
+  ASSERT_EQ(1u, candidates.size());
+  EXPECT_EQ("broker", selector.Endpoint(candidates[0]).host);
+  EXPECT_EQ(5673, selector.Endpoint(candidates[0]).port);
+}
+
+TEST(endpoint_selector, orders_by_locality) {
+  EndpointSelector selector(TwoRacks());
+  std::vector<std::size_t> expected = {0, 2, 1};
+  EXPECT_EQ(expected, selector.Candidates(std::chrono::steady_clock::now()));
+}
+
+TEST(endpoint_selector, measured_handshake_goes_first) {
+  EndpointSelector selector(TwoRacks());
+  selector.Succeeded(0, std::chrono::milliseconds(20));
+  selector.Succeeded(2, std::chrono::milliseconds(5));
+  std::vector<std::size_t> expected = {2, 0, 1};
+  EXPECT_EQ(expected, selector.Candidates(std::chrono::steady_clock::now()));
+}
+
+TEST(endpoint_selector, failed_goes_after_every_locality) {
+  EndpointSelector selector(TwoRacks());
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  selector.Failed(0, now);
+  selector.Failed(2, now);
+
+  std::vector<std::size_t> expected = {1, 0, 2};
+  EXPECT_EQ(expected, selector.Candidates(now));
+  EXPECT_TRUE(selector.SameTier(0, 2, now));
+  EXPECT_FALSE(selector.SameTier(0, 1, now));
+}
+
+TEST(endpoint_selector, penalty_expires) {
+  EndpointSelector selector(TwoRacks());
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  selector.Failed(0, now);
+
+  std::vector<std::size_t> expected = {0, 2, 1};
+  EXPECT_EQ(expected,
+            selector.Candidates(now + EndpointSelector::FAILURE_PENALTY));
+}
+
+TEST(endpoint_selector, success_clears_penalty) {
+  EndpointSelector selector(TwoRacks());
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  selector.Failed(0, now);
+  selector.Succeeded(0, std::chrono::milliseconds(1));
+
+  std::vector<std::size_t> expected = {0, 2, 1};
+  EXPECT_EQ(expected, selector.Candidates(now));
+}
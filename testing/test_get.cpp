@@ -63,6 +63,30 @@ TEST(test_get, get_big) {
   EXPECT_EQ(message->Body(), new_message->Message()->Body());
 }
 
+TEST_F(connected_test, get_many) {
+  std::string queue = channel->DeclareQueue("");
+  for (int i = 0; i < 40; ++i) {
+    channel->BasicPublish("", queue,
+                          BasicMessage::Create("Message " + std::to_string(i)));
+  }
+
+  std::vector<Envelope::ptr_t> envelopes;
+  EXPECT_EQ(30, channel->BasicGetMany(queue, 30, envelopes, false));
+  ASSERT_EQ(30, envelopes.size());
+  EXPECT_EQ("Message 0", envelopes.front()->Message()->Body());
+  EXPECT_EQ("Message 29", envelopes.back()->Message()->Body());
+  channel->BasicAck(envelopes.back()->GetDeliveryInfo(), true);
+
+  EXPECT_EQ(10, channel->BasicGetMany(queue, 100, envelopes));
+  ASSERT_EQ(40, envelopes.size());
+  EXPECT_EQ("Message 39", envelopes.back()->Message()->Body());
+  EXPECT_EQ(0, channel->BasicGetMany(queue, 100, envelopes));
+
+  EXPECT_THROW(
+      channel->BasicGetMany("test_get_nonexistantqueue", 10, envelopes),
+      ChannelException);
+}
+
 TEST_F(connected_test, bad_queue) {
   Envelope::ptr_t new_message;
   EXPECT_THROW(channel->BasicGet(new_message, "test_get_nonexistantqueue"),
@@ -31,6 +31,8 @@
 #include <algorithm>
 #include <array>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #include "connected_test.h"
 
@@ -115,6 +117,91 @@ TEST(basic_message, embedded_nulls) {
   EXPECT_EQ(body2, message->Body());
 }
 
+TEST(basic_message, move_body) {
+  std::string body(1000, 'm');
+  const char *data = body.data();
+  BasicMessage::ptr_t message = BasicMessage::Create(std::move(body));
+  EXPECT_EQ(data, message->Body().data());
+
+  std::string correlation_id("a correlation id longer than SSO");
+  message->CorrelationId(std::move(correlation_id));
+  EXPECT_EQ("a correlation id longer than SSO", message->CorrelationId());
+
+  std::string released = message->ReleaseBody();
+  EXPECT_EQ(data, released.data());
+  EXPECT_TRUE(message->Body().empty());
+
+  message->Body(std::move(released));
+  EXPECT_EQ(data, message->Body().data());
+}
+
+TEST(basic_message, find_header) {
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  TableValue value;
+  EXPECT_FALSE(message->FindHeader("trace-id", value));
+
+  Table headers;
+  headers.insert(TableEntry("trace-id", "abc123"));
+  message->HeaderTable(headers);
+  EXPECT_TRUE(message->FindHeader("trace-id", value));
+  EXPECT_EQ("abc123", value.GetString());
+  EXPECT_FALSE(message->FindHeader("span-id", value));
+}
+
+TEST_F(connected_test, received_headers) {
+  const std::string queue = channel->DeclareQueue("");
+  const std::string consumer = channel->BasicConsume(queue);
+
+  BasicMessage::ptr_t out_message = BasicMessage::Create("Message Body");
+  out_message->ContentType("text/plain");
+  Table headers;
+  headers.insert(TableEntry("trace-id", "abc123"));
+  headers.insert(TableEntry("hops", 3));
+  out_message->HeaderTable(headers);
+  channel->BasicPublish("", queue, out_message);
+
+  BasicMessage::ptr_t in_message =
+      channel->BasicConsumeMessage(consumer)->Message();
+  EXPECT_TRUE(in_message->ContentTypeIsSet());
+  EXPECT_FALSE(in_message->ReplyToIsSet());
+  EXPECT_TRUE(in_message->HeaderTableIsSet());
+
+  TableValue value;
+  EXPECT_TRUE(in_message->FindHeader("trace-id", value));
+  EXPECT_EQ("abc123", value.GetString());
+  EXPECT_EQ("text/plain", in_message->ContentType());
+  EXPECT_EQ(headers, in_message->HeaderTable());
+}
+
+TEST_F(connected_test, received_message_concurrent_reads) {
+  const std::string queue = channel->DeclareQueue("");
+  const std::string consumer = channel->BasicConsume(queue);
+
+  BasicMessage::ptr_t out_message = BasicMessage::Create("Message Body");
+  out_message->ContentType("text/plain");
+  out_message->MessageId("id-1");
+  Table headers;
+  headers.insert(TableEntry("trace-id", "abc123"));
+  out_message->HeaderTable(headers);
+  channel->BasicPublish("", queue, out_message);
+
+  std::shared_ptr<const BasicMessage> in_message =
+      channel->BasicConsumeMessage(consumer)->Message();
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.push_back(std::thread([&]() {
+      TableValue value;
+      EXPECT_TRUE(in_message->FindHeader("trace-id", value));
+      EXPECT_EQ("text/plain", in_message->ContentType());
+      EXPECT_EQ("id-1", in_message->MessageId());
+      EXPECT_EQ(headers, in_message->HeaderTable());
+    }));
+  }
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+}
+
 TEST_F(connected_test, replaced_received_body) {
   const std::string queue = channel->DeclareQueue("");
   const std::string consumer = channel->BasicConsume(queue);
@@ -72,6 +72,20 @@ TEST_F(connected_test, publish_mandatory_fail) {
       MessageReturnedException);
 }
 
+TEST_F(connected_test, publish_try_mandatory_fail) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+
+  Channel::PublishConfirm result =
+      channel->TryBasicPublish("", "test_publish_notexist", message, true);
+  EXPECT_EQ(Channel::PublishConfirm::pc_returned, result.status);
+  EXPECT_EQ("test_publish_notexist", result.returned.routing_key);
+  EXPECT_EQ("message body", result.returned.message->Body());
+
+  std::string queue = channel->DeclareQueue("");
+  result = channel->TryBasicPublish("", queue, message, true);
+  EXPECT_EQ(Channel::PublishConfirm::pc_acked, result.status);
+}
+
 TEST_F(connected_test, publish_mandatory_success) {
   BasicMessage::ptr_t message = BasicMessage::Create("message body");
   std::string queue = channel->DeclareQueue("");
@@ -86,3 +100,326 @@ TEST_F(connected_test, publish_immediate_success) {
 
   channel->BasicPublish("", queue, message, true);
 }
+
+TEST_F(connected_test, publish_async_success) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = channel->DeclareQueue("");
+
+  std::vector<Channel::PublishConfirm> confirms;
+  channel->SetPublishConfirmCallback(
+      [&confirms](const Channel::PublishConfirm &confirm) {
+        confirms.push_back(confirm);
+      });
+
+  std::uint64_t first = channel->BasicPublishAsync("", queue, message);
+  std::uint64_t second = channel->BasicPublishAsync("", queue, message);
+  EXPECT_LT(first, second);
+
+  EXPECT_TRUE(channel->WaitForConfirms());
+  EXPECT_EQ(0, channel->UnconfirmedPublishCount());
+  ASSERT_EQ(2, confirms.size());
+  EXPECT_EQ(first, confirms[0].sequence_number);
+  EXPECT_EQ(second, confirms[1].sequence_number);
+  EXPECT_EQ(Channel::PublishConfirm::pc_acked, confirms[0].status);
+  EXPECT_EQ(Channel::PublishConfirm::pc_acked, confirms[1].status);
+}
+
+TEST_F(connected_test, publish_async_window) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = channel->DeclareQueue("");
+
+  channel->SetPublishConfirmWindow(2);
+  for (int i = 0; i < 10; ++i) {
+    channel->BasicPublishAsync("", queue, message);
+    EXPECT_GE(2, channel->UnconfirmedPublishCount());
+  }
+  EXPECT_TRUE(channel->WaitForConfirms());
+
+  EXPECT_THROW(channel->SetPublishConfirmWindow(0), std::invalid_argument);
+}
+
+TEST_F(connected_test, publish_async_callback_publishes) {
+  Channel::OpenOpts opts = GetTestOpenOpts();
+  opts.thread_safe = true;
+  Channel::ptr_t safe = Channel::Open(opts);
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = safe->DeclareQueue("");
+
+  // With a window of 1 each publish from the callback waits for a confirm
+  safe->SetPublishConfirmWindow(1);
+  int confirmed = 0;
+  safe->SetPublishConfirmCallback(
+      [&](const Channel::PublishConfirm &confirm) {
+        EXPECT_EQ(Channel::PublishConfirm::pc_acked, confirm.status);
+        if (++confirmed < 5) {
+          safe->BasicPublishAsync("", queue, message);
+        }
+      });
+
+  safe->BasicPublishAsync("", queue, message);
+  safe->BasicPublishAsync("", queue, message);
+  EXPECT_TRUE(safe->WaitForConfirms());
+  EXPECT_EQ(0, safe->UnconfirmedPublishCount());
+  EXPECT_LE(5, confirmed);
+}
+
+TEST_F(connected_test, publish_async_unblocked) {
+  Channel::OpenOpts opts = GetTestOpenOpts();
+  opts.blocked_publish_buffer_size = 10;
+  Channel::ptr_t buffered = Channel::Open(opts);
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = buffered->DeclareQueue("");
+
+  int notifications = 0;
+  buffered->SetConnectionBlockedCallback(
+      [&notifications](bool, const std::string &) { ++notifications; });
+
+  // Without a broker alarm nothing is held back
+  EXPECT_FALSE(buffered->IsBlocked());
+  buffered->BasicPublishAsync("", queue, message);
+  EXPECT_FALSE(buffered->WantsWrite());
+  EXPECT_TRUE(buffered->WaitForConfirms());
+  EXPECT_EQ(0, buffered->UnconfirmedPublishCount());
+  EXPECT_EQ(0, notifications);
+}
+
+TEST_F(connected_test, publish_stats) {
+  Channel::OpenOpts opts = GetTestOpenOpts();
+  opts.collect_stats = true;
+  Channel::ptr_t counted = Channel::Open(opts);
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = counted->DeclareQueue("");
+
+  counted->BasicPublish("", queue, message);
+  counted->BasicPublishAsync("", queue, message);
+  EXPECT_TRUE(counted->WaitForConfirms());
+
+  Channel::Stats stats = counted->GetStats();
+  EXPECT_EQ(2, stats.messages_published);
+  EXPECT_EQ(2, stats.confirm_latency.count);
+  EXPECT_LE(2, stats.channels_opened);
+  EXPECT_EQ(0, stats.channels_closed);
+  EXPECT_LT(0, stats.frames_read);
+  EXPECT_FALSE(stats.rpc_latency.empty());
+  EXPECT_LT(0, stats.confirm_latency.Percentile(0.5));
+
+  // Without collect_stats only the gauges are filled in
+  stats = channel->GetStats();
+  EXPECT_EQ(0, stats.frames_read);
+  EXPECT_TRUE(stats.rpc_latency.empty());
+}
+
+TEST_F(connected_test, publish_async_mandatory_fail) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+
+  std::vector<Channel::PublishConfirm> confirms;
+  channel->SetPublishConfirmCallback(
+      [&confirms](const Channel::PublishConfirm &confirm) {
+        confirms.push_back(confirm);
+      });
+
+  channel->BasicPublishAsync("", "test_publish_notexist", message, true);
+  EXPECT_TRUE(channel->WaitForConfirms());
+
+  ASSERT_EQ(1, confirms.size());
+  EXPECT_EQ(Channel::PublishConfirm::pc_returned, confirms[0].status);
+  EXPECT_EQ("message body", confirms[0].returned.message->Body());
+  EXPECT_EQ("test_publish_notexist", confirms[0].returned.routing_key);
+}
+
+TEST_F(connected_test, publish_async_mandatory_acked_together) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = channel->DeclareQueue("");
+
+  std::vector<Channel::PublishConfirm> confirms;
+  channel->SetPublishConfirmCallback(
+      [&confirms](const Channel::PublishConfirm &confirm) {
+        confirms.push_back(confirm);
+      });
+
+  // Nothing is read until WaitForConfirms, so the broker is free to ack the
+  // routed publishes and the returned one with a single multiple=true ack
+  std::vector<std::uint64_t> routed;
+  for (int i = 0; i < 10; ++i) {
+    routed.push_back(channel->BasicPublishAsync("", queue, message, true));
+  }
+  std::uint64_t returned =
+      channel->BasicPublishAsync("", "test_publish_notexist", message, true);
+  EXPECT_TRUE(channel->WaitForConfirms());
+
+  ASSERT_EQ(routed.size() + 1, confirms.size());
+  for (std::size_t i = 0; i < routed.size(); ++i) {
+    EXPECT_EQ(routed[i], confirms[i].sequence_number);
+    EXPECT_EQ(Channel::PublishConfirm::pc_acked, confirms[i].status);
+  }
+  EXPECT_EQ(returned, confirms.back().sequence_number);
+  EXPECT_EQ(Channel::PublishConfirm::pc_returned, confirms.back().status);
+  EXPECT_EQ("test_publish_notexist", confirms.back().returned.routing_key);
+}
+
+TEST_F(connected_test, publish_async_badexchange) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+
+  channel->BasicPublishAsync("test_publish_notexist", "test_publish_rk",
+                             message);
+  EXPECT_THROW(channel->WaitForConfirms(), ChannelException);
+  EXPECT_EQ(0, channel->UnconfirmedPublishCount());
+
+  channel->BasicPublishAsync("", "test_publish_rk", message);
+  EXPECT_TRUE(channel->WaitForConfirms());
+}
+
+TEST_F(connected_test, publish_batch_success) {
+  std::string queue = channel->DeclareQueue("");
+  std::vector<BasicMessage::ptr_t> messages;
+  for (int i = 0; i < 100; ++i) {
+    messages.push_back(BasicMessage::Create("message body"));
+  }
+
+  std::vector<Channel::PublishConfirm> results =
+      channel->BasicPublishBatch("", queue, messages);
+
+  ASSERT_EQ(messages.size(), results.size());
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    EXPECT_EQ(Channel::PublishConfirm::pc_acked, results[i].status);
+  }
+  EXPECT_EQ(0, channel->UnconfirmedPublishCount());
+}
+
+TEST_F(connected_test, publish_batch_mandatory) {
+  std::string queue = channel->DeclareQueue("");
+  std::vector<std::pair<std::string, BasicMessage::ptr_t> > messages;
+  messages.push_back(
+      std::make_pair(queue, BasicMessage::Create("message body")));
+  messages.push_back(std::make_pair(std::string("test_publish_notexist"),
+                                    BasicMessage::Create("message body")));
+  messages.push_back(
+      std::make_pair(queue, BasicMessage::Create("message body")));
+
+  std::vector<Channel::PublishConfirm> results =
+      channel->BasicPublishBatch("", messages, true);
+
+  ASSERT_EQ(3, results.size());
+  EXPECT_EQ(Channel::PublishConfirm::pc_acked, results[0].status);
+  EXPECT_EQ(Channel::PublishConfirm::pc_returned, results[1].status);
+  EXPECT_EQ("test_publish_notexist", results[1].returned.routing_key);
+  EXPECT_EQ(Channel::PublishConfirm::pc_acked, results[2].status);
+}
+
+TEST_F(connected_test, publish_no_confirms) {
+  Channel::OpenOpts opts = GetTestOpenOpts();
+  opts.publisher_confirms = false;
+  Channel::ptr_t unconfirmed = Channel::Open(opts);
+  std::string queue = unconfirmed->DeclareQueue("");
+
+  unconfirmed->BasicPublish("", queue, BasicMessage::Create("message body"));
+  unconfirmed->BasicPublish("", "test_publish_notexist",
+                            BasicMessage::Create("returned body"), true);
+
+  Channel::ReturnedMessage returned;
+  ASSERT_TRUE(unconfirmed->GetReturnedMessage(returned, -1));
+  EXPECT_EQ("test_publish_notexist", returned.routing_key);
+  EXPECT_EQ("returned body", returned.message->Body());
+  EXPECT_FALSE(unconfirmed->GetReturnedMessage(returned));
+
+  Envelope::ptr_t env;
+  ASSERT_TRUE(unconfirmed->BasicGet(env, queue));
+  EXPECT_EQ("message body", env->Message()->Body());
+}
+
+TEST_F(connected_test, publish_template) {
+  std::string queue = channel->DeclareQueue("");
+  BasicMessage::ptr_t properties = BasicMessage::Create();
+  properties->ContentType("text/plain");
+  properties->AppId("publish_template");
+  Table headers;
+  headers.insert(TableEntry("key", "value"));
+  properties->HeaderTable(headers);
+
+  PublishTemplate::ptr_t publish =
+      PublishTemplate::Create("", queue, *properties);
+  // The template keeps its own copy
+  properties->ContentType("application/octet-stream");
+
+  channel->BasicPublish(*publish, "Message1");
+  PublishTemplate::Overrides overrides;
+  overrides.message_id = "id2";
+  overrides.timestamp = 1234;
+  channel->BasicPublish(*publish, "Message2", overrides);
+
+  std::string consumer = channel->BasicConsume(queue);
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ("Message1", envelope->Message()->Body());
+  EXPECT_EQ("text/plain", envelope->Message()->ContentType());
+  EXPECT_EQ("publish_template", envelope->Message()->AppId());
+  EXPECT_FALSE(envelope->Message()->MessageIdIsSet());
+  EXPECT_EQ(headers, envelope->Message()->HeaderTable());
+
+  envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ("Message2", envelope->Message()->Body());
+  EXPECT_EQ("id2", envelope->Message()->MessageId());
+  EXPECT_EQ(1234, envelope->Message()->Timestamp());
+}
+
+TEST_F(connected_test, publish_segments) {
+  std::string queue = channel->DeclareQueue("");
+  BasicMessage::ptr_t properties = BasicMessage::Create();
+  properties->ContentType("text/plain");
+
+  // Larger than a frame, so one segment is split over several body frames
+  std::string large(300 * 1024, 'x');
+  std::vector<std::string_view> body;
+  body.push_back("head-");
+  body.push_back(std::string_view());
+  body.push_back(large);
+  body.push_back("-tail");
+  channel->BasicPublish("", queue, properties, body);
+
+  PublishTemplate::ptr_t publish =
+      PublishTemplate::Create("", queue, *properties);
+  std::vector<std::string_view> parts;
+  parts.push_back("Mess");
+  parts.push_back("age2");
+  channel->BasicPublish(*publish, parts);
+
+  std::string consumer = channel->BasicConsume(queue);
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ("head-" + large + "-tail", envelope->Message()->Body());
+  EXPECT_EQ("text/plain", envelope->Message()->ContentType());
+
+  envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ("Message2", envelope->Message()->Body());
+}
+
+TEST_F(connected_test, publish_relay) {
+  std::string source = channel->DeclareQueue("");
+  std::string destination = channel->DeclareQueue("");
+
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  message->ContentType("text/plain");
+  Table headers;
+  headers.insert(TableEntry("kept", 1));
+  headers.insert(TableEntry("replaced", 2));
+  message->HeaderTable(headers);
+  channel->BasicPublish("", source, message);
+
+  Envelope::ptr_t received;
+  ASSERT_TRUE(channel->BasicGet(received, source, true));
+  TableValue value;
+  EXPECT_TRUE(received->Message()->FindHeader("kept", value));
+
+  FlatTable edits;
+  edits.Set("replaced", std::int32_t(3));
+  edits.Set("added", "hop");
+  channel->BasicRelay("", destination, received->Message(), edits);
+
+  Envelope::ptr_t relayed;
+  ASSERT_TRUE(channel->BasicGet(relayed, destination, true));
+  EXPECT_EQ("message body", relayed->Message()->Body());
+  EXPECT_EQ("text/plain", relayed->Message()->ContentType());
+  const Table &relayed_headers = relayed->Message()->HeaderTable();
+  EXPECT_EQ(3, relayed_headers.size());
+  EXPECT_EQ(1, relayed_headers.at("kept").GetInteger());
+  EXPECT_EQ(3, relayed_headers.at("replaced").GetInteger());
+  EXPECT_EQ("hop", relayed_headers.at("added").GetString());
+}
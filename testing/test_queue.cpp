@@ -27,6 +27,8 @@
  */
 
 #include <cstdint>
+#include <exception>
+#include <stdexcept>
 
 #include "connected_test.h"
 
@@ -247,3 +249,66 @@ TEST_F(connected_test, queue_purge_badqueue) {
   EXPECT_THROW(channel->PurgeQueue("purge_queue_queuenotexist"),
                ChannelException);
 }
+
+TEST_F(connected_test, declare_topology) {
+  std::vector<Channel::TopologyOp> ops;
+  ops.push_back(Channel::TopologyOp::DeclareExchange("declare_topology_exch"));
+  ops.push_back(Channel::TopologyOp::DeclareQueue(""));
+  ops.push_back(Channel::TopologyOp::DeclareQueue("declare_topology_queue"));
+  ops.push_back(Channel::TopologyOp::BindQueue(
+      "declare_topology_queue", "declare_topology_exch", "rk"));
+  // Refused, the rest of the batch still goes ahead
+  ops.push_back(Channel::TopologyOp::BindQueue("declare_topology_queue",
+                                               "declare_topology_notexist"));
+  ops.push_back(Channel::TopologyOp::BindQueue(
+      "declare_topology_queue", "declare_topology_exch", "rk2"));
+
+  std::vector<Channel::TopologyResult> results = channel->DeclareTopology(ops);
+  ASSERT_EQ(ops.size(), results.size());
+  EXPECT_TRUE(results[0].Succeeded());
+  EXPECT_FALSE(results[1].queue_name.empty());
+  EXPECT_EQ("declare_topology_queue", results[2].queue_name);
+  EXPECT_TRUE(results[3].Succeeded());
+  EXPECT_FALSE(results[4].Succeeded());
+  EXPECT_THROW(std::rethrow_exception(results[4].error), NotFoundException);
+  EXPECT_TRUE(results[5].Succeeded());
+
+  channel->BasicPublish("declare_topology_exch", "rk2",
+                        BasicMessage::Create("routed"), true);
+
+  channel->DeleteQueue("declare_topology_queue");
+  channel->DeleteExchange("declare_topology_exch");
+}
+
+TEST_F(connected_test, declare_topology_nowait) {
+  std::vector<Channel::TopologyOp> ops;
+  ops.push_back(
+      Channel::TopologyOp::DeclareExchange("declare_topology_nowait_exch"));
+  ops.push_back(Channel::TopologyOp::DeclareQueue("declare_topology_nowait"));
+  ops.push_back(Channel::TopologyOp::BindQueue(
+      "declare_topology_nowait", "declare_topology_nowait_exch", "rk"));
+
+  std::vector<Channel::TopologyResult> results =
+      channel->DeclareTopology(ops, true);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    EXPECT_TRUE(results[i].Succeeded());
+  }
+  channel->BasicPublish("declare_topology_nowait_exch", "rk",
+                        BasicMessage::Create("routed"), true);
+
+  // Found by making the batch again with replies
+  Channel::TopologyOp refused = Channel::TopologyOp::BindQueue(
+      "declare_topology_nowait", "declare_topology_nowait_notexist");
+  ops.insert(ops.begin() + 1, refused);
+  results = channel->DeclareTopology(ops, true);
+  EXPECT_TRUE(results[0].Succeeded());
+  EXPECT_FALSE(results[1].Succeeded());
+  EXPECT_TRUE(results[2].Succeeded());
+  EXPECT_TRUE(results[3].Succeeded());
+
+  ops.push_back(Channel::TopologyOp::DeclareQueue(""));
+  EXPECT_THROW(channel->DeclareTopology(ops, true), std::invalid_argument);
+
+  channel->DeleteQueue("declare_topology_nowait");
+  channel->DeleteExchange("declare_topology_nowait_exch");
+}
@@ -0,0 +1,111 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+namespace {
+// Answers one request waiting for consumer, echoing its body back
+void AnswerRequest(Channel::ptr_t channel, const std::string &consumer,
+                   const std::string &prefix) {
+  Envelope::ptr_t request = channel->BasicConsumeMessage(consumer);
+  BasicMessage::ptr_t reply =
+      BasicMessage::Create(prefix + request->Message()->Body());
+  reply->CorrelationId(request->Message()->CorrelationId());
+  channel->BasicPublish("", request->Message()->ReplyTo(), reply);
+}
+}  // namespace
+
+TEST_F(connected_test, rpc_call) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+
+  std::string first =
+      channel->RpcSend("", queue, BasicMessage::Create("first"));
+  std::string second =
+      channel->RpcSend("", queue, BasicMessage::Create("second"));
+  EXPECT_NE(first, second);
+  EXPECT_EQ(2, channel->PendingRpcCalls());
+  AnswerRequest(channel, consumer, "re: ");
+  AnswerRequest(channel, consumer, "re: ");
+
+  // Replies are matched to their call whatever order they are waited for in
+  BasicMessage::ptr_t reply;
+  ASSERT_TRUE(channel->RpcWaitForReply(second, reply, 5000));
+  EXPECT_EQ("re: second", reply->Body());
+  ASSERT_TRUE(channel->RpcWaitForReply(first, reply, 5000));
+  EXPECT_EQ("re: first", reply->Body());
+  EXPECT_EQ(0, channel->PendingRpcCalls());
+  EXPECT_THROW(channel->RpcWaitForReply(first, reply, 0),
+               std::invalid_argument);
+}
+
+TEST_F(connected_test, rpc_call_timeout) {
+  std::string queue = channel->DeclareQueue("");
+
+  // Nothing answers
+  EXPECT_FALSE(channel->RpcCall("", queue, BasicMessage::Create("ping"), 1));
+  EXPECT_EQ(0, channel->PendingRpcCalls());
+
+  std::string correlation_id =
+      channel->RpcSend("", queue, BasicMessage::Create("ping"));
+  BasicMessage::ptr_t reply;
+  EXPECT_FALSE(channel->RpcWaitForReply(correlation_id, reply, 1));
+  EXPECT_EQ(1, channel->PendingRpcCalls());
+  channel->RpcAbandon(correlation_id);
+  EXPECT_EQ(0, channel->PendingRpcCalls());
+}
+
+#ifndef _WIN32
+TEST(connecting_test, rpc_call_lost_to_recovery) {
+  Channel::OpenOpts opts = connected_test::GetTestOpenOpts();
+  opts.automatic_recovery = true;
+  Channel::ptr_t channel = Channel::Open(opts);
+  std::string queue = channel->DeclareQueue("");
+
+  std::string correlation_id =
+      channel->RpcSend("", queue, BasicMessage::Create("ping"));
+  shutdown(channel->GetSocketFD(), SHUT_RDWR);
+  BasicMessage::ptr_t reply;
+  EXPECT_THROW(channel->RpcWaitForReply(correlation_id, reply, 1000),
+               std::runtime_error);
+
+  // The next call reconnects, the reply would have gone to the old
+  // connection's reply queue
+  EXPECT_THROW(channel->RpcWaitForReply(correlation_id, reply, 1000),
+               ConnectionClosedException);
+  EXPECT_EQ(0, channel->PendingRpcCalls());
+  EXPECT_THROW(channel->RpcWaitForReply(correlation_id, reply, 0),
+               std::invalid_argument);
+}
+#endif
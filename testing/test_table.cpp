@@ -29,6 +29,7 @@
 #include <algorithm>
 #include <ctime>
 #include <cstdint>
+#include <stdexcept>
 #include <variant>
 
 #include "connected_test.h"
@@ -831,6 +832,89 @@ TEST(table, convert_to_rabbitmq_empty) {
   EXPECT_EQ(0, table_out.size());
 }
 
+TEST(table, flat_table) {
+  std::vector<TableValue> array_in;
+  array_in.push_back(TableValue(false));
+  array_in.push_back(TableValue(std::string("Another string")));
+  Table table_inner;
+  table_inner.insert(TableEntry("inner_string", "An inner table"));
+  table_inner.insert(TableEntry("inner array", array_in));
+
+  Table table_in;
+  table_in.insert(TableEntry("void_key", TableValue()));
+  table_in.insert(TableEntry("uint8_key", uint8_t(8)));
+  table_in.insert(TableEntry("int64_key", int64_t(64)));
+  table_in.insert(TableEntry("timestamp_key", TableValue::Timestamp(64)));
+  table_in.insert(TableEntry("double_key", double(2.25)));
+  table_in.insert(TableEntry("string_key", "A string!"));
+  table_in.insert(TableEntry("array_key", array_in));
+  table_in.insert(TableEntry("table_key", table_inner));
+
+  FlatTable flat(table_in);
+  EXPECT_EQ(table_in.size(), flat.size());
+  EXPECT_EQ(table_in, flat.ToTable());
+  EXPECT_EQ(flat, FlatTable(flat.ToTable()));
+
+  EXPECT_TRUE(flat.Contains("string_key"));
+  EXPECT_FALSE(flat.Contains("missing_key"));
+  EXPECT_EQ("A string!", flat.GetString("string_key").value());
+  EXPECT_FALSE(flat.GetString("uint8_key").has_value());
+  EXPECT_EQ(TableValue(table_inner), flat.Get("table_key"));
+  EXPECT_THROW(flat.Get("missing_key"), std::out_of_range);
+
+  // Built up by hand, in any order, the result is the same
+  FlatTable inner;
+  inner.Set("inner array", TableValue(array_in));
+  inner.Set("inner_string", "An inner table");
+  FlatTable by_hand;
+  by_hand.Set("table_key", inner);
+  by_hand.Set("string_key", "Replaced");
+  by_hand.Set("string_key", "A string!");
+  by_hand.Set("array_key", TableValue(array_in));
+  by_hand.Set("double_key", 2.25);
+  by_hand.SetTimestamp("timestamp_key", 64);
+  by_hand.Set("int64_key", int64_t(64));
+  by_hand.Set("uint8_key", uint8_t(8));
+  by_hand.Set("extra_key", true);
+  by_hand.SetVoid("void_key");
+  EXPECT_NE(flat, by_hand);
+  EXPECT_TRUE(by_hand.Erase("extra_key"));
+  EXPECT_FALSE(by_hand.Erase("extra_key"));
+  EXPECT_EQ(flat, by_hand);
+
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  message->HeaderTable(flat);
+  EXPECT_TRUE(message->HeaderTableIsSet());
+  EXPECT_EQ(flat, message->HeaderFlatTable());
+  TableValue value;
+  EXPECT_TRUE(message->FindHeader("double_key", value));
+  EXPECT_EQ(2.25, value.GetDouble());
+  EXPECT_EQ(table_in, message->HeaderTable());
+}
+
+TEST_F(connected_test, basic_message_flat_header_roundtrip) {
+  FlatTable arguments;
+  arguments.Set("x-max-length", int32_t(10));
+  std::string queue =
+      channel->DeclareQueue("", false, false, true, true, arguments);
+
+  FlatTable inner;
+  inner.Set("inner_string", "An inner table");
+  FlatTable headers;
+  headers.Set("string_key", "A string!");
+  headers.Set("int32_key", int32_t(32));
+  headers.Set("table_key", inner);
+
+  BasicMessage::ptr_t message = BasicMessage::Create("Body");
+  message->HeaderTable(headers);
+  channel->BasicPublish("", queue, message);
+
+  std::string tag = channel->BasicConsume(queue, "");
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(tag);
+  EXPECT_EQ(headers, envelope->Message()->HeaderFlatTable());
+  EXPECT_EQ(headers.ToTable(), envelope->Message()->HeaderTable());
+}
+
 TEST_F(connected_test, basic_message_header_roundtrip) {
   Table table_in;
   table_in.insert(TableEntry("void_key", TableValue()));
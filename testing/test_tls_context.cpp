@@ -0,0 +1,213 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <gtest/gtest.h>
+
+#ifdef SAC_SSL_SUPPORT_ENABLED
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <memory>
+
+#include "SimpleAmqpClient/AmqpLibraryException.h"
+#include "SimpleAmqpClient/TlsContext.h"
+
+using namespace AmqpClient;
+using Detail::TlsContext;
+
+namespace {
+typedef std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> ctx_ptr_t;
+
+ctx_ptr_t ClientContext() {
+  return ctx_ptr_t(SSL_CTX_new(TLS_client_method()), SSL_CTX_free);
+}
+
+// A TLS 1.2 server with a throwaway self-signed certificate, so that the
+// session is settled by the end of the handshake
+ctx_ptr_t ServerContext() {
+  ctx_ptr_t ctx(SSL_CTX_new(TLS_server_method()), SSL_CTX_free);
+  SSL_CTX_set_max_proto_version(ctx.get(), TLS1_2_VERSION);
+
+  EVP_PKEY *key = NULL;
+  EVP_PKEY_CTX *keygen = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+  EVP_PKEY_keygen_init(keygen);
+  EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keygen, NID_X9_62_prime256v1);
+  EVP_PKEY_keygen(keygen, &key);
+  EVP_PKEY_CTX_free(keygen);
+
+  X509 *cert = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, key);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                             reinterpret_cast<const unsigned char *>("broker"),
+                             -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  X509_sign(cert, key, EVP_sha256());
+
+  SSL_CTX_use_certificate(ctx.get(), cert);
+  SSL_CTX_use_PrivateKey(ctx.get(), key);
+  X509_free(cert);
+  EVP_PKEY_free(key);
+  return ctx;
+}
+
+// Runs a handshake between the two through a BIO pair, returning whether it
+// resumed a session
+bool Handshake(SSL_CTX *client_ctx, SSL_CTX *server_ctx) {
+  SSL *client = SSL_new(client_ctx);
+  SSL *server = SSL_new(server_ctx);
+  BIO *client_bio = NULL;
+  BIO *server_bio = NULL;
+  BIO_new_bio_pair(&client_bio, 0, &server_bio, 0);
+  SSL_set_bio(client, client_bio, client_bio);
+  SSL_set_bio(server, server_bio, server_bio);
+  SSL_set_connect_state(client);
+  SSL_set_accept_state(server);
+
+  for (int round = 0; round < 100; ++round) {
+    const int client_done = SSL_do_handshake(client);
+    const int server_done = SSL_do_handshake(server);
+    if (1 == client_done && 1 == server_done) {
+      break;
+    }
+  }
+  EXPECT_TRUE(SSL_is_init_finished(client));
+  const bool resumed = 0 != SSL_session_reused(client);
+  // Closed cleanly, as rabbitmq-c does, since OpenSSL will not resume a
+  // session whose connection was dropped mid-stream
+  SSL_shutdown(client);
+  SSL_free(client);
+  SSL_free(server);
+  return resumed;
+}
+
+Channel::OpenOpts::TLSParams ResumingParams() {
+  Channel::OpenOpts::TLSParams params;
+  params.verify_peer = false;
+  params.verify_hostname = false;
+  params.resume_sessions = true;
+  return params;
+}
+}  // namespace
+
+TEST(tls_context, rejects_bad_cipher_list) {
+  ctx_ptr_t ctx = ClientContext();
+  Channel::OpenOpts::TLSParams params;
+  params.cipher_list = "NOT-A-CIPHER";
+  EXPECT_THROW(TlsContext::Configure(ctx.get(), params, "broker:5671"),
+               AmqpLibraryException);
+
+  params = Channel::OpenOpts::TLSParams();
+  params.groups = "not-a-group";
+  EXPECT_THROW(TlsContext::Configure(ctx.get(), params, "broker:5671"),
+               AmqpLibraryException);
+}
+
+TEST(tls_context, counts_full_handshakes) {
+  ctx_ptr_t server = ServerContext();
+  ctx_ptr_t client = ClientContext();
+  Channel::OpenOpts::TLSParams params;
+  params.verify_peer = false;
+  params.verify_hostname = false;
+  TlsContext::Configure(client.get(), params, "counts:5671");
+
+  const Channel::TlsHandshakeStats before = TlsContext::Stats();
+  EXPECT_FALSE(Handshake(client.get(), server.get()));
+  EXPECT_FALSE(Handshake(client.get(), server.get()));
+  const Channel::TlsHandshakeStats after = TlsContext::Stats();
+  EXPECT_EQ(before.full + 2, after.full);
+  EXPECT_EQ(before.resumed, after.resumed);
+}
+
+TEST(tls_context, resumes_sessions) {
+  ctx_ptr_t server = ServerContext();
+  const Channel::TlsHandshakeStats before = TlsContext::Stats();
+
+  // A fresh context per connection, as rabbitmq-c makes one per socket
+  ctx_ptr_t first = ClientContext();
+  TlsContext::Configure(first.get(), ResumingParams(), "resumes:5671");
+  EXPECT_FALSE(Handshake(first.get(), server.get()));
+
+  ctx_ptr_t second = ClientContext();
+  TlsContext::Configure(second.get(), ResumingParams(), "resumes:5671");
+  EXPECT_TRUE(Handshake(second.get(), server.get()));
+
+  const Channel::TlsHandshakeStats after = TlsContext::Stats();
+  EXPECT_EQ(before.full + 1, after.full);
+  EXPECT_EQ(before.resumed + 1, after.resumed);
+}
+
+TEST(tls_context, session_set_before_connect) {
+  ctx_ptr_t server = ServerContext();
+  ctx_ptr_t first = ClientContext();
+  TlsContext::Configure(first.get(), ResumingParams(), "before-connect:5671");
+  EXPECT_FALSE(Handshake(first.get(), server.get()));
+
+  // rabbitmq-c connects straight after SSL_new(), the session must already
+  // be in place by then
+  ctx_ptr_t second = ClientContext();
+  TlsContext::Configure(second.get(), ResumingParams(), "before-connect:5671");
+  SSL *ssl = SSL_new(second.get());
+  EXPECT_TRUE(NULL != SSL_get0_session(ssl));
+  SSL_free(ssl);
+
+  ctx_ptr_t other = ClientContext();
+  TlsContext::Configure(other.get(), ResumingParams(), "before-connect:5672");
+  ssl = SSL_new(other.get());
+  EXPECT_TRUE(NULL == SSL_get0_session(ssl));
+  SSL_free(ssl);
+}
+
+TEST(tls_context, sessions_kept_per_params) {
+  ctx_ptr_t server = ServerContext();
+  ctx_ptr_t first = ClientContext();
+  TlsContext::Configure(first.get(), ResumingParams(), "per-params:5671");
+  EXPECT_FALSE(Handshake(first.get(), server.get()));
+
+  // Same broker, but the connection would have checked a different CA
+  Channel::OpenOpts::TLSParams other_ca = ResumingParams();
+  other_ca.ca_cert_path = "/etc/other-ca.pem";
+  ctx_ptr_t second = ClientContext();
+  TlsContext::Configure(second.get(), other_ca, "per-params:5671");
+  EXPECT_FALSE(Handshake(second.get(), server.get()));
+
+  // Nor is a session shared between endpoints
+  ctx_ptr_t third = ClientContext();
+  TlsContext::Configure(third.get(), ResumingParams(), "per-params:5672");
+  EXPECT_FALSE(Handshake(third.get(), server.get()));
+
+  ctx_ptr_t fourth = ClientContext();
+  TlsContext::Configure(fourth.get(), ResumingParams(), "per-params:5671");
+  EXPECT_TRUE(Handshake(fourth.get(), server.get()));
+}
+#endif